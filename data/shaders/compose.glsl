@@ -9,38 +9,26 @@ void main() {
 
 #fragment
 #version 460
-uniform sampler2D texDiffuse;
-uniform sampler2D texNormal;
 uniform sampler2D texLightness;
-uniform sampler2D texEmission;
-uniform sampler2D texDepth;
 in vec2 fragUV;
 out vec4 outFinal;
 
 #include "uniform_blocks/common.glsl"
+#include "functions/gbuffer.glsl"
 
+// Runs at window resolution. texLightness gets a GL_LINEAR sampler object, so the rendered area is
+// scaled up to the window bilinearly, the clamp keeps the filter inside it
 void main() {
+	vec2 texUV = gbufferUVClamped(fragUV);
 	float gamma = 2.2;
-	vec3 albedo = pow(texture(texDiffuse, fragUV).xyz, vec3(gamma));
-	vec3 N = (texture(texNormal, fragUV).xyz - .5) * 2.0;
-	vec3 Lo = texture(texLightness, fragUV).xyz;
-	vec3 emission = texture(texEmission, fragUV).xyz;
+	vec3 Lo = texture(texLightness, texUV).xyz;
 
-	vec3 ambient = vec3(0);//vec3(.03) * albedo;
-	vec3 color = ambient + Lo;//mix(ambient + Lo, ambient + albedo * emission.x, emission);
-	
-	// Fog
-	float depth = texture(texDepth, fragUV).x;
-	vec4 screenPos = vec4(gl_FragCoord.x / viewportSize.x, gl_FragCoord.y / viewportSize.y, depth, 1.0) * 2.0 - 1.0;
-	vec4 viewPosition = inverse(matProjection) * screenPos;
-	float zDistance = (-viewPosition.z / viewPosition.w);
-	float fogStrength = clamp(zDistance / 5.0, 0.0, 1.0);
+	vec3 ambient = vec3(0);
+	vec3 color = ambient + Lo;
 
 	// Gamma correction
 	color = color / (color + vec3(1.0));
 	color = pow(color, vec3(1.0/gamma));
 
-	//color = mix(color, vec3(0), fogStrength);
-
 	outFinal = vec4(color, 1.0);
-}
\ No newline at end of file
+}
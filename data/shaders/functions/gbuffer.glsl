@@ -0,0 +1,53 @@
+// G-buffer packing, expects uniform_blocks/common.glsl to be included first
+
+vec2 octahedralWrap(vec2 v) {
+	return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+// Unit vector to [0, 1] RG, the lower hemisphere folds over the diagonals of the square
+vec2 encodeNormalOctahedral(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	n.xy = n.z >= 0.0 ? n.xy : octahedralWrap(n.xy);
+	return n.xy * 0.5 + 0.5;
+}
+
+vec3 decodeNormalOctahedral(vec2 f) {
+	f = f * 2.0 - 1.0;
+	vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+	float t = clamp(-n.z, 0.0, 1.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+// G-buffer targets are over-allocated and rendered into their lower left corner,
+// screen uv from a fullscreen pass maps to target uv through uvScale
+vec2 gbufferUV(vec2 screenUV) {
+	return screenUV * uvScale;
+}
+
+// For filtered lookups that do not land on texel centers, keeps the filter inside the rendered area
+vec2 gbufferUVClamped(vec2 screenUV) {
+	return min(screenUV * uvScale, uvMax);
+}
+
+// Distance along the view axis for a [0, 1] depth buffer value
+float linearizeDepth(float depth) {
+	float z = depth * 2.0 - 1.0;
+	return 2.0 * zNear * zFar / (zFar + zNear - z * (zFar - zNear));
+}
+
+// Assumes a symmetric perspective projection, [0][0] and [1][1] are the only xy terms
+vec3 reconstructViewPosition(vec2 uv, float depth) {
+	float viewZ = linearizeDepth(depth);
+	vec2 ndc = uv * 2.0 - 1.0;
+	return vec3(ndc.x * viewZ / matProjection[0][0], ndc.y * viewZ / matProjection[1][1], -viewZ);
+}
+
+vec3 viewToWorld(vec3 viewPos) {
+	return (matViewInverse * vec4(viewPos, 1.0)).xyz;
+}
+
+vec3 reconstructWorldPosition(vec2 uv, float depth) {
+	return viewToWorld(reconstructViewPosition(uv, depth));
+}
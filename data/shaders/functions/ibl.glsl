@@ -0,0 +1,51 @@
+// Image based lighting terms, expects ubCommon, texCubemapSpecular, texCubemapSpecularNext and texBrdfLut to be declared
+
+const float MAX_REFLECTION_LOD = 4.0;
+
+vec3 fresnelSchlickRoughness(float cosTheta, vec3 F0, float roughness)
+{
+	return F0 + (max(vec3(1.0 - roughness), F0) - F0) * pow(clamp(1.0 - cosTheta, 0.0, 1.0), 5.0);
+}
+
+// Coefficients come with the cosine convolution applied, so this is the irradiance over pi.
+// Ringing can take it below zero opposite a strong light
+vec3 sampleIrradiance(vec3 N) {
+	vec3 e = shIrradiance[0].xyz * 0.282095
+		+ shIrradiance[1].xyz * (0.488603 * N.y)
+		+ shIrradiance[2].xyz * (0.488603 * N.z)
+		+ shIrradiance[3].xyz * (0.488603 * N.x)
+		+ shIrradiance[4].xyz * (1.092548 * N.x * N.y)
+		+ shIrradiance[5].xyz * (1.092548 * N.y * N.z)
+		+ shIrradiance[6].xyz * (0.315392 * (3.0 * N.z * N.z - 1.0))
+		+ shIrradiance[7].xyz * (1.092548 * N.x * N.z)
+		+ shIrradiance[8].xyz * (0.546274 * (N.x * N.x - N.y * N.y));
+	return max(e, vec3(0.0));
+}
+
+vec3 samplePrefiltered(vec3 N, vec3 V, float roughness) {
+	// Cubemaps are baked with z flipped
+	vec3 R = reflect(-V, N) * vec3(1, 1, -1);
+	vec3 color = textureLod(texCubemapSpecular, R, roughness * MAX_REFLECTION_LOD).xyz;
+	// Uniform branch, the second lookup only happens during a switch
+	if (iblFade > 0.0) {
+		color = mix(color, textureLod(texCubemapSpecularNext, R, roughness * MAX_REFLECTION_LOD).xyz, iblFade);
+	}
+	return color;
+}
+
+// Irradiance and prefiltered radiance are the expensive lookups, everything here depends on the pixel's own material
+vec3 combineIBL(vec3 albedo, vec3 N, vec3 V, float roughness, float metallic, vec3 irradiance, vec3 prefilteredColor) {
+	float NdotV = max(dot(N, V), 0.0);
+	vec3 F0 = vec3(0.04);
+	F0 = mix(F0, albedo, metallic);
+	vec3 F = fresnelSchlickRoughness(NdotV, F0, roughness);
+
+	vec3 kS = F;
+	vec3 kD = 1.0 - kS;
+	kD *= 1.0 - metallic;
+
+	vec2 envBRDF = texture(texBrdfLut, vec2(NdotV, roughness)).xy;
+	vec3 specular = prefilteredColor * (F * envBRDF.x + envBRDF.y);
+	vec3 diffuse = irradiance * albedo;
+	return kD * diffuse + specular;
+}
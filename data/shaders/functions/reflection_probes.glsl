@@ -0,0 +1,48 @@
+// Local reflection probes over the global IBL, expects uniform_blocks/probes.glsl, functions/ibl.glsl
+// and texProbeSpecular to be declared
+
+// 1 deeper inside the box than the blend distance, 0 at and outside its faces
+float probeWeight(ProbeData probe, vec3 worldPos) {
+	vec3 outside = max(probe.boxMinBlend.xyz - worldPos, worldPos - probe.boxMaxLayer.xyz);
+	float depth = -max(max(outside.x, outside.y), outside.z);
+	return clamp(depth / max(probe.boxMinBlend.w, 1e-4), 0.0, 1.0);
+}
+
+// The reflected ray is intersected with the influence box and looked up from the capture point,
+// so nearby surfaces land where they are rather than at infinity
+vec3 probeParallaxDirection(ProbeData probe, vec3 worldPos, vec3 R) {
+	vec3 toMax = (probe.boxMaxLayer.xyz - worldPos) / R;
+	vec3 toMin = (probe.boxMinBlend.xyz - worldPos) / R;
+	vec3 far = max(toMax, toMin);
+	float t = min(min(far.x, far.y), far.z);
+	return worldPos + R * t - probe.position.xyz;
+}
+
+// Probes covering the pixel replace the global lookups by their weight, the smaller ones first until
+// the weights add up to 1. Diffuse takes the roughest level along N, close enough to the cosine lobe at
+// probe resolution
+void applyReflectionProbes(vec2 uv, vec3 worldPos, vec3 N, vec3 V, float roughness, inout vec3 irradiance, inout vec3 prefilteredColor) {
+	uint mask = probeTileMask(uv);
+	if (mask == 0u) {
+		return;
+	}
+	vec3 R = reflect(-V, N);
+	vec3 probeIrradiance = vec3(0);
+	vec3 probeSpecular = vec3(0);
+	float total = 0.0;
+	while (mask != 0u && total < 1.0) {
+		int i = findLSB(mask);
+		mask &= mask - 1u;
+		float w = min(probeWeight(probes[i], worldPos), 1.0 - total);
+		if (w <= 0.0) {
+			continue;
+		}
+		float layer = probes[i].boxMaxLayer.w;
+		vec3 dir = probeParallaxDirection(probes[i], worldPos, R) * vec3(1, 1, -1);
+		probeSpecular += textureLod(texProbeSpecular, vec4(dir, layer), roughness * MAX_REFLECTION_LOD).xyz * w;
+		probeIrradiance += textureLod(texProbeSpecular, vec4(N * vec3(1, 1, -1), layer), MAX_REFLECTION_LOD).xyz * w;
+		total += w;
+	}
+	irradiance = irradiance * (1.0 - total) + probeIrradiance;
+	prefilteredColor = prefilteredColor * (1.0 - total) + probeSpecular;
+}
@@ -10,22 +10,28 @@ layout(location = 5) in vec4 inColorRGBA;
 out vec3 fragNormal;
 out vec2 fragUV;
 out vec4 fragColor;
+out vec4 fragInstanceColor;
 out vec3 fragWorldPos;
 out mat3 fragTBN;
 
 #include "uniform_blocks/common.glsl"
 #include "uniform_blocks/model.glsl"
+#include "uniform_blocks/instances.glsl"
 
 void main() {
-	vec3 T = normalize(vec3(matModel * vec4(inTangent, 0.0)));
-	vec3 B = normalize(vec3(matModel * vec4(inBitangent, 0.0)));
-	vec3 N = normalize(vec3(matModel * vec4(inNormal, 0.0)));
+	InstanceData instance = instances[gl_BaseInstance + gl_InstanceID];
+	mat4 model = matModel * instance.transform;
+
+	vec3 T = normalize(vec3(model * vec4(inTangent, 0.0)));
+	vec3 B = normalize(vec3(model * vec4(inBitangent, 0.0)));
+	vec3 N = normalize(vec3(model * vec4(inNormal, 0.0)));
 	fragTBN = mat3(T, B, N);
 
-	fragNormal = (matModel * vec4(inNormal, 0.0)).xyz;
+	fragNormal = (model * vec4(inNormal, 0.0)).xyz;
 	fragUV = inUV;
 	fragColor = inColorRGBA;
-	vec4 WP = matModel * vec4(inPosition, 1.0);
+	fragInstanceColor = instance.color;
+	vec4 WP = model * vec4(inPosition, 1.0);
 	fragWorldPos = WP.xyz;
 	gl_Position = matProjection * matView * WP;
 }
@@ -35,39 +41,38 @@ void main() {
 in vec3 fragNormal;
 in vec2 fragUV;
 in vec4 fragColor;
+in vec4 fragInstanceColor;
 in vec3 fragWorldPos;
 in mat3 fragTBN;
 
 uniform sampler2D texDiffuse;
 uniform sampler2D texNormal;
-uniform sampler2D texRoughness;
-uniform sampler2D texMetallic;
-uniform sampler2D texEmission;
+uniform sampler2D texMaterial;	// Roughness, metallic, AO
 
 out vec4 outAlbedo;
 out vec4 outNormal;
-out vec4 outWorldPos;
-out vec4 outRoughness;
-out vec4 outMetallic;
-out vec4 outEmission;
+out vec4 outMaterial;
+
+#include "uniform_blocks/common.glsl"
+#include "functions/gbuffer.glsl"
 
 void main() {
 	vec3 N = normalize(fragNormal);
 	vec4 diffuse = texture(texDiffuse, fragUV);
-	vec3 normal = texture(texNormal, fragUV).xyz;
-	normal = normal * 2.0 - 1.0;
+	// z is rebuilt, imported normal maps are BC5 and only keep x and y
+	vec2 normal_xy = texture(texNormal, fragUV).xy * 2.0 - 1.0;
+	vec3 normal = vec3(normal_xy, sqrt(max(.0, 1.0 - dot(normal_xy, normal_xy))));
 	normal = normalize(fragTBN * normal);
-	float roughness = texture(texRoughness, fragUV).x;
-	float metallic = texture(texMetallic, fragUV).x;            
-	float emission = texture(texEmission, fragUV).x;
+	vec3 material = texture(texMaterial, fragUV).rgb;
+	float roughness = material.r;
+	float metallic = material.g;
+	float ao = material.b;
 
-	vec3 color = diffuse.xyz;// * fragColor.xyz;
-	float alpha = diffuse.a * fragColor.a;
+	vec3 color = diffuse.xyz * fragInstanceColor.rgb;// * fragColor.xyz;
+	float alpha = diffuse.a * fragColor.a * fragInstanceColor.a;
 
 	outAlbedo = vec4(color, alpha);
-	outNormal = vec4((normal + 1.0) / 2.0, 1.0);//vec4((N + 1.0) / 2.0, 1.0);
-	outWorldPos = vec4(fragWorldPos, 1.0);
-	outRoughness = vec4(roughness, 0.0, 0.0, 1.0);
-	outMetallic = vec4(metallic, 0.0, 0.0, 1.0);
-	outEmission = vec4(emission, 0.0, 0.0, 1.0);
+	outNormal = vec4(encodeNormalOctahedral(normal), 0.0, 1.0);
+	// Alpha stays 1, the geometry pass blends with source alpha
+	outMaterial = vec4(roughness, metallic, ao, 1.0);
 }
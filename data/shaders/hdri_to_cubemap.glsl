@@ -1,16 +1,23 @@
 #vertex
 #version 460
+#extension GL_ARB_shader_viewport_layer_array : enable
 
 layout(location = 0) in vec3 inPosition;
 
 out vec3 fragPosition;
 
-uniform mat4 matProjection;
-uniform mat4 matView;
+// One matrix per cubemap face, see glxDrawCubeFaces()
+layout(std140) uniform ubCubeFaces {
+    mat4 matFaceViewProjection[6];
+};
 
 void main() {
+    int face = gl_BaseInstance + gl_InstanceID;
     fragPosition = inPosition;
-    gl_Position = matProjection * matView * vec4(inPosition, 1.0);
+    gl_Position = matFaceViewProjection[face] * vec4(inPosition, 1.0);
+#ifdef GL_ARB_shader_viewport_layer_array
+    gl_Layer = face;
+#endif
 }
 
 
@@ -0,0 +1,53 @@
+#vertex
+#version 460
+layout(location = 0) in vec3 inPosition;
+out vec2 fragUV;
+void main() {
+	fragUV = vec2((inPosition.x + 1.0) * .5, (inPosition.y + 1.0) * .5);
+	gl_Position = vec4(inPosition, 1.0);
+}
+
+#fragment
+#version 460
+uniform sampler2D texReference;
+uniform sampler2D texReduced;
+uniform sampler2D texDepth;
+in vec2 fragUV;
+out vec4 outLightness;
+
+#include "uniform_blocks/common.glsl"
+#include "uniform_blocks/ibl_stats.glsl"
+#include "functions/gbuffer.glsl"
+
+// Same curve as compose.glsl, errors are measured on what ends up on screen
+vec3 displayColor(vec3 c) {
+	c = c / (c + vec3(1.0));
+	return pow(c, vec3(1.0 / 2.2));
+}
+
+// Accumulates the reduced rate IBL's error against the full rate one, then adds the reduced one to lightness
+void main() {
+	vec2 texUV = gbufferUV(fragUV);
+	if (texture(texDepth, texUV).x >= 1.0) {
+		discard;
+	}
+	vec3 reference = texture(texReference, texUV).xyz;
+	vec3 reduced = texture(texReduced, texUV).xyz;
+
+	vec3 e = abs(displayColor(reference) - displayColor(reduced));
+	float squared = dot(e, e) / 3.0;
+	uint scaled = uint(squared * IBL_STAT_ERROR_SCALE);
+	// 64 bit sum, a wrapped low word carries into the high one
+	uint prev = atomicAdd(iblStats[IBL_STAT_ERROR_SUM_LO], scaled);
+	if (prev + scaled < prev) {
+		atomicAdd(iblStats[IBL_STAT_ERROR_SUM_HI], 1u);
+	}
+	atomicAdd(iblStats[IBL_STAT_PIXELS], 1u);
+	float maxChannel = max(e.x, max(e.y, e.z));
+	if (maxChannel > 2.0 / 255.0) {
+		atomicAdd(iblStats[IBL_STAT_VISIBLE_ERRORS], 1u);
+	}
+	atomicMax(iblStats[IBL_STAT_MAX_ERROR], uint(maxChannel * IBL_STAT_ERROR_SCALE));
+
+	outLightness = vec4(reduced, 1.0);
+}
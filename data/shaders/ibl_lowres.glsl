@@ -0,0 +1,55 @@
+#vertex
+#version 460
+layout(location = 0) in vec3 inPosition;
+void main() {
+	gl_Position = vec4(inPosition, 1.0);
+}
+
+#fragment
+#version 460
+uniform sampler2D texNormal;
+uniform sampler2D texMaterial;
+uniform sampler2D texDepth;
+uniform samplerCube texCubemapSpecular;
+uniform samplerCube texCubemapSpecularNext;
+uniform samplerCubeArray texProbeSpecular;
+uniform sampler2D texBrdfLut;
+uniform int downscale;
+out vec4 outIrradiance;
+out vec4 outSpecular;
+out vec4 outGuide;
+
+#include "uniform_blocks/common.glsl"
+#include "functions/gbuffer.glsl"
+#include "uniform_blocks/probes.glsl"
+#include "functions/ibl.glsl"
+#include "functions/reflection_probes.glsl"
+
+// Far enough behind everything for the upsampler's depth weight to reject it, still fits a half float
+const float SKY_DEPTH = 60000.0;
+
+// One pixel per downscale x downscale block, the lookups that depend on the view and the environment only.
+// The material terms are applied per full resolution pixel in ibl_upsample.glsl
+void main() {
+	ivec2 src = min(ivec2(gl_FragCoord.xy) * downscale + downscale / 2, ivec2(viewportSize) - 1);
+	float depth = texelFetch(texDepth, src, 0).x;
+	if (depth >= 1.0) {
+		outIrradiance = vec4(0);
+		outSpecular = vec4(0);
+		outGuide = vec4(SKY_DEPTH, 0.5, 0.5, 0);
+		return;
+	}
+
+	vec3 N = decodeNormalOctahedral(texelFetch(texNormal, src, 0).xy);
+	float roughness = texelFetch(texMaterial, src, 0).x;
+	vec2 screenUV = (vec2(src) + 0.5) / viewportSize;
+	vec3 worldPos = reconstructWorldPosition(screenUV, depth);
+	vec3 V = normalize(cameraPosition - worldPos);
+
+	vec3 irradiance = sampleIrradiance(N);
+	vec3 prefilteredColor = samplePrefiltered(N, V, roughness);
+	applyReflectionProbes(screenUV, worldPos, N, V, roughness, irradiance, prefilteredColor);
+	outIrradiance = vec4(irradiance, 1.0);
+	outSpecular = vec4(prefilteredColor, 1.0);
+	outGuide = vec4(linearizeDepth(depth), encodeNormalOctahedral(N), 0);
+}
@@ -0,0 +1,95 @@
+#vertex
+#version 460
+layout(location = 0) in vec3 inPosition;
+out vec2 fragUV;
+void main() {
+	fragUV = vec2((inPosition.x + 1.0) * .5, (inPosition.y + 1.0) * .5);
+	gl_Position = vec4(inPosition, 1.0);
+}
+
+#fragment
+#version 460
+uniform sampler2D texDiffuse;
+uniform sampler2D texNormal;
+uniform sampler2D texMaterial;
+uniform sampler2D texDepth;
+uniform sampler2D texIrradianceLow;
+uniform sampler2D texSpecularLow;
+uniform sampler2D texGuideLow;
+uniform samplerCube texCubemapSpecular;
+uniform samplerCube texCubemapSpecularNext;
+uniform samplerCubeArray texProbeSpecular;
+uniform sampler2D texBrdfLut;
+uniform int downscale;
+uniform int collectStats;
+in vec2 fragUV;
+out vec4 outLightness;
+
+#include "uniform_blocks/common.glsl"
+#include "uniform_blocks/ibl_stats.glsl"
+#include "functions/gbuffer.glsl"
+#include "uniform_blocks/probes.glsl"
+#include "functions/ibl.glsl"
+#include "functions/reflection_probes.glsl"
+
+// Relative view depth difference that drops a sample's weight to 1/e
+const float DEPTH_SHARPNESS = 50.0;
+const float NORMAL_POWER = 16.0;
+// Below this share of the bilinear footprint surviving the bilateral weights the pixel is on an edge
+// the low resolution pass did not sample, it gets shaded at full rate instead
+const float EDGE_WEIGHT_THRESHOLD = 0.3;
+
+// Joint bilateral upsample of ibl_lowres.glsl, additive into lightness like environment.glsl
+void main() {
+	vec2 texUV = gbufferUV(fragUV);
+	float depth = texture(texDepth, texUV).x;
+	if (depth >= 1.0) {
+		discard;
+	}
+
+	float gamma = 2.2;
+	vec3 albedo = pow(texture(texDiffuse, texUV).xyz, vec3(gamma));
+	vec3 N = decodeNormalOctahedral(texture(texNormal, texUV).xy);
+	vec3 worldPos = reconstructWorldPosition(fragUV, depth);
+	vec3 material = texture(texMaterial, texUV).xyz;
+	float roughness = material.x;
+	float metallic = material.y;
+	float ao = material.z;
+	vec3 V = normalize(cameraPosition - worldPos);
+	float viewDepth = linearizeDepth(depth);
+
+	// Low resolution texel i was taken at full resolution pixel i * downscale + downscale / 2
+	ivec2 lowSize = (ivec2(viewportSize) + downscale - 1) / downscale;
+	vec2 p = (gl_FragCoord.xy - 0.5 - float(downscale / 2)) / float(downscale);
+	ivec2 base = ivec2(floor(p));
+	vec2 f = p - vec2(base);
+
+	vec3 irradiance = vec3(0);
+	vec3 prefilteredColor = vec3(0);
+	float weightSum = 0.0;
+	for (int i = 0; i < 4; ++i) {
+		ivec2 offset = ivec2(i & 1, i >> 1);
+		ivec2 c = clamp(base + offset, ivec2(0), lowSize - 1);
+		vec2 bilinear = mix(1.0 - f, f, vec2(offset));
+		vec4 guide = texelFetch(texGuideLow, c, 0);
+		float depthWeight = exp(-abs(guide.x - viewDepth) / viewDepth * DEPTH_SHARPNESS);
+		float normalWeight = pow(max(dot(N, decodeNormalOctahedral(guide.yz)), 0.0), NORMAL_POWER);
+		float w = bilinear.x * bilinear.y * depthWeight * normalWeight;
+		irradiance += texelFetch(texIrradianceLow, c, 0).xyz * w;
+		prefilteredColor += texelFetch(texSpecularLow, c, 0).xyz * w;
+		weightSum += w;
+	}
+
+	if (weightSum < EDGE_WEIGHT_THRESHOLD) {
+		irradiance = sampleIrradiance(N);
+		prefilteredColor = samplePrefiltered(N, V, roughness);
+		applyReflectionProbes(fragUV, worldPos, N, V, roughness, irradiance, prefilteredColor);
+		if (collectStats != 0) {
+			atomicAdd(iblStats[IBL_STAT_FALLBACKS], 1u);
+		}
+	} else {
+		irradiance /= weightSum;
+		prefilteredColor /= weightSum;
+	}
+	outLightness = vec4(combineIBL(albedo, N, V, roughness, metallic, irradiance, prefilteredColor) * ao, 1.0);
+}
@@ -0,0 +1,65 @@
+#vertex
+#version 460
+layout(location = 0) in vec3 inPosition;
+out vec2 fragUV;
+void main() {
+	fragUV = vec2((inPosition.x + 1.0) * .5, (inPosition.y + 1.0) * .5);
+	gl_Position = vec4(inPosition, 1.0);
+}
+
+#fragment
+#version 460
+uniform sampler2D texDiffuse;
+uniform sampler2D texNormal;
+uniform sampler2D texMaterial;
+uniform sampler2D texDepth;
+in vec2 fragUV;
+out vec4 outLightness;
+
+#include "uniform_blocks/common.glsl"
+#include "uniform_blocks/clusters.glsl"
+#include "functions/gbuffer.glsl"
+#include "functions/pbr.glsl"
+
+// Smooth window to zero at the light radius on top of inverse square falloff
+float distanceFalloff(float dist2, float radius) {
+	float ratio = dist2 / (radius * radius);
+	float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+	return window * window / (dist2 + 1.0);
+}
+
+void main() {
+	vec2 texUV = gbufferUV(fragUV);
+	float depth = texture(texDepth, texUV).x;
+	if (depth >= 1.0) {
+		discard;
+	}
+
+	float gamma = 2.2;
+	vec3 albedo = pow(texture(texDiffuse, texUV).xyz, vec3(gamma));
+	vec3 N = decodeNormalOctahedral(texture(texNormal, texUV).xy);
+	vec3 material = texture(texMaterial, texUV).xyz;
+	float roughness = material.x;
+	float metallic = material.y;
+
+	vec3 viewPos = reconstructViewPosition(fragUV, depth);
+	vec3 worldPos = viewToWorld(viewPos);
+	vec3 V = normalize(cameraPosition - worldPos);
+
+	uvec2 range = clusterRanges[clusterIndex(fragUV, -viewPos.z)];
+	vec3 Lo = vec3(0);
+	for (uint i = 0; i < range.y; ++i) {
+		LightData light = lights[lightIndices[range.x + i]];
+		vec3 toLight = light.positionRadius.xyz - worldPos;
+		float dist2 = dot(toLight, toLight);
+		float radius = light.positionRadius.w;
+		if (dist2 >= radius * radius) {
+			continue;
+		}
+		vec3 L = toLight * inversesqrt(dist2);
+		float spot = clamp(dot(-L, light.directionSpotScale.xyz) * light.directionSpotScale.w + light.colorSpotOffset.w, 0.0, 1.0);
+		vec3 radiance = light.colorSpotOffset.rgb * distanceFalloff(dist2, radius) * spot * spot;
+		Lo += evalBrdf(N, V, L, albedo, metallic, roughness) * radiance;
+	}
+	outLightness = vec4(Lo, 1.0);
+}
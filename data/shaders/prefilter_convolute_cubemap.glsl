@@ -1,30 +1,43 @@
 #vertex
 #version 460
+#extension GL_ARB_shader_viewport_layer_array : enable
 
 layout(location = 0) in vec3 inPosition;
 out vec3 fragPosition;
 
-uniform mat4 matProjection;
-uniform mat4 matView;
+// One matrix per cubemap face, see glxDrawCubeFaces(). Face views have no translation
+layout(std140) uniform ubCubeFaces {
+    mat4 matFaceViewProjection[6];
+};
 
 void main() {
+    int face = gl_BaseInstance + gl_InstanceID;
     fragPosition = inPosition;
 
-    mat4 rotView = mat4(mat3(matView)); // Removing translation
-    vec4 clipPos = matProjection * rotView * vec4(inPosition, 1.0);
+    vec4 clipPos = matFaceViewProjection[face] * vec4(inPosition, 1.0);
 
     gl_Position = clipPos.xyww;
+#ifdef GL_ARB_shader_viewport_layer_array
+    gl_Layer = face;
+#endif
 }
 
 
 #fragment
 #version 460
 
+// Matches PrefilterSample in src/game/prefilter_samples.hpp, a run of samples per roughness mip
+layout(std430, binding = 5) readonly buffer bufPrefilterSamples {
+    vec4 prefilterSamples[];    // xyz light direction around N = +z, w source lod
+};
+
 out vec4 outAlbedo;
 in vec3 fragPosition;
 
 uniform samplerCube cubemapEnvironment;
 uniform float roughness;
+uniform int sampleOffset;
+uniform int sampleCount;    // Table samples for this mip, 0 runs the per texel reference loop
 
 const float PI = 3.14159265359;
 
@@ -74,8 +87,24 @@ vec3 ImportanceSampleGGX(vec2 Xi, vec3 N, float roughness) {
     return normalize(sampleVec);
 }
 
-void main() {
-    vec3 N = normalize(fragPosition);
+// Directions, weights and lods come precomputed from prefilterBuildSamples()
+vec3 prefilterTable(vec3 N) {
+    vec3 up = abs(N.z) < 0.999 ? vec3(0.0, 0.0, 1.0) : vec3(1.0, 0.0, 0.0);
+    vec3 tangent = normalize(cross(up, N));
+    vec3 bitangent = cross(N, tangent);
+
+    float totalWeight = 0.0;
+    vec3 prefilteredColor = vec3(0.0);
+    for(int i = sampleOffset; i < sampleOffset + sampleCount; ++i) {
+        vec4 s = prefilterSamples[i];
+        vec3 L = tangent * s.x + bitangent * s.y + N * s.z;
+        prefilteredColor += textureLod(cubemapEnvironment, L, s.w).rgb * s.z;
+        totalWeight += s.z;
+    }
+    return prefilteredColor / totalWeight;
+}
+
+vec3 prefilterReference(vec3 N) {
     vec3 R = N;
     vec3 V = R;
 
@@ -102,7 +131,11 @@ void main() {
             totalWeight += NdotL;
         }
     }
-    prefilteredColor = prefilteredColor / totalWeight;
+    return prefilteredColor / totalWeight;
+}
 
+void main() {
+    vec3 N = normalize(fragPosition);
+    vec3 prefilteredColor = sampleCount > 0 ? prefilterTable(N) : prefilterReference(N);
     outAlbedo = vec4(prefilteredColor, 1.0);
 }
\ No newline at end of file
@@ -12,6 +12,11 @@ void main() {
 uniform sampler2D texDiffuse;
 in vec2 fragUV;
 out vec4 outAlbedo;
+
+#include "uniform_blocks/common.glsl"
+#include "functions/gbuffer.glsl"
+
+// Scales the rendered area of a target up to the window
 void main() {
-	outAlbedo = vec4(texture(texDiffuse, fragUV).xyz, 1.0);
+	outAlbedo = vec4(texture(texDiffuse, gbufferUVClamped(fragUV)).xyz, 1.0);
 }
@@ -14,12 +14,11 @@ in vec2 fragUV;
 out vec4 outAlbedo;
 
 #include "uniform_blocks/common.glsl"
+#include "functions/gbuffer.glsl"
 
 void main() {
-	float depth = texture(texDiffuse, fragUV).x;
-	vec4 screenPos = vec4(gl_FragCoord.x / viewportSize.x, gl_FragCoord.y / viewportSize.y, depth, 1.0) * 2.0 - 1.0;
-	vec4 viewPosition = inverse(matProjection) * screenPos;
-	float zDistance = (-viewPosition.z / viewPosition.w);
+	float depth = texture(texDiffuse, gbufferUVClamped(fragUV)).x;
+	float zDistance = linearizeDepth(depth);
 	float value = zDistance / (zFar - zNear);
 
 	outAlbedo = vec4(vec3(value), 1.0);
@@ -0,0 +1,55 @@
+#vertex
+#version 460
+
+layout(location = 0) in vec3 inPosition;
+layout(location = 1) in vec3 inNormal;
+layout(location = 4) in vec2 inUV;
+out vec3 fragNormal;
+out vec2 fragUV;
+out vec3 fragWorldPos;
+
+#include "uniform_blocks/common.glsl"
+#include "uniform_blocks/model.glsl"
+
+// Objects are drawn one by one, without instance data
+void main() {
+	vec4 WP = matModel * vec4(inPosition, 1.0);
+	fragNormal = mat3(matModel) * inNormal;
+	fragUV = inUV;
+	fragWorldPos = WP.xyz;
+	gl_Position = matProjection * matView * WP;
+}
+
+#fragment
+#version 460
+in vec3 fragNormal;
+in vec2 fragUV;
+in vec3 fragWorldPos;
+
+uniform sampler2D texDiffuse;
+uniform sampler2D texMaterial;	// Roughness, metallic, AO
+uniform samplerCube texCubemapSpecular;
+uniform samplerCube texCubemapSpecularNext;
+uniform sampler2D texBrdfLut;
+
+out vec4 outLightness;
+
+#include "uniform_blocks/common.glsl"
+#include "functions/ibl.glsl"
+
+// Forward shaded reflection probe capture, see reflection_probes.hpp. Lit by the global environment only,
+// at probe resolution the direct lights and other probes are not worth the passes
+void main() {
+	float gamma = 2.2;
+	vec3 albedo = pow(texture(texDiffuse, fragUV).xyz, vec3(gamma));
+	vec3 N = normalize(fragNormal);
+	vec3 V = normalize(cameraPosition - fragWorldPos);
+	vec3 material = texture(texMaterial, fragUV).rgb;
+	float roughness = material.r;
+	float metallic = material.g;
+	float ao = material.b;
+
+	vec3 irradiance = sampleIrradiance(N);
+	vec3 prefilteredColor = samplePrefiltered(N, V, roughness);
+	outLightness = vec4(combineIBL(albedo, N, V, roughness, metallic, irradiance, prefilteredColor) * ao, 1.0);
+}
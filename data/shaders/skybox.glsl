@@ -1,34 +1,30 @@
 #vertex
 #version 460 
-in vec3 inPosition;
-out vec3 frag_cube_vec;
-
-#include "uniform_blocks/common.glsl"
+layout(location = 0) in vec3 inPosition;
+out vec2 fragNDC;
 
+// Fullscreen triangle on the far plane, only passes the depth test where the G-buffer is empty
 void main(){
-	frag_cube_vec = vec3(inPosition.x, inPosition.y, -inPosition.z);
-	mat4 view = matView;
-	view[3] = vec4(0,0,0,1);
-	vec4 pos = matProjection * view * vec4(inPosition, 1.0);
-	gl_Position = pos.xyww;
+	fragNDC = inPosition.xy;
+	gl_Position = vec4(inPosition.xy, 1.0, 1.0);
 }
 
 #fragment
 #version 460
-in vec3 frag_cube_vec;
+in vec2 fragNDC;
 uniform samplerCube texCubemapEnvironment;
-out vec4 outFinal;
+uniform samplerCube texCubemapEnvironmentNext;
+out vec4 outLightness;
 
 #include "uniform_blocks/common.glsl"
 
 void main(){
-	float gamma = 2.2;
-
-	vec3 color = textureLod(texCubemapEnvironment, (frag_cube_vec), 0/*(cos(time) + 1.0) * 2.0*/).xyz;
-	
-	// Gamma correction
-	color = color / (color + vec3(1.0));
-	color = pow(color, vec3(1.0/gamma));
+	vec4 viewDir = matProjectionInverse * vec4(fragNDC, 1.0, 1.0);
+	vec3 dir = mat3(matViewInverse) * (viewDir.xyz / viewDir.w);
+	vec3 color = textureLod(texCubemapEnvironment, dir * vec3(1, 1, -1), 0/*(cos(time) + 1.0) * 2.0*/).xyz;
+	if (iblFade > 0.0) {
+		color = mix(color, textureLod(texCubemapEnvironmentNext, dir * vec3(1, 1, -1), 0).xyz, iblFade);
+	}
 
-	outFinal = vec4(color.xyz, 1.0);
+	outLightness = vec4(color, 1.0);
 }
@@ -0,0 +1,30 @@
+// Matches UniformBufferClusters and GpuLight in src/game/clustered_lights.hpp
+layout(std140, binding = 2) uniform ubClusters {
+	uvec4 clusterDims;			// x, y, z, light count
+	float clusterNear;
+	float clusterFar;
+	float clusterSliceScale;	// slice = log(depth / clusterNear) * clusterSliceScale
+};
+
+struct LightData {
+	vec4 positionRadius;
+	vec4 colorSpotOffset;
+	vec4 directionSpotScale;
+};
+
+layout(std430, binding = 1) readonly buffer bufLights {
+	LightData lights[];
+};
+// Offset and count into lightIndices, x fastest, then y, then z
+layout(std430, binding = 2) readonly buffer bufLightClusters {
+	uvec2 clusterRanges[];
+};
+layout(std430, binding = 3) readonly buffer bufLightIndices {
+	uint lightIndices[];
+};
+
+uint clusterIndex(vec2 uv, float viewDepth) {
+	uvec2 tile = min(uvec2(uv * vec2(clusterDims.xy)), clusterDims.xy - 1u);
+	int slice = clamp(int(log(viewDepth / clusterNear) * clusterSliceScale), 0, int(clusterDims.z) - 1);
+	return (uint(slice) * clusterDims.y + tile.y) * clusterDims.x + tile.x;
+}
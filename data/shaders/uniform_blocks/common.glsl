@@ -6,4 +6,10 @@ layout(std140) uniform ubCommon {
 	vec2 viewportSize;
 	float zNear;
 	float zFar;
+	vec2 uvScale;	// Render size over target size, see dynamic_resolution.hpp
+	vec2 uvMax;		// Last texel center inside the rendered area
+	mat4 matProjectionInverse;
+	mat4 matViewInverse;
+	vec4 shIrradiance[9];	// L2 SH of the diffuse environment, rgb, see sh_irradiance.hpp
+	float iblFade;			// Weight of the *Next IBL maps while an environment switch fades in, see env_switch.hpp
 };
\ No newline at end of file
@@ -0,0 +1,13 @@
+// Matches IBL_STAT_* in src/game/ibl_compare.hpp, zeroed every frame the comparison runs
+layout(std430, binding = 4) buffer bufIblStats {
+	uint iblStats[];
+};
+
+const int IBL_STAT_ERROR_SUM_LO = 0;	// Squared error in 1/ERROR_SCALE units, 64 bits over two words
+const int IBL_STAT_ERROR_SUM_HI = 1;
+const int IBL_STAT_PIXELS = 2;
+const int IBL_STAT_VISIBLE_ERRORS = 3;	// Pixels off by more than a display quantization step or two
+const int IBL_STAT_MAX_ERROR = 4;
+const int IBL_STAT_FALLBACKS = 5;		// Pixels the upsampler shaded at full rate
+
+const float IBL_STAT_ERROR_SCALE = 1048576.0;
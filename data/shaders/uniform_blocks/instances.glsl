@@ -0,0 +1,9 @@
+struct InstanceData {
+	mat4 transform;
+	vec4 color;
+};
+
+// Indexed with gl_BaseInstance + gl_InstanceID, slot 0 is the identity instance
+layout(std430, binding = 0) readonly buffer bufInstances {
+	InstanceData instances[];
+};
\ No newline at end of file
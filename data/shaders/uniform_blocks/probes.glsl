@@ -0,0 +1,21 @@
+// Matches GpuReflectionProbe in src/game/reflection_probes.hpp
+struct ProbeData {
+	vec4 boxMinBlend;	// Influence box min, blend distance inwards from its faces
+	vec4 boxMaxLayer;	// Influence box max, cube index in texProbeSpecular
+	vec4 position;		// Capture point
+};
+
+// Smallest box first
+layout(std430, binding = 6) readonly buffer bufProbes {
+	uvec4 probeTiles;	// x, y tile counts, probe count
+	ProbeData probes[];
+};
+// Bit i set if probes[i] may cover the tile, x fastest
+layout(std430, binding = 7) readonly buffer bufProbeTiles {
+	uint probeTileMasks[];
+};
+
+uint probeTileMask(vec2 uv) {
+	uvec2 tile = min(uvec2(uv * vec2(probeTiles.xy)), probeTiles.xy - 1u);
+	return probeTileMasks[tile.y * probeTiles.x + tile.x];
+}
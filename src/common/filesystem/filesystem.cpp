@@ -155,6 +155,48 @@ bool fsSlurpFile(const std::string& path, std::vector<uint8_t>& data) {
     fclose(f);
     return true;
 }
+
+bool fsMapFile(const std::string& path, fs_mapped_file* out) {
+    *out = fs_mapped_file();
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, 0, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, 0);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+        // Empty files can't be mapped
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, 0, PAGE_READONLY, 0, 0, 0);
+    if (!mapping) {
+        CloseHandle(file);
+        return false;
+    }
+    const void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!view) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    out->data = (const uint8_t*)view;
+    out->size = (size_t)size.QuadPart;
+    out->file_handle = file;
+    out->mapping_handle = mapping;
+    return true;
+}
+void fsUnmapFile(fs_mapped_file* file) {
+    if (file->data) {
+        UnmapViewOfFile(file->data);
+    }
+    if (file->mapping_handle) {
+        CloseHandle((HANDLE)file->mapping_handle);
+    }
+    if (file->file_handle) {
+        CloseHandle((HANDLE)file->file_handle);
+    }
+    *file = fs_mapped_file();
+}
 std::string fsSlurpTextFile(const std::string& path) {
     std::string ret;
 
@@ -34,6 +34,16 @@ std::string fsGetModulePath();
 std::string fsGetModuleDir();
 
 bool fsSlurpFile(const std::string& path, std::vector<uint8_t>& data);
+
+// Read-only view of a whole file, pages are loaded by the OS as they are touched
+struct fs_mapped_file {
+    const uint8_t* data = 0;
+    size_t size = 0;
+    void* file_handle = 0;
+    void* mapping_handle = 0;
+};
+bool fsMapFile(const std::string& path, fs_mapped_file* out);
+void fsUnmapFile(fs_mapped_file* file);
 std::string fsSlurpTextFile(const std::string& path);
 
 bool fsFileCopy(const std::string& from, const std::string& to);
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stdint.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define SIMD_X86 1
+#include <immintrin.h>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#else
+#define SIMD_X86 0
+#endif
+
+// MSVC lets any function use AVX2 intrinsics, gcc/clang need the target spelled out per function.
+// Only call SIMD_TARGET_AVX2 functions after simdHasAvx2() returned true
+#if defined(_MSC_VER) || !SIMD_X86
+#define SIMD_TARGET_AVX2
+#else
+#define SIMD_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+#if SIMD_X86
+inline bool simdDetectAvx2() {
+	uint32_t regs[4] = { 0 };
+#if defined(_MSC_VER)
+	__cpuid((int*)regs, 0);
+	if (regs[0] < 7) {
+		return false;
+	}
+	__cpuid((int*)regs, 1);
+#else
+	if (__get_cpuid_max(0, 0) < 7) {
+		return false;
+	}
+	__cpuid(1, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	const bool osxsave = (regs[2] & (1u << 27)) != 0;
+	const bool avx = (regs[2] & (1u << 28)) != 0;
+	if (!osxsave || !avx) {
+		return false;
+	}
+	// The OS has to save ymm registers on context switch
+#if defined(_MSC_VER)
+	uint64_t xcr0 = _xgetbv(0);
+#else
+	uint32_t xcr0_lo = 0, xcr0_hi = 0;
+	__asm__("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	uint64_t xcr0 = ((uint64_t)xcr0_hi << 32) | xcr0_lo;
+#endif
+	if ((xcr0 & 6) != 6) {
+		return false;
+	}
+#if defined(_MSC_VER)
+	__cpuidex((int*)regs, 7, 0);
+#else
+	__cpuid_count(7, 0, regs[0], regs[1], regs[2], regs[3]);
+#endif
+	return (regs[1] & (1u << 5)) != 0;
+}
+#endif
+
+inline bool simdHasAvx2() {
+#if SIMD_X86
+	static const bool has_avx2 = simdDetectAvx2();
+	return has_avx2;
+#else
+	return false;
+#endif
+}
+
+inline int simdCountTrailingZeros(uint32_t v) {
+#if defined(_MSC_VER)
+	unsigned long idx;
+	_BitScanForward(&idx, v);
+	return (int)idx;
+#else
+	return __builtin_ctz(v);
+#endif
+}
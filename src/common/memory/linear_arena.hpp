@@ -0,0 +1,67 @@
+#pragma once
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+// Bump allocator over a single block reserved up front.
+// Nothing is freed individually, reset() drops everything at once,
+// meant to be reset at the start of every frame
+class LinearArena {
+	uint8_t* _base = 0;
+	size_t _capacity = 0;
+	size_t _offset = 0;
+public:
+	LinearArena() {}
+	~LinearArena() {
+		release();
+	}
+	LinearArena(const LinearArena&) = delete;
+	LinearArena& operator=(const LinearArena&) = delete;
+	LinearArena(LinearArena&& other) noexcept
+	: _base(other._base), _capacity(other._capacity), _offset(other._offset) {
+		other._base = 0;
+		other._capacity = 0;
+		other._offset = 0;
+	}
+
+	bool init(size_t capacity) {
+		release();
+		_base = (uint8_t*)malloc(capacity);
+		if (!_base) {
+			return false;
+		}
+		_capacity = capacity;
+		_offset = 0;
+		return true;
+	}
+	void release() {
+		free(_base);
+		_base = 0;
+		_capacity = 0;
+		_offset = 0;
+	}
+
+	// align must be a power of two, returns null when the arena is exhausted
+	void* alloc(size_t size, size_t align = 16) {
+		assert((align & (align - 1)) == 0);
+		uintptr_t at = ((uintptr_t)_base + _offset + (align - 1)) & ~(uintptr_t)(align - 1);
+		size_t new_offset = (at - (uintptr_t)_base) + size;
+		if (new_offset > _capacity) {
+			return 0;
+		}
+		_offset = new_offset;
+		return (void*)at;
+	}
+	template<typename T>
+	T* allocArray(size_t count) {
+		return (T*)alloc(sizeof(T) * count, alignof(T) > 16 ? alignof(T) : 16);
+	}
+
+	void reset() { _offset = 0; }
+
+	size_t capacity() const { return _capacity; }
+	size_t used() const { return _offset; }
+};
@@ -1,4 +1,5 @@
 #include "glextutil.h"
+#include <string.h>
 
 //WGL
 PFNWGLCHOOSEPIXELFORMATARBPROC wglChoosePixelFormatARB;
@@ -8,6 +9,14 @@ PFNWGLSWAPINTERVALEXTPROC wglSwapIntervalEXT;
 //GL extension function pointers
 PFNGLDRAWARRAYSINSTANCEDPROC glDrawArraysInstanced;
 PFNGLDRAWELEMENTSINSTANCEDPROC glDrawElementsInstanced;
+PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC glDrawArraysInstancedBaseInstance;
+PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXBASEINSTANCEPROC glDrawElementsInstancedBaseVertexBaseInstance;
+PFNGLMULTIDRAWARRAYSINDIRECTPROC glMultiDrawArraysIndirect;
+PFNGLMULTIDRAWELEMENTSINDIRECTPROC glMultiDrawElementsIndirect;
+PFNGLMULTIDRAWARRAYSINDIRECTCOUNTARBPROC glMultiDrawArraysIndirectCountARB;
+PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC glMultiDrawElementsIndirectCountARB;
+
+PFNGLGETSTRINGIPROC glGetStringi;
 
 PFNGLGENVERTEXARRAYSPROC glGenVertexArrays;
 PFNGLBINDVERTEXARRAYPROC glBindVertexArray;
@@ -21,6 +30,10 @@ PFNGLGETBUFFERSUBDATAPROC glGetBufferSubData;
 PFNGLCOPYBUFFERSUBDATAPROC glCopyBufferSubData;
 PFNGLMAPBUFFERRANGEPROC glMapBufferRange;
 PFNGLUNMAPBUFFERPROC    glUnmapBuffer;
+PFNGLBUFFERSTORAGEPROC glBufferStorage;
+PFNGLFENCESYNCPROC glFenceSync;
+PFNGLCLIENTWAITSYNCPROC glClientWaitSync;
+PFNGLDELETESYNCPROC glDeleteSync;
 
 PFNGLVERTEXATTRIBPOINTERPROC glVertexAttribPointer;
 PFNGLENABLEVERTEXATTRIBARRAYPROC glEnableVertexAttribArray;
@@ -132,6 +145,15 @@ PFNGLBINDFRAGDATALOCATIONPROC glBindFragDataLocation;
 PFNGLGETFRAGDATALOCATIONPROC glGetFragDataLocation;
 
 PFNGLFRAMEBUFFERTEXTURE2DPROC glFramebufferTexture2D;
+PFNGLFRAMEBUFFERTEXTURELAYERPROC glFramebufferTextureLayer;
+PFNGLINVALIDATEFRAMEBUFFERPROC glInvalidateFramebuffer;
+PFNGLINVALIDATETEXIMAGEPROC glInvalidateTexImage;
+PFNGLCLEARBUFFERFVPROC glClearBufferfv;
+PFNGLTEXSTORAGE2DPROC glTexStorage2D;
+PFNGLTEXTUREVIEWPROC glTextureView;
+PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC glCompressedTexSubImage2D;
+PFNGLTEXSTORAGE3DPROC glTexStorage3D;
+PFNGLTEXSTORAGE2DMULTISAMPLEPROC glTexStorage2DMultisample;
 
 PFNGLGETUNIFORMBLOCKINDEXPROC glGetUniformBlockIndex;
 PFNGLGETUNIFORMINDICESPROC glGetUniformIndices;
@@ -149,6 +171,19 @@ PFNGLDISPATCHCOMPUTEGROUPSIZEARBPROC glDispatchComputeGroupSizeARB;
 
 PFNGLMEMORYBARRIERPROC glMemoryBarrier;
 
+PFNGLGENQUERIESPROC glGenQueries;
+PFNGLDELETEQUERIESPROC glDeleteQueries;
+PFNGLBEGINQUERYPROC glBeginQuery;
+PFNGLENDQUERYPROC glEndQuery;
+PFNGLGETQUERYOBJECTIVPROC glGetQueryObjectiv;
+PFNGLGETQUERYOBJECTUI64VPROC glGetQueryObjectui64v;
+PFNGLQUERYCOUNTERPROC glQueryCounter;
+
+PFNGLGENSAMPLERSPROC glGenSamplers;
+PFNGLDELETESAMPLERSPROC glDeleteSamplers;
+PFNGLBINDSAMPLERPROC glBindSampler;
+PFNGLSAMPLERPARAMETERIPROC glSamplerParameteri;
+
 PFNGLDEBUGMESSAGECALLBACKPROC glDebugMessageCallback;
 
 HMODULE opengl32Module = NULL;
@@ -198,9 +233,21 @@ void GLEXTLoadFunctions()
     GLPROCLOAD(PFNGLCOPYBUFFERSUBDATAPROC, glCopyBufferSubData);
     GLPROCLOAD(PFNGLMAPBUFFERRANGEPROC, glMapBufferRange);
     GLPROCLOAD(PFNGLUNMAPBUFFERPROC, glUnmapBuffer);
+    GLPROCLOAD(PFNGLBUFFERSTORAGEPROC, glBufferStorage);
+    GLPROCLOAD(PFNGLFENCESYNCPROC, glFenceSync);
+    GLPROCLOAD(PFNGLCLIENTWAITSYNCPROC, glClientWaitSync);
+    GLPROCLOAD(PFNGLDELETESYNCPROC, glDeleteSync);
 
     GLPROCLOAD(PFNGLDRAWARRAYSINSTANCEDPROC, glDrawArraysInstanced);
     GLPROCLOAD(PFNGLDRAWELEMENTSINSTANCEDPROC, glDrawElementsInstanced);
+    GLPROCLOAD(PFNGLDRAWARRAYSINSTANCEDBASEINSTANCEPROC, glDrawArraysInstancedBaseInstance);
+    GLPROCLOAD(PFNGLDRAWELEMENTSINSTANCEDBASEVERTEXBASEINSTANCEPROC, glDrawElementsInstancedBaseVertexBaseInstance);
+    GLPROCLOAD(PFNGLMULTIDRAWARRAYSINDIRECTPROC, glMultiDrawArraysIndirect);
+    GLPROCLOAD(PFNGLMULTIDRAWELEMENTSINDIRECTPROC, glMultiDrawElementsIndirect);
+    GLPROCLOAD(PFNGLMULTIDRAWARRAYSINDIRECTCOUNTARBPROC, glMultiDrawArraysIndirectCountARB);
+    GLPROCLOAD(PFNGLMULTIDRAWELEMENTSINDIRECTCOUNTARBPROC, glMultiDrawElementsIndirectCountARB);
+
+    GLPROCLOAD(PFNGLGETSTRINGIPROC, glGetStringi);
 
     GLPROCLOAD(PFNGLVERTEXATTRIBPOINTERPROC, glVertexAttribPointer);
     GLPROCLOAD(PFNGLENABLEVERTEXATTRIBARRAYPROC, glEnableVertexAttribArray);
@@ -312,6 +359,15 @@ void GLEXTLoadFunctions()
     GLPROCLOAD(PFNGLGETFRAGDATALOCATIONPROC, glGetFragDataLocation);
 
     GLPROCLOAD(PFNGLFRAMEBUFFERTEXTURE2DPROC, glFramebufferTexture2D);
+    GLPROCLOAD(PFNGLFRAMEBUFFERTEXTURELAYERPROC, glFramebufferTextureLayer);
+    GLPROCLOAD(PFNGLINVALIDATEFRAMEBUFFERPROC, glInvalidateFramebuffer);
+    GLPROCLOAD(PFNGLINVALIDATETEXIMAGEPROC, glInvalidateTexImage);
+    GLPROCLOAD(PFNGLCLEARBUFFERFVPROC, glClearBufferfv);
+    GLPROCLOAD(PFNGLTEXSTORAGE2DPROC, glTexStorage2D);
+    GLPROCLOAD(PFNGLTEXTUREVIEWPROC, glTextureView);
+    GLPROCLOAD(PFNGLCOMPRESSEDTEXSUBIMAGE2DPROC, glCompressedTexSubImage2D);
+    GLPROCLOAD(PFNGLTEXSTORAGE3DPROC, glTexStorage3D);
+    GLPROCLOAD(PFNGLTEXSTORAGE2DMULTISAMPLEPROC, glTexStorage2DMultisample);
 
     GLPROCLOAD(PFNGLGETUNIFORMBLOCKINDEXPROC, glGetUniformBlockIndex);
     GLPROCLOAD(PFNGLGETUNIFORMINDICESPROC, glGetUniformIndices);
@@ -329,8 +385,35 @@ void GLEXTLoadFunctions()
 
     GLPROCLOAD(PFNGLMEMORYBARRIERPROC, glMemoryBarrier);
 
+    GLPROCLOAD(PFNGLGENQUERIESPROC, glGenQueries);
+    GLPROCLOAD(PFNGLDELETEQUERIESPROC, glDeleteQueries);
+    GLPROCLOAD(PFNGLBEGINQUERYPROC, glBeginQuery);
+    GLPROCLOAD(PFNGLENDQUERYPROC, glEndQuery);
+    GLPROCLOAD(PFNGLGETQUERYOBJECTIVPROC, glGetQueryObjectiv);
+    GLPROCLOAD(PFNGLGETQUERYOBJECTUI64VPROC, glGetQueryObjectui64v);
+    GLPROCLOAD(PFNGLQUERYCOUNTERPROC, glQueryCounter);
+
+    GLPROCLOAD(PFNGLGENSAMPLERSPROC, glGenSamplers);
+    GLPROCLOAD(PFNGLDELETESAMPLERSPROC, glDeleteSamplers);
+    GLPROCLOAD(PFNGLBINDSAMPLERPROC, glBindSampler);
+    GLPROCLOAD(PFNGLSAMPLERPARAMETERIPROC, glSamplerParameteri);
+
     GLPROCLOAD(PFNGLDEBUGMESSAGECALLBACKPROC, glDebugMessageCallback);
     
     FreeLibrary(opengl32Module);
     opengl32Module = NULL;
-}
\ No newline at end of file
+}
+
+bool glxExtensionSupported(const char* name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for(int i = 0; i < count; ++i)
+    {
+        if(strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
@@ -5,6 +5,15 @@
 static ProfilerNode root_node;
 static thread_local ProfilerNode* current_node = 0;
 
+struct ProfilerEvent {
+	double time_ms;
+	std::string category;
+	std::string text;
+};
+static std::vector<ProfilerEvent> events;
+static std::mutex events_mtx;
+static LARGE_INTEGER events_start = { 0 };
+
 void profilerScopeBegin(const char* name) {
 	if (current_node == 0) {
 		current_node = &root_node;
@@ -47,6 +56,28 @@ void profilerScopeEnd() {
 	current_node = current_node->parent;
 }
 
+void profilerRecordMs(const char* name, double ms) {
+	profilerScopeBegin(name);
+	current_node->mtx.lock();
+	current_node->total_ms += ms;
+	current_node->mtx.unlock();
+	current_node = current_node->parent;
+}
+
+void profilerEvent(const char* category, const std::string& text) {
+	LARGE_INTEGER now;
+	LARGE_INTEGER freq;
+	QueryPerformanceCounter(&now);
+	QueryPerformanceFrequency(&freq);
+
+	std::lock_guard<std::mutex> lock(events_mtx);
+	if (events_start.QuadPart == 0) {
+		events_start = now;
+	}
+	double ms = (double)(now.QuadPart - events_start.QuadPart) * 1000.0 / (double)freq.QuadPart;
+	events.push_back(ProfilerEvent{ ms, category, text });
+}
+
 bool profilerDump(const char* filename) {
 	std::ofstream strm(filename, std::ios::out | std::ios::trunc);
 	if (!strm) {
@@ -58,5 +89,21 @@ bool profilerDump(const char* filename) {
 	root_node.calcPercentages();
 	root_node.dump(strm);
 
+	return true;
+}
+
+bool profilerDumpEvents(const char* filename) {
+	std::ofstream strm(filename, std::ios::out | std::ios::trunc);
+	if (!strm) {
+		return false;
+	}
+
+	strm << "MsecSinceFirst|Category|Text\n";
+
+	std::lock_guard<std::mutex> lock(events_mtx);
+	for (auto& e : events) {
+		strm << e.time_ms << "|" << e.category << "|" << e.text << "\n";
+	}
+
 	return true;
 }
\ No newline at end of file
@@ -73,8 +73,13 @@ struct ProfilerNode {
 
 void profilerScopeBegin(const char* name);
 void profilerScopeEnd();
+// Adds a child of the current scope timed elsewhere, e.g. by a gpu query
+void profilerRecordMs(const char* name, double ms);
+// Timestamped one-off entries, for decisions rather than timings
+void profilerEvent(const char* category, const std::string& text);
 
 bool profilerDump(const char* filename);
+bool profilerDumpEvents(const char* filename);
 
 
 class ProfilerScopedObject {
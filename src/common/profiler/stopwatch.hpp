@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdint.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+
+
+// Wall clock timer for benchmarks and one-off measurements,
+// use PROF_* for anything that should end up in the frame profile
+class Stopwatch {
+	LARGE_INTEGER _start;
+public:
+	Stopwatch() {
+		reset();
+	}
+	void reset() {
+		QueryPerformanceCounter(&_start);
+	}
+	double elapsedMs() const {
+		LARGE_INTEGER _end;
+		LARGE_INTEGER _freq;
+		QueryPerformanceCounter(&_end);
+		QueryPerformanceFrequency(&_freq);
+		return (double)(_end.QuadPart - _start.QuadPart) * 1000.0 / (double)_freq.QuadPart;
+	}
+};
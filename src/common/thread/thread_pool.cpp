@@ -0,0 +1,100 @@
+#include "thread/thread_pool.hpp"
+
+#include <assert.h>
+#include <algorithm>
+
+
+ThreadPool::ThreadPool(int thread_count) {
+    if (thread_count <= 0) {
+        thread_count = std::max(1, (int)std::thread::hardware_concurrency());
+    }
+    for (int i = 0; i < thread_count - 1; ++i) {
+        _threads.push_back(std::thread(&ThreadPool::workerMain, this, i));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        _quit = true;
+    }
+    _cv_work.notify_all();
+    for (auto& t : _threads) {
+        t.join();
+    }
+}
+
+void ThreadPool::parallelFor(int count, const job_fn_t& fn) {
+    if (count <= 0) {
+        return;
+    }
+    const int caller = threadCount() - 1;
+    if (count == 1 || _threads.empty()) {
+        for (int i = 0; i < count; ++i) {
+            fn(i, caller);
+        }
+        return;
+    }
+
+    std::lock_guard<std::mutex> dispatch_lock(_dispatch_mtx);
+    {
+        std::unique_lock<std::mutex> lock(_mtx);
+        _fn = &fn;
+        _count = count;
+        _next_index = 0;
+        _remaining = count;
+        ++_generation;
+    }
+    _cv_work.notify_all();
+
+    runJobs(caller);
+
+    // Wait for stragglers to finish their last index and to stop touching _fn
+    std::unique_lock<std::mutex> lock(_mtx);
+    _cv_done.wait(lock, [this]() { return _remaining == 0 && _busy_workers == 0; });
+    _fn = 0;
+}
+
+void ThreadPool::runJobs(int worker) {
+    while (true) {
+        int index = _next_index.fetch_add(1);
+        if (index >= _count) {
+            break;
+        }
+        (*_fn)(index, worker);
+        if (_remaining.fetch_sub(1) == 1) {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cv_done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::workerMain(int worker) {
+    uint64_t seen_generation = 0;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            _cv_work.wait(lock, [this, seen_generation]() { return _quit || (_fn && _generation != seen_generation); });
+            if (_quit) {
+                return;
+            }
+            seen_generation = _generation;
+            ++_busy_workers;
+        }
+
+        runJobs(worker);
+
+        {
+            std::unique_lock<std::mutex> lock(_mtx);
+            --_busy_workers;
+            if (_busy_workers == 0) {
+                _cv_done.notify_all();
+            }
+        }
+    }
+}
+
+ThreadPool* getThreadPool() {
+    static ThreadPool pool;
+    return &pool;
+}
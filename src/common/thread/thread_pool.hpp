@@ -0,0 +1,51 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+// Fixed set of worker threads for fork-join style work.
+// The calling thread takes part in parallelFor(), so worker indices
+// are in [0, threadCount()) with the caller being the last one
+class ThreadPool {
+public:
+	typedef std::function<void(int index, int worker)> job_fn_t;
+
+	// thread_count includes the calling thread, 0 picks one per hardware thread
+	explicit ThreadPool(int thread_count = 0);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	int threadCount() const { return (int)_threads.size() + 1; }
+
+	// Calls fn for every index in [0, count) and blocks until all of them are done.
+	// Not reentrant, don't call from inside a job
+	void parallelFor(int count, const job_fn_t& fn);
+
+private:
+	void workerMain(int worker);
+	void runJobs(int worker);
+
+	std::vector<std::thread> _threads;
+	std::mutex _mtx;
+	std::mutex _dispatch_mtx;
+	std::condition_variable _cv_work;
+	std::condition_variable _cv_done;
+
+	const job_fn_t* _fn = 0;
+	int _count = 0;
+	uint64_t _generation = 0;
+	std::atomic<int> _next_index = 0;
+	std::atomic<int> _remaining = 0;
+	int _busy_workers = 0;
+	bool _quit = false;
+};
+
+// Shared pool sized to the machine, created on first use
+ThreadPool* getThreadPool();
@@ -0,0 +1,171 @@
+#include "auto_instancing.hpp"
+
+#include <assert.h>
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+void glxInitAutoInstancer(AutoInstancer* inst) {
+    glGenBuffers(1, &inst->instance_buffer);
+    inst->instance_buffer_size = 0;
+}
+
+void glxDestroyAutoInstancer(AutoInstancer* inst) {
+    glDeleteBuffers(1, &inst->instance_buffer);
+    inst->instance_buffer = 0;
+    inst->instance_buffer_size = 0;
+}
+
+// The sort key truncates its fields, so equal keys don't mean equal state, compare everything
+static bool isSameDraw(const DrawCmdStream* s, uint32_t a, uint32_t b) {
+    const DrawCmdState& sa = s->states[a];
+    const DrawCmdState& sb = s->states[b];
+    const DrawCmdGeometry& ga = s->geometry[a];
+    const DrawCmdGeometry& gb = s->geometry[b];
+    return sa.progid == sb.progid
+        && sa.ub_model == sb.ub_model
+        && sa.bindings == sb.bindings
+        && sa.type == sb.type
+        && sa.mode == sb.mode
+        && ga.vao == gb.vao
+        && ga.offset == gb.offset
+        && ga.count == gb.count;
+}
+
+static void pushInstance(AutoInstancer* inst, const DrawInstanceData* instance_table, uint32_t instance_id) {
+    if (instance_id == DRAW_INSTANCE_NONE || !instance_table) {
+        inst->staging.push_back(inst->staging[0]);
+    } else {
+        inst->staging.push_back(instance_table[instance_id]);
+    }
+}
+
+void autoInstanceDrawCmds(AutoInstancer* inst, const DrawCmdStream* in, const DrawInstanceData* instance_table, DrawCmdStream* out) {
+    PROF_SCOPE_FN();
+
+    assert(in->order.size() == in->count());
+    assert(in != out);
+
+    drawCmdStreamClear(out);
+    out->binding_sets = in->binding_sets;
+    out->binding_uniform_buffers = in->binding_uniform_buffers;
+    out->binding_textures = in->binding_textures;
+
+    inst->staging.clear();
+    DrawInstanceData identity;
+    identity.transform = gfxm::mat4(1.0f);
+    identity.color = gfxm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    inst->staging.push_back(identity);
+
+    inst->stats = AutoInstancingStats();
+    inst->stats.draws_before = in->count();
+
+    const int count = in->count();
+    int group_begin = 0;
+    while (group_begin < count) {
+        // Commands with equal keys sit next to each other after sorting,
+        // within such a group bring identical draws together
+        const uint64_t key = in->keys[in->order[group_begin]];
+        int group_end = group_begin + 1;
+        while (group_end < count && in->keys[in->order[group_end]] == key) {
+            ++group_end;
+        }
+        inst->group_order.assign(in->order.begin() + group_begin, in->order.begin() + group_end);
+        std::stable_sort(inst->group_order.begin(), inst->group_order.end(), [in](uint32_t a, uint32_t b) {
+            const DrawCmdState& sa = in->states[a];
+            const DrawCmdState& sb = in->states[b];
+            const DrawCmdGeometry& ga = in->geometry[a];
+            const DrawCmdGeometry& gb = in->geometry[b];
+            if (sa.progid != sb.progid) return sa.progid < sb.progid;
+            if (sa.ub_model != sb.ub_model) return sa.ub_model < sb.ub_model;
+            if (sa.bindings != sb.bindings) return sa.bindings < sb.bindings;
+            if (sa.mode != sb.mode) return sa.mode < sb.mode;
+            if (ga.vao != gb.vao) return ga.vao < gb.vao;
+            if (ga.offset != gb.offset) return ga.offset < gb.offset;
+            if (ga.count != gb.count) return ga.count < gb.count;
+            return sa.type < sb.type;
+        });
+
+        const int group_size = inst->group_order.size();
+        int run_begin = 0;
+        while (run_begin < group_size) {
+            const uint32_t first = inst->group_order[run_begin];
+            int run_end = run_begin + 1;
+            while (run_end < group_size && isSameDraw(in, first, inst->group_order[run_end])) {
+                ++run_end;
+            }
+            const int run_length = run_end - run_begin;
+
+            const DrawCmdState& state = in->states[first];
+            const DrawCmdGeometry& geom = in->geometry[first];
+            const bool already_instanced = isDrawCmdInstanced(state.type);
+            const int min_instances = geom.count <= inst->small_mesh_max_indices ? inst->min_instances_small : inst->min_instances_large;
+            const bool collapse = inst->enabled && !already_instanced && run_length >= min_instances;
+            const DRAW_CMD_TYPE instanced_type = isDrawCmdIndexed(state.type) ? DRAW_CMD_INDEXED_INSTANCED : DRAW_CMD_ARRAY_INSTANCED;
+
+            if (collapse) {
+                const GLuint base_instance = inst->staging.size();
+                for (int i = run_begin; i < run_end; ++i) {
+                    pushInstance(inst, instance_table, in->instance_ids[inst->group_order[i]]);
+                }
+                uint32_t idx = drawCmdStreamPush(
+                    out, instanced_type, state.mode, geom.vao, state.progid, state.ub_model,
+                    geom.offset, geom.count, run_length, state.bindings
+                );
+                out->geometry[idx].base_instance = base_instance;
+                inst->stats.instanced_batches++;
+                inst->stats.instances += run_length;
+            } else {
+                for (int i = run_begin; i < run_end; ++i) {
+                    const uint32_t src = inst->group_order[i];
+                    const DrawCmdState& s = in->states[src];
+                    const DrawCmdGeometry& g = in->geometry[src];
+                    const uint32_t instance_id = in->instance_ids[src];
+                    const bool instanced = isDrawCmdInstanced(s.type);
+                    if (instance_id == DRAW_INSTANCE_NONE && !instanced) {
+                        // Slot 0, nothing to fetch
+                        drawCmdStreamPush(out, (DRAW_CMD_TYPE)s.type, s.mode, g.vao, s.progid, s.ub_model, g.offset, g.count, g.instance_count, s.bindings);
+                        continue;
+                    }
+                    // The shader fetches gl_BaseInstance + gl_InstanceID, already instanced commands
+                    // get a copy of their one transform per instance
+                    const GLuint instance_count = instanced ? g.instance_count : 1;
+                    const GLuint base_instance = inst->staging.size();
+                    for (GLuint k = 0; k < instance_count; ++k) {
+                        pushInstance(inst, instance_table, instance_id);
+                    }
+                    uint32_t idx = drawCmdStreamPush(
+                        out, instanced_type, s.mode, g.vao, s.progid, s.ub_model,
+                        g.offset, g.count, instance_count, s.bindings
+                    );
+                    out->geometry[idx].base_instance = base_instance;
+                }
+            }
+            run_begin = run_end;
+        }
+        group_begin = group_end;
+    }
+
+    // Output was produced in sorted order already
+    out->order.resize(out->count());
+    for (int i = 0; i < out->count(); ++i) {
+        out->order[i] = i;
+    }
+    inst->stats.draws_after = out->count();
+}
+
+void glxUploadAutoInstancer(AutoInstancer* inst) {
+    PROF_SCOPE_FN();
+
+    const size_t size = inst->staging.size() * sizeof(DrawInstanceData);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, inst->instance_buffer);
+    if (size > inst->instance_buffer_size) {
+        inst->instance_buffer_size = std::max(size, inst->instance_buffer_size * 2);
+    }
+    // Orphan and refill, the previous frame may still be reading the old storage
+    glBufferData(GL_SHADER_STORAGE_BUFFER, inst->instance_buffer_size, 0, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, inst->staging.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_INSTANCES, inst->instance_buffer);
+}
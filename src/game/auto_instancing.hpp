@@ -0,0 +1,53 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+#include "draw_cmd.hpp"
+
+
+// Matches InstanceData in data/shaders/uniform_blocks/instances.glsl (std430)
+struct DrawInstanceData {
+	gfxm::mat4 transform;
+	gfxm::vec4 color;
+};
+static_assert(sizeof(DrawInstanceData) == 80, "DrawInstanceData must match the std430 layout");
+
+constexpr GLuint SSBO_BINDING_INSTANCES = 0;
+
+struct AutoInstancingStats {
+	int draws_before = 0;
+	int draws_after = 0;
+	int instanced_batches = 0;
+	int instances = 0;
+};
+
+// Collapses runs of sorted commands that draw the same mesh with the same program,
+// model buffer and material bindings into single instanced draws
+struct AutoInstancer {
+	GLuint instance_buffer = 0;
+	size_t instance_buffer_size = 0;
+	std::vector<DrawInstanceData> staging;
+	std::vector<uint32_t> group_order;
+
+	// Run length at which a run turns into one instanced draw.
+	// Small meshes are dominated by per-draw overhead so they batch sooner,
+	// big ones gain little and pay for the instance fetch in every vertex.
+	// Size is the command's count, indices for indexed draws and vertices otherwise
+	int min_instances_small = 2;
+	int min_instances_large = 8;
+	int small_mesh_max_indices = 4096;
+	bool enabled = true;
+
+	AutoInstancingStats stats;
+};
+
+void glxInitAutoInstancer(AutoInstancer* inst);
+void glxDestroyAutoInstancer(AutoInstancer* inst);
+
+// Writes a sorted stream to out where every command has an instance slot.
+// Slot 0 is always the identity transform with white color, used by commands without an instance id.
+// instance_table is indexed by the stream's instance ids, may be null if none are set
+void autoInstanceDrawCmds(AutoInstancer* inst, const DrawCmdStream* in, const DrawInstanceData* instance_table, DrawCmdStream* out);
+// Uploads the instance data gathered by autoInstanceDrawCmds() and binds it at SSBO_BINDING_INSTANCES
+void glxUploadAutoInstancer(AutoInstancer* inst);
@@ -0,0 +1,83 @@
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "auto_instancing.hpp"
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+
+
+void benchAutoInstancing() {
+    const int COMMAND_COUNT = 131072;
+    const int ITERATIONS = 10;
+
+    uint32_t seed = 0x2468ace;
+    auto rnd = [&seed]()->uint32_t {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+
+    std::vector<DrawInstanceData> instances(COMMAND_COUNT);
+    DrawCmdStream stream;
+    drawCmdStreamReserve(&stream, COMMAND_COUNT);
+    int expected_drawn = 0;
+    for (int i = 0; i < COMMAND_COUNT; ++i) {
+        instances[i].transform = gfxm::translate(gfxm::mat4(1.0f), gfxm::vec3(rnd() % 1000, 0, rnd() % 1000));
+        instances[i].color = gfxm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+        // Few programs and materials, a mix of small props and a handful of large meshes
+        const GLuint mesh = rnd() % 256;
+        const GLuint count = mesh < 240 ? 36 + mesh * 12 : 16384 + mesh;
+        if (i % 97 == 0) {
+            // Instanced by the caller already, every other one without an instance of its own
+            const uint32_t instance_id = i % 2 ? (uint32_t)i : DRAW_INSTANCE_NONE;
+            drawCmdStreamPush(&stream, DRAW_CMD_ARRAY_INSTANCED, GL_TRIANGLES, 1 + mesh, 1 + rnd() % 8, 1, 0, count, 4, 0, instance_id);
+            expected_drawn += 4;
+            continue;
+        }
+        drawCmdStreamPush(&stream, DRAW_CMD_ARRAY, GL_TRIANGLES, 1 + mesh, 1 + rnd() % 8, 1, 0, count, 0, 0, i);
+        expected_drawn++;
+    }
+    drawCmdStreamSort(&stream);
+
+    AutoInstancer instancer;
+    DrawCmdStream out;
+    drawCmdStreamReserve(&out, COMMAND_COUNT);
+    double best = 1e9;
+    for (int it = 0; it < ITERATIONS; ++it) {
+        Stopwatch sw;
+        autoInstanceDrawCmds(&instancer, &stream, instances.data(), &out);
+        best = std::min(best, sw.elapsedMs());
+    }
+
+    // Every input instance must be drawn exactly once, and every instanced draw needs slots of its own
+    // for gl_BaseInstance + gl_InstanceID to read
+    int drawn = 0;
+    int bad_slots = 0;
+    std::vector<uint8_t> slot_used(instancer.staging.size(), 0);
+    for (int i = 0; i < out.count(); ++i) {
+        if (!isDrawCmdInstanced((DRAW_CMD_TYPE)out.states[i].type)) {
+            drawn++;
+            continue;
+        }
+        const DrawCmdGeometry& g = out.geometry[i];
+        drawn += g.instance_count;
+        for (GLuint k = 0; k < g.instance_count; ++k) {
+            const size_t slot = (size_t)g.base_instance + k;
+            if (slot == 0 || slot >= slot_used.size() || slot_used[slot]) {
+                bad_slots++;
+            } else {
+                slot_used[slot] = 1;
+            }
+        }
+    }
+    const AutoInstancingStats& s = instancer.stats;
+    LOG("bench", "auto instancing: " << s.draws_before << " -> " << s.draws_after << " draws, "
+        << s.instanced_batches << " batches with " << s.instances << " instances, "
+        << instancer.staging.size() * sizeof(DrawInstanceData) / 1024 << "KB instance data, " << best << "ms");
+    if (drawn != expected_drawn) {
+        LOG_ERR("bench", "auto instancing: " << drawn << " instances drawn, expected " << expected_drawn);
+    }
+    if (bad_slots) {
+        LOG_ERR("bench", "auto instancing: " << bad_slots << " instances read a slot out of range or shared with another draw");
+    }
+}
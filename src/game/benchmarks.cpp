@@ -0,0 +1,58 @@
+#include "benchmarks.hpp"
+
+#include <string.h>
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+
+
+struct BenchmarkEntry {
+    const char* name;
+    void(*fn)();
+};
+
+static const BenchmarkEntry s_benchmarks[] = {
+    { "draw_cmd", &benchDrawCmdStream },
+    { "draw_cmd_record", &benchDrawCmdRecording },
+    { "frustum_cull", &benchFrustumCull },
+    { "bvh", &benchBvh },
+    { "occlusion", &benchOcclusionCull },
+    { "instancing", &benchAutoInstancing },
+    { "mesh_lod", &benchMeshLod },
+    { "clustered_lights", &benchClusteredLights },
+    { "dynres", &benchDynamicResolution },
+    { "render_graph", &benchRenderGraph },
+    { "sh_irradiance", &benchShIrradiance },
+    { "texture_compress", &benchTextureCompress },
+};
+
+bool runBenchmarks(int argc, char* argv[]) {
+    int first = -1;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-bench") == 0) {
+            first = i + 1;
+            break;
+        }
+    }
+    if (first < 0) {
+        return false;
+    }
+
+    const int count = sizeof(s_benchmarks) / sizeof(s_benchmarks[0]);
+    for (int i = 0; i < count; ++i) {
+        bool selected = first >= argc;
+        for (int j = first; j < argc; ++j) {
+            if (strcmp(argv[j], s_benchmarks[i].name) == 0) {
+                selected = true;
+            }
+        }
+        if (!selected) {
+            continue;
+        }
+
+        LOG("bench", "Running '" << s_benchmarks[i].name << "'");
+        Stopwatch sw;
+        s_benchmarks[i].fn();
+        LOG("bench", "'" << s_benchmarks[i].name << "' done in " << sw.elapsedMs() << "ms");
+    }
+    return true;
+}
@@ -0,0 +1,19 @@
+#pragma once
+
+
+// Runs the benchmarks named after -bench on the command line (all of them if none are named)
+// Returns false if -bench was not passed
+bool runBenchmarks(int argc, char* argv[]);
+
+void benchDrawCmdStream();
+void benchDrawCmdRecording();
+void benchFrustumCull();
+void benchBvh();
+void benchOcclusionCull();
+void benchAutoInstancing();
+void benchMeshLod();
+void benchClusteredLights();
+void benchDynamicResolution();
+void benchRenderGraph();
+void benchShIrradiance();
+void benchTextureCompress();
@@ -0,0 +1,418 @@
+#include "bvh.hpp"
+
+#include <assert.h>
+#include <float.h>
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+// Relative costs for the surface area heuristic
+constexpr float BVH_TRAVERSAL_COST = 1.0f;
+constexpr float BVH_INTERSECTION_COST = 1.0f;
+
+static float aabbHalfArea(const gfxm::vec3& min, const gfxm::vec3& max) {
+    gfxm::vec3 e = max - min;
+    return e.x * e.y + e.y * e.z + e.z * e.x;
+}
+
+struct BvhBin {
+    gfxm::aabb box = gfxm::aabb(gfxm::vec3(FLT_MAX, FLT_MAX, FLT_MAX), gfxm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    int count = 0;
+};
+
+static void growBox(gfxm::aabb& box, const gfxm::aabb& other) {
+    box.from.x = std::min(box.from.x, other.from.x);
+    box.from.y = std::min(box.from.y, other.from.y);
+    box.from.z = std::min(box.from.z, other.from.z);
+    box.to.x = std::max(box.to.x, other.to.x);
+    box.to.y = std::max(box.to.y, other.to.y);
+    box.to.z = std::max(box.to.z, other.to.z);
+}
+
+static void updateNodeBounds(Bvh* bvh, BvhNode& node) {
+    gfxm::aabb box(gfxm::vec3(FLT_MAX, FLT_MAX, FLT_MAX), gfxm::vec3(-FLT_MAX, -FLT_MAX, -FLT_MAX));
+    for (uint32_t i = 0; i < node.count; ++i) {
+        growBox(box, bvh->prim_bounds[bvh->prim_indices[node.left_first + i]]);
+    }
+    node.min = box.from;
+    node.max = box.to;
+}
+
+// Returns false if no split beats keeping the node as a leaf
+static bool findSahSplit(const Bvh* bvh, const BvhNode& node, int* out_axis, float* out_pos) {
+    gfxm::vec3 cmin(FLT_MAX, FLT_MAX, FLT_MAX);
+    gfxm::vec3 cmax(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (uint32_t i = 0; i < node.count; ++i) {
+        const gfxm::vec3& c = bvh->prim_centroids[bvh->prim_indices[node.left_first + i]];
+        cmin = gfxm::vec3(std::min(cmin.x, c.x), std::min(cmin.y, c.y), std::min(cmin.z, c.z));
+        cmax = gfxm::vec3(std::max(cmax.x, c.x), std::max(cmax.y, c.y), std::max(cmax.z, c.z));
+    }
+
+    float best_cost = node.count * BVH_INTERSECTION_COST;
+    bool found = false;
+    for (int axis = 0; axis < 3; ++axis) {
+        const float lo = cmin[axis];
+        const float hi = cmax[axis];
+        if (hi <= lo) {
+            continue;
+        }
+
+        BvhBin bins[BVH_SAH_BINS];
+        const float scale = BVH_SAH_BINS / (hi - lo);
+        for (uint32_t i = 0; i < node.count; ++i) {
+            uint32_t prim = bvh->prim_indices[node.left_first + i];
+            int b = std::min(BVH_SAH_BINS - 1, (int)((bvh->prim_centroids[prim][axis] - lo) * scale));
+            bins[b].count++;
+            growBox(bins[b].box, bvh->prim_bounds[prim]);
+        }
+
+        // Sweep from both sides to get the cost of every split plane between bins
+        float left_area[BVH_SAH_BINS - 1], right_area[BVH_SAH_BINS - 1];
+        int left_count[BVH_SAH_BINS - 1], right_count[BVH_SAH_BINS - 1];
+        BvhBin left_acc, right_acc;
+        for (int i = 0; i < BVH_SAH_BINS - 1; ++i) {
+            left_acc.count += bins[i].count;
+            growBox(left_acc.box, bins[i].box);
+            left_count[i] = left_acc.count;
+            left_area[i] = left_acc.count ? aabbHalfArea(left_acc.box.from, left_acc.box.to) : .0f;
+
+            const int j = BVH_SAH_BINS - 1 - i;
+            right_acc.count += bins[j].count;
+            growBox(right_acc.box, bins[j].box);
+            right_count[j - 1] = right_acc.count;
+            right_area[j - 1] = right_acc.count ? aabbHalfArea(right_acc.box.from, right_acc.box.to) : .0f;
+        }
+
+        const float node_area = aabbHalfArea(node.min, node.max);
+        const float inv_area = node_area > .0f ? 1.0f / node_area : .0f;
+        for (int i = 0; i < BVH_SAH_BINS - 1; ++i) {
+            if (left_count[i] == 0 || right_count[i] == 0) {
+                continue;
+            }
+            float cost = BVH_TRAVERSAL_COST
+                + BVH_INTERSECTION_COST * (left_count[i] * left_area[i] + right_count[i] * right_area[i]) * inv_area;
+            if (cost < best_cost) {
+                best_cost = cost;
+                *out_axis = axis;
+                *out_pos = lo + (i + 1) / scale;
+                found = true;
+            }
+        }
+    }
+    return found;
+}
+
+void bvhBuild(Bvh* bvh, const gfxm::aabb* boxes, int count) {
+    PROF_SCOPE_FN();
+
+    bvh->nodes.clear();
+    bvh->prim_indices.resize(count);
+    bvh->prim_bounds.assign(boxes, boxes + count);
+    bvh->prim_centroids.resize(count);
+    for (int i = 0; i < count; ++i) {
+        bvh->prim_indices[i] = i;
+        bvh->prim_centroids[i] = (boxes[i].from + boxes[i].to) * .5f;
+    }
+    bvh->refits_since_build = 0;
+
+    if (count == 0) {
+        bvh->build_sah_cost = bvh->sah_cost = .0f;
+        return;
+    }
+
+    // A binary tree with n leaves has 2n - 1 nodes
+    bvh->nodes.reserve(count * 2);
+    BvhNode root;
+    root.left_first = 0;
+    root.count = count;
+    updateNodeBounds(bvh, root);
+    bvh->nodes.push_back(root);
+
+    uint32_t stack[BVH_MAX_DEPTH];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const uint32_t node_idx = stack[--sp];
+        BvhNode node = bvh->nodes[node_idx];
+        if (node.count <= BVH_MAX_LEAF_PRIMS) {
+            continue;
+        }
+
+        int axis = 0;
+        float split = .0f;
+        if (!findSahSplit(bvh, node, &axis, &split)) {
+            continue;
+        }
+
+        uint32_t* first = &bvh->prim_indices[node.left_first];
+        uint32_t* last = first + node.count;
+        uint32_t* mid = std::partition(first, last, [bvh, axis, split](uint32_t prim) {
+            return bvh->prim_centroids[prim][axis] < split;
+        });
+        const uint32_t left_count = mid - first;
+        if (left_count == 0 || left_count == node.count) {
+            continue;
+        }
+        if (sp + 2 > BVH_MAX_DEPTH) {
+            LOG_WARN("bvh", "Max depth reached, leaving a leaf with " << node.count << " objects");
+            continue;
+        }
+
+        BvhNode left, right;
+        left.left_first = node.left_first;
+        left.count = left_count;
+        right.left_first = node.left_first + left_count;
+        right.count = node.count - left_count;
+        updateNodeBounds(bvh, left);
+        updateNodeBounds(bvh, right);
+
+        const uint32_t left_idx = bvh->nodes.size();
+        bvh->nodes.push_back(left);
+        bvh->nodes.push_back(right);
+        bvh->nodes[node_idx].left_first = left_idx;
+        bvh->nodes[node_idx].count = 0;
+
+        stack[sp++] = left_idx + 1;
+        stack[sp++] = left_idx;
+    }
+
+    bvh->build_sah_cost = bvh->sah_cost = bvhComputeSahCost(bvh);
+}
+
+void bvhRefit(Bvh* bvh, const gfxm::aabb* boxes) {
+    PROF_SCOPE_FN();
+
+    const int count = bvh->prim_bounds.size();
+    for (int i = 0; i < count; ++i) {
+        bvh->prim_bounds[i] = boxes[i];
+        bvh->prim_centroids[i] = (boxes[i].from + boxes[i].to) * .5f;
+    }
+
+    for (int i = (int)bvh->nodes.size() - 1; i >= 0; --i) {
+        BvhNode& node = bvh->nodes[i];
+        if (node.count > 0) {
+            updateNodeBounds(bvh, node);
+        } else {
+            const BvhNode& l = bvh->nodes[node.left_first];
+            const BvhNode& r = bvh->nodes[node.left_first + 1];
+            node.min = gfxm::vec3(std::min(l.min.x, r.min.x), std::min(l.min.y, r.min.y), std::min(l.min.z, r.min.z));
+            node.max = gfxm::vec3(std::max(l.max.x, r.max.x), std::max(l.max.y, r.max.y), std::max(l.max.z, r.max.z));
+        }
+    }
+
+    ++bvh->refits_since_build;
+    bvh->sah_cost = bvhComputeSahCost(bvh);
+}
+
+bool bvhUpdate(Bvh* bvh, const gfxm::aabb* boxes, int count) {
+    if (count != bvh->prim_bounds.size() || bvh->nodes.empty()) {
+        bvhBuild(bvh, boxes, count);
+        return true;
+    }
+    bvhRefit(bvh, boxes);
+    if (bvh->sah_cost > bvh->build_sah_cost * bvh->rebuild_threshold) {
+        LOG_DBG("bvh", "Rebuilding after " << bvh->refits_since_build << " refits, sah cost " << bvh->build_sah_cost << " -> " << bvh->sah_cost);
+        bvhBuild(bvh, boxes, count);
+        return true;
+    }
+    return false;
+}
+
+float bvhComputeSahCost(const Bvh* bvh) {
+    if (bvh->nodes.empty()) {
+        return .0f;
+    }
+    const float root_area = aabbHalfArea(bvh->nodes[0].min, bvh->nodes[0].max);
+    if (root_area <= .0f) {
+        return .0f;
+    }
+    float cost = .0f;
+    for (const BvhNode& node : bvh->nodes) {
+        float area = aabbHalfArea(node.min, node.max);
+        cost += area * (node.count ? node.count * BVH_INTERSECTION_COST : BVH_TRAVERSAL_COST);
+    }
+    return cost / root_area;
+}
+
+// Plane test against a box given as min/max, bit i of mask set means plane i still needs testing.
+// Returns -1 if the box is outside, otherwise the planes the box still straddles
+static int frustumPlaneMask(const gfxm::frustum& f, const gfxm::vec3& min, const gfxm::vec3& max, int mask) {
+    for (int i = 0; i < 6; ++i) {
+        if ((mask & (1 << i)) == 0) {
+            continue;
+        }
+        const gfxm::vec4& p = f.planes[i];
+        // Furthest corner along the normal, same arithmetic as gfxm::frustum_vs_aabb
+        float dp = p.x * (p.x > .0f ? max.x : min.x)
+            + p.y * (p.y > .0f ? max.y : min.y)
+            + p.z * (p.z > .0f ? max.z : min.z)
+            + p.w * 1.0f;
+        if (dp < .0f) {
+            return -1;
+        }
+        float dn = p.x * (p.x > .0f ? min.x : max.x)
+            + p.y * (p.y > .0f ? min.y : max.y)
+            + p.z * (p.z > .0f ? min.z : max.z)
+            + p.w * 1.0f;
+        if (dn >= .0f) {
+            mask &= ~(1 << i);
+        }
+    }
+    return mask;
+}
+
+int bvhFrustumCull(const Bvh* bvh, const gfxm::frustum& f, uint32_t* out_visible) {
+    PROF_SCOPE_FN();
+
+    if (bvh->nodes.empty()) {
+        return 0;
+    }
+
+    struct Entry {
+        uint32_t node;
+        int mask;
+    };
+    Entry stack[BVH_MAX_DEPTH * 2];
+    int sp = 0;
+    stack[sp++] = Entry{ 0, 0x3F };
+
+    int n = 0;
+    while (sp > 0) {
+        Entry e = stack[--sp];
+        const BvhNode& node = bvh->nodes[e.node];
+        int mask = frustumPlaneMask(f, node.min, node.max, e.mask);
+        if (mask < 0) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                uint32_t prim = bvh->prim_indices[node.left_first + i];
+                const gfxm::aabb& box = bvh->prim_bounds[prim];
+                if (mask == 0 || frustumPlaneMask(f, box.from, box.to, mask) >= 0) {
+                    out_visible[n++] = prim;
+                }
+            }
+            continue;
+        }
+        stack[sp++] = Entry{ node.left_first + 1, mask };
+        stack[sp++] = Entry{ node.left_first, mask };
+    }
+    return n;
+}
+
+// Entry distance along the ray, FLT_MAX on a miss
+static float rayBoxDistance(const gfxm::ray& ray, const gfxm::vec3& min, const gfxm::vec3& max, float t_max) {
+    float tx1 = (min.x - ray.origin.x) * ray.direction_inverse.x;
+    float tx2 = (max.x - ray.origin.x) * ray.direction_inverse.x;
+    float tmin = std::min(tx1, tx2);
+    float tmax = std::max(tx1, tx2);
+    float ty1 = (min.y - ray.origin.y) * ray.direction_inverse.y;
+    float ty2 = (max.y - ray.origin.y) * ray.direction_inverse.y;
+    tmin = std::max(tmin, std::min(ty1, ty2));
+    tmax = std::min(tmax, std::max(ty1, ty2));
+    float tz1 = (min.z - ray.origin.z) * ray.direction_inverse.z;
+    float tz2 = (max.z - ray.origin.z) * ray.direction_inverse.z;
+    tmin = std::max(tmin, std::min(tz1, tz2));
+    tmax = std::min(tmax, std::max(tz1, tz2));
+    if (tmax >= tmin && tmax >= .0f && tmin < t_max) {
+        return std::max(tmin, .0f);
+    }
+    return FLT_MAX;
+}
+
+bool bvhRaycast(const Bvh* bvh, const gfxm::ray& ray, uint32_t* out_object, float* out_t, bvh_ray_hit_fn_t hit_fn, void* user_ptr) {
+    if (bvh->nodes.empty()) {
+        return false;
+    }
+
+    float closest = ray.length;
+    bool hit = false;
+
+    uint32_t stack[BVH_MAX_DEPTH * 2];
+    int sp = 0;
+    if (rayBoxDistance(ray, bvh->nodes[0].min, bvh->nodes[0].max, closest) == FLT_MAX) {
+        return false;
+    }
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const BvhNode& node = bvh->nodes[stack[--sp]];
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                uint32_t prim = bvh->prim_indices[node.left_first + i];
+                float t = FLT_MAX;
+                if (hit_fn) {
+                    if (!hit_fn(user_ptr, prim, ray, &t)) {
+                        continue;
+                    }
+                } else {
+                    const gfxm::aabb& box = bvh->prim_bounds[prim];
+                    t = rayBoxDistance(ray, box.from, box.to, closest);
+                }
+                if (t < closest) {
+                    closest = t;
+                    *out_object = prim;
+                    hit = true;
+                }
+            }
+            continue;
+        }
+
+        // Visit the nearer child first so later hits can prune the other one
+        uint32_t near_idx = node.left_first;
+        uint32_t far_idx = node.left_first + 1;
+        float t_near = rayBoxDistance(ray, bvh->nodes[near_idx].min, bvh->nodes[near_idx].max, closest);
+        float t_far = rayBoxDistance(ray, bvh->nodes[far_idx].min, bvh->nodes[far_idx].max, closest);
+        if (t_far < t_near) {
+            std::swap(near_idx, far_idx);
+            std::swap(t_near, t_far);
+        }
+        if (t_far != FLT_MAX) {
+            stack[sp++] = far_idx;
+        }
+        if (t_near != FLT_MAX) {
+            stack[sp++] = near_idx;
+        }
+    }
+
+    if (hit) {
+        *out_t = closest;
+    }
+    return hit;
+}
+
+int bvhQueryAabb(const Bvh* bvh, const gfxm::aabb& box, std::vector<uint32_t>& out) {
+    if (bvh->nodes.empty()) {
+        return 0;
+    }
+
+    auto overlaps = [&box](const gfxm::vec3& min, const gfxm::vec3& max) {
+        return min.x <= box.to.x && max.x >= box.from.x
+            && min.y <= box.to.y && max.y >= box.from.y
+            && min.z <= box.to.z && max.z >= box.from.z;
+    };
+
+    const size_t start = out.size();
+    uint32_t stack[BVH_MAX_DEPTH * 2];
+    int sp = 0;
+    stack[sp++] = 0;
+    while (sp > 0) {
+        const BvhNode& node = bvh->nodes[stack[--sp]];
+        if (!overlaps(node.min, node.max)) {
+            continue;
+        }
+        if (node.count > 0) {
+            for (uint32_t i = 0; i < node.count; ++i) {
+                uint32_t prim = bvh->prim_indices[node.left_first + i];
+                const gfxm::aabb& pb = bvh->prim_bounds[prim];
+                if (overlaps(pb.from, pb.to)) {
+                    out.push_back(prim);
+                }
+            }
+            continue;
+        }
+        stack[sp++] = node.left_first + 1;
+        stack[sp++] = node.left_first;
+    }
+    return out.size() - start;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+
+
+// Flat node, children of an interior node are stored next to each other at left_first and left_first + 1,
+// always after their parent, so a reverse walk over the array visits children before parents
+struct BvhNode {
+	gfxm::vec3 min;
+	uint32_t left_first;	// Left child for interior nodes, first entry in prim_indices for leaves
+	gfxm::vec3 max;
+	uint32_t count;			// 0 for interior nodes
+};
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes");
+
+struct Bvh {
+	std::vector<BvhNode> nodes;
+	std::vector<uint32_t> prim_indices;
+	std::vector<gfxm::aabb> prim_bounds;
+	std::vector<gfxm::vec3> prim_centroids;
+
+	float build_sah_cost = .0f;
+	float sah_cost = .0f;
+	int refits_since_build = 0;
+	// Rebuild once refitting has made the tree this much worse than when it was built
+	float rebuild_threshold = 1.4f;
+};
+
+constexpr int BVH_MAX_LEAF_PRIMS = 4;
+constexpr int BVH_SAH_BINS = 16;
+constexpr int BVH_MAX_DEPTH = 64;
+
+// Binned SAH build over object bounds, object i ends up as prim index i
+void bvhBuild(Bvh* bvh, const gfxm::aabb* boxes, int count);
+// Updates bounds in place without changing the topology, count must match the last build
+void bvhRefit(Bvh* bvh, const gfxm::aabb* boxes);
+// Refits, or rebuilds when the object count changed or the tree degraded past rebuild_threshold.
+// Returns true if a rebuild happened
+bool bvhUpdate(Bvh* bvh, const gfxm::aabb* boxes, int count);
+
+float bvhComputeSahCost(const Bvh* bvh);
+
+// Appends indices of objects whose bounds pass gfxm::frustum_vs_aabb, returns how many were added.
+// Nodes fully inside a plane stop testing it, nodes fully inside the frustum are taken whole
+int bvhFrustumCull(const Bvh* bvh, const gfxm::frustum& f, uint32_t* out_visible);
+
+// Precise hit test for picking, return false for a miss, otherwise the distance along the ray
+typedef bool(*bvh_ray_hit_fn_t)(void* user_ptr, uint32_t object, const gfxm::ray& ray, float* out_t);
+
+// Finds the closest object along ray.direction within ray.length.
+// Without a hit callback object bounds are the hit shapes
+bool bvhRaycast(const Bvh* bvh, const gfxm::ray& ray, uint32_t* out_object, float* out_t, bvh_ray_hit_fn_t hit_fn = 0, void* user_ptr = 0);
+
+// Appends indices of objects whose bounds overlap box, returns how many were added
+int bvhQueryAabb(const Bvh* bvh, const gfxm::aabb& box, std::vector<uint32_t>& out);
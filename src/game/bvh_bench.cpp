@@ -0,0 +1,158 @@
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "bvh.hpp"
+#include "frustum_cull.hpp"
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+
+
+void benchBvh() {
+    const int OBJECT_COUNT = 200000;
+    const int RAY_COUNT = 10000;
+    const int QUERY_COUNT = 10000;
+    const float EXTENT = 2000.f;
+
+    uint32_t seed = 0xB0B;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+
+    std::vector<gfxm::vec3> positions(OBJECT_COUNT);
+    std::vector<gfxm::vec3> velocities(OBJECT_COUNT);
+    std::vector<gfxm::vec3> half_extents(OBJECT_COUNT);
+    std::vector<gfxm::aabb> boxes(OBJECT_COUNT);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        positions[i] = gfxm::vec3((rnd01() * 2.f - 1.f) * EXTENT, rnd01() * 50.f, (rnd01() * 2.f - 1.f) * EXTENT);
+        velocities[i] = gfxm::vec3(rnd01() - .5f, .0f, rnd01() - .5f) * 2.f;
+        half_extents[i] = gfxm::vec3(.5f + rnd01() * 2.f, .5f + rnd01() * 2.f, .5f + rnd01() * 2.f);
+        boxes[i] = gfxm::aabb(positions[i] - half_extents[i], positions[i] + half_extents[i]);
+    }
+
+    Bvh bvh;
+    Stopwatch sw;
+    bvhBuild(&bvh, boxes.data(), OBJECT_COUNT);
+    LOG("bench", "bvh: build " << OBJECT_COUNT << " objects in " << sw.elapsedMs() << "ms, "
+        << bvh.nodes.size() << " nodes (" << bvh.nodes.size() * sizeof(BvhNode) / 1024 << "KB), sah cost " << bvh.build_sah_cost);
+
+    // Frustum culling against the flat SIMD path, both must find the same set
+    AabbSoa soa;
+    aabbSoaResize(&soa, OBJECT_COUNT);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        aabbSoaSet(&soa, i, boxes[i]);
+    }
+    std::vector<uint32_t> flat_visible(OBJECT_COUNT);
+    std::vector<uint32_t> bvh_visible(OBJECT_COUNT);
+    gfxm::mat4 proj = gfxm::perspective(gfxm::radian(60.f), 16.f / 9.f, .1f, 500.f);
+    gfxm::mat4 view = gfxm::inverse(gfxm::translate(gfxm::mat4(1.0f), gfxm::vec3(0, 20.f, 0)));
+    gfxm::frustum f = gfxm::make_frustum(proj, view);
+
+    double flat_ms = 1e9, bvh_ms = 1e9;
+    int flat_n = 0, bvh_n = 0;
+    for (int it = 0; it < 20; ++it) {
+        sw.reset();
+        flat_n = frustumCullAabbs(f, &soa, 0, OBJECT_COUNT, flat_visible.data());
+        flat_ms = std::min(flat_ms, sw.elapsedMs());
+        sw.reset();
+        bvh_n = bvhFrustumCull(&bvh, f, bvh_visible.data());
+        bvh_ms = std::min(bvh_ms, sw.elapsedMs());
+    }
+    std::sort(bvh_visible.begin(), bvh_visible.begin() + bvh_n);
+    bool cull_ok = flat_n == bvh_n && std::equal(flat_visible.begin(), flat_visible.begin() + flat_n, bvh_visible.begin());
+    LOG("bench", "bvh: frustum cull " << bvh_ms << "ms vs flat simd " << flat_ms << "ms, "
+        << bvh_n << " visible, " << (cull_ok ? "matches" : "MISMATCH"));
+
+    // Picking rays from a camera looking down at the field, checked against brute force
+    std::vector<gfxm::ray> rays(RAY_COUNT);
+    gfxm::mat4 pick_view = gfxm::inverse(gfxm::translate(gfxm::mat4(1.0f), gfxm::vec3(0, 300.f, 0)) * gfxm::to_mat4(gfxm::angle_axis(gfxm::radian(-60.f), gfxm::vec3(1, 0, 0))));
+    gfxm::mat4 pick_proj = gfxm::perspective(gfxm::radian(60.f), 16.f / 9.f, .1f, 5000.f);
+    for (int i = 0; i < RAY_COUNT; ++i) {
+        rays[i] = gfxm::ray_viewport_to_world(gfxm::vec2(1920.f, 1080.f), gfxm::vec2(rnd01() * 1920.f, rnd01() * 1080.f), pick_proj, pick_view);
+    }
+    sw.reset();
+    int hits = 0;
+    std::vector<uint32_t> bvh_hit(RAY_COUNT, ~0u);
+    std::vector<float> bvh_hit_t(RAY_COUNT, .0f);
+    for (int i = 0; i < RAY_COUNT; ++i) {
+        if (bvhRaycast(&bvh, rays[i], &bvh_hit[i], &bvh_hit_t[i])) {
+            ++hits;
+        }
+    }
+    double ray_ms = sw.elapsedMs();
+
+    // Brute force over a subset, it's slow
+    const int BRUTE_RAYS = 200;
+    int ray_mismatch = 0;
+    sw.reset();
+    for (int i = 0; i < BRUTE_RAYS; ++i) {
+        float best = rays[i].length;
+        uint32_t best_obj = ~0u;
+        for (int j = 0; j < OBJECT_COUNT; ++j) {
+            const gfxm::aabb& b = boxes[j];
+            float tx1 = (b.from.x - rays[i].origin.x) * rays[i].direction_inverse.x;
+            float tx2 = (b.to.x - rays[i].origin.x) * rays[i].direction_inverse.x;
+            float ty1 = (b.from.y - rays[i].origin.y) * rays[i].direction_inverse.y;
+            float ty2 = (b.to.y - rays[i].origin.y) * rays[i].direction_inverse.y;
+            float tz1 = (b.from.z - rays[i].origin.z) * rays[i].direction_inverse.z;
+            float tz2 = (b.to.z - rays[i].origin.z) * rays[i].direction_inverse.z;
+            float tmin = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+            float tmax = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+            if (tmax >= tmin && tmax >= .0f && tmin < best) {
+                best = std::max(tmin, .0f);
+                best_obj = j;
+            }
+        }
+        if (best_obj != bvh_hit[i] && (best_obj == ~0u || bvh_hit[i] == ~0u || best != bvh_hit_t[i])) {
+            ++ray_mismatch;
+        }
+    }
+    double brute_ray_ms = sw.elapsedMs() / BRUTE_RAYS * RAY_COUNT;
+    LOG("bench", "bvh: " << RAY_COUNT << " picking rays " << ray_ms << "ms (" << hits << " hits), brute force estimate "
+        << brute_ray_ms << "ms, " << ray_mismatch << " mismatches in " << BRUTE_RAYS << " checked");
+
+    // Overlap queries
+    std::vector<uint32_t> query_result;
+    query_result.reserve(1024);
+    sw.reset();
+    size_t total_found = 0;
+    for (int i = 0; i < QUERY_COUNT; ++i) {
+        gfxm::vec3 c((rnd01() * 2.f - 1.f) * EXTENT, rnd01() * 50.f, (rnd01() * 2.f - 1.f) * EXTENT);
+        query_result.clear();
+        total_found += bvhQueryAabb(&bvh, gfxm::aabb(c - gfxm::vec3(10, 10, 10), c + gfxm::vec3(10, 10, 10)), query_result);
+    }
+    LOG("bench", "bvh: " << QUERY_COUNT << " aabb queries " << sw.elapsedMs() << "ms, " << total_found << " overlaps");
+
+    // Moving objects, refit every frame and let bvhUpdate decide when to rebuild
+    double refit_total = .0;
+    double rebuild_total = .0;
+    int rebuilds = 0;
+    const int FRAMES = 120;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        for (int i = 0; i < OBJECT_COUNT; ++i) {
+            positions[i] = positions[i] + velocities[i];
+            boxes[i] = gfxm::aabb(positions[i] - half_extents[i], positions[i] + half_extents[i]);
+        }
+        sw.reset();
+        bool rebuilt = bvhUpdate(&bvh, boxes.data(), OBJECT_COUNT);
+        double ms = sw.elapsedMs();
+        if (rebuilt) {
+            ++rebuilds;
+            rebuild_total += ms;
+        } else {
+            refit_total += ms;
+        }
+    }
+    LOG("bench", "bvh: " << FRAMES << " frames of motion, refit avg " << (refit_total / std::max(1, FRAMES - rebuilds))
+        << "ms, " << rebuilds << " rebuilds avg " << (rebuild_total / std::max(1, rebuilds)) << "ms, final sah cost " << bvh.sah_cost);
+
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        aabbSoaSet(&soa, i, boxes[i]);
+    }
+    flat_n = frustumCullAabbs(f, &soa, 0, OBJECT_COUNT, flat_visible.data());
+    bvh_n = bvhFrustumCull(&bvh, f, bvh_visible.data());
+    std::sort(bvh_visible.begin(), bvh_visible.begin() + bvh_n);
+    cull_ok = flat_n == bvh_n && std::equal(flat_visible.begin(), flat_visible.begin() + flat_n, bvh_visible.begin());
+    LOG("bench", "bvh: frustum cull after refits " << (cull_ok ? "matches" : "MISMATCH") << " flat simd");
+}
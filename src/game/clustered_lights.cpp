@@ -0,0 +1,380 @@
+#include "clustered_lights.hpp"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "log/log.hpp"
+#include "math/simd.hpp"
+#include "profiler/profiler.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+
+
+constexpr int LIGHT_BIN_CHUNK_SIZE = 1024;
+
+void glxInitClusteredLights(ClusteredLights* cl) {
+    glGenBuffers(1, &cl->ub_clusters);
+    glGenBuffers(1, &cl->light_buffer);
+    glGenBuffers(1, &cl->cluster_buffer);
+    glGenBuffers(1, &cl->index_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cl->cluster_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_COUNT * 2 * sizeof(uint32_t), 0, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    cl->light_buffer_size = 0;
+    cl->index_buffer_size = 0;
+}
+
+void glxDestroyClusteredLights(ClusteredLights* cl) {
+    glDeleteBuffers(1, &cl->ub_clusters);
+    glDeleteBuffers(1, &cl->light_buffer);
+    glDeleteBuffers(1, &cl->cluster_buffer);
+    glDeleteBuffers(1, &cl->index_buffer);
+    cl->ub_clusters = cl->light_buffer = cl->cluster_buffer = cl->index_buffer = 0;
+    cl->light_buffer_size = 0;
+    cl->index_buffer_size = 0;
+}
+
+// Tile boundary planes through the eye, normalized, positive side towards the next tile.
+// x boundary k sits at ndc 2k/X - 1: proj[0][0] * x + ndc * z = 0
+struct ClusterPlanes {
+    float x_nx[LIGHT_CLUSTERS_X + 1];
+    float x_nz[LIGHT_CLUSTERS_X + 1];
+    float y_ny[LIGHT_CLUSTERS_Y + 1];
+    float y_nz[LIGHT_CLUSTERS_Y + 1];
+    // View depth where slice k starts, k in [1, LIGHT_CLUSTERS_Z)
+    float slice_depth[LIGHT_CLUSTERS_Z];
+};
+
+static void makeClusterPlanes(ClusterPlanes* p, const gfxm::mat4& proj, float cluster_near, float slice_scale) {
+    for (int k = 0; k <= LIGHT_CLUSTERS_X; ++k) {
+        float ndc = 2.0f * k / LIGHT_CLUSTERS_X - 1.0f;
+        float inv_len = 1.0f / sqrtf(proj[0][0] * proj[0][0] + ndc * ndc);
+        p->x_nx[k] = proj[0][0] * inv_len;
+        p->x_nz[k] = ndc * inv_len;
+    }
+    for (int k = 0; k <= LIGHT_CLUSTERS_Y; ++k) {
+        float ndc = 2.0f * k / LIGHT_CLUSTERS_Y - 1.0f;
+        float inv_len = 1.0f / sqrtf(proj[1][1] * proj[1][1] + ndc * ndc);
+        p->y_ny[k] = proj[1][1] * inv_len;
+        p->y_nz[k] = ndc * inv_len;
+    }
+    p->slice_depth[0] = .0f;
+    for (int k = 1; k < LIGHT_CLUSTERS_Z; ++k) {
+        p->slice_depth[k] = cluster_near * expf(k / slice_scale);
+    }
+}
+
+static void prepareLights(ClusteredLights* cl, const Light* lights, int begin, int end, const gfxm::mat4& view) {
+    for (int i = begin; i < end; ++i) {
+        const Light& l = lights[i];
+        GpuLight& g = cl->gpu_lights[i];
+        gfxm::vec3 center = l.position;
+        float radius = l.radius;
+        if (l.type == LIGHT_SPOT) {
+            const float cos_outer = cosf(l.outer_angle);
+            const float cos_inner = cosf(l.inner_angle);
+            const float spot_scale = 1.0f / std::max(cos_inner - cos_outer, 1e-4f);
+            g.color_spot_offset = gfxm::vec4(l.color * l.intensity, -cos_outer * spot_scale);
+            g.direction_spot_scale = gfxm::vec4(l.direction, spot_scale);
+            // Smallest sphere around the cone, wide cones are bound by their cap
+            if (cos_outer < .70710678f) {
+                center = l.position + l.direction * (cos_outer * l.radius);
+                radius = sinf(l.outer_angle) * l.radius;
+            } else {
+                radius = l.radius / (2.0f * cos_outer);
+                center = l.position + l.direction * radius;
+            }
+        } else {
+            g.color_spot_offset = gfxm::vec4(l.color * l.intensity, 1.0f);
+            g.direction_spot_scale = gfxm::vec4(.0f, .0f, -1.0f, .0f);
+        }
+        g.position_radius = gfxm::vec4(l.position, l.radius);
+
+        gfxm::vec4 c = view * gfxm::vec4(center, 1.0f);
+        cl->sphere_x[i] = c.x;
+        cl->sphere_y[i] = c.y;
+        cl->sphere_z[i] = c.z;
+        cl->sphere_r[i] = radius;
+    }
+}
+
+static void computeRangesScalar(ClusteredLights* cl, const ClusterPlanes& p, float zfar, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        const float cx = cl->sphere_x[i];
+        const float cy = cl->sphere_y[i];
+        const float cz = cl->sphere_z[i];
+        const float r = cl->sphere_r[i];
+        const float neg_r = -r;
+
+        // A tile overlaps when the sphere reaches the positive side of its first plane
+        // and the negative side of the next one. Min/max of the overlapping tiles
+        // stays conservative even where the plane distances aren't monotonic
+        int x0 = -1, x1 = -1;
+        float d_prev = p.x_nx[0] * cx + p.x_nz[0] * cz;
+        for (int k = 0; k < LIGHT_CLUSTERS_X; ++k) {
+            float d_next = p.x_nx[k + 1] * cx + p.x_nz[k + 1] * cz;
+            if (d_prev > neg_r && d_next < r) {
+                x0 = x0 < 0 ? k : x0;
+                x1 = k;
+            }
+            d_prev = d_next;
+        }
+        int y0 = -1, y1 = -1;
+        d_prev = p.y_ny[0] * cy + p.y_nz[0] * cz;
+        for (int k = 0; k < LIGHT_CLUSTERS_Y; ++k) {
+            float d_next = p.y_ny[k + 1] * cy + p.y_nz[k + 1] * cz;
+            if (d_prev > neg_r && d_next < r) {
+                y0 = y0 < 0 ? k : y0;
+                y1 = k;
+            }
+            d_prev = d_next;
+        }
+
+        const float depth_min = -cz - r;
+        const float depth_max = -cz + r;
+        int z0 = 0, z1 = 0;
+        for (int k = 1; k < LIGHT_CLUSTERS_Z; ++k) {
+            z0 += depth_min >= p.slice_depth[k];
+            z1 += depth_max > p.slice_depth[k];
+        }
+        if (x0 < 0 || y0 < 0 || depth_max <= .0f || depth_min >= zfar) {
+            z0 = LIGHT_CLUSTERS_Z;
+            z1 = -1;
+        }
+        cl->x_min[i] = x0; cl->x_max[i] = x1;
+        cl->y_min[i] = y0; cl->y_max[i] = y1;
+        cl->z_min[i] = z0; cl->z_max[i] = z1;
+    }
+}
+
+#if SIMD_X86
+static inline __m128i selectEpi32(__m128i mask, __m128i a, __m128i b) {
+    return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+}
+
+// Same operation order as computeRangesScalar() so both produce the same ranges
+static void computeTileRangeSse(
+    const float* nxy, const float* nz, int planes,
+    __m128 cxy, __m128 cz, __m128 r, __m128 neg_r,
+    __m128i* out_min, __m128i* out_max
+) {
+    __m128i t0 = _mm_set1_epi32(-1);
+    __m128i t1 = _mm_set1_epi32(-1);
+    __m128 d_prev = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(nxy[0]), cxy), _mm_mul_ps(_mm_set1_ps(nz[0]), cz));
+    for (int k = 0; k < planes - 1; ++k) {
+        __m128 d_next = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(nxy[k + 1]), cxy), _mm_mul_ps(_mm_set1_ps(nz[k + 1]), cz));
+        __m128i overlap = _mm_castps_si128(_mm_and_ps(_mm_cmpgt_ps(d_prev, neg_r), _mm_cmplt_ps(d_next, r)));
+        __m128i kk = _mm_set1_epi32(k);
+        __m128i first = _mm_and_si128(overlap, _mm_cmplt_epi32(t0, _mm_setzero_si128()));
+        t0 = selectEpi32(first, kk, t0);
+        t1 = selectEpi32(overlap, kk, t1);
+        d_prev = d_next;
+    }
+    *out_min = t0;
+    *out_max = t1;
+}
+
+static void computeRangesSse(ClusteredLights* cl, const ClusterPlanes& p, float zfar, int begin, int end) {
+    assert(begin % 4 == 0);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 far_plane = _mm_set1_ps(zfar);
+    for (int i = begin; i < end; i += 4) {
+        const __m128 cx = _mm_loadu_ps(&cl->sphere_x[i]);
+        const __m128 cy = _mm_loadu_ps(&cl->sphere_y[i]);
+        const __m128 cz = _mm_loadu_ps(&cl->sphere_z[i]);
+        const __m128 r = _mm_loadu_ps(&cl->sphere_r[i]);
+        const __m128 neg_r = _mm_sub_ps(zero, r);
+
+        __m128i x0, x1, y0, y1;
+        computeTileRangeSse(p.x_nx, p.x_nz, LIGHT_CLUSTERS_X + 1, cx, cz, r, neg_r, &x0, &x1);
+        computeTileRangeSse(p.y_ny, p.y_nz, LIGHT_CLUSTERS_Y + 1, cy, cz, r, neg_r, &y0, &y1);
+
+        const __m128 depth_min = _mm_sub_ps(_mm_sub_ps(zero, cz), r);
+        const __m128 depth_max = _mm_add_ps(_mm_sub_ps(zero, cz), r);
+        __m128i z0 = _mm_setzero_si128();
+        __m128i z1 = _mm_setzero_si128();
+        for (int k = 1; k < LIGHT_CLUSTERS_Z; ++k) {
+            const __m128 b = _mm_set1_ps(p.slice_depth[k]);
+            // Compare masks are -1 where true
+            z0 = _mm_sub_epi32(z0, _mm_castps_si128(_mm_cmpge_ps(depth_min, b)));
+            z1 = _mm_sub_epi32(z1, _mm_castps_si128(_mm_cmpgt_ps(depth_max, b)));
+        }
+
+        __m128i outside = _mm_or_si128(_mm_cmplt_epi32(x0, _mm_setzero_si128()), _mm_cmplt_epi32(y0, _mm_setzero_si128()));
+        outside = _mm_or_si128(outside, _mm_castps_si128(_mm_cmple_ps(depth_max, zero)));
+        outside = _mm_or_si128(outside, _mm_castps_si128(_mm_cmpge_ps(depth_min, far_plane)));
+        z0 = selectEpi32(outside, _mm_set1_epi32(LIGHT_CLUSTERS_Z), z0);
+        z1 = selectEpi32(outside, _mm_set1_epi32(-1), z1);
+
+        _mm_storeu_si128((__m128i*)&cl->x_min[i], x0);
+        _mm_storeu_si128((__m128i*)&cl->x_max[i], x1);
+        _mm_storeu_si128((__m128i*)&cl->y_min[i], y0);
+        _mm_storeu_si128((__m128i*)&cl->y_max[i], y1);
+        _mm_storeu_si128((__m128i*)&cl->z_min[i], z0);
+        _mm_storeu_si128((__m128i*)&cl->z_max[i], z1);
+    }
+}
+#endif
+
+static void resizeLightArrays(ClusteredLights* cl, int light_count) {
+    const int padded = (light_count + 7) & ~7;
+    cl->gpu_lights.resize(light_count);
+    // Padding spheres sit behind the camera and never get binned
+    cl->sphere_x.resize(padded);
+    cl->sphere_y.resize(padded);
+    cl->sphere_z.resize(padded);
+    cl->sphere_r.resize(padded);
+    for (int i = light_count; i < padded; ++i) {
+        cl->sphere_x[i] = .0f;
+        cl->sphere_y[i] = .0f;
+        cl->sphere_z[i] = FLT_MAX;
+        cl->sphere_r[i] = .0f;
+    }
+    cl->x_min.resize(padded);
+    cl->x_max.resize(padded);
+    cl->y_min.resize(padded);
+    cl->y_max.resize(padded);
+    cl->z_min.resize(padded);
+    cl->z_max.resize(padded);
+}
+
+void clusterLightsBin(
+    ClusteredLights* cl,
+    const Light* lights, int light_count,
+    const gfxm::mat4& view, const gfxm::mat4& proj, float zfar,
+    ThreadPool* pool,
+    LIGHT_BIN_PATH path
+) {
+    PROF_SCOPE_FN();
+    Stopwatch sw;
+
+    const float slice_scale = LIGHT_CLUSTERS_Z / logf(zfar / cl->cluster_near);
+    ClusterPlanes planes;
+    makeClusterPlanes(&planes, proj, cl->cluster_near, slice_scale);
+
+    cl->ub_data.dims[0] = LIGHT_CLUSTERS_X;
+    cl->ub_data.dims[1] = LIGHT_CLUSTERS_Y;
+    cl->ub_data.dims[2] = LIGHT_CLUSTERS_Z;
+    cl->ub_data.dims[3] = light_count;
+    cl->ub_data.cluster_near = cl->cluster_near;
+    cl->ub_data.cluster_far = zfar;
+    cl->ub_data.slice_scale = slice_scale;
+    cl->ub_data._pad = .0f;
+
+    resizeLightArrays(cl, light_count);
+
+    // Per light view space bounds and cluster ranges, chunks are a multiple of 8 so SIMD never splits a group
+    const int padded = (int)cl->sphere_x.size();
+    const int chunk_count = (padded + LIGHT_BIN_CHUNK_SIZE - 1) / LIGHT_BIN_CHUNK_SIZE;
+    pool->parallelFor(chunk_count, [cl, lights, light_count, padded, &view, &planes, zfar, path](int chunk, int) {
+        const int begin = chunk * LIGHT_BIN_CHUNK_SIZE;
+        const int end = std::min(begin + LIGHT_BIN_CHUNK_SIZE, padded);
+        prepareLights(cl, lights, begin, std::min(end, light_count), view);
+#if SIMD_X86
+        if (path != LIGHT_BIN_SCALAR) {
+            computeRangesSse(cl, planes, zfar, begin, end);
+            return;
+        }
+#endif
+        computeRangesScalar(cl, planes, zfar, begin, end);
+    });
+
+    // Every slice belongs to one job, so counts and writes never race.
+    // Lights go in in index order, the lists come out the same for any thread count
+    cl->cluster_ranges.resize(LIGHT_CLUSTER_COUNT * 2);
+    std::vector<uint32_t>& ranges = cl->cluster_ranges;
+    auto forEachLightInSlice = [cl, light_count](int z, auto&& fn) {
+        for (int i = 0; i < light_count; ++i) {
+            if (z < cl->z_min[i] || z > cl->z_max[i]) {
+                continue;
+            }
+            for (int y = cl->y_min[i]; y <= cl->y_max[i]; ++y) {
+                const int row = (z * LIGHT_CLUSTERS_Y + y) * LIGHT_CLUSTERS_X;
+                for (int x = cl->x_min[i]; x <= cl->x_max[i]; ++x) {
+                    fn(row + x, (uint32_t)i);
+                }
+            }
+        }
+    };
+
+    pool->parallelFor(LIGHT_CLUSTERS_Z, [&ranges, &forEachLightInSlice](int z, int) {
+        const int first = z * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+        for (int c = first; c < first + LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y; ++c) {
+            ranges[c * 2 + 1] = 0;
+        }
+        forEachLightInSlice(z, [&ranges](int cluster, uint32_t) {
+            ranges[cluster * 2 + 1]++;
+        });
+    });
+
+    uint32_t offset = 0;
+    int dropped = 0;
+    int max_cluster_lights = 0;
+    for (int c = 0; c < LIGHT_CLUSTER_COUNT; ++c) {
+        const uint32_t count = ranges[c * 2 + 1];
+        const uint32_t kept = std::min<uint32_t>(count, LIGHT_CLUSTER_MAX_INDICES - offset);
+        ranges[c * 2] = offset;
+        ranges[c * 2 + 1] = kept;
+        offset += kept;
+        dropped += count - kept;
+        max_cluster_lights = std::max(max_cluster_lights, (int)count);
+    }
+    if (dropped) {
+        LOG_WARN("lights", "Cluster light index list full, dropped " << dropped << " entries");
+    }
+
+    cl->light_indices.resize(offset);
+    pool->parallelFor(LIGHT_CLUSTERS_Z, [cl, &ranges, &forEachLightInSlice](int z, int) {
+        uint32_t written[LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y] = { 0 };
+        const int first = z * LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y;
+        forEachLightInSlice(z, [cl, &ranges, &written, first](int cluster, uint32_t light) {
+            uint32_t& n = written[cluster - first];
+            if (n < ranges[cluster * 2 + 1]) {
+                cl->light_indices[ranges[cluster * 2] + n++] = light;
+            }
+        });
+    });
+
+    int binned = 0;
+    for (int i = 0; i < light_count; ++i) {
+        binned += cl->z_min[i] <= cl->z_max[i];
+    }
+    cl->stats.lights = light_count;
+    cl->stats.binned_lights = binned;
+    cl->stats.indices = offset;
+    cl->stats.max_cluster_lights = max_cluster_lights;
+    cl->stats.dropped_indices = dropped;
+    cl->stats.bin_ms = sw.elapsedMs();
+}
+
+static void uploadGrowingBuffer(GLuint buffer, size_t* capacity, const void* data, size_t size) {
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    if (size > *capacity || *capacity == 0) {
+        *capacity = std::max(std::max(size, *capacity * 2), (size_t)64);
+    }
+    // Orphan and refill, the previous frame may still be reading the old storage
+    glBufferData(GL_SHADER_STORAGE_BUFFER, *capacity, 0, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, size, data);
+}
+
+void glxUploadClusteredLights(ClusteredLights* cl) {
+    PROF_SCOPE_FN();
+
+    glBindBuffer(GL_UNIFORM_BUFFER, cl->ub_clusters);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(cl->ub_data), &cl->ub_data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+    uploadGrowingBuffer(cl->light_buffer, &cl->light_buffer_size, cl->gpu_lights.data(), cl->gpu_lights.size() * sizeof(GpuLight));
+    uploadGrowingBuffer(cl->index_buffer, &cl->index_buffer_size, cl->light_indices.data(), cl->light_indices.size() * sizeof(uint32_t));
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, cl->cluster_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, LIGHT_CLUSTER_COUNT * 2 * sizeof(uint32_t), 0, GL_STREAM_DRAW);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, cl->cluster_ranges.size() * sizeof(uint32_t), cl->cluster_ranges.data());
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_UNIFORM_BUFFER, UB_BINDING_CLUSTERS, cl->ub_clusters);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_LIGHTS, cl->light_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_LIGHT_CLUSTERS, cl->cluster_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_LIGHT_INDICES, cl->index_buffer);
+}
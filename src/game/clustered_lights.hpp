@@ -0,0 +1,116 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+#include "platform/win32/gl/glextutil.h"
+
+
+class ThreadPool;
+
+enum LIGHT_TYPE {
+	LIGHT_POINT,
+	LIGHT_SPOT
+};
+
+struct Light {
+	LIGHT_TYPE type;
+	gfxm::vec3 position;
+	gfxm::vec3 direction;	// Spot only, normalized
+	gfxm::vec3 color;
+	float intensity;
+	float radius;			// Influence falls to zero here
+	float inner_angle;		// Spot only, half angles in radians
+	float outer_angle;
+};
+
+// Matches LightData in data/shaders/uniform_blocks/clusters.glsl (std430).
+// Point lights get spot_scale 0 and spot_offset 1 so the cone term is always 1
+struct GpuLight {
+	gfxm::vec4 position_radius;
+	gfxm::vec4 color_spot_offset;		// Color premultiplied by intensity
+	gfxm::vec4 direction_spot_scale;
+};
+static_assert(sizeof(GpuLight) == 48, "GpuLight must match the std430 layout");
+
+// Matches ubClusters
+struct UniformBufferClusters {
+	uint32_t dims[4];		// Clusters along x, y, z and the light count
+	float cluster_near;
+	float cluster_far;
+	float slice_scale;		// slice = log(depth / cluster_near) * slice_scale
+	float _pad;
+};
+
+constexpr GLuint UB_BINDING_CLUSTERS = 2;
+constexpr GLuint SSBO_BINDING_LIGHTS = 1;
+constexpr GLuint SSBO_BINDING_LIGHT_CLUSTERS = 2;
+constexpr GLuint SSBO_BINDING_LIGHT_INDICES = 3;
+
+constexpr int LIGHT_CLUSTERS_X = 16;
+constexpr int LIGHT_CLUSTERS_Y = 9;
+constexpr int LIGHT_CLUSTERS_Z = 24;
+constexpr int LIGHT_CLUSTER_COUNT = LIGHT_CLUSTERS_X * LIGHT_CLUSTERS_Y * LIGHT_CLUSTERS_Z;
+constexpr int LIGHT_CLUSTER_MAX_INDICES = 1 << 20;
+
+struct ClusterBinStats {
+	int lights = 0;
+	int binned_lights = 0;		// Lights touching at least one cluster
+	int indices = 0;
+	int max_cluster_lights = 0;
+	int dropped_indices = 0;	// Over LIGHT_CLUSTER_MAX_INDICES
+	double bin_ms = .0;
+};
+
+enum LIGHT_BIN_PATH {
+	LIGHT_BIN_AUTO,
+	LIGHT_BIN_SCALAR,
+	LIGHT_BIN_SSE
+};
+
+// Froxel grid over the view frustum: x and y split the screen evenly,
+// z is split exponentially between cluster_near and the far plane, anything closer lands in slice 0
+struct ClusteredLights {
+	GLuint ub_clusters = 0;
+	GLuint light_buffer = 0;
+	GLuint cluster_buffer = 0;
+	GLuint index_buffer = 0;
+	size_t light_buffer_size = 0;
+	size_t index_buffer_size = 0;
+
+	float cluster_near = .1f;
+
+	std::vector<GpuLight> gpu_lights;
+	// View space bounding spheres, padded to a multiple of 8
+	std::vector<float> sphere_x;
+	std::vector<float> sphere_y;
+	std::vector<float> sphere_z;
+	std::vector<float> sphere_r;
+	// Inclusive cluster ranges per light, z_min > z_max for lights outside the frustum
+	std::vector<int32_t> x_min, x_max;
+	std::vector<int32_t> y_min, y_max;
+	std::vector<int32_t> z_min, z_max;
+
+	// offset and count into light_indices for every cluster, x fastest, then y, then z
+	std::vector<uint32_t> cluster_ranges;
+	std::vector<uint32_t> light_indices;
+
+	UniformBufferClusters ub_data;
+	ClusterBinStats stats;
+};
+
+void glxInitClusteredLights(ClusteredLights* cl);
+void glxDestroyClusteredLights(ClusteredLights* cl);
+
+// Assigns lights to the clusters of the view, only touches CPU memory.
+// proj must be a symmetric perspective projection
+void clusterLightsBin(
+	ClusteredLights* cl,
+	const Light* lights, int light_count,
+	const gfxm::mat4& view, const gfxm::mat4& proj, float zfar,
+	ThreadPool* pool,
+	LIGHT_BIN_PATH path = LIGHT_BIN_AUTO
+);
+
+// Uploads the last binning result and binds it at the UB_BINDING_/SSBO_BINDING_ slots above
+void glxUploadClusteredLights(ClusteredLights* cl);
@@ -0,0 +1,107 @@
+#include "benchmarks.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <thread>
+#include <vector>
+#include "clustered_lights.hpp"
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+
+
+static void makeBenchLights(std::vector<Light>& lights, int count) {
+    uint32_t seed = 0x5EED;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+    lights.resize(count);
+    for (int i = 0; i < count; ++i) {
+        Light& l = lights[i];
+        l.type = (i & 1) ? LIGHT_SPOT : LIGHT_POINT;
+        l.position = gfxm::vec3((rnd01() * 2.f - 1.f) * 100.f, rnd01() * 10.f - 2.f, -rnd01() * 200.f + 20.f);
+        l.direction = gfxm::normalize(gfxm::vec3(rnd01() * 2.f - 1.f, -1.f, rnd01() * 2.f - 1.f));
+        l.color = gfxm::vec3(rnd01(), rnd01(), rnd01());
+        l.intensity = 1.f + rnd01() * 10.f;
+        l.radius = 1.f + rnd01() * 7.f;
+        l.outer_angle = .2f + rnd01() * 1.f;
+        l.inner_angle = l.outer_angle * .8f;
+    }
+}
+
+// Random points in the frustum must find every light whose bounding sphere contains them in their cluster
+static int countMissedLights(const ClusteredLights* cl, const gfxm::mat4& proj) {
+    uint32_t seed = 0xF00D;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+    int missed = 0;
+    for (int s = 0; s < 20000; ++s) {
+        const float u = rnd01(), v = rnd01();
+        const float depth = .01f + rnd01() * 200.f;
+        const gfxm::vec3 p((u * 2.f - 1.f) * depth / proj[0][0], (v * 2.f - 1.f) * depth / proj[1][1], -depth);
+        const int cx = std::min((int)(u * LIGHT_CLUSTERS_X), LIGHT_CLUSTERS_X - 1);
+        const int cy = std::min((int)(v * LIGHT_CLUSTERS_Y), LIGHT_CLUSTERS_Y - 1);
+        const int cz = std::max(0, std::min((int)(logf(depth / cl->ub_data.cluster_near) * cl->ub_data.slice_scale), LIGHT_CLUSTERS_Z - 1));
+        const int cluster = (cz * LIGHT_CLUSTERS_Y + cy) * LIGHT_CLUSTERS_X + cx;
+        const uint32_t* first = &cl->light_indices[0] + cl->cluster_ranges[cluster * 2];
+        const uint32_t* last = first + cl->cluster_ranges[cluster * 2 + 1];
+        for (int i = 0; i < cl->stats.lights; ++i) {
+            gfxm::vec3 d = p - gfxm::vec3(cl->sphere_x[i], cl->sphere_y[i], cl->sphere_z[i]);
+            if (gfxm::length(d) < cl->sphere_r[i] * .999f && !std::binary_search(first, last, (uint32_t)i)) {
+                ++missed;
+            }
+        }
+    }
+    return missed;
+}
+
+void benchClusteredLights() {
+    const int ITERATIONS = 20;
+    const int light_counts[] = { 1024, 4096, 16384 };
+
+    const gfxm::mat4 view = gfxm::inverse(gfxm::translate(gfxm::mat4(1.0f), gfxm::vec3(0, 2.f, 0)));
+    const gfxm::mat4 proj = gfxm::perspective(gfxm::radian(60.f), 16.f / 9.f, .01f, 1000.f);
+    const int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+
+    for (int light_count : light_counts) {
+        std::vector<Light> lights;
+        makeBenchLights(lights, light_count);
+
+        ClusteredLights reference;
+        clusterLightsBin(&reference, lights.data(), light_count, view, proj, 1000.f, getThreadPool(), LIGHT_BIN_SCALAR);
+        ClusteredLights simd;
+        clusterLightsBin(&simd, lights.data(), light_count, view, proj, 1000.f, getThreadPool(), LIGHT_BIN_SSE);
+        if (reference.cluster_ranges != simd.cluster_ranges || reference.light_indices != simd.light_indices) {
+            LOG_ERR("bench", "clustered_lights: SSE and scalar binning disagree");
+        }
+        const int missed = countMissedLights(&simd, proj);
+        if (missed) {
+            LOG_ERR("bench", "clustered_lights: " << missed << " light/point overlaps missing from their cluster");
+        }
+
+        int non_empty = 0;
+        for (int c = 0; c < LIGHT_CLUSTER_COUNT; ++c) {
+            non_empty += simd.cluster_ranges[c * 2 + 1] > 0;
+        }
+        const ClusterBinStats& s = simd.stats;
+        LOG("bench", "clustered_lights: " << light_count << " lights, " << s.binned_lights << " in view, "
+            << s.indices << " indices, " << (non_empty ? s.indices / (float)non_empty : .0f) << " avg / "
+            << s.max_cluster_lights << " max per non-empty cluster");
+
+        for (int thread_count = 1; ; thread_count = std::min(thread_count * 2, max_threads)) {
+            ThreadPool pool(thread_count);
+            double best = 1e9;
+            for (int it = 0; it < ITERATIONS; ++it) {
+                clusterLightsBin(&simd, lights.data(), light_count, view, proj, 1000.f, &pool);
+                best = std::min(best, simd.stats.bin_ms);
+            }
+            LOG("bench", "clustered_lights:   " << thread_count << " threads: " << best << "ms");
+            if (thread_count == max_threads) {
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,198 @@
+#include "draw_cmd.hpp"
+
+#include <assert.h>
+#include <string.h>
+#include <utility>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+void drawCmdStreamReserve(DrawCmdStream* stream, int count) {
+    stream->keys.reserve(count);
+    stream->states.reserve(count);
+    stream->geometry.reserve(count);
+    stream->instance_ids.reserve(count);
+    stream->order.reserve(count);
+}
+
+void drawCmdStreamClear(DrawCmdStream* stream) {
+    stream->keys.clear();
+    stream->states.clear();
+    stream->geometry.clear();
+    stream->instance_ids.clear();
+    stream->order.clear();
+    stream->binding_sets.clear();
+    stream->binding_uniform_buffers.clear();
+    stream->binding_textures.clear();
+}
+
+uint16_t drawCmdStreamAddBindings(DrawCmdStream* stream, const GLuint* uniform_buffers, int num_uniform_buffers, const GLuint* textures, int num_textures) {
+    if (num_uniform_buffers > MAX_CUSTOM_UNIFORM_BUFFERS) {
+        LOG_ERR("draw_cmd", "Too many uniform buffers in a binding set: " << num_uniform_buffers);
+        return 0;
+    }
+    if (num_textures > MAX_DRAW_CMD_TEXTURES) {
+        LOG_ERR("draw_cmd", "Too many textures in a binding set: " << num_textures);
+        return 0;
+    }
+    if (stream->binding_sets.size() >= MAX_DRAW_BINDING_SETS) {
+        LOG_ERR("draw_cmd", "Binding set limit reached");
+        return 0;
+    }
+
+    DrawBindingSet set = {};
+    set.first_uniform_buffer = stream->binding_uniform_buffers.size();
+    set.first_texture = stream->binding_textures.size();
+    set.num_uniform_buffers = num_uniform_buffers;
+    set.num_textures = num_textures;
+    stream->binding_uniform_buffers.insert(stream->binding_uniform_buffers.end(), uniform_buffers, uniform_buffers + num_uniform_buffers);
+    stream->binding_textures.insert(stream->binding_textures.end(), textures, textures + num_textures);
+    stream->binding_sets.push_back(set);
+    return (uint16_t)stream->binding_sets.size();
+}
+
+const DrawBindingSet* drawCmdStreamGetBindings(const DrawCmdStream* stream, uint16_t bindings) {
+    if (bindings == 0) {
+        return 0;
+    }
+    assert(bindings <= stream->binding_sets.size());
+    return &stream->binding_sets[bindings - 1];
+}
+
+void glxBindDrawBindingSet(const DrawCmdStream* stream, uint16_t bindings) {
+    const DrawBindingSet* set = drawCmdStreamGetBindings(stream, bindings);
+    if (!set) {
+        return;
+    }
+    for (int i = 0; i < set->num_uniform_buffers; ++i) {
+        glBindBufferBase(GL_UNIFORM_BUFFER, DRAW_BINDING_FIRST_UNIFORM_BUFFER + i, stream->binding_uniform_buffers[set->first_uniform_buffer + i]);
+    }
+    for (int i = 0; i < set->num_textures; ++i) {
+        glActiveTexture(GL_TEXTURE0 + DRAW_BINDING_FIRST_TEXTURE_UNIT + i);
+        glBindTexture(GL_TEXTURE_2D, stream->binding_textures[set->first_texture + i]);
+    }
+}
+
+uint32_t drawCmdStreamPush(
+    DrawCmdStream* stream,
+    DRAW_CMD_TYPE type,
+    GLenum mode,
+    GLuint vao,
+    GLuint progid,
+    GLuint ub_model,
+    GLuint offset,
+    GLuint count,
+    GLuint instance_count,
+    uint16_t bindings,
+    uint32_t instance_id
+) {
+    assert(mode <= 0xFF);
+
+    DrawCmdState state;
+    state.progid = progid;
+    state.ub_model = ub_model;
+    state.bindings = bindings;
+    state.type = type;
+    state.mode = (uint8_t)mode;
+
+    DrawCmdGeometry geom;
+    geom.vao = vao;
+    geom.offset = offset;
+    geom.count = count;
+    geom.instance_count = instance_count;
+    geom.base_instance = 0;
+
+    uint32_t index = stream->keys.size();
+    stream->keys.push_back(makeDrawCmdSortKey(progid, vao, ub_model, bindings, type, state.mode));
+    stream->states.push_back(state);
+    stream->geometry.push_back(geom);
+    stream->instance_ids.push_back(instance_id);
+    return index;
+}
+
+void drawCmdStreamSort(DrawCmdStream* stream) {
+    PROF_SCOPE_FN();
+
+    const int count = stream->count();
+    stream->order.resize(count);
+    for (int i = 0; i < count; ++i) {
+        stream->order[i] = i;
+    }
+    if (count < 2) {
+        return;
+    }
+
+    // Bytes that are the same in every key don't need a pass,
+    // with a handful of programs and vaos most of them are skipped
+    uint64_t all_or = 0;
+    uint64_t all_and = ~0ULL;
+    for (int i = 0; i < count; ++i) {
+        all_or |= stream->keys[i];
+        all_and &= stream->keys[i];
+    }
+    const uint64_t varying = all_or ^ all_and;
+    if (varying == 0) {
+        return;
+    }
+
+    auto& keys_src = stream->sort_keys_tmp[0];
+    auto& keys_dst = stream->sort_keys_tmp[1];
+    keys_src.assign(stream->keys.begin(), stream->keys.end());
+    keys_dst.resize(count);
+    stream->sort_order_tmp.resize(count);
+
+    uint32_t* order_src = stream->order.data();
+    uint32_t* order_dst = stream->sort_order_tmp.data();
+    uint64_t* ksrc = keys_src.data();
+    uint64_t* kdst = keys_dst.data();
+
+    for (int shift = 0; shift < 64; shift += 8) {
+        if (((varying >> shift) & 0xFF) == 0) {
+            continue;
+        }
+
+        uint32_t offsets[256];
+        memset(offsets, 0, sizeof(offsets));
+        for (int i = 0; i < count; ++i) {
+            ++offsets[(ksrc[i] >> shift) & 0xFF];
+        }
+        uint32_t sum = 0;
+        for (int i = 0; i < 256; ++i) {
+            uint32_t c = offsets[i];
+            offsets[i] = sum;
+            sum += c;
+        }
+        for (int i = 0; i < count; ++i) {
+            uint32_t at = offsets[(ksrc[i] >> shift) & 0xFF]++;
+            kdst[at] = ksrc[i];
+            order_dst[at] = order_src[i];
+        }
+
+        std::swap(ksrc, kdst);
+        std::swap(order_src, order_dst);
+    }
+
+    if (order_src != stream->order.data()) {
+        memcpy(stream->order.data(), order_src, count * sizeof(uint32_t));
+    }
+}
+
+uint64_t drawCmdStreamTriangleCount(const DrawCmdStream* stream) {
+    uint64_t total = 0;
+    for (int i = 0; i < stream->count(); ++i) {
+        const DrawCmdState& state = stream->states[i];
+        const DrawCmdGeometry& geom = stream->geometry[i];
+        uint64_t triangles = 0;
+        switch (state.mode) {
+        case GL_TRIANGLES:
+            triangles = geom.count / 3;
+            break;
+        case GL_TRIANGLE_STRIP:
+        case GL_TRIANGLE_FAN:
+            triangles = geom.count > 2 ? geom.count - 2 : 0;
+            break;
+        }
+        total += triangles * (isDrawCmdInstanced((DRAW_CMD_TYPE)state.type) ? geom.instance_count : 1);
+    }
+    return total;
+}
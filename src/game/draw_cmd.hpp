@@ -0,0 +1,126 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+
+
+enum DRAW_CMD_TYPE : uint8_t {
+	DRAW_CMD_ARRAY,
+	DRAW_CMD_INDEXED,
+	DRAW_CMD_ARRAY_INSTANCED,
+	DRAW_CMD_INDEXED_INSTANCED
+};
+
+inline bool isDrawCmdIndexed(uint8_t type) {
+	return type == DRAW_CMD_INDEXED || type == DRAW_CMD_INDEXED_INSTANCED;
+}
+inline bool isDrawCmdInstanced(uint8_t type) {
+	return type == DRAW_CMD_ARRAY_INSTANCED || type == DRAW_CMD_INDEXED_INSTANCED;
+}
+
+// Pipeline state of a command, what batching compares
+struct DrawCmdState {
+	GLuint progid;
+	GLuint ub_model;
+	uint16_t bindings;	// 1-based index into DrawCmdStream::binding_sets, 0 means none
+	uint8_t type;		// DRAW_CMD_TYPE
+	uint8_t mode;		// Primitive mode, every GLenum draw mode fits in a byte
+};
+static_assert(sizeof(DrawCmdState) == 12, "DrawCmdState size changed");
+
+// What to draw
+struct DrawCmdGeometry {
+	GLuint vao;
+	GLuint offset;		// First vertex for array draws, byte offset into the index buffer for indexed ones
+	GLuint count;
+	GLuint instance_count;
+	GLuint base_instance;	// First slot in the instance buffer, 0 is the identity instance
+};
+static_assert(sizeof(DrawCmdGeometry) == 20, "DrawCmdGeometry size changed");
+
+// Commands that don't reference per-instance data (transform, color)
+constexpr uint32_t DRAW_INSTANCE_NONE = 0xFFFFFFFF;
+
+// Extra uniform buffers and textures, stored once and shared between commands
+struct DrawBindingSet {
+	uint32_t first_uniform_buffer;
+	uint32_t first_texture;
+	uint8_t num_uniform_buffers;
+	uint8_t num_textures;
+};
+
+constexpr int MAX_CUSTOM_UNIFORM_BUFFERS = 16;
+constexpr int MAX_DRAW_CMD_TEXTURES = 16;
+// Handles are 1-based and have to fit the 11 bits the sort key keeps
+constexpr int MAX_DRAW_BINDING_SETS = 0x7FF;
+
+// Where glxBindDrawBindingSet() puts a set: uniform buffers after the renderer's fixed blocks,
+// textures after the units SamplerArray hands out
+constexpr GLuint DRAW_BINDING_FIRST_UNIFORM_BUFFER = 4;
+constexpr GLuint DRAW_BINDING_FIRST_TEXTURE_UNIT = 16;
+
+// Draw commands as parallel arrays, sorting only touches keys and order,
+// batching only touches states and geometry
+struct DrawCmdStream {
+	std::vector<uint64_t> keys;
+	std::vector<DrawCmdState> states;
+	std::vector<DrawCmdGeometry> geometry;
+	// Index into the caller's instance data table, see auto_instancing.hpp
+	std::vector<uint32_t> instance_ids;
+
+	// Submission order, filled by drawCmdStreamSort()
+	std::vector<uint32_t> order;
+
+	std::vector<DrawBindingSet> binding_sets;
+	std::vector<GLuint> binding_uniform_buffers;
+	std::vector<GLuint> binding_textures;
+
+	// Radix sort scratch
+	std::vector<uint64_t> sort_keys_tmp[2];
+	std::vector<uint32_t> sort_order_tmp;
+
+	int count() const { return (int)keys.size(); }
+};
+
+// progid:16 | vao:16 | ub_model:16 | bindings:11 | indexed:1 | mode:4
+// Names are truncated, a collision only costs an extra batch since auto instancing and the indirect
+// batches compare the real fields. Binding set handles always fit, see MAX_DRAW_BINDING_SETS
+inline uint64_t makeDrawCmdSortKey(GLuint progid, GLuint vao, GLuint ub_model, uint16_t bindings, uint8_t type, uint8_t mode) {
+	return ((uint64_t)(progid & 0xFFFF) << 48)
+		| ((uint64_t)(vao & 0xFFFF) << 32)
+		| ((uint64_t)(ub_model & 0xFFFF) << 16)
+		| ((uint64_t)(bindings & 0x7FF) << 5)
+		| ((uint64_t)(isDrawCmdIndexed(type) ? 1 : 0) << 4)
+		| (uint64_t)(mode & 0xF);
+}
+
+void drawCmdStreamReserve(DrawCmdStream* stream, int count);
+void drawCmdStreamClear(DrawCmdStream* stream);
+
+// Returns a handle to pass to drawCmdStreamPush(), 0 on failure
+uint16_t drawCmdStreamAddBindings(DrawCmdStream* stream, const GLuint* uniform_buffers, int num_uniform_buffers, const GLuint* textures, int num_textures);
+const DrawBindingSet* drawCmdStreamGetBindings(const DrawCmdStream* stream, uint16_t bindings);
+// Uniform buffers from DRAW_BINDING_FIRST_UNIFORM_BUFFER, textures as GL_TEXTURE_2D from
+// DRAW_BINDING_FIRST_TEXTURE_UNIT. Nothing to do for handle 0
+void glxBindDrawBindingSet(const DrawCmdStream* stream, uint16_t bindings);
+
+uint32_t drawCmdStreamPush(
+	DrawCmdStream* stream,
+	DRAW_CMD_TYPE type,
+	GLenum mode,
+	GLuint vao,
+	GLuint progid,
+	GLuint ub_model,
+	GLuint offset,
+	GLuint count,
+	GLuint instance_count = 0,
+	uint16_t bindings = 0,
+	uint32_t instance_id = DRAW_INSTANCE_NONE
+);
+
+// Stable radix sort of the keys, the result is written to stream->order
+void drawCmdStreamSort(DrawCmdStream* stream);
+
+// Triangles the stream submits, counting every instance. Point and line draws count as 0
+uint64_t drawCmdStreamTriangleCount(const DrawCmdStream* stream);
@@ -0,0 +1,135 @@
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "draw_cmd.hpp"
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+
+
+// The layout DrawCmdStream replaced, kept here for comparison
+struct FatDrawCmd {
+    DRAW_CMD_TYPE type;
+    GLenum mode;
+    GLuint vao;
+    GLuint progid;
+    GLint offset;
+    GLsizei count;
+    GLsizei instance_count;
+    GLuint ub_model;
+    GLuint uniform_buffers[MAX_CUSTOM_UNIFORM_BUFFERS];
+    uint32_t num_uniform_buffers;
+    GLuint textures[MAX_DRAW_CMD_TEXTURES];
+    uint32_t num_textures;
+};
+
+struct BenchSceneCmd {
+    GLuint progid;
+    GLuint vao;
+    GLuint ub_model;
+    GLenum mode;
+    GLuint count;
+};
+
+static void makeBenchScene(std::vector<BenchSceneCmd>& out, int count) {
+    uint32_t seed = 0x1234567;
+    auto rnd = [&seed]()->uint32_t {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    out.resize(count);
+    for (int i = 0; i < count; ++i) {
+        out[i].progid = 1 + rnd() % 32;
+        out[i].vao = 1 + rnd() % 1024;
+        out[i].ub_model = 1 + rnd() % 64;
+        out[i].mode = (rnd() % 4) ? GL_TRIANGLES : GL_TRIANGLE_STRIP;
+        out[i].count = 36 + rnd() % 4096;
+    }
+}
+
+static uint64_t fatSortKey(const FatDrawCmd& c) {
+    return makeDrawCmdSortKey(c.progid, c.vao, c.ub_model, 0, c.type, (uint8_t)c.mode);
+}
+
+void benchDrawCmdStream() {
+    const int CMD_COUNT = 100000;
+    const int ITERATIONS = 20;
+
+    std::vector<BenchSceneCmd> scene;
+    makeBenchScene(scene, CMD_COUNT);
+
+    std::vector<FatDrawCmd> fat;
+    fat.reserve(CMD_COUNT);
+    DrawCmdStream stream;
+    drawCmdStreamReserve(&stream, CMD_COUNT);
+
+    double fat_build = 1e9, fat_sort = 1e9, fat_iterate = 1e9;
+    double soa_build = 1e9, soa_sort = 1e9, soa_iterate = 1e9;
+    uint64_t sink = 0;
+
+    for (int it = 0; it < ITERATIONS; ++it) {
+        // Old layout
+        {
+            Stopwatch sw;
+            fat.clear();
+            for (int i = 0; i < CMD_COUNT; ++i) {
+                const BenchSceneCmd& s = scene[i];
+                FatDrawCmd cmd = { DRAW_CMD_ARRAY, s.mode, s.vao, s.progid, 0, (GLsizei)s.count, 0, s.ub_model };
+                fat.push_back(cmd);
+            }
+            fat_build = std::min(fat_build, sw.elapsedMs());
+
+            sw.reset();
+            std::stable_sort(fat.begin(), fat.end(), [](const FatDrawCmd& a, const FatDrawCmd& b) {
+                return fatSortKey(a) < fatSortKey(b);
+            });
+            fat_sort = std::min(fat_sort, sw.elapsedMs());
+
+            sw.reset();
+            GLuint bound_prog = 0, bound_vao = 0, bound_ub = 0;
+            for (int i = 0; i < CMD_COUNT; ++i) {
+                const FatDrawCmd& cmd = fat[i];
+                if (cmd.progid != bound_prog) { bound_prog = cmd.progid; ++sink; }
+                if (cmd.vao != bound_vao) { bound_vao = cmd.vao; ++sink; }
+                if (cmd.ub_model != bound_ub) { bound_ub = cmd.ub_model; ++sink; }
+                sink += cmd.count + cmd.offset;
+            }
+            fat_iterate = std::min(fat_iterate, sw.elapsedMs());
+        }
+
+        // Stream
+        {
+            Stopwatch sw;
+            drawCmdStreamClear(&stream);
+            for (int i = 0; i < CMD_COUNT; ++i) {
+                const BenchSceneCmd& s = scene[i];
+                drawCmdStreamPush(&stream, DRAW_CMD_ARRAY, s.mode, s.vao, s.progid, s.ub_model, 0, s.count);
+            }
+            soa_build = std::min(soa_build, sw.elapsedMs());
+
+            sw.reset();
+            drawCmdStreamSort(&stream);
+            soa_sort = std::min(soa_sort, sw.elapsedMs());
+
+            sw.reset();
+            GLuint bound_prog = 0, bound_vao = 0, bound_ub = 0;
+            for (int i = 0; i < CMD_COUNT; ++i) {
+                const uint32_t idx = stream.order[i];
+                const DrawCmdState& state = stream.states[idx];
+                const DrawCmdGeometry& geom = stream.geometry[idx];
+                if (state.progid != bound_prog) { bound_prog = state.progid; ++sink; }
+                if (geom.vao != bound_vao) { bound_vao = geom.vao; ++sink; }
+                if (state.ub_model != bound_ub) { bound_ub = state.ub_model; ++sink; }
+                sink += geom.count + geom.offset;
+            }
+            soa_iterate = std::min(soa_iterate, sw.elapsedMs());
+        }
+    }
+
+    const size_t soa_bytes = sizeof(uint64_t) + sizeof(DrawCmdState) + sizeof(DrawCmdGeometry) + sizeof(uint32_t) * 2;
+    LOG("bench", "draw_cmd: " << CMD_COUNT << " commands, best of " << ITERATIONS << " (checksum " << sink << ")");
+    LOG("bench", "draw_cmd: bytes per command: fat " << sizeof(FatDrawCmd) << ", stream " << soa_bytes);
+    LOG("bench", "draw_cmd: build   fat " << fat_build << "ms, stream " << soa_build << "ms");
+    LOG("bench", "draw_cmd: sort    fat " << fat_sort << "ms, stream " << soa_sort << "ms");
+    LOG("bench", "draw_cmd: iterate fat " << fat_iterate << "ms, stream " << soa_iterate << "ms");
+}
@@ -0,0 +1,83 @@
+#include "draw_cmd_recorder.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+bool drawCmdRecorderInit(DrawCmdRecorder* rec, int max_commands, size_t extra_bytes) {
+    // Alignment padding for the four arrays
+    size_t bytes = max_commands * (sizeof(uint64_t) + sizeof(DrawCmdState) + sizeof(DrawCmdGeometry) + sizeof(uint32_t))
+        + 4 * 16 + extra_bytes;
+    if (!rec->arena.init(bytes)) {
+        LOG_ERR("draw_cmd", "Failed to reserve " << bytes << " bytes for a command recorder");
+        return false;
+    }
+    rec->capacity = max_commands;
+    drawCmdRecorderBegin(rec);
+    return true;
+}
+
+void drawCmdRecorderBegin(DrawCmdRecorder* rec) {
+    rec->arena.reset();
+    rec->keys = rec->arena.allocArray<uint64_t>(rec->capacity);
+    rec->states = rec->arena.allocArray<DrawCmdState>(rec->capacity);
+    rec->geometry = rec->arena.allocArray<DrawCmdGeometry>(rec->capacity);
+    rec->instance_ids = rec->arena.allocArray<uint32_t>(rec->capacity);
+    rec->count = 0;
+    rec->dropped = 0;
+    rec->spans.clear();
+}
+
+void drawCmdStreamMerge(DrawCmdStream* stream, const DrawCmdRecorder* recorders, int recorder_count) {
+    PROF_SCOPE_FN();
+
+    size_t total = stream->keys.size();
+    for (int i = 0; i < recorder_count; ++i) {
+        total += recorders[i].count;
+        if (recorders[i].dropped) {
+            LOG_WARN("draw_cmd", "Recorder " << i << " dropped " << recorders[i].dropped << " commands, capacity is " << recorders[i].capacity);
+        }
+    }
+
+    // Every run of commands with the chunk and recorder it came from, unmarked ones as chunk -1
+    struct Run {
+        int chunk;
+        int recorder;
+        int first;
+        int count;
+    };
+    std::vector<Run> runs;
+    for (int i = 0; i < recorder_count; ++i) {
+        const DrawCmdRecorder& rec = recorders[i];
+        const int marked = rec.spans.empty() ? rec.count : rec.spans[0].first;
+        if (marked > 0) {
+            runs.push_back(Run{ -1, i, 0, marked });
+        }
+        for (size_t s = 0; s < rec.spans.size(); ++s) {
+            const int end = s + 1 < rec.spans.size() ? rec.spans[s + 1].first : rec.count;
+            runs.push_back(Run{ rec.spans[s].chunk, i, rec.spans[s].first, end - rec.spans[s].first });
+        }
+    }
+    std::sort(runs.begin(), runs.end(), [](const Run& a, const Run& b) {
+        return a.chunk != b.chunk ? a.chunk < b.chunk : a.recorder < b.recorder;
+    });
+
+    size_t at = stream->keys.size();
+    stream->keys.resize(total);
+    stream->states.resize(total);
+    stream->geometry.resize(total);
+    stream->instance_ids.resize(total);
+    for (const Run& run : runs) {
+        if (run.count == 0) {
+            continue;
+        }
+        const DrawCmdRecorder& rec = recorders[run.recorder];
+        memcpy(&stream->keys[at], rec.keys + run.first, run.count * sizeof(uint64_t));
+        memcpy(&stream->states[at], rec.states + run.first, run.count * sizeof(DrawCmdState));
+        memcpy(&stream->geometry[at], rec.geometry + run.first, run.count * sizeof(DrawCmdGeometry));
+        memcpy(&stream->instance_ids[at], rec.instance_ids + run.first, run.count * sizeof(uint32_t));
+        at += run.count;
+    }
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <vector>
+#include "draw_cmd.hpp"
+#include "memory/linear_arena.hpp"
+
+
+// Commands of one parallelFor() chunk, from first up to the next span or the end of the recorder
+struct DrawCmdRecorderSpan {
+	int chunk;
+	int first;
+};
+
+// Per-thread command buffer. Arrays are carved from a frame arena in
+// drawCmdRecorderBegin(), pushing is a plain write with no locks and no allocation.
+// Binding set handles must be created on the owning DrawCmdStream beforehand
+struct DrawCmdRecorder {
+	LinearArena arena;
+
+	uint64_t* keys = 0;
+	DrawCmdState* states = 0;
+	DrawCmdGeometry* geometry = 0;
+	uint32_t* instance_ids = 0;
+	int count = 0;
+	int capacity = 0;
+	int dropped = 0;	// Pushes that didn't fit, reported on merge
+	std::vector<DrawCmdRecorderSpan> spans;	// Kept between frames, stops allocating once warm
+};
+
+// Reserves arena memory for max_commands plus extra_bytes of scratch for the recording thread
+bool drawCmdRecorderInit(DrawCmdRecorder* rec, int max_commands, size_t extra_bytes = 0);
+// Resets the arena, call once per frame before recording
+void drawCmdRecorderBegin(DrawCmdRecorder* rec);
+// Commands pushed from here on belong to chunk, call at the start of every parallelFor() index.
+// Which worker runs a chunk changes from run to run, the merge puts chunks back in index order
+inline void drawCmdRecorderBeginChunk(DrawCmdRecorder* rec, int chunk) {
+	rec->spans.push_back(DrawCmdRecorderSpan{ chunk, rec->count });
+}
+
+inline bool drawCmdRecorderPush(
+	DrawCmdRecorder* rec,
+	DRAW_CMD_TYPE type,
+	GLenum mode,
+	GLuint vao,
+	GLuint progid,
+	GLuint ub_model,
+	GLuint offset,
+	GLuint count,
+	GLuint instance_count = 0,
+	uint16_t bindings = 0,
+	uint32_t instance_id = DRAW_INSTANCE_NONE
+) {
+	if (rec->count == rec->capacity) {
+		++rec->dropped;
+		return false;
+	}
+	const int i = rec->count++;
+	rec->keys[i] = makeDrawCmdSortKey(progid, vao, ub_model, bindings, type, (uint8_t)mode);
+	rec->states[i] = DrawCmdState{ progid, ub_model, bindings, (uint8_t)type, (uint8_t)mode };
+	rec->geometry[i] = DrawCmdGeometry{ vao, offset, count, instance_count, 0 };
+	rec->instance_ids[i] = instance_id;
+	return true;
+}
+
+// Appends the recorded commands in chunk order, so the result doesn't depend on which worker took which
+// chunk. Commands pushed before a recorder's first drawCmdRecorderBeginChunk() go first, in recorder order.
+// Call drawCmdStreamSort() afterwards
+void drawCmdStreamMerge(DrawCmdStream* stream, const DrawCmdRecorder* recorders, int recorder_count);
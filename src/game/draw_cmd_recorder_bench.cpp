@@ -0,0 +1,98 @@
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "draw_cmd_recorder.hpp"
+#include "log/log.hpp"
+#include "math/gfxm.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+
+
+struct BenchObject {
+    gfxm::mat4 transform;
+    gfxm::aabb local_box;
+    GLuint progid;
+    GLuint vao;
+    GLuint ub_model;
+    GLuint count;
+};
+
+void benchDrawCmdRecording() {
+    const int OBJECT_COUNT = 262144;
+    const int CHUNK_SIZE = 2048;
+    const int ITERATIONS = 10;
+
+    uint32_t seed = 0x7654321;
+    auto rnd = [&seed]()->uint32_t {
+        seed = seed * 1664525u + 1013904223u;
+        return seed >> 8;
+    };
+    std::vector<BenchObject> objects(OBJECT_COUNT);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        BenchObject& o = objects[i];
+        o.transform = gfxm::translate(gfxm::mat4(1.0f), gfxm::vec3(rnd() % 1000, rnd() % 100, rnd() % 1000));
+        o.local_box = gfxm::aabb{ gfxm::vec3(-.5f, -.5f, -.5f), gfxm::vec3(.5f, .5f, .5f) };
+        o.progid = 1 + rnd() % 16;
+        o.vao = 1 + rnd() % 512;
+        o.ub_model = 1 + rnd() % 64;
+        o.count = 36 + rnd() % 4096;
+    }
+
+    const int max_threads = std::max(1, (int)std::thread::hardware_concurrency());
+    const int chunk_count = (OBJECT_COUNT + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    DrawCmdStream stream;
+    drawCmdStreamReserve(&stream, OBJECT_COUNT);
+
+    double single_thread_ms = 0;
+    for (int thread_count = 1; ; thread_count = std::min(thread_count * 2, max_threads)) {
+        ThreadPool pool(thread_count);
+        std::vector<DrawCmdRecorder> recorders(pool.threadCount());
+        for (auto& rec : recorders) {
+            drawCmdRecorderInit(&rec, OBJECT_COUNT);
+        }
+
+        double best_record = 1e9, best_merge = 1e9, best_total = 1e9;
+        for (int it = 0; it < ITERATIONS; ++it) {
+            Stopwatch sw_total;
+            for (auto& rec : recorders) {
+                drawCmdRecorderBegin(&rec);
+            }
+            Stopwatch sw;
+            pool.parallelFor(chunk_count, [&](int chunk, int worker) {
+                DrawCmdRecorder* rec = &recorders[worker];
+                drawCmdRecorderBeginChunk(rec, chunk);
+                const int begin = chunk * CHUNK_SIZE;
+                const int end = std::min(begin + CHUNK_SIZE, OBJECT_COUNT);
+                for (int i = begin; i < end; ++i) {
+                    const BenchObject& o = objects[i];
+                    // Stand-in for per-object scene work, skip what lands below the ground
+                    gfxm::aabb box = gfxm::aabb_transform(o.local_box, o.transform);
+                    if (box.to.y < .0f) {
+                        continue;
+                    }
+                    drawCmdRecorderPush(rec, DRAW_CMD_ARRAY, GL_TRIANGLES, o.vao, o.progid, o.ub_model, 0, o.count);
+                }
+            });
+            best_record = std::min(best_record, sw.elapsedMs());
+
+            sw.reset();
+            drawCmdStreamClear(&stream);
+            drawCmdStreamMerge(&stream, recorders.data(), recorders.size());
+            drawCmdStreamSort(&stream);
+            best_merge = std::min(best_merge, sw.elapsedMs());
+            best_total = std::min(best_total, sw_total.elapsedMs());
+        }
+        if (thread_count == 1) {
+            single_thread_ms = best_total;
+        }
+
+        LOG("bench", "draw_cmd_record: " << thread_count << " threads, record " << best_record
+            << "ms, merge+sort " << best_merge << "ms, total " << best_total
+            << "ms, " << (stream.count() / best_total / 1000.0) << "M cmd/s, speedup x" << (single_thread_ms / best_total));
+
+        if (thread_count == max_threads) {
+            break;
+        }
+    }
+}
@@ -0,0 +1,182 @@
+#include "draw_indirect.hpp"
+
+#include <assert.h>
+#include <string.h>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+static bool isSameBatch(const DrawCmdStream* stream, uint32_t a, uint32_t b) {
+    const DrawCmdState& sa = stream->states[a];
+    const DrawCmdState& sb = stream->states[b];
+    return sa.progid == sb.progid
+        && sa.ub_model == sb.ub_model
+        && sa.bindings == sb.bindings
+        && sa.mode == sb.mode
+        && isDrawCmdIndexed(sa.type) == isDrawCmdIndexed(sb.type)
+        && stream->geometry[a].vao == stream->geometry[b].vao;
+}
+
+bool glxIndirectParametersSupported() {
+    return glxExtensionSupported("GL_ARB_indirect_parameters")
+        && glMultiDrawArraysIndirectCountARB != 0
+        && glMultiDrawElementsIndirectCountARB != 0;
+}
+
+void glxInitDrawIndirectQueue(DrawIndirectQueue* queue) {
+    glGenBuffers(1, &queue->indirect_buffer);
+    if (glxIndirectParametersSupported()) {
+        glGenBuffers(1, &queue->parameter_buffer);
+    } else {
+        LOG_WARN("gl/indirect", "GL_ARB_indirect_parameters not supported, draw counts will be supplied from the cpu");
+    }
+}
+
+void glxDestroyDrawIndirectQueue(DrawIndirectQueue* queue) {
+    glDeleteBuffers(1, &queue->indirect_buffer);
+    if (queue->parameter_buffer) {
+        glDeleteBuffers(1, &queue->parameter_buffer);
+    }
+    queue->indirect_buffer = 0;
+    queue->parameter_buffer = 0;
+}
+
+void buildDrawIndirectQueue(DrawIndirectQueue* queue, const DrawCmdStream* stream) {
+    PROF_SCOPE_FN();
+
+    queue->cmd_data.clear();
+    queue->draw_counts.clear();
+    queue->batches.clear();
+
+    assert(stream->order.size() == stream->count());
+
+    uint32_t prev = 0;
+    for (int i = 0; i < stream->order.size(); ++i) {
+        const uint32_t idx = stream->order[i];
+        const DrawCmdState& state = stream->states[idx];
+        const DrawCmdGeometry& geom = stream->geometry[idx];
+        GLuint instance_count = isDrawCmdInstanced(state.type) ? geom.instance_count : 1;
+        if (instance_count == 0) {
+            continue;
+        }
+
+        if (queue->batches.empty() || !isSameBatch(stream, prev, idx)) {
+            DrawIndirectBatch batch = {};
+            batch.progid = state.progid;
+            batch.vao = geom.vao;
+            batch.ub_model = state.ub_model;
+            batch.bindings = state.bindings;
+            batch.mode = state.mode;
+            batch.indexed = isDrawCmdIndexed(state.type);
+            batch.cmd_offset = queue->cmd_data.size();
+            batch.draw_count = 0;
+            batch.count_offset = queue->batches.size() * sizeof(GLuint);
+            queue->batches.push_back(batch);
+        }
+        prev = idx;
+        DrawIndirectBatch& batch = queue->batches.back();
+
+        size_t at = queue->cmd_data.size();
+        if (batch.indexed) {
+            DrawElementsIndirectCommand dc = {};
+            dc.count = geom.count;
+            dc.instance_count = instance_count;
+            dc.first_index = geom.offset / sizeof(GLuint); // Stream stores a byte offset for indexed draws
+            dc.base_vertex = 0;
+            dc.base_instance = geom.base_instance;
+            queue->cmd_data.resize(at + sizeof(dc));
+            memcpy(&queue->cmd_data[at], &dc, sizeof(dc));
+        } else {
+            DrawArraysIndirectCommand dc = {};
+            dc.count = geom.count;
+            dc.instance_count = instance_count;
+            dc.first = geom.offset;
+            dc.base_instance = geom.base_instance;
+            queue->cmd_data.resize(at + sizeof(dc));
+            memcpy(&queue->cmd_data[at], &dc, sizeof(dc));
+        }
+        ++batch.draw_count;
+    }
+
+    queue->draw_counts.resize(queue->batches.size());
+    for (int i = 0; i < queue->batches.size(); ++i) {
+        queue->draw_counts[i] = queue->batches[i].draw_count;
+    }
+}
+
+void glxUploadDrawIndirectQueue(DrawIndirectQueue* queue) {
+    PROF_SCOPE_FN();
+
+    if (queue->cmd_data.empty()) {
+        return;
+    }
+
+    // glBufferData every frame orphans the previous storage, no need to wait on the gpu
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, queue->indirect_buffer);
+    glBufferData(GL_DRAW_INDIRECT_BUFFER, queue->cmd_data.size(), queue->cmd_data.data(), GL_STREAM_DRAW);
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+
+    if (queue->parameter_buffer) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, queue->parameter_buffer);
+        glBufferData(GL_PARAMETER_BUFFER_ARB, queue->draw_counts.size() * sizeof(GLuint), queue->draw_counts.data(), GL_STREAM_DRAW);
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    }
+}
+
+void glxSubmitDrawIndirectQueue(const DrawIndirectQueue* queue, const DrawCmdStream* stream) {
+    PROF_SCOPE_FN();
+
+    if (queue->batches.empty()) {
+        return;
+    }
+
+    const bool use_parameter_buffer = queue->parameter_buffer != 0;
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, queue->indirect_buffer);
+    if (use_parameter_buffer) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, queue->parameter_buffer);
+    }
+
+    GLuint bound_progid = 0;
+    GLuint bound_vao = 0;
+    GLuint bound_ub_model = 0;
+    uint16_t bound_bindings = 0;
+    for (int i = 0; i < queue->batches.size(); ++i) {
+        const DrawIndirectBatch& batch = queue->batches[i];
+
+        if (batch.bindings != bound_bindings) {
+            glxBindDrawBindingSet(stream, batch.bindings);
+            bound_bindings = batch.bindings;
+        }
+        if (batch.ub_model != bound_ub_model) {
+            glBindBufferBase(GL_UNIFORM_BUFFER, 1, batch.ub_model);
+            bound_ub_model = batch.ub_model;
+        }
+        if (batch.vao != bound_vao) {
+            glBindVertexArray(batch.vao);
+            bound_vao = batch.vao;
+        }
+        if (batch.progid != bound_progid) {
+            glUseProgram(batch.progid);
+            bound_progid = batch.progid;
+        }
+
+        if (batch.indexed) {
+            if (use_parameter_buffer) {
+                glMultiDrawElementsIndirectCountARB(batch.mode, GL_UNSIGNED_INT, batch.cmd_offset, batch.count_offset, batch.draw_count, 0);
+            } else {
+                glMultiDrawElementsIndirect(batch.mode, GL_UNSIGNED_INT, (const void*)batch.cmd_offset, batch.draw_count, 0);
+            }
+        } else {
+            if (use_parameter_buffer) {
+                glMultiDrawArraysIndirectCountARB(batch.mode, batch.cmd_offset, batch.count_offset, batch.draw_count, 0);
+            } else {
+                glMultiDrawArraysIndirect(batch.mode, (const void*)batch.cmd_offset, batch.draw_count, 0);
+            }
+        }
+    }
+
+    if (use_parameter_buffer) {
+        glBindBuffer(GL_PARAMETER_BUFFER_ARB, 0);
+    }
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+#include "draw_cmd.hpp"
+
+
+// Memory layouts expected by glMultiDrawArraysIndirect/glMultiDrawElementsIndirect
+struct DrawArraysIndirectCommand {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first;
+	GLuint base_instance;
+};
+static_assert(sizeof(DrawArraysIndirectCommand) == 16, "DrawArraysIndirectCommand misaligned");
+
+struct DrawElementsIndirectCommand {
+	GLuint count;
+	GLuint instance_count;
+	GLuint first_index;
+	GLint base_vertex;
+	GLuint base_instance;
+};
+static_assert(sizeof(DrawElementsIndirectCommand) == 20, "DrawElementsIndirectCommand misaligned");
+
+// A run of commands that share program, vertex array, model buffer, binding set and primitive mode,
+// submitted with a single glMultiDraw*Indirect call
+struct DrawIndirectBatch {
+	GLuint progid;
+	GLuint vao;
+	GLuint ub_model;
+	uint16_t bindings;	// Handle into the stream the queue was built from
+	GLenum mode;
+	bool indexed;
+	GLintptr cmd_offset;	// Byte offset into the indirect buffer
+	GLsizei draw_count;		// Upper bound, the actual count may come from the parameter buffer
+	GLintptr count_offset;	// Byte offset into the parameter buffer
+};
+
+struct DrawIndirectQueue {
+	GLuint indirect_buffer = 0;
+	GLuint parameter_buffer = 0;
+
+	std::vector<uint8_t> cmd_data;
+	std::vector<GLuint> draw_counts;
+	std::vector<DrawIndirectBatch> batches;
+};
+
+// GL_ARB_indirect_parameters lets the draw count be sourced from a buffer,
+// so a gpu pass can write it without a cpu readback
+bool glxIndirectParametersSupported();
+
+void glxInitDrawIndirectQueue(DrawIndirectQueue* queue);
+void glxDestroyDrawIndirectQueue(DrawIndirectQueue* queue);
+
+// Groups consecutive commands of a sorted stream into batches and fills the indirect command data, cpu only
+void buildDrawIndirectQueue(DrawIndirectQueue* queue, const DrawCmdStream* stream);
+void glxUploadDrawIndirectQueue(DrawIndirectQueue* queue);
+// Samplers are expected to be bound by the caller, binding sets are bound from stream,
+// the one the queue was built from
+void glxSubmitDrawIndirectQueue(const DrawIndirectQueue* queue, const DrawCmdStream* stream);
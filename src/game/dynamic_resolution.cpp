@@ -0,0 +1,88 @@
+#include "dynamic_resolution.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+
+static int snapSize(int size, int step, int max_size) {
+    int snapped = (size + step / 2) / step * step;
+    return std::max(step, std::min(snapped, max_size));
+}
+
+// Sizes come from the area state, hysteresis comes from step_px:
+// small corrections accumulate in log_area until they add up to a whole step
+static bool applyArea(DynamicResolution* dr) {
+    float scale = sqrtf(expf(dr->log_area));
+    int w = snapSize((int)(dr->max_width * scale), dr->params.step_px, dr->max_width);
+    int h = snapSize((int)(dr->max_height * scale), dr->params.step_px, dr->max_height);
+    if (w == dr->width && h == dr->height) {
+        return false;
+    }
+    dr->width = w;
+    dr->height = h;
+    dr->changes++;
+    return true;
+}
+
+void dynresInit(DynamicResolution* dr, int max_width, int max_height, const DynamicResolutionParams& params) {
+    dr->params = params;
+    dr->max_width = max_width;
+    dr->max_height = max_height;
+    dr->width = max_width;
+    dr->height = max_height;
+    dr->log_area = 2.0f * logf(params.max_scale);
+    dr->filtered_ms = .0f;
+    dr->error[0] = .0f;
+    dr->error[1] = .0f;
+    dr->samples = 0;
+    dr->changes = 0;
+    applyArea(dr);
+    dr->changes = 0;
+}
+
+bool dynresUpdate(DynamicResolution* dr, float frame_ms) {
+    const DynamicResolutionParams& p = dr->params;
+    if (frame_ms <= .0f) {
+        return false;
+    }
+
+    if (dr->samples == 0) {
+        dr->filtered_ms = frame_ms;
+    } else {
+        dr->filtered_ms += (frame_ms - dr->filtered_ms) * p.smoothing;
+    }
+
+    // Positive when under budget. Clamped so a single hitch can't throw the scale to the floor
+    float e = std::max(-1.0f, std::min((p.target_ms - dr->filtered_ms) / p.target_ms, 1.0f));
+    if (fabsf(e) < p.deadband) {
+        e = .0f;
+    } else {
+        e -= e > .0f ? p.deadband : -p.deadband;
+    }
+    float e1 = dr->samples > 0 ? dr->error[0] : e;
+    float e2 = dr->samples > 1 ? dr->error[1] : e1;
+    float delta = p.kp * (e - e1) + p.ki * e + p.kd * (e - 2.0f * e1 + e2);
+    dr->error[1] = e1;
+    dr->error[0] = e;
+    dr->samples++;
+
+    // Clamping the state is the anti-windup, the velocity form has no integral to unwind
+    float min_log = 2.0f * logf(p.min_scale);
+    float max_log = 2.0f * logf(p.max_scale);
+    dr->log_area = std::max(min_log, std::min(dr->log_area + delta, max_log));
+    return applyArea(dr);
+}
+
+void dynresSetScale(DynamicResolution* dr, float scale) {
+    const DynamicResolutionParams& p = dr->params;
+    scale = std::max(p.min_scale, std::min(scale, p.max_scale));
+    dr->log_area = 2.0f * logf(scale);
+    dr->samples = 0;
+    applyArea(dr);
+}
+
+void dynresResize(DynamicResolution* dr, int max_width, int max_height) {
+    dr->max_width = max_width;
+    dr->max_height = max_height;
+    applyArea(dr);
+}
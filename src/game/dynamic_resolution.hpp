@@ -0,0 +1,46 @@
+#pragma once
+
+#include <stdint.h>
+
+
+struct DynamicResolutionParams {
+	float target_ms = 14.0f;	// GPU frame time budget, a bit under 60Hz to leave room for noise
+	float min_scale = .5f;		// Per axis, relative to the allocated targets
+	float max_scale = 1.0f;
+	// PID gains in velocity form, acting on log(render area) with the relative frame time error as input
+	float kp = .35f;
+	float ki = .12f;
+	float kd = .05f;
+	float smoothing = .3f;		// Weight of the newest sample in the frame time average
+	float deadband = .05f;		// Relative error treated as on target, keeps noise from moving the scale
+	int step_px = 8;			// Render size granularity, smaller changes are not applied
+};
+
+// Drives the render scale from measured frame times.
+// Cost is treated as proportional to pixel count, so the controller works on area and reports a per-axis scale
+struct DynamicResolution {
+	DynamicResolutionParams params;
+
+	int max_width = 0;		// Allocated target size
+	int max_height = 0;
+	int width = 0;			// Current render size, a sub-rectangle of the targets
+	int height = 0;
+
+	float log_area = .0f;	// log(scale^2), the controller state
+	float filtered_ms = .0f;
+	float error[2] = { .0f, .0f };	// Previous two errors for the P and D terms
+	int samples = 0;
+	int changes = 0;		// Applied size changes since init
+};
+
+void dynresInit(DynamicResolution* dr, int max_width, int max_height, const DynamicResolutionParams& params = DynamicResolutionParams());
+// Feeds one frame time measurement. Returns true if width/height changed
+bool dynresUpdate(DynamicResolution* dr, float frame_ms);
+// Pins the render size to scale, the controller resumes from there on the next update
+void dynresSetScale(DynamicResolution* dr, float scale);
+// New upper bound for the render size, keeps the current scale and controller state
+void dynresResize(DynamicResolution* dr, int max_width, int max_height);
+
+inline float dynresScale(const DynamicResolution* dr) {
+	return dr->width / (float)dr->max_width;
+}
@@ -0,0 +1,79 @@
+#include "benchmarks.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include "dynamic_resolution.hpp"
+#include "log/log.hpp"
+
+
+// Frame time model: a fixed part plus a part proportional to pixel count,
+// measured with the same few frames of latency the gpu timer ring has
+struct DynresSimulation {
+    float fixed_ms;
+    float full_res_ms;	// Pixel-proportional cost at max_scale
+    const char* name;
+};
+
+static void runDynresSimulation(const DynresSimulation& sim, int frames, int latency) {
+    DynamicResolution dr;
+    dynresInit(&dr, 2560, 1440);
+
+    uint32_t seed = 0xC0FFEE;
+    auto noise = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24) * 2.f - 1.f;
+    };
+
+    const int HISTORY = 16;
+    float history[HISTORY] = { 0 };
+    // Per load phase: frames until within 10% of the target and size changes after that
+    int settle_frame[2] = { -1, -1 };
+    int changes_at_settle[2] = { 0, 0 };
+    int changes_at_end[2] = { 0, 0 };
+    float sum_ms = .0f;
+    float sum_scale = .0f;
+    int tail_frames = 0;
+    for (int frame = 0; frame < frames; ++frame) {
+        // Load doubles halfway through, the controller has to find a new scale
+        float load = frame < frames / 2 ? 1.0f : 2.0f;
+        float area = (dr.width * (float)dr.height) / (dr.max_width * (float)dr.max_height);
+        float ms = sim.fixed_ms + sim.full_res_ms * load * area;
+        ms *= 1.0f + .05f * noise();
+        history[frame % HISTORY] = ms;
+        if (frame >= latency) {
+            dynresUpdate(&dr, history[(frame - latency) % HISTORY]);
+        }
+        int phase = frame < frames / 2 ? 0 : 1;
+        if (settle_frame[phase] < 0 && fabsf(ms - dr.params.target_ms) < dr.params.target_ms * .1f) {
+            settle_frame[phase] = frame - phase * (frames / 2);
+            changes_at_settle[phase] = dr.changes;
+        }
+        changes_at_end[phase] = dr.changes;
+        if (frame >= frames - frames / 4) {
+            sum_ms += ms;
+            sum_scale += dynresScale(&dr);
+            tail_frames++;
+        }
+    }
+    LOG("bench", "dynres: " << sim.name << ": last quarter " << sum_ms / tail_frames << "ms at scale " << sum_scale / tail_frames
+        << " (target " << dr.params.target_ms << "ms), " << dr.changes << " size changes total");
+    for (int i = 0; i < 2; ++i) {
+        if (settle_frame[i] < 0) {
+            LOG("bench", "dynres:   load x" << i + 1 << ": never within 10% of the target");
+        } else {
+            LOG("bench", "dynres:   load x" << i + 1 << ": within 10% after " << settle_frame[i] << " frames, "
+                << changes_at_end[i] - changes_at_settle[i] << " size changes after that");
+        }
+    }
+}
+
+void benchDynamicResolution() {
+    const DynresSimulation sims[] = {
+        { 2.0f, 8.0f, "light load" },
+        { 2.0f, 20.0f, "heavy load" },
+        { 4.0f, 40.0f, "very heavy load" },
+    };
+    for (auto& sim : sims) {
+        runDynresSimulation(sim, 1200, 3);
+    }
+}
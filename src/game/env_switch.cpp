@@ -0,0 +1,196 @@
+#include "env_switch.hpp"
+
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+#include "thread/thread_pool.hpp"
+#include "stb_image.h"
+
+
+// Starting points until the first slices of a kind have been measured, on the slow side
+constexpr double INITIAL_GPU_MS_PER_COST = 1e-6;
+constexpr double INITIAL_CPU_MS_PER_COST[ENV_SLICE_KIND_COUNT] = { 2e-5, 2e-7 };
+
+void glxInitEnvSwitch(EnvSwitch* s, const EnvSwitchParams& params) {
+    s->params = params;
+    s->state = ENV_SWITCH_IDLE;
+    for (int i = 0; i < ENV_SLICE_KIND_COUNT; ++i) {
+        s->gpu_ms_per_cost[i] = INITIAL_GPU_MS_PER_COST;
+        s->cpu_ms_per_cost[i] = INITIAL_CPU_MS_PER_COST[i];
+    }
+    for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+        s->timed_kind[i] = ENV_SLICE_DRAW;
+        s->timed_cost[i] = 1.0;
+    }
+    glxInitGpuTimer(&s->gpu_timer);
+}
+
+void glxDestroyEnvSwitch(EnvSwitch* s) {
+    if (s->worker.joinable()) {
+        s->worker.join();
+    }
+    if (s->state == ENV_SWITCH_BAKING || s->state == ENV_SWITCH_FADING) {
+        glDeleteTextures(1, &s->maps.environment);
+        glDeleteTextures(1, &s->maps.specular);
+    }
+    s->slices.clear();
+    s->source = EnvSource();
+    s->state = ENV_SWITCH_IDLE;
+    glxDestroyGpuTimer(&s->gpu_timer);
+}
+
+static void envSwitchLoad(EnvSwitch* s) {
+    Stopwatch sw;
+    EnvSource& source = s->source;
+    const char* path = s->path.c_str();
+    uint64_t source_hash = 0;
+    if (!iblHashFile(path, &source_hash)) {
+        LOG_ERR("env_switch", "Can't read " << path);
+        s->loaded = true;
+        return;
+    }
+    const std::string cache_path = iblCachePath(source_hash, s->bake_params);
+    if (iblCacheReadFile(cache_path.c_str(), source_hash, s->bake_params, &source.cache_file)) {
+        source.irradiance_sh = ((const IblCacheHeader*)source.cache_file.data())->irradiance_sh;
+        source.ok = true;
+    } else {
+        stbi_set_flip_vertically_on_load_thread(true);
+        int ncomp;
+        float* rgb = stbi_loadf(path, &source.width, &source.height, &ncomp, 3);
+        if (rgb) {
+            source.rgb.assign(rgb, rgb + (size_t)source.width * source.height * 3);
+            stbi_image_free(rgb);
+            // Not the shared pool, the render thread would wait on its dispatch lock
+            ThreadPool pool(1);
+            shProjectEquirect(&source.irradiance_sh, source.rgb.data(), source.width, source.height, &pool);
+            source.ok = true;
+        } else {
+            LOG_ERR("env_switch", "Failed to decode " << path << ": " << stbi_failure_reason());
+        }
+    }
+    source.load_ms = sw.elapsedMs();
+    s->loaded = true;
+}
+
+bool envSwitchStart(EnvSwitch* s, const char* path, const IblBakeParams& params) {
+    if (s->state != ENV_SWITCH_IDLE) {
+        return false;
+    }
+    s->path = path;
+    s->bake_params = params;
+    s->source = EnvSource();
+    s->slices.clear();
+    s->next_slice = 0;
+    s->maps = IBLTextureSet{};
+    s->fade = .0f;
+    s->stats = EnvSwitchStats();
+    s->sw_total.reset();
+    s->loaded = false;
+    s->state = ENV_SWITCH_LOADING;
+    s->worker = std::thread(envSwitchLoad, s);
+    return true;
+}
+
+// A slower result is taken as is, faster ones only pull the estimate down gradually so
+// one quick frame doesn't let the next run over
+static void learnMsPerCost(double* ms_per_cost, double measured) {
+    *ms_per_cost = measured > *ms_per_cost ? measured : *ms_per_cost * .75 + measured * .25;
+}
+
+static void envSwitchRunSlices(EnvSwitch* s) {
+    const double budget_ms = s->params.budget_ms;
+    const ENV_SLICE_KIND kind = s->slices[s->next_slice].kind;
+    const int slot = s->gpu_timer.frame % GPU_TIMER_LATENCY;
+    Stopwatch sw;
+    double cpu_ms = .0;
+    double frame_cost = .0;
+    int ran = 0;
+    glxGpuTimerBegin(&s->gpu_timer);
+    while (s->next_slice < (int)s->slices.size()) {
+        const EnvSlice& slice = s->slices[s->next_slice];
+        if (slice.kind != kind) {
+            break;
+        }
+        const double predicted_gpu_ms = (frame_cost + slice.cost) * s->gpu_ms_per_cost[kind];
+        const double predicted_cpu_ms = cpu_ms + slice.cost * s->cpu_ms_per_cost[kind];
+        if (ran > 0 && (predicted_gpu_ms > budget_ms || predicted_cpu_ms > budget_ms)) {
+            break;
+        }
+        slice.run();
+        const double slice_ms = sw.elapsedMs() - cpu_ms;
+        cpu_ms += slice_ms;
+        learnMsPerCost(&s->cpu_ms_per_cost[kind], slice_ms / slice.cost);
+        frame_cost += slice.cost;
+        ++ran;
+        ++s->next_slice;
+    }
+    glxGpuTimerEnd(&s->gpu_timer);
+    s->timed_kind[slot] = kind;
+    s->timed_cost[slot] = frame_cost;
+
+    s->stats.frames++;
+    s->stats.slices += ran;
+    s->stats.max_frame_cpu_ms = std::max(s->stats.max_frame_cpu_ms, cpu_ms);
+    if (cpu_ms > budget_ms) {
+        s->stats.cpu_frames_over_budget++;
+    }
+}
+
+static void envSwitchCollectGpuTimes(EnvSwitch* s) {
+    glxGpuTimerResolve(&s->gpu_timer);
+    for (int i = 0; i < s->gpu_timer.resolved_count; ++i) {
+        const GpuTimerResult& result = s->gpu_timer.resolved[i];
+        const int slot = result.frame % GPU_TIMER_LATENCY;
+        learnMsPerCost(&s->gpu_ms_per_cost[s->timed_kind[slot]], result.ms / s->timed_cost[slot]);
+        s->stats.max_frame_gpu_ms = std::max(s->stats.max_frame_gpu_ms, result.ms);
+        if (result.ms > s->params.budget_ms) {
+            s->stats.gpu_frames_over_budget++;
+        }
+    }
+}
+
+ENV_SWITCH_EVENT glxEnvSwitchUpdate(EnvSwitch* s, double dt_ms) {
+    PROF_SCOPE_FN();
+    ENV_SWITCH_EVENT event = ENV_SWITCH_EVENT_NONE;
+    switch (s->state) {
+    case ENV_SWITCH_LOADING:
+        if (!s->loaded) {
+            break;
+        }
+        s->worker.join();
+        s->stats.load_ms = s->source.load_ms;
+        if (!s->source.ok) {
+            s->state = ENV_SWITCH_IDLE;
+            event = ENV_SWITCH_EVENT_FAILED;
+            break;
+        }
+        s->stats.from_cache = !s->source.cache_file.empty();
+        s->state = ENV_SWITCH_BAKING;
+        event = ENV_SWITCH_EVENT_SOURCE_READY;
+        break;
+    case ENV_SWITCH_BAKING:
+        if (s->next_slice < (int)s->slices.size()) {
+            envSwitchRunSlices(s);
+        }
+        if (s->next_slice == (int)s->slices.size()) {
+            // Drops whatever the slices captured along with the decoded source
+            s->slices.clear();
+            s->source = EnvSource();
+            s->state = ENV_SWITCH_FADING;
+            event = ENV_SWITCH_EVENT_BAKED;
+        }
+        break;
+    case ENV_SWITCH_FADING:
+        s->fade = std::min(1.f, s->fade + (float)(dt_ms / std::max(1.0, s->params.fade_ms)));
+        if (s->fade >= 1.f) {
+            s->stats.total_ms = s->sw_total.elapsedMs();
+            s->state = ENV_SWITCH_IDLE;
+            event = ENV_SWITCH_EVENT_FADED;
+        }
+        break;
+    default:
+        break;
+    }
+    envSwitchCollectGpuTimes(s);
+    return event;
+}
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+#include "platform/win32/gl/glextutil.h"
+#include "profiler/stopwatch.hpp"
+#include "gpu_timer.hpp"
+#include "ibl_cache.hpp"
+
+
+// Environment switching at runtime without a hitch. A worker thread reads the HDRI's cache file or
+// decodes the image and projects the SH, the render thread then runs the uploads and bake passes in
+// slices, only as many per frame as fit the budget, and cross-fades from the old maps once they are done
+
+struct EnvSwitchParams {
+	double budget_ms = 2.0;		// Per frame, GPU and CPU time of the slices are held to it separately
+	double fade_ms = 500.0;
+};
+
+enum ENV_SWITCH_STATE {
+	ENV_SWITCH_IDLE,
+	ENV_SWITCH_LOADING,		// Worker thread running
+	ENV_SWITCH_BAKING,		// Slices running on the render thread
+	ENV_SWITCH_FADING
+};
+
+enum ENV_SWITCH_EVENT {
+	ENV_SWITCH_EVENT_NONE,
+	ENV_SWITCH_EVENT_FAILED,		// Source could not be loaded, back to idle
+	ENV_SWITCH_EVENT_SOURCE_READY,	// Caller fills slices and maps from source
+	ENV_SWITCH_EVENT_BAKED,			// maps are complete, the fade starts
+	ENV_SWITCH_EVENT_FADED			// Caller takes over maps, back to idle
+};
+
+// Slices of one kind run together in a frame so the GPU timer result can be attributed to it
+enum ENV_SLICE_KIND {
+	ENV_SLICE_UPLOAD,		// Texel uploads, mostly CPU
+	ENV_SLICE_DRAW,			// Bake passes and mip generation, mostly GPU
+	ENV_SLICE_KIND_COUNT
+};
+
+// cost is in texels, times samples per texel for shader passes. The scheduler learns
+// what a unit costs for each kind from the slices that ran
+struct EnvSlice {
+	ENV_SLICE_KIND kind;
+	double cost;
+	std::function<void()> run;
+};
+
+// What the worker hands over, either a validated cache file or the decoded equirect
+struct EnvSource {
+	std::vector<uint8_t> cache_file;
+	std::vector<float> rgb;		// Flipped vertically, as loadCubemapHDRI() uploads it
+	int width = 0;
+	int height = 0;
+	ShIrradiance irradiance_sh;
+	double load_ms = .0;
+	bool ok = false;
+};
+
+struct EnvSwitchStats {
+	double load_ms = .0;			// On the worker
+	int frames = 0;					// That ran slices
+	int slices = 0;
+	double max_frame_cpu_ms = .0;	// Of the slices, not the whole frame
+	double max_frame_gpu_ms = .0;
+	int cpu_frames_over_budget = 0;	// Includes single slices that were over on their own
+	int gpu_frames_over_budget = 0;
+	double total_ms = .0;			// Start to fully faded in
+	bool from_cache = false;
+};
+
+struct EnvSwitch {
+	EnvSwitchParams params;
+	ENV_SWITCH_STATE state = ENV_SWITCH_IDLE;
+	std::string path;
+	IblBakeParams bake_params;
+
+	std::thread worker;
+	std::atomic<bool> loaded = false;
+	EnvSource source;
+
+	std::vector<EnvSlice> slices;
+	int next_slice = 0;
+	IBLTextureSet maps = {};		// Being baked, then fading in
+	float fade = .0f;				// Weight of maps over the current environment
+
+	GpuTimer gpu_timer;
+	double gpu_ms_per_cost[ENV_SLICE_KIND_COUNT];
+	double cpu_ms_per_cost[ENV_SLICE_KIND_COUNT];
+	// Per GpuTimer slot, what the frame's timed slices were
+	ENV_SLICE_KIND timed_kind[GPU_TIMER_LATENCY];
+	double timed_cost[GPU_TIMER_LATENCY];
+
+	Stopwatch sw_total;
+	EnvSwitchStats stats;
+};
+
+void glxInitEnvSwitch(EnvSwitch* s, const EnvSwitchParams& params);
+// Waits for the worker, deletes maps that never faded in
+void glxDestroyEnvSwitch(EnvSwitch* s);
+
+// Starts loading path on the worker, false while another switch is still running
+bool envSwitchStart(EnvSwitch* s, const char* path, const IblBakeParams& params);
+// Once per frame before drawing. Runs slices while baking, at least one per frame
+// so a budget too small for the largest slice still makes progress
+ENV_SWITCH_EVENT glxEnvSwitchUpdate(EnvSwitch* s, double dt_ms);
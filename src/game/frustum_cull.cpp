@@ -0,0 +1,201 @@
+#include "frustum_cull.hpp"
+
+#include <assert.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include "math/simd.hpp"
+#include "profiler/profiler.hpp"
+#include "thread/thread_pool.hpp"
+
+
+constexpr int FRUSTUM_CULL_CHUNK_SIZE = 4096;
+
+void aabbSoaResize(AabbSoa* soa, int count) {
+    const int padded = (count + 7) & ~7;
+    // Padding boxes are inverted, they never pass and never get written out anyway
+    soa->min_x.resize(padded, FLT_MAX);
+    soa->min_y.resize(padded, FLT_MAX);
+    soa->min_z.resize(padded, FLT_MAX);
+    soa->max_x.resize(padded, -FLT_MAX);
+    soa->max_y.resize(padded, -FLT_MAX);
+    soa->max_z.resize(padded, -FLT_MAX);
+    soa->count = count;
+}
+
+// For every plane pick the box corner furthest along its normal,
+// the box is outside if that corner is behind the plane
+struct CullPlane {
+    float nx, ny, nz, d;
+    const float* xs;
+    const float* ys;
+    const float* zs;
+};
+
+static void makeCullPlanes(const gfxm::frustum& f, const AabbSoa* boxes, CullPlane* planes) {
+    for (int i = 0; i < 6; ++i) {
+        const gfxm::vec4& p = f.planes[i];
+        planes[i].nx = p.x;
+        planes[i].ny = p.y;
+        planes[i].nz = p.z;
+        planes[i].d = p.w;
+        planes[i].xs = p.x > .0f ? boxes->max_x.data() : boxes->min_x.data();
+        planes[i].ys = p.y > .0f ? boxes->max_y.data() : boxes->min_y.data();
+        planes[i].zs = p.z > .0f ? boxes->max_z.data() : boxes->min_z.data();
+    }
+}
+
+static int cullScalar(const CullPlane* planes, int begin, int end, uint32_t* out) {
+    int n = 0;
+    for (int i = begin; i < end; ++i) {
+        bool visible = true;
+        for (int j = 0; j < 6; ++j) {
+            const CullPlane& p = planes[j];
+            // Same operation order as gfxm::dot so results match the reference bit for bit
+            float d = p.nx * p.xs[i] + p.ny * p.ys[i] + p.nz * p.zs[i] + p.d * 1.0f;
+            if (d < .0f) {
+                visible = false;
+                break;
+            }
+        }
+        if (visible) {
+            out[n++] = i;
+        }
+    }
+    return n;
+}
+
+#if SIMD_X86
+static int cullSse(const CullPlane* planes, int begin, int end, uint32_t* out) {
+    int n = 0;
+    int i = begin;
+    const __m128 zero = _mm_setzero_ps();
+    for (; i + 4 <= end; i += 4) {
+        __m128 outside = _mm_setzero_ps();
+        for (int j = 0; j < 6; ++j) {
+            const CullPlane& p = planes[j];
+            __m128 d = _mm_mul_ps(_mm_set1_ps(p.nx), _mm_loadu_ps(p.xs + i));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.ny), _mm_loadu_ps(p.ys + i)));
+            d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p.nz), _mm_loadu_ps(p.zs + i)));
+            d = _mm_add_ps(d, _mm_set1_ps(p.d));
+            outside = _mm_or_ps(outside, _mm_cmplt_ps(d, zero));
+        }
+        uint32_t visible = ~(uint32_t)_mm_movemask_ps(outside) & 0xF;
+        while (visible) {
+            out[n++] = i + simdCountTrailingZeros(visible);
+            visible &= visible - 1;
+        }
+    }
+    return n + cullScalar(planes, i, end, out + n);
+}
+
+SIMD_TARGET_AVX2
+static int cullAvx2(const CullPlane* planes, int begin, int end, uint32_t* out) {
+    int n = 0;
+    int i = begin;
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= end; i += 8) {
+        __m256 outside = _mm256_setzero_ps();
+        for (int j = 0; j < 6; ++j) {
+            const CullPlane& p = planes[j];
+            __m256 d = _mm256_mul_ps(_mm256_set1_ps(p.nx), _mm256_loadu_ps(p.xs + i));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.ny), _mm256_loadu_ps(p.ys + i)));
+            d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p.nz), _mm256_loadu_ps(p.zs + i)));
+            d = _mm256_add_ps(d, _mm256_set1_ps(p.d));
+            outside = _mm256_or_ps(outside, _mm256_cmp_ps(d, zero, _CMP_LT_OQ));
+        }
+        uint32_t visible = ~(uint32_t)_mm256_movemask_ps(outside) & 0xFF;
+        while (visible) {
+            out[n++] = i + simdCountTrailingZeros(visible);
+            visible &= visible - 1;
+        }
+    }
+    return n + cullScalar(planes, i, end, out + n);
+}
+#endif
+
+static FRUSTUM_CULL_PATH resolveCullPath(FRUSTUM_CULL_PATH path) {
+#if SIMD_X86
+    if (path == FRUSTUM_CULL_AUTO) {
+        return simdHasAvx2() ? FRUSTUM_CULL_AVX2 : FRUSTUM_CULL_SSE;
+    }
+    if (path == FRUSTUM_CULL_AVX2 && !simdHasAvx2()) {
+        return FRUSTUM_CULL_SSE;
+    }
+    return path;
+#else
+    return FRUSTUM_CULL_SCALAR;
+#endif
+}
+
+int frustumCullAabbs(
+    const gfxm::frustum& f,
+    const AabbSoa* boxes,
+    int begin, int end,
+    uint32_t* out_visible,
+    FRUSTUM_CULL_PATH path
+) {
+    assert(begin >= 0 && end <= boxes->count);
+    CullPlane planes[6];
+    makeCullPlanes(f, boxes, planes);
+
+    switch (resolveCullPath(path)) {
+#if SIMD_X86
+    case FRUSTUM_CULL_SSE:
+        return cullSse(planes, begin, end, out_visible);
+    case FRUSTUM_CULL_AVX2:
+        return cullAvx2(planes, begin, end, out_visible);
+#endif
+    default:
+        return cullScalar(planes, begin, end, out_visible);
+    }
+}
+
+int frustumCullAabbsParallel(
+    const gfxm::frustum& f,
+    const AabbSoa* boxes,
+    uint32_t* out_visible,
+    ThreadPool* pool,
+    FRUSTUM_CULL_PATH path
+) {
+    PROF_SCOPE_FN();
+
+    const int chunk_count = (boxes->count + FRUSTUM_CULL_CHUNK_SIZE - 1) / FRUSTUM_CULL_CHUNK_SIZE;
+    if (chunk_count <= 1 || pool->threadCount() == 1) {
+        return frustumCullAabbs(f, boxes, 0, boxes->count, out_visible, path);
+    }
+
+    // Every chunk writes to its own range of the output, then the ranges are packed in order
+    constexpr int MAX_STACK_CHUNKS = 1024;
+    int stack_counts[MAX_STACK_CHUNKS];
+    std::vector<int> heap_counts;
+    int* chunk_visible = stack_counts;
+    if (chunk_count > MAX_STACK_CHUNKS) {
+        heap_counts.resize(chunk_count);
+        chunk_visible = heap_counts.data();
+    }
+
+    pool->parallelFor(chunk_count, [&](int chunk, int) {
+        const int begin = chunk * FRUSTUM_CULL_CHUNK_SIZE;
+        const int end = std::min(begin + FRUSTUM_CULL_CHUNK_SIZE, boxes->count);
+        chunk_visible[chunk] = frustumCullAabbs(f, boxes, begin, end, out_visible + begin, path);
+    });
+
+    int total = chunk_visible[0];
+    for (int i = 1; i < chunk_count; ++i) {
+        const int n = chunk_visible[i];
+        if (n) {
+            memmove(out_visible + total, out_visible + i * FRUSTUM_CULL_CHUNK_SIZE, n * sizeof(uint32_t));
+        }
+        total += n;
+    }
+    return total;
+}
+
+const char* frustumCullPathName(FRUSTUM_CULL_PATH path) {
+    switch (resolveCullPath(path)) {
+    case FRUSTUM_CULL_SSE: return "sse";
+    case FRUSTUM_CULL_AVX2: return "avx2";
+    default: return "scalar";
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+
+
+class ThreadPool;
+
+// World space bounding boxes, one array per component.
+// Arrays are padded to a multiple of 8 so SIMD loops never need a scalar tail
+struct AabbSoa {
+	std::vector<float> min_x;
+	std::vector<float> min_y;
+	std::vector<float> min_z;
+	std::vector<float> max_x;
+	std::vector<float> max_y;
+	std::vector<float> max_z;
+	int count = 0;
+};
+
+void aabbSoaResize(AabbSoa* soa, int count);
+inline void aabbSoaSet(AabbSoa* soa, int i, const gfxm::aabb& box) {
+	soa->min_x[i] = box.from.x;
+	soa->min_y[i] = box.from.y;
+	soa->min_z[i] = box.from.z;
+	soa->max_x[i] = box.to.x;
+	soa->max_y[i] = box.to.y;
+	soa->max_z[i] = box.to.z;
+}
+inline gfxm::aabb aabbSoaGet(const AabbSoa* soa, int i) {
+	return gfxm::aabb{
+		gfxm::vec3(soa->min_x[i], soa->min_y[i], soa->min_z[i]),
+		gfxm::vec3(soa->max_x[i], soa->max_y[i], soa->max_z[i])
+	};
+}
+
+enum FRUSTUM_CULL_PATH {
+	FRUSTUM_CULL_AUTO,
+	FRUSTUM_CULL_SCALAR,
+	FRUSTUM_CULL_SSE,
+	FRUSTUM_CULL_AVX2
+};
+
+// Tests boxes [begin, end) and writes indices of the visible ones to out_visible in ascending order.
+// Same result as gfxm::frustum_vs_aabb, but only the corner furthest along each plane normal is tested.
+// Returns the number of visible boxes, out_visible must have room for end - begin entries
+int frustumCullAabbs(
+	const gfxm::frustum& f,
+	const AabbSoa* boxes,
+	int begin, int end,
+	uint32_t* out_visible,
+	FRUSTUM_CULL_PATH path = FRUSTUM_CULL_AUTO
+);
+
+// Splits the work into chunks across the pool, the visible list stays in ascending order.
+// out_visible must have room for boxes->count entries
+int frustumCullAabbsParallel(
+	const gfxm::frustum& f,
+	const AabbSoa* boxes,
+	uint32_t* out_visible,
+	ThreadPool* pool,
+	FRUSTUM_CULL_PATH path = FRUSTUM_CULL_AUTO
+);
+
+const char* frustumCullPathName(FRUSTUM_CULL_PATH path);
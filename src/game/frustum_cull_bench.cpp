@@ -0,0 +1,98 @@
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include <vector>
+#include "frustum_cull.hpp"
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+
+
+static void makeCullBenchBoxes(AabbSoa* soa, int count, float extent) {
+    uint32_t seed = 0xC0FFEE;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+    aabbSoaResize(soa, count);
+    for (int i = 0; i < count; ++i) {
+        gfxm::vec3 c((rnd01() * 2.f - 1.f) * extent, (rnd01() * 2.f - 1.f) * extent * .1f, (rnd01() * 2.f - 1.f) * extent);
+        gfxm::vec3 h(.1f + rnd01() * 4.f, .1f + rnd01() * 4.f, .1f + rnd01() * 4.f);
+        aabbSoaSet(soa, i, gfxm::aabb{ c - h, c + h });
+    }
+}
+
+// Every path has to agree with gfxm::frustum_vs_aabb exactly
+static bool validateFrustumCull(const gfxm::frustum& f, const AabbSoa* boxes, std::vector<uint32_t>& scratch) {
+    std::vector<uint32_t> reference;
+    for (int i = 0; i < boxes->count; ++i) {
+        if (gfxm::frustum_vs_aabb(f, aabbSoaGet(boxes, i))) {
+            reference.push_back(i);
+        }
+    }
+
+    bool ok = true;
+    const FRUSTUM_CULL_PATH paths[] = { FRUSTUM_CULL_SCALAR, FRUSTUM_CULL_SSE, FRUSTUM_CULL_AVX2 };
+    for (auto path : paths) {
+        int n = frustumCullAabbsParallel(f, boxes, scratch.data(), getThreadPool(), path);
+        if (n != reference.size() || !std::equal(reference.begin(), reference.end(), scratch.begin())) {
+            LOG_ERR("bench", "frustum_cull: " << frustumCullPathName(path) << " disagrees with frustum_vs_aabb, "
+                << n << " visible, expected " << reference.size());
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+void benchFrustumCull() {
+    const int BOX_COUNT = 1000000;
+    const int ITERATIONS = 20;
+
+    AabbSoa boxes;
+    makeCullBenchBoxes(&boxes, BOX_COUNT, 1000.f);
+    std::vector<uint32_t> visible(BOX_COUNT);
+
+    gfxm::mat4 proj = gfxm::perspective(gfxm::radian(60.f), 16.f / 9.f, .01f, 1000.f);
+    bool ok = true;
+    for (int i = 0; i < 8; ++i) {
+        gfxm::mat4 cam = gfxm::to_mat4(gfxm::angle_axis(i * gfxm::pi2 / 8.f, gfxm::vec3(0, 1, 0)));
+        cam = gfxm::translate(cam, gfxm::vec3(0, 10.f * i, 0));
+        ok &= validateFrustumCull(gfxm::make_frustum(proj, gfxm::inverse(cam)), &boxes, visible);
+    }
+    LOG("bench", "frustum_cull: correctness vs frustum_vs_aabb " << (ok ? "passed" : "FAILED"));
+
+    gfxm::frustum f = gfxm::make_frustum(proj, gfxm::mat4(1.0f));
+
+    double reference_ms = 1e9;
+    int reference_visible = 0;
+    for (int it = 0; it < 3; ++it) {
+        Stopwatch sw;
+        int n = 0;
+        for (int i = 0; i < BOX_COUNT; ++i) {
+            if (gfxm::frustum_vs_aabb(f, aabbSoaGet(&boxes, i))) {
+                visible[n++] = i;
+            }
+        }
+        reference_ms = std::min(reference_ms, sw.elapsedMs());
+        reference_visible = n;
+    }
+    LOG("bench", "frustum_cull: frustum_vs_aabb " << (BOX_COUNT / reference_ms) << " boxes/ms (" << reference_visible << " visible)");
+
+    const FRUSTUM_CULL_PATH paths[] = { FRUSTUM_CULL_SCALAR, FRUSTUM_CULL_SSE, FRUSTUM_CULL_AVX2 };
+    for (auto path : paths) {
+        double single_ms = 1e9;
+        double parallel_ms = 1e9;
+        int n = 0;
+        for (int it = 0; it < ITERATIONS; ++it) {
+            Stopwatch sw;
+            n = frustumCullAabbs(f, &boxes, 0, BOX_COUNT, visible.data(), path);
+            single_ms = std::min(single_ms, sw.elapsedMs());
+
+            sw.reset();
+            frustumCullAabbsParallel(f, &boxes, visible.data(), getThreadPool(), path);
+            parallel_ms = std::min(parallel_ms, sw.elapsedMs());
+        }
+        LOG("bench", "frustum_cull: " << frustumCullPathName(path) << " " << (BOX_COUNT / single_ms) << " boxes/ms single thread, "
+            << (BOX_COUNT / parallel_ms) << " boxes/ms on " << getThreadPool()->threadCount() << " threads (" << n << " visible)");
+    }
+}
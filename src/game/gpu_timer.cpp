@@ -0,0 +1,68 @@
+#include "gpu_timer.hpp"
+
+#include "log/log.hpp"
+
+
+void glxInitGpuTimer(GpuTimer* t) {
+    glGenQueries(GPU_TIMER_LATENCY * 2, &t->queries[0][0]);
+    for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+        t->pending[i] = false;
+    }
+    t->frame = 0;
+    t->last_ms = .0;
+    t->has_result = false;
+}
+
+void glxDestroyGpuTimer(GpuTimer* t) {
+    glDeleteQueries(GPU_TIMER_LATENCY * 2, &t->queries[0][0]);
+    for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+        t->queries[i][0] = 0;
+        t->queries[i][1] = 0;
+        t->pending[i] = false;
+    }
+}
+
+void glxGpuTimerBegin(GpuTimer* t) {
+    int slot = t->frame % GPU_TIMER_LATENCY;
+    if (t->pending[slot]) {
+        // The ring caught up with a query that never came back, drop it rather than stall
+        LOG_DBG("gl/timer", "GPU timer result dropped, frame " << t->frame);
+        t->pending[slot] = false;
+    }
+    glQueryCounter(t->queries[slot][0], GL_TIMESTAMP);
+}
+
+void glxGpuTimerEnd(GpuTimer* t) {
+    int slot = t->frame % GPU_TIMER_LATENCY;
+    glQueryCounter(t->queries[slot][1], GL_TIMESTAMP);
+    t->pending[slot] = true;
+    t->pending_frame[slot] = t->frame;
+}
+
+bool glxGpuTimerResolve(GpuTimer* t) {
+    bool updated = false;
+    t->resolved_count = 0;
+    // Oldest first so last_ms ends up with the newest result available
+    for (int i = 1; i <= GPU_TIMER_LATENCY; ++i) {
+        int slot = (t->frame + i) % GPU_TIMER_LATENCY;
+        if (!t->pending[slot]) {
+            continue;
+        }
+        GLint available = 0;
+        glGetQueryObjectiv(t->queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            continue;
+        }
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        glGetQueryObjectui64v(t->queries[slot][0], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(t->queries[slot][1], GL_QUERY_RESULT, &end);
+        t->pending[slot] = false;
+        t->last_ms = (double)(end - begin) * 1e-6;
+        t->has_result = true;
+        t->resolved[t->resolved_count++] = GpuTimerResult{ t->pending_frame[slot], t->last_ms };
+        updated = true;
+    }
+    t->frame++;
+    return updated;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+
+
+// Frames a result may stay in flight before it is read back,
+// enough that reading never stalls on a driver queueing a few frames ahead
+constexpr int GPU_TIMER_LATENCY = 4;
+
+struct GpuTimerResult {
+	int frame;		// GpuTimer::frame at the Begin this result belongs to
+	double ms;
+};
+
+// GL_TIMESTAMP pairs in a ring, results are read back a few frames later without blocking
+struct GpuTimer {
+	GLuint queries[GPU_TIMER_LATENCY][2] = { 0 };
+	bool pending[GPU_TIMER_LATENCY] = { false };
+	int pending_frame[GPU_TIMER_LATENCY] = { 0 };
+	int frame = 0;
+	double last_ms = .0;	// Most recent result that came back
+	bool has_result = false;
+	// Everything the last Resolve collected, oldest first, for callers that attribute results to frames
+	GpuTimerResult resolved[GPU_TIMER_LATENCY];
+	int resolved_count = 0;
+};
+
+void glxInitGpuTimer(GpuTimer* t);
+void glxDestroyGpuTimer(GpuTimer* t);
+
+void glxGpuTimerBegin(GpuTimer* t);
+void glxGpuTimerEnd(GpuTimer* t);
+// Collects any results that are ready and advances the ring, call once per frame after End.
+// Returns true if last_ms was updated
+bool glxGpuTimerResolve(GpuTimer* t);
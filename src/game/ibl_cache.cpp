@@ -0,0 +1,272 @@
+#include "ibl_cache.hpp"
+
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "filesystem/filesystem.hpp"
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+constexpr int HALF_SIZE = 2;
+constexpr uint64_t IMAGE_ALIGNMENT = 16;
+
+uint64_t iblHash(const void* data, size_t size, uint64_t seed) {
+    const uint8_t* bytes = (const uint8_t*)data;
+    uint64_t h = seed;
+    for (size_t i = 0; i < size; ++i) {
+        h ^= bytes[i];
+        h *= 0x100000001b3ull;
+    }
+    return h;
+}
+
+uint64_t iblBakeParamsHash(const IblBakeParams& params) {
+    const int32_t sizes[] = {
+        params.environment_size, params.specular_size, params.specular_mips, params.brdf_lut_size, params.prefilter_samples
+    };
+    uint64_t h = iblHash(sizes, sizeof(sizes));
+    h = iblHash(&params.shader_hash, sizeof(params.shader_hash), h);
+    const uint32_t version = IBL_CACHE_VERSION;
+    return iblHash(&version, sizeof(version), h);
+}
+
+bool iblHashFile(const char* path, uint64_t* out_hash) {
+    fs_mapped_file file;
+    if (!fsMapFile(path, &file)) {
+        return false;
+    }
+    *out_hash = iblHash(file.data, file.size);
+    fsUnmapFile(&file);
+    return true;
+}
+
+IblBakeParams iblDefaultBakeParams() {
+    IblBakeParams params;
+    const char* bake_shaders[] = {
+        "shaders/hdri_to_cubemap.glsl",
+        "shaders/prefilter_convolute_cubemap.glsl",
+        "shaders/integrate_brdf.glsl"
+    };
+    std::string sources;
+    for (const char* path : bake_shaders) {
+        sources += fsSlurpTextFile(path);
+    }
+    params.shader_hash = iblHash(sources.data(), sources.size());
+    return params;
+}
+
+std::string iblCachePath(uint64_t source_hash, const IblBakeParams& params) {
+    std::ostringstream ss;
+    ss << "cache/ibl/" << std::hex << std::setw(16) << std::setfill('0') << iblHash(&source_hash, sizeof(source_hash), iblBakeParamsHash(params)) << ".iblc";
+    return ss.str();
+}
+
+std::vector<IblCacheImage> iblCacheLayout(const IblBakeParams& params) {
+    std::vector<IblCacheImage> images;
+    auto addCube = [&images](IBL_CACHE_MAP map, int size, int mips) {
+        for (int mip = 0; mip < mips; ++mip) {
+            const int mip_size = std::max(1, size >> mip);
+            for (int face = 0; face < 6; ++face) {
+                images.push_back(IblCacheImage{ (uint32_t)map, (uint32_t)face, (uint32_t)mip, (uint32_t)mip_size, (uint32_t)mip_size, 3, 0, 0 });
+            }
+        }
+    };
+    addCube(IBL_CACHE_ENVIRONMENT, params.environment_size, 1);
+    addCube(IBL_CACHE_SPECULAR, params.specular_size, params.specular_mips);
+    images.push_back(IblCacheImage{ IBL_CACHE_BRDF_LUT, 0, 0, (uint32_t)params.brdf_lut_size, (uint32_t)params.brdf_lut_size, 2, 0, 0 });
+
+    uint64_t offset = sizeof(IblCacheHeader) + images.size() * sizeof(IblCacheImage);
+    for (auto& img : images) {
+        offset = (offset + IMAGE_ALIGNMENT - 1) / IMAGE_ALIGNMENT * IMAGE_ALIGNMENT;
+        img.offset = offset;
+        img.size = (uint64_t)img.width * img.height * img.channels * HALF_SIZE;
+        offset += img.size;
+    }
+    return images;
+}
+
+static GLuint createImmutableCubeMap(int size, int mips) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, tex);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, mips, GL_RGB16F, size, size);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, mips - 1);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, mips > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    return tex;
+}
+
+static bool iblCacheValidate(const uint8_t* data, size_t size, uint64_t source_hash, const IblBakeParams& params) {
+    const std::vector<IblCacheImage> expected = iblCacheLayout(params);
+    const IblCacheHeader* header = (const IblCacheHeader*)data;
+    const IblCacheImage* images = (const IblCacheImage*)(data + sizeof(IblCacheHeader));
+    bool valid = size >= sizeof(IblCacheHeader)
+        && header->magic == IBL_CACHE_MAGIC
+        && header->version == IBL_CACHE_VERSION
+        && header->source_hash == source_hash
+        && header->params_hash == iblBakeParamsHash(params)
+        && header->image_count == expected.size()
+        && size >= expected.back().offset + expected.back().size;
+    // The layout is fully determined by the params, a table that disagrees means a broken file
+    for (int i = 0; valid && i < expected.size(); ++i) {
+        valid = memcmp(&images[i], &expected[i], sizeof(IblCacheImage)) == 0;
+    }
+    return valid;
+}
+
+bool iblCacheReadFile(const char* cache_path, uint64_t source_hash, const IblBakeParams& params, std::vector<uint8_t>* out) {
+    std::vector<uint8_t> data;
+    if (!fsSlurpFile(cache_path, data)) {
+        return false;
+    }
+    if (!iblCacheValidate(data.data(), data.size(), source_hash, params)) {
+        LOG_WARN("ibl_cache", "Ignoring stale or malformed cache file " << cache_path);
+        return false;
+    }
+    *out = std::move(data);
+    return true;
+}
+
+// Down to 1x1, like the environment a fresh bake renders
+static int fullMipCount(int size) {
+    int mips = 1;
+    while ((size >> mips) > 0) {
+        ++mips;
+    }
+    return mips;
+}
+
+IBLTextureSet glxIblCacheCreateTextures(const IblBakeParams& params) {
+    IBLTextureSet set = {};
+    // Only the top level is stored, the rest is generated once its last face is uploaded
+    set.environment = createImmutableCubeMap(params.environment_size, fullMipCount(params.environment_size));
+    set.specular = createImmutableCubeMap(params.specular_size, params.specular_mips);
+    return set;
+}
+
+void glxIblCacheUploadImage(const IBLTextureSet& set, GLuint brdf_lut, const IblCacheImage& img, const uint8_t* pixels) {
+    // RGB half rows are not 4 byte aligned for odd sizes
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (img.map == IBL_CACHE_BRDF_LUT) {
+        glBindTexture(GL_TEXTURE_2D, brdf_lut);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.width, img.height, GL_RG, GL_HALF_FLOAT, pixels);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    } else {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, img.map == IBL_CACHE_ENVIRONMENT ? set.environment : set.specular);
+        glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + img.face, img.mip, 0, 0, img.width, img.height, GL_RGB, GL_HALF_FLOAT, pixels);
+        if (img.map == IBL_CACHE_ENVIRONMENT && img.face == 5) {
+            glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+}
+
+bool glxIblCacheLoad(const char* cache_path, uint64_t source_hash, const IblBakeParams& params, IBLTextureSet* out_set, GLuint* out_brdf_lut) {
+    PROF_SCOPE_FN();
+    fs_mapped_file file;
+    if (!fsMapFile(cache_path, &file)) {
+        return false;
+    }
+    if (!iblCacheValidate(file.data, file.size, source_hash, params)) {
+        LOG_WARN("ibl_cache", "Ignoring stale or malformed cache file " << cache_path);
+        fsUnmapFile(&file);
+        return false;
+    }
+
+    const IblCacheHeader* header = (const IblCacheHeader*)file.data;
+    IBLTextureSet set = glxIblCacheCreateTextures(params);
+    GLuint brdf_lut;
+    glGenTextures(1, &brdf_lut);
+    glBindTexture(GL_TEXTURE_2D, brdf_lut);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RG16F, params.brdf_lut_size, params.brdf_lut_size);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glBindTexture(GL_TEXTURE_2D, 0);
+    for (const IblCacheImage& img : iblCacheLayout(params)) {
+        glxIblCacheUploadImage(set, brdf_lut, img, file.data + img.offset);
+    }
+
+    set.irradiance_sh = header->irradiance_sh;
+    fsUnmapFile(&file);
+    *out_set = set;
+    *out_brdf_lut = brdf_lut;
+    return true;
+}
+
+std::vector<uint8_t> iblCacheCreateFile(uint64_t source_hash, const IblBakeParams& params, const ShIrradiance& irradiance_sh) {
+    const std::vector<IblCacheImage> images = iblCacheLayout(params);
+    std::vector<uint8_t> data(images.back().offset + images.back().size, 0);
+
+    IblCacheHeader header = {};
+    header.magic = IBL_CACHE_MAGIC;
+    header.version = IBL_CACHE_VERSION;
+    header.source_hash = source_hash;
+    header.params_hash = iblBakeParamsHash(params);
+    header.image_count = images.size();
+    header.irradiance_sh = irradiance_sh;
+    memcpy(data.data(), &header, sizeof(header));
+    memcpy(data.data() + sizeof(header), images.data(), images.size() * sizeof(IblCacheImage));
+    return data;
+}
+
+bool iblCacheWriteFile(const char* cache_path, const std::vector<uint8_t>& data) {
+    std::string path = cache_path;
+    size_t dir_end = path.find_last_of("/\\");
+    if (dir_end != std::string::npos) {
+        fsCreateDirRecursive(path.substr(0, dir_end));
+    }
+    // Written under a temporary name so a crash mid-write never leaves a file that looks valid
+    std::string tmp_path = path + ".tmp";
+    FILE* f = fopen(tmp_path.c_str(), "wb");
+    if (!f) {
+        LOG_ERR("ibl_cache", "Failed to open " << tmp_path << " for writing");
+        return false;
+    }
+    bool written = fwrite(data.data(), data.size(), 1, f) == 1;
+    fclose(f);
+    remove(path.c_str());
+    if (!written || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        LOG_ERR("ibl_cache", "Failed to write " << path);
+        remove(tmp_path.c_str());
+        return false;
+    }
+    LOG("ibl_cache", "Wrote " << path << ", " << data.size() / 1024 << "KB");
+    return true;
+}
+
+bool glxIblCacheSave(const char* cache_path, uint64_t source_hash, const IblBakeParams& params, const IBLTextureSet& set, GLuint brdf_lut) {
+    PROF_SCOPE_FN();
+    const std::vector<IblCacheImage> images = iblCacheLayout(params);
+    std::vector<uint8_t> data = iblCacheCreateFile(source_hash, params, set.irradiance_sh);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    const GLuint cubes[] = { set.environment, set.specular };
+    for (const IblCacheImage& img : images) {
+        uint8_t* pixels = data.data() + img.offset;
+        if (img.map == IBL_CACHE_BRDF_LUT) {
+            glBindTexture(GL_TEXTURE_2D, brdf_lut);
+            glGetTexImage(GL_TEXTURE_2D, 0, GL_RG, GL_HALF_FLOAT, pixels);
+            continue;
+        }
+        glBindTexture(GL_TEXTURE_CUBE_MAP, cubes[img.map]);
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + img.face, img.mip, GL_RGB, GL_HALF_FLOAT, pixels);
+    }
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    return iblCacheWriteFile(cache_path, data);
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+#include "sh_irradiance.hpp"
+
+
+struct IBLTextureSet {
+	GLuint environment;
+	GLuint specular;
+	ShIrradiance irradiance_sh;		// Projected on the CPU from the source image, goes into ubCommon
+};
+
+// Everything that decides what a bake produces besides the source image
+struct IblBakeParams {
+	int environment_size = 512;
+	int specular_size = 128;
+	int specular_mips = 5;		// Fixed by createSpecularCubeMap() and SPECULAR_MIP_COUNT
+	int brdf_lut_size = 512;
+	int prefilter_samples = 128;	// Per texel from prefilterBuildSamples() tables, 0 runs the shader's reference loop
+	uint64_t shader_hash = 0;	// Sources of the bake shaders, editing one invalidates every cache file
+};
+
+// Baked environment file, all little endian:
+//   IblCacheHeader, includes the irradiance SH coefficients
+//   IblCacheImage[image_count]
+//   image data, half float texels, each image 16 byte aligned
+// Cubemap images are RGB, one per face and mip, the BRDF LUT is RG
+constexpr uint32_t IBL_CACHE_MAGIC = 0x43424C49;	// "IBLC"
+constexpr uint32_t IBL_CACHE_VERSION = 2;
+
+enum IBL_CACHE_MAP {
+	IBL_CACHE_ENVIRONMENT,
+	IBL_CACHE_SPECULAR,
+	IBL_CACHE_BRDF_LUT
+};
+
+struct IblCacheHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_hash;
+	uint64_t params_hash;
+	uint32_t image_count;
+	uint32_t reserved;
+	ShIrradiance irradiance_sh;
+};
+
+struct IblCacheImage {
+	uint32_t map;		// IBL_CACHE_MAP
+	uint32_t face;		// 0 for the LUT
+	uint32_t mip;
+	uint32_t width;
+	uint32_t height;
+	uint32_t channels;
+	uint64_t offset;	// From the start of the file
+	uint64_t size;
+};
+
+// 64 bit FNV-1a, pass a previous result as seed to chain
+uint64_t iblHash(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ull);
+uint64_t iblBakeParamsHash(const IblBakeParams& params);
+// Default sizes, shader_hash from the bake shaders under shaders/. The CPU baker (src/iblbake) implements
+// the same shaders and uses the same params, so its files are picked up by the renderer
+IblBakeParams iblDefaultBakeParams();
+// Source contents rather than path or timestamp, so copies and touched files still hit
+bool iblHashFile(const char* path, uint64_t* out_hash);
+std::string iblCachePath(uint64_t source_hash, const IblBakeParams& params);
+
+// What a bake with these params consists of, in file order, with offsets and sizes filled in
+std::vector<IblCacheImage> iblCacheLayout(const IblBakeParams& params);
+// Header and image table filled in, texels zeroed, image data goes at the iblCacheLayout() offsets
+std::vector<uint8_t> iblCacheCreateFile(uint64_t source_hash, const IblBakeParams& params, const ShIrradiance& irradiance_sh);
+// Written under a temporary name and renamed, creates the directory
+bool iblCacheWriteFile(const char* cache_path, const std::vector<uint8_t>& data);
+
+// Whole file into memory and validated, no GL calls so it can run on a loader thread
+bool iblCacheReadFile(const char* cache_path, uint64_t source_hash, const IblBakeParams& params, std::vector<uint8_t>* out);
+// Environment and specular cubemaps with immutable storage for the cache images to go into
+IBLTextureSet glxIblCacheCreateTextures(const IblBakeParams& params);
+// One image of the layout, brdf_lut is only touched by the LUT image. The last environment face
+// generates the environment's lower mips, upload in layout order
+void glxIblCacheUploadImage(const IBLTextureSet& set, GLuint brdf_lut, const IblCacheImage& img, const uint8_t* pixels);
+
+// On a hit the file is mapped once and every face and mip goes straight from the mapping to glTexSubImage2D,
+// no shader passes. Returns false if the file is missing, stale or malformed, out is untouched then
+bool glxIblCacheLoad(const char* cache_path, uint64_t source_hash, const IblBakeParams& params, IBLTextureSet* out_set, GLuint* out_brdf_lut);
+// Reads the baked textures back and writes them out
+bool glxIblCacheSave(const char* cache_path, uint64_t source_hash, const IblBakeParams& params, const IBLTextureSet& set, GLuint brdf_lut);
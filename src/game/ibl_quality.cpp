@@ -0,0 +1,138 @@
+#include "ibl_quality.hpp"
+
+#include <stdio.h>
+#include <algorithm>
+#include <math.h>
+#include "log/log.hpp"
+
+
+int iblDownscale(IBL_QUALITY quality) {
+    switch (quality) {
+    case IBL_QUALITY_HALF:
+        return 2;
+    case IBL_QUALITY_QUARTER:
+        return 4;
+    default:
+        return 1;
+    }
+}
+
+const char* iblQualityName(IBL_QUALITY quality) {
+    switch (quality) {
+    case IBL_QUALITY_FULL:
+        return "full";
+    case IBL_QUALITY_HALF:
+        return "half";
+    case IBL_QUALITY_QUARTER:
+        return "quarter";
+    default:
+        return "unknown";
+    }
+}
+
+void glxInitIblCompareStats(IblCompareStats* s) {
+    glGenBuffers(GPU_TIMER_LATENCY, s->buffers);
+    for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->buffers[i]);
+        glBufferData(GL_SHADER_STORAGE_BUFFER, IBL_STAT_COUNT * sizeof(uint32_t), 0, GL_DYNAMIC_READ);
+        s->pending[i] = false;
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    s->frame = 0;
+    s->last = IblCompareFrame();
+    s->has_result = false;
+}
+
+void glxDestroyIblCompareStats(IblCompareStats* s) {
+    glDeleteBuffers(GPU_TIMER_LATENCY, s->buffers);
+    for (int i = 0; i < GPU_TIMER_LATENCY; ++i) {
+        s->buffers[i] = 0;
+        s->pending[i] = false;
+    }
+}
+
+bool glxIblCompareStatsBegin(IblCompareStats* s) {
+    const int slot = s->frame % GPU_TIMER_LATENCY;
+    bool updated = false;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, s->buffers[slot]);
+    if (s->pending[slot]) {
+        // Atomics from the fragment shader have to be visible to the read
+        glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+        uint32_t values[IBL_STAT_COUNT];
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(values), values);
+        s->last.squared_error_sum = ((uint64_t)values[IBL_STAT_ERROR_SUM_HI] << 32) | values[IBL_STAT_ERROR_SUM_LO];
+        s->last.pixels = values[IBL_STAT_PIXELS];
+        s->last.visible_errors = values[IBL_STAT_VISIBLE_ERRORS];
+        s->last.max_error = values[IBL_STAT_MAX_ERROR];
+        s->last.fallbacks = values[IBL_STAT_FALLBACKS];
+        s->pending[slot] = false;
+        s->has_result = true;
+        updated = true;
+    }
+    const uint32_t zeros[IBL_STAT_COUNT] = { 0 };
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeros), zeros);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_IBL_STATS, s->buffers[slot]);
+    s->pending[slot] = true;
+    s->frame++;
+    return updated;
+}
+
+void iblCompareAccumulate(IblCompareTotals* t, const IblCompareFrame& frame, double reference_ms, double reduced_ms) {
+    t->frames++;
+    t->reference_ms += reference_ms;
+    t->reduced_ms += reduced_ms;
+    t->squared_error_sum += (double)frame.squared_error_sum / IBL_STAT_ERROR_SCALE;
+    t->pixels += frame.pixels;
+    t->visible_errors += frame.visible_errors;
+    t->fallbacks += frame.fallbacks;
+    t->max_error = std::max(t->max_error, frame.max_error);
+}
+
+bool iblCompareSummarize(const IblCompareTotals* t, IblCompareSummary* out) {
+    if (t->frames == 0 || t->pixels == 0) {
+        return false;
+    }
+    const double mse = t->squared_error_sum / t->pixels;
+    out->reference_ms = t->reference_ms / t->frames;
+    out->reduced_ms = t->reduced_ms / t->frames;
+    out->psnr_db = mse > .0 ? 10.0 * log10(1.0 / mse) : INFINITY;
+    out->rmse = sqrt(mse) * 255.0;
+    out->max_error = t->max_error / IBL_STAT_ERROR_SCALE * 255.0;
+    out->visible_error_percent = 100.0 * t->visible_errors / t->pixels;
+    out->fallback_percent = 100.0 * t->fallbacks / t->pixels;
+    return true;
+}
+
+void iblCompareLogSummary(const IblCompareTotals* t, IBL_QUALITY quality) {
+    IblCompareSummary s;
+    if (!iblCompareSummarize(t, &s)) {
+        LOG_WARN("renderer", "IBL compare (" << iblQualityName(quality) << "): no results");
+        return;
+    }
+    LOG("renderer", "IBL compare (" << iblQualityName(quality) << " rate, " << t->frames << " frames): gpu "
+        << s.reduced_ms << "ms vs " << s.reference_ms << "ms full rate (" << (s.reference_ms > .0 ? 100.0 * s.reduced_ms / s.reference_ms : .0) << "%), "
+        << "PSNR " << s.psnr_db << "dB, RMSE " << s.rmse << "/255, max error " << s.max_error << "/255, "
+        << s.visible_error_percent << "% pixels off by more than 2/255, "
+        << s.fallback_percent << "% shaded at full rate on edges");
+}
+
+bool iblCompareWriteCsv(const char* path, const IblCompareTotals* totals) {
+    FILE* f = fopen(path, "w");
+    if (!f) {
+        LOG_ERR("renderer", "Failed to open " << path << " for writing");
+        return false;
+    }
+    fprintf(f, "rate,frames,reduced_ms,full_rate_ms,psnr_db,rmse_255,max_error_255,visible_error_percent,fallback_percent\n");
+    for (int i = 0; i < IBL_QUALITY_COUNT; ++i) {
+        IblCompareSummary s;
+        if (!iblCompareSummarize(&totals[i], &s)) {
+            continue;
+        }
+        fprintf(f, "%s,%d,%.4f,%.4f,%.2f,%.3f,%.3f,%.4f,%.4f\n", iblQualityName((IBL_QUALITY)i), totals[i].frames,
+            s.reduced_ms, s.reference_ms, s.psnr_db, s.rmse, s.max_error, s.visible_error_percent, s.fallback_percent);
+    }
+    fclose(f);
+    LOG("renderer", "IBL compare results written to " << path);
+    return true;
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+#include "gpu_timer.hpp"
+
+
+// Rate the irradiance and prefiltered specular lookups run at, see shaders/ibl_lowres.glsl and ibl_upsample.glsl
+enum IBL_QUALITY {
+	IBL_QUALITY_FULL,
+	IBL_QUALITY_HALF,
+	IBL_QUALITY_QUARTER,
+	IBL_QUALITY_COUNT
+};
+
+int iblDownscale(IBL_QUALITY quality);
+const char* iblQualityName(IBL_QUALITY quality);
+
+// Matches shaders/uniform_blocks/ibl_stats.glsl
+constexpr GLuint SSBO_BINDING_IBL_STATS = 4;
+enum IBL_STAT {
+	IBL_STAT_ERROR_SUM_LO,
+	IBL_STAT_ERROR_SUM_HI,
+	IBL_STAT_PIXELS,
+	IBL_STAT_VISIBLE_ERRORS,
+	IBL_STAT_MAX_ERROR,
+	IBL_STAT_FALLBACKS,
+	IBL_STAT_COUNT
+};
+constexpr double IBL_STAT_ERROR_SCALE = 1048576.0;
+
+// Errors are in display space, after the tonemap and gamma of compose.glsl
+struct IblCompareFrame {
+	uint64_t squared_error_sum = 0;		// In 1/IBL_STAT_ERROR_SCALE units
+	uint32_t pixels = 0;
+	uint32_t visible_errors = 0;
+	uint32_t max_error = 0;
+	uint32_t fallbacks = 0;
+};
+
+// Counters the compare pass accumulates into, one buffer per frame in flight like GpuTimer
+struct IblCompareStats {
+	GLuint buffers[GPU_TIMER_LATENCY] = { 0 };
+	bool pending[GPU_TIMER_LATENCY] = { false };
+	int frame = 0;
+	IblCompareFrame last;
+	bool has_result = false;
+};
+
+void glxInitIblCompareStats(IblCompareStats* s);
+void glxDestroyIblCompareStats(IblCompareStats* s);
+// Reads back the frame that used this slot before, then zeroes it and binds it at SSBO_BINDING_IBL_STATS.
+// The buffer was written GPU_TIMER_LATENCY frames ago so the read rarely waits. Returns true if last was updated
+bool glxIblCompareStatsBegin(IblCompareStats* s);
+
+// Full rate against reduced rate over a run of frames
+struct IblCompareTotals {
+	int frames = 0;
+	double reference_ms = .0;
+	double reduced_ms = .0;
+	double squared_error_sum = .0;
+	uint64_t pixels = 0;
+	uint64_t visible_errors = 0;
+	uint64_t fallbacks = 0;
+	uint32_t max_error = 0;
+};
+
+// Per frame averages and display space errors, RMSE and max error in 1/255 steps
+struct IblCompareSummary {
+	double reference_ms = .0;
+	double reduced_ms = .0;
+	double psnr_db = .0;
+	double rmse = .0;
+	double max_error = .0;
+	double visible_error_percent = .0;
+	double fallback_percent = .0;
+};
+
+void iblCompareAccumulate(IblCompareTotals* t, const IblCompareFrame& frame, double reference_ms, double reduced_ms);
+// False if nothing was accumulated
+bool iblCompareSummarize(const IblCompareTotals* t, IblCompareSummary* out);
+void iblCompareLogSummary(const IblCompareTotals* t, IBL_QUALITY quality);
+// One row per rate that has results, totals is indexed by IBL_QUALITY
+bool iblCompareWriteCsv(const char* path, const IblCompareTotals* totals);
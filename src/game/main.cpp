@@ -5,6 +5,10 @@
 #include "windowsx.h"
 
 #include "profiler/profiler.hpp"
+#include "ibl_quality.hpp"
+#include "prefilter_samples.hpp"
+#include "reflection_probes.hpp"
+#include "texture_stream.hpp"
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "stb_image.h"
@@ -135,7 +139,24 @@ static void toggleFullscreen() {
     }
 }
 
+// Resizes the window around a client area of width x height, WM_SIZE reports what the system allowed
+static void setWindowClientSize(int width, int height) {
+    RECT wr = { 0, 0, width, height };
+    AdjustWindowRect(&wr, (DWORD)GetWindowLongPtr(s_hWnd, GWL_STYLE), FALSE);
+    SetWindowPos(s_hWnd, 0, 0, 0, wr.right - wr.left, wr.bottom - wr.top, SWP_NOMOVE | SWP_NOZORDER);
+}
+
 static bool dbgShowGBuffer = false;
+static bool useMultiDrawIndirect = true;
+static bool useOcclusionCulling = true;
+static bool useAutoInstancing = true;
+static bool useLod = true;
+static bool useClusteredLights = true;
+static bool useDynamicResolution = true;
+static IBL_QUALITY iblQuality = IBL_QUALITY_FULL;
+static bool dbgIblCompare = false;
+static bool dbgLogFrameStats = false;
+static bool dbgNextEnvironment = false;
 static bool lMouseButtonPressed = false;
 static bool rMouseButtonPressed = false;
 
@@ -202,6 +223,44 @@ static LRESULT CALLBACK WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lPara
         case VK_F1:
             dbgShowGBuffer = !dbgShowGBuffer;
             break;
+        case VK_F2:
+            useMultiDrawIndirect = !useMultiDrawIndirect;
+            LOG("renderer", "Multi draw indirect " << (useMultiDrawIndirect ? "enabled" : "disabled"));
+            break;
+        case VK_F3:
+            useOcclusionCulling = !useOcclusionCulling;
+            LOG("renderer", "Occlusion culling " << (useOcclusionCulling ? "enabled" : "disabled"));
+            break;
+        case VK_F4:
+            dbgLogFrameStats = true;
+            break;
+        case VK_F5:
+            useAutoInstancing = !useAutoInstancing;
+            LOG("renderer", "Auto instancing " << (useAutoInstancing ? "enabled" : "disabled"));
+            break;
+        case VK_F6:
+            useLod = !useLod;
+            LOG("renderer", "LOD " << (useLod ? "enabled" : "disabled"));
+            break;
+        case VK_F7:
+            useClusteredLights = !useClusteredLights;
+            LOG("renderer", "Clustered lights " << (useClusteredLights ? "enabled" : "disabled"));
+            break;
+        case VK_F8:
+            useDynamicResolution = !useDynamicResolution;
+            LOG("renderer", "Dynamic resolution " << (useDynamicResolution ? "enabled" : "disabled"));
+            break;
+        case VK_F9:
+            iblQuality = (IBL_QUALITY)((iblQuality + 1) % IBL_QUALITY_COUNT);
+            LOG("renderer", "IBL at " << iblQualityName(iblQuality) << " rate");
+            break;
+        case VK_F11:
+            dbgIblCompare = !dbgIblCompare;
+            LOG("renderer", "IBL comparison against full rate " << (dbgIblCompare ? "enabled" : "disabled"));
+            break;
+        case VK_F12:
+            dbgNextEnvironment = true;
+            break;
         };
         break;
     case WM_KEYUP:
@@ -540,6 +599,9 @@ void glxSetUniform1i(GLuint progid, const char* name, int value) {
     }
 }
 
+// ubCubeFaces of the cubemap bake passes. 0 and 1 are ubCommon and ubModel, 2 is UB_BINDING_CLUSTERS
+constexpr GLuint UB_BINDING_CUBE_FACES = 3;
+
 inline void prepareShaderProgram(GLuint progid) {
     // Set fragment output locations
     {
@@ -623,7 +685,6 @@ inline void prepareShaderProgram(GLuint progid) {
         glxSetUniform1i(progid, "texDepth", 7);
         glxSetUniform1i(progid, "cubemapEnvironment", 8);
         glxSetUniform1i(progid, "texBrdfLut", 9);
-        glxSetUniform1i(progid, "cubemapIrradiance", 10);
         glxSetUniform1i(progid, "cubemapSpecular", 11);
         glxSetUniform1i(progid, "texHdri", 12);        
         glUseProgram(0);
@@ -638,6 +699,10 @@ inline void prepareShaderProgram(GLuint progid) {
         if (block_index != GL_INVALID_INDEX) {
             glUniformBlockBinding(progid, block_index, 1);
         }
+        block_index = glGetUniformBlockIndex(progid, "ubCubeFaces");
+        if (block_index != GL_INVALID_INDEX) {
+            glUniformBlockBinding(progid, block_index, UB_BINDING_CUBE_FACES);
+        }
     }
 }
 
@@ -711,6 +776,7 @@ inline GLuint glxCreateShaderProgram(const char* vs, const char* fs) {
 }
 
 #include <map>
+#include <memory>
 
 inline GLuint loadShader(const char* filename) {
     std::string src = fsSlurpTextFile(filename);
@@ -785,6 +851,13 @@ struct UniformBufferCommon {
     gfxm::vec2 viewportSize;
     float zNear;
     float zFar;
+    gfxm::vec2 uvScale;
+    gfxm::vec2 uvMax;
+    gfxm::mat4 matProjectionInverse;
+    gfxm::mat4 matViewInverse;
+    gfxm::vec4 shIrradiance[9];
+    float iblFade;
+    float _pad_ibl_fade[3];
 };
 static_assert(
     sizeof(UniformBufferCommon) 
@@ -794,7 +867,13 @@ static_assert(
     + sizeof(float)
     + sizeof(gfxm::vec2)
     + sizeof(float)
-    + sizeof(float),
+    + sizeof(float)
+    + sizeof(gfxm::vec2)
+    + sizeof(gfxm::vec2)
+    + sizeof(gfxm::mat4)
+    + sizeof(gfxm::mat4)
+    + sizeof(gfxm::vec4) * 9
+    + sizeof(float) * 4,
     "UniformBufferCommon misaligned"
 );
 
@@ -904,7 +983,7 @@ GLuint createFramebufferDepthTexture2d(int width, int height) {
     glGenTextures(1, &tex);
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, tex);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, 0);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_BYTE, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_LOD, 0);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LOD, 0);
@@ -925,10 +1004,15 @@ GLuint createCubeMap(int width, int height, GLint internalFormat) {
     for (int i = 0; i < 6; ++i) {
         glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, internalFormat, width, height, 0, GL_RGB, GL_FLOAT, 0);
     }
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, 0);
+    // Full chain for the prefilter's lod lookups, the caller fills it with glGenerateMipmap()
+    int max_level = 0;
+    while ((std::max(width, height) >> max_level) > 1) {
+        ++max_level;
+    }
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LEVEL, max_level);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_LOD, 0);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LOD, 0);
-    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAX_LOD, max_level);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
@@ -960,28 +1044,18 @@ GLuint createSpecularCubeMap(int width, int height, GLint internalFormat) {
     return tex;
 }
 
-void cubemapConvolute(GLuint vao_cube, GLuint progid, GLuint cubemap_in, GLuint cubemap_out, int width, int height) {
-    GLuint fbo;
-    glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    GLenum draw_buffers[] = {
-        GL_COLOR_ATTACHMENT0
-    };
-    glDrawBuffers(1, draw_buffers);
+// What the cubemap bake passes need to cover the six faces, see glxDrawCubeFaces()
+struct CubeBakeResources {
+    GLuint vao_cube = 0;            // inverted cube, 36 vertices
+    GLuint ub_face_views = 0;       // ubCubeFaces, projection * view per face in GL face order
+    bool layered = false;           // GL_ARB_shader_viewport_layer_array, gl_Layer can be written from the vertex shader
+    GLuint prog_hdri_to_cubemap = 0;
+    GLuint prog_prefilter = 0;      // prefilter_convolute_cubemap.glsl
+};
 
-    glActiveTexture(GL_TEXTURE0 + 8);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_in);
-    glViewport(0, 0, width, height);
-    glBindVertexArray(vao_cube);
-    //glFrontFace(GL_CW);
-    glEnable(GL_DEPTH_TEST);
-    glDisable(GL_STENCIL_TEST);
-    glEnable(GL_CULL_FACE);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LEQUAL);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glUseProgram(progid);
-    gfxm::mat4 views[6] = {
+// Rotation part of each face's view in GL face order, a direction d lands on the texel a lookup with d reads
+gfxm::mat4 cubeFaceView(int face) {
+    const gfxm::mat4 views[6] = {
         gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 1.f,  .0f,  .0f), gfxm::vec3(.0f, -1.f,  .0f)),
         gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3(-1.f,  .0f,  .0f), gfxm::vec3(.0f, -1.f,  .0f)),
         gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  1.f,  .0f), gfxm::vec3(.0f,  .0f,  1.f)),
@@ -989,117 +1063,164 @@ void cubemapConvolute(GLuint vao_cube, GLuint progid, GLuint cubemap_in, GLuint
         gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  .0f,  1.f), gfxm::vec3(.0f, -1.f,  .0f)),
         gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  .0f, -1.f), gfxm::vec3(.0f, -1.f,  .0f)),
     };
-    gfxm::mat4 projection = gfxm::perspective(gfxm::radian(90.0f), 1.0f, 0.1f, 10.0f);
+    return views[face];
+}
 
-    glUniformMatrix4fv(glGetUniformLocation(progid, "matProjection"), 1, GL_FALSE, (float*)&projection);
+void glxInitCubeBakeResources(CubeBakeResources* cube, GLuint vao_cube) {
+    gfxm::mat4 projection = gfxm::perspective(gfxm::radian(90.0f), 1.0f, 0.1f, 10.0f);
+    gfxm::mat4 face_views[6];
     for (int i = 0; i < 6; ++i) {
-        glUniformMatrix4fv(glGetUniformLocation(progid, "matView"), 1, GL_FALSE, (float*)&views[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemap_out, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+        face_views[i] = projection * cubeFaceView(i);
     }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glUseProgram(0);
-    glBindVertexArray(0);
-    glDeleteFramebuffers(1, &fbo);
+    cube->vao_cube = vao_cube;
+    glGenBuffers(1, &cube->ub_face_views);
+    glBindBuffer(GL_UNIFORM_BUFFER, cube->ub_face_views);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(face_views), face_views, GL_STATIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    cube->layered = glxExtensionSupported("GL_ARB_shader_viewport_layer_array");
+    if (!cube->layered) {
+        LOG_WARN("gl", "GL_ARB_shader_viewport_layer_array not supported, cubemap bakes will draw one face at a time");
+    }
+    cube->prog_hdri_to_cubemap = loadShader("shaders/hdri_to_cubemap.glsl");
+    cube->prog_prefilter = loadShader("shaders/prefilter_convolute_cubemap.glsl");
 }
 
-void cubemapPrefilterConvolute(GLuint vao_cube, GLuint progid, GLuint cubemap_in, GLuint cubemap_out, int width, int height) {
-    GLuint fbo;
-    glGenFramebuffers(1, &fbo);
+// Fixed function state of the bake passes, they also run between frames during an environment switch
+void beginCubeBakePass(GLuint fbo, GLuint progid) {
     glBindFramebuffer(GL_FRAMEBUFFER, fbo);
     GLenum draw_buffers[] = {
         GL_COLOR_ATTACHMENT0
     };
     glDrawBuffers(1, draw_buffers);
-
-    glActiveTexture(GL_TEXTURE0 + 8);
-    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_in);
-    glBindVertexArray(vao_cube);
     //glFrontFace(GL_CW);
     glEnable(GL_DEPTH_TEST);
     glDisable(GL_STENCIL_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_BLEND);
     glEnable(GL_CULL_FACE);
     glDepthMask(GL_TRUE);
     glDepthFunc(GL_LEQUAL);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
     glUseProgram(progid);
-    gfxm::mat4 views[6] = {
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 1.f,  .0f,  .0f), gfxm::vec3(.0f, -1.f,  .0f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3(-1.f,  .0f,  .0f), gfxm::vec3(.0f, -1.f,  .0f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  1.f,  .0f), gfxm::vec3(.0f,  .0f,  1.f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f, -1.f,  .0f), gfxm::vec3(.0f,  .0f, -1.f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  .0f,  1.f), gfxm::vec3(.0f, -1.f,  .0f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  .0f, -1.f), gfxm::vec3(.0f, -1.f,  .0f)),
-    };
-    gfxm::mat4 projection = gfxm::perspective(gfxm::radian(90.0f), 1.0f, 0.1f, 10.0f);
+}
 
-    glUniformMatrix4fv(glGetUniformLocation(progid, "matProjection"), 1, GL_FALSE, (float*)&projection);
-    const int nMipLevels = 5;
-    for (int mip = 0; mip < nMipLevels; ++mip) {
-        int mipW = width * powf(.5f, mip);
-        int mipH = height * powf(.5f, mip);
-        glViewport(0, 0, mipW, mipH);
+void endCubeBakePass() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glUseProgram(0);
+    glBindVertexArray(0);
+}
 
-        float roughness = (float)mip / (float)(nMipLevels - 1);
-        glUniform1f(glGetUniformLocation(progid, "roughness"), roughness);
-        for (int i = 0; i < 6; ++i) {
-            glUniformMatrix4fv(glGetUniformLocation(progid, "matView"), 1, GL_FALSE, (float*)&views[i]);
-            glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemap_out, mip);
-            glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-            glDrawArrays(GL_TRIANGLES, 0, 36);
+// Runs the bound program over faces [first_face, first_face + face_count) of one level of cubemap_out,
+// the shader picks its view with gl_BaseInstance + gl_InstanceID. Layered, the whole level is attached and
+// one instanced draw routes each instance to its face through gl_Layer
+void glxDrawCubeFaces(const CubeBakeResources& cube, GLuint cubemap_out, int mip, int first_face = 0, int face_count = 6) {
+    glBindBufferBase(GL_UNIFORM_BUFFER, UB_BINDING_CUBE_FACES, cube.ub_face_views);
+    glBindVertexArray(cube.vao_cube);
+    if (cube.layered) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, cubemap_out, mip);
+        // Clearing a level would wipe faces drawn by earlier calls, the passes cover every texel anyway
+        if (face_count == 6) {
+            glClear(GL_COLOR_BUFFER_BIT);
         }
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 36, face_count, first_face);
+        return;
     }
+    for (int i = first_face; i < first_face + face_count; ++i) {
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemap_out, mip);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 36, 1, i);
+    }
+}
 
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glUseProgram(0);
-    glBindVertexArray(0);
-    glDeleteFramebuffers(1, &fbo);
+// glxDrawCubeFaces() into all six faces of one cube of a cube map array, a face at a time.
+// The attachment is never layered so gl_Layer writes are ignored
+void glxDrawCubeArrayFaces(const CubeBakeResources& cube, GLuint array_out, int cube_index, int mip) {
+    glBindBufferBase(GL_UNIFORM_BUFFER, UB_BINDING_CUBE_FACES, cube.ub_face_views);
+    glBindVertexArray(cube.vao_cube);
+    for (int i = 0; i < 6; ++i) {
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, array_out, mip, cube_index * 6 + i);
+        glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, 36, 1, i);
+    }
 }
 
-void cubemapFromHdri(GLuint vao_cube, GLuint progid, GLuint tex_hdri, GLuint cubemap_out, int width, int height) {
+constexpr int SPECULAR_MIP_COUNT = 5;
+static_assert(SPECULAR_MIP_COUNT == REFLECTION_PROBE_MIPS, "Probes are prefiltered with the environment's mip roughness");
+
+// prefilterBuildSamples() tables for every specular mip in one SSBO. With sample_count 0 there is
+// no buffer and the counts stay 0, the shader runs its per texel reference loop then
+struct PrefilterSampleTables {
+    GLuint ssbo = 0;
+    int offsets[SPECULAR_MIP_COUNT] = { 0 };
+    int counts[SPECULAR_MIP_COUNT] = { 0 };
+};
+
+// source_size is the environment's level 0 size, the tables pick lods from it
+void glxCreatePrefilterSampleTables(PrefilterSampleTables* tables, int sample_count, int source_size) {
+    *tables = PrefilterSampleTables();
+    if (sample_count <= 0) {
+        return;
+    }
+    std::vector<PrefilterSample> samples;
+    std::vector<PrefilterSample> mip_samples;
+    for (int mip = 0; mip < SPECULAR_MIP_COUNT; ++mip) {
+        prefilterBuildSamples(&mip_samples, (float)mip / (float)(SPECULAR_MIP_COUNT - 1), sample_count, source_size);
+        tables->offsets[mip] = (int)samples.size();
+        tables->counts[mip] = (int)mip_samples.size();
+        samples.insert(samples.end(), mip_samples.begin(), mip_samples.end());
+    }
+    glGenBuffers(1, &tables->ssbo);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, tables->ssbo);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, samples.size() * sizeof(PrefilterSample), samples.data(), GL_STATIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void glxDestroyPrefilterSampleTables(PrefilterSampleTables* tables) {
+    if (tables->ssbo) {
+        glDeleteBuffers(1, &tables->ssbo);
+    }
+    *tables = PrefilterSampleTables();
+}
+
+// Viewport, uniforms and input for one specular mip, the prefilter program in use
+void prefilterSetupLevel(GLuint progid, const PrefilterSampleTables& tables, GLuint cubemap_in, int size, int mip) {
+    glActiveTexture(GL_TEXTURE0 + 8);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_in);
+    if (tables.ssbo) {
+        glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_PREFILTER_SAMPLES, tables.ssbo);
+    }
+    const int mip_size = std::max(1, size >> mip);
+    glViewport(0, 0, mip_size, mip_size);
+    glUniform1f(glGetUniformLocation(progid, "roughness"), (float)mip / (float)(SPECULAR_MIP_COUNT - 1));
+    glUniform1i(glGetUniformLocation(progid, "sampleOffset"), tables.offsets[mip]);
+    glUniform1i(glGetUniformLocation(progid, "sampleCount"), tables.counts[mip]);
+}
+
+// sample_count 0 runs the shader's per texel reference loop, otherwise every mip reads a
+// prefilterBuildSamples() table. source_size is the environment's level 0 size, the tables pick lods from it
+void cubemapPrefilterConvolute(const CubeBakeResources& cube, GLuint progid, GLuint cubemap_in, GLuint cubemap_out, int size, int sample_count, int source_size) {
+    PrefilterSampleTables tables;
+    glxCreatePrefilterSampleTables(&tables, sample_count, source_size);
+
     GLuint fbo;
     glGenFramebuffers(1, &fbo);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    GLenum draw_buffers[] = {
-        GL_COLOR_ATTACHMENT0
-    };
-    glDrawBuffers(1, draw_buffers);
+    beginCubeBakePass(fbo, progid);
+    for (int mip = 0; mip < SPECULAR_MIP_COUNT; ++mip) {
+        prefilterSetupLevel(progid, tables, cubemap_in, size, mip);
+        glxDrawCubeFaces(cube, cubemap_out, mip);
+    }
+    endCubeBakePass();
+    glDeleteFramebuffers(1, &fbo);
+    glxDestroyPrefilterSampleTables(&tables);
+}
 
+void cubemapFromHdri(const CubeBakeResources& cube, GLuint progid, GLuint tex_hdri, GLuint cubemap_out, int size) {
+    GLuint fbo;
+    glGenFramebuffers(1, &fbo);
+    beginCubeBakePass(fbo, progid);
     glActiveTexture(GL_TEXTURE0 + 12);
     glBindTexture(GL_TEXTURE_2D, tex_hdri);
-    glViewport(0, 0, width, height);
-    glBindVertexArray(vao_cube);
-    //glFrontFace(GL_CW);
-    glEnable(GL_DEPTH_TEST);
-    glDisable(GL_STENCIL_TEST);
-    glEnable(GL_CULL_FACE);
-    glDepthMask(GL_TRUE);
-    glDepthFunc(GL_LEQUAL);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glUseProgram(progid);
-    gfxm::mat4 views[6] = {
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 1.f,  .0f,  .0f), gfxm::vec3(.0f, -1.f,  .0f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3(-1.f,  .0f,  .0f), gfxm::vec3(.0f, -1.f,  .0f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  1.f,  .0f), gfxm::vec3(.0f,  .0f,  1.f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f, -1.f,  .0f), gfxm::vec3(.0f,  .0f, -1.f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  .0f,  1.f), gfxm::vec3(.0f, -1.f,  .0f)),
-        gfxm::lookAt(gfxm::vec3(.0f, .0f, .0f), gfxm::vec3( 0.f,  .0f, -1.f), gfxm::vec3(.0f, -1.f,  .0f)),
-    };
-    gfxm::mat4 projection = gfxm::perspective(gfxm::radian(90.0f), 1.0f, 0.1f, 10.0f);
-
-    glUniformMatrix4fv(glGetUniformLocation(progid, "matProjection"), 1, GL_FALSE, (float*)&projection);
-    for (int i = 0; i < 6; ++i) {
-        glUniformMatrix4fv(glGetUniformLocation(progid, "matView"), 1, GL_FALSE, (float*)&views[i]);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, cubemap_out, 0);
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
-    }
-
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glUseProgram(0);
-    glBindVertexArray(0);
+    glViewport(0, 0, size, size);
+    glxDrawCubeFaces(cube, cubemap_out, 0);
+    endCubeBakePass();
     glDeleteFramebuffers(1, &fbo);
 
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap_out);
@@ -1120,82 +1241,17 @@ void glxBindCubemapSlot(int slot, GLuint cubemap) {
     glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
 }
 
-GLuint loadRGBATexture(const char* filename) {
-    GLuint texture;
-    stbi_set_flip_vertically_on_load(true);
-    int w, h, comp;
-    stbi_uc* data = stbi_load(filename, &w, &h, &comp, 4);
-    if (!data) {
-        LOG_ERR("gl/textures", "Failed to load texture " << filename);
-        return 0;
-    }
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, w, h, 0, GL_RGBA, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(data);
-    return texture;
-}
-
-GLuint loadRGBTexture(const char* filename) {
-    GLuint texture;
-    stbi_set_flip_vertically_on_load(true);
-    int w, h, comp;
-    stbi_uc* data = stbi_load(filename, &w, &h, &comp, 3);
-    if (!data) {
-        LOG_ERR("gl/textures", "Failed to load texture " << filename);
-        return 0;
-    }
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(data);
-    return texture;
-}
-
-GLuint loadSingleChannelTexture(const char* filename) {
-    GLuint texture;
-    stbi_set_flip_vertically_on_load(true);
-    int w, h, comp;
-    stbi_uc* data = stbi_load(filename, &w, &h, &comp, 1);
-    if (!data) {
-        LOG_ERR("gl/textures", "Failed to load texture " << filename);
-        return 0;
-    }
-    glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, w, h, 0, GL_RED, GL_UNSIGNED_BYTE, data);
-    glGenerateMipmap(GL_TEXTURE_2D);
-    glBindTexture(GL_TEXTURE_2D, 0);
-    stbi_image_free(data);
-    return texture;
-}
-
 struct GlPbrTextures {
     GLuint albedo;
     GLuint normal;
-    GLuint roughness;
-    GLuint metallic;
-    GLuint ao;
+    GLuint material;    // Roughness, metallic, AO in RGB
     GLuint emission;
 };
 
+// Names are valid right away, the contents stream in over the next frames.
+// Sources run through teximport load block compressed
 GlPbrTextures loadPbrTextures(
+    TextureStream* stream,
     const char* albedo,
     const char* normal,
     const char* roughness,
@@ -1204,46 +1260,33 @@ GlPbrTextures loadPbrTextures(
     const char* emission = 0
 ) {
     GlPbrTextures textures = { 0 };
-    textures.albedo = loadRGBATexture(albedo);
-    textures.normal = loadRGBTexture(normal);
-    textures.roughness = loadSingleChannelTexture(roughness);
-    if (metallic) {
-        textures.metallic = loadSingleChannelTexture(metallic);
-    }
-    if (ao) {
-        textures.ao = loadSingleChannelTexture(ao);
-    }
+    textures.albedo = glxTextureStreamLoad(stream, albedo, TEXTURE_ROLE_ALBEDO);
+    textures.normal = glxTextureStreamLoad(stream, normal, TEXTURE_ROLE_NORMAL);
+    textures.material = glxTextureStreamLoadMaterial(stream, roughness, metallic, ao);
     if (emission) {
-        textures.emission = loadRGBTexture(emission);
+        textures.emission = glxTextureStreamLoad(stream, emission, TEXTURE_ROLE_EMISSION);
     }
     return textures;
 }
 
-enum DRAW_CMD_TYPE {
-    DRAW_CMD_ARRAY,
-    DRAW_CMD_INDEXED,
-    DRAW_CMD_ARRAY_INSTANCED,
-    DRAW_CMD_INDEXED_INSTANCED
-};
-
-constexpr int MAX_CUSTOM_UNIFORM_BUFFERS = 16;
-constexpr int MAX_DRAW_CMD_TEXTURES = 16;
-struct DrawCmd {
-    DRAW_CMD_TYPE type;
-    GLenum mode;
-    GLuint vao;
-    GLuint progid;
-    GLint offset;
-    GLsizei count;
-    GLsizei instance_count;
-    GLuint ub_model;
-    GLuint uniform_buffers[MAX_CUSTOM_UNIFORM_BUFFERS];
-    uint32_t num_uniform_buffers;
-    GLuint textures[MAX_DRAW_CMD_TEXTURES];
-    uint32_t num_textures;
-};
-
+#include "draw_cmd.hpp"
+#include "draw_cmd_recorder.hpp"
+#include "draw_indirect.hpp"
+#include "auto_instancing.hpp"
+#include "mesh_lod.hpp"
+#include "mesh_simplify.hpp"
+#include "frustum_cull.hpp"
+#include "occlusion_cull.hpp"
+#include "clustered_lights.hpp"
+#include "dynamic_resolution.hpp"
+#include "gpu_timer.hpp"
+#include "render_graph.hpp"
+#include "ibl_cache.hpp"
+#include "profiler/stopwatch.hpp"
+#include "benchmarks.hpp"
+#include "thread/thread_pool.hpp"
 #include "sampler_set.hpp"
+#include "env_switch.hpp"
 
 
 SamplerArray makeSamplerArray(ShaderProgram* prog, SamplerSet* material_samplers, SamplerSet* frame_samplers, FramebufferDesc* output_textures) {
@@ -1314,60 +1357,112 @@ void bindSamplers(const SamplerArray* samplers) {
 
 struct RendererGlobalResources {
     GLuint vao_screen_triangle = 0;
-    GLuint vao_inverted_cube = 0;
+    CubeBakeResources cube_bake;
     GLuint tex_brdf = 0;
+    TextureStream texture_stream;
 };
 
-struct IBLTextureSet {
-    GLuint environment;
-    GLuint irradiance;
-    GLuint specular;
-};
-
-bool makeIBLCubemaps(IBLTextureSet& set, GLuint vao_cube) {
-    const int convoluted_width = 32;
-    const int convoluted_height = 32;
-
-    auto prog_convolute = loadShader("shaders/convolute_cubemap.glsl");
-    set.irradiance = createCubeMap(convoluted_width, convoluted_height, GL_RGB16F);
-    cubemapConvolute(vao_cube, prog_convolute, set.environment, set.irradiance, convoluted_width, convoluted_height);
-
-    auto prog_prefilter_convolute = loadShader("shaders/prefilter_convolute_cubemap.glsl");
-    set.specular = createSpecularCubeMap(128, 128, GL_RGB16F);
-    cubemapPrefilterConvolute(vao_cube, prog_prefilter_convolute, set.environment, set.specular, 128, 128);
-    return true;
+GLuint makeBrdfLut(GLuint vao_triangle, int size) {
+    GLuint tex_brdf = 0;
+    auto prog_brdf = loadShader("shaders/integrate_brdf.glsl");
+    tex_brdf = createFramebufferTexture2d(size, size, GL_RG16F);
+    GLuint fbo;
+    {
+        glGenFramebuffers(1, &fbo);
+        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_brdf, 0);
+        GLenum draw_buffers[] = {
+            GL_COLOR_ATTACHMENT0,
+        };
+        glDrawBuffers(1, draw_buffers);
+        if (!glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
+            LOG_ERR("gl/framebuffer", "Framebuffer is incomplete");
+            return -1;
+        }
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
+    glFrontFace(GL_CCW);
+    glViewport(0, 0, size, size);
+    glScissor(0, 0, size, size);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    glUseProgram(prog_brdf);
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glBindVertexArray(vao_triangle);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glUseProgram(0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glBindVertexArray(0);
+    return tex_brdf;
 }
 
-IBLTextureSet loadCubemapHDRI(RendererGlobalResources* prd, const char* path) {
-    IBLTextureSet set;
-    
+// Equirect rgb as stbi_loadf() returns it with vertical flip on, null leaves the cubemap black
+GLuint makeEnvironmentCubemap(const CubeBakeResources& cube, const float* rgb, int width, int height, int size) {
     GLuint tex_hdri;
     glGenTextures(1, &tex_hdri);
-
-    stbi_set_flip_vertically_on_load(true);
-    int width, height, ncomp;
-    float* data = stbi_loadf(path, &width, &height, &ncomp, 3);
-    if (data) {
+    if (rgb) {
         glBindTexture(GL_TEXTURE_2D, tex_hdri);
-        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, data);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, rgb);
 
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
         glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
         glGenerateMipmap(GL_TEXTURE_2D);
-
-        stbi_image_free(data);
     }
 
-    auto prog_hdri_to_cubemap = loadShader("shaders/hdri_to_cubemap.glsl");
-    set.environment = createCubeMap(512, 512, GL_RGB16F);
-    cubemapFromHdri(prd->vao_inverted_cube, prog_hdri_to_cubemap, tex_hdri, set.environment, 512, 512);
+    GLuint environment = createCubeMap(size, size, GL_RGB16F);
+    cubemapFromHdri(cube, cube.prog_hdri_to_cubemap, tex_hdri, environment, size);
 
     glDeleteTextures(1, &tex_hdri);
+    return environment;
+}
+
+// Diffuse irradiance is SH projected on the CPU from the source image, see sh_irradiance.hpp
+bool makeIBLCubemaps(IBLTextureSet& set, const CubeBakeResources& cube, const IblBakeParams& params) {
+    set.specular = createSpecularCubeMap(params.specular_size, params.specular_size, GL_RGB16F);
+    cubemapPrefilterConvolute(cube, cube.prog_prefilter, set.environment, set.specular, params.specular_size, params.prefilter_samples, params.environment_size);
+    return true;
+}
+
+// Bakes are cached under cache/ibl keyed by the source contents and IblBakeParams, a hit skips every shader pass
+IBLTextureSet loadCubemapHDRI(RendererGlobalResources* prd, const char* path) {
+    IBLTextureSet set;
+    Stopwatch sw;
+    const IblBakeParams params = iblDefaultBakeParams();
+    uint64_t source_hash = 0;
+    std::string cache_path;
+    if (iblHashFile(path, &source_hash)) {
+        cache_path = iblCachePath(source_hash, params);
+        GLuint brdf_lut = 0;
+        if (glxIblCacheLoad(cache_path.c_str(), source_hash, params, &set, &brdf_lut)) {
+            if (prd->tex_brdf) {
+                glDeleteTextures(1, &brdf_lut);
+            } else {
+                prd->tex_brdf = brdf_lut;
+            }
+            LOG("renderer", "IBL maps for " << path << " loaded from " << cache_path << " in " << sw.elapsedMs() << "ms");
+            return set;
+        }
+    }
 
-    makeIBLCubemaps(set, prd->vao_inverted_cube);
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, ncomp;
+    float* data = stbi_loadf(path, &width, &height, &ncomp, 3);
+    if (data) {
+        shProjectEquirect(&set.irradiance_sh, data, width, height, getThreadPool());
+    }
+    set.environment = makeEnvironmentCubemap(prd->cube_bake, data, width, height, params.environment_size);
+    stbi_image_free(data);
+
+    makeIBLCubemaps(set, prd->cube_bake, params);
+    if (!prd->tex_brdf) {
+        prd->tex_brdf = makeBrdfLut(prd->vao_screen_triangle, params.brdf_lut_size);
+    }
+    LOG("renderer", "IBL maps for " << path << " baked in " << sw.elapsedMs() << "ms");
 
+    if (!cache_path.empty()) {
+        glxIblCacheSave(cache_path.c_str(), source_hash, params, set, prd->tex_brdf);
+    }
     return set;
 }
 
@@ -1386,6 +1481,8 @@ IBLTextureSet loadCubemap(RendererGlobalResources* prd, const char* posx, const
         posx, negx, posy, negy, posz, negz
     };
     stbi_set_flip_vertically_on_load(false);
+    std::vector<float> face_rgb[6];
+    int face_size = 0;
     for (int i = 0; i < 6; ++i) {
         int w, h, comp;
         stbi_uc* data = stbi_load(paths[i], &w, &h, &comp, 3);
@@ -1394,47 +1491,117 @@ IBLTextureSet loadCubemap(RendererGlobalResources* prd, const char* posx, const
             0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE,
             data
         );
+        if (data && w == h && (i == 0 || w == face_size)) {
+            face_size = w;
+            face_rgb[i].resize(w * h * 3);
+            for (int j = 0; j < w * h * 3; ++j) {
+                face_rgb[i][j] = data[j] / 255.f;
+            }
+        }
         stbi_image_free(data);
     }
     glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-    makeIBLCubemaps(set, prd->vao_inverted_cube);
+    const float* faces[6];
+    bool faces_complete = true;
+    for (int i = 0; i < 6; ++i) {
+        faces[i] = face_rgb[i].data();
+        faces_complete = faces_complete && !face_rgb[i].empty();
+    }
+    if (faces_complete) {
+        shProjectCubeFaces(&set.irradiance_sh, faces, face_size);
+    } else {
+        LOG_WARN("renderer", "Cubemap faces are missing or not the same square size, no diffuse environment light");
+    }
+
+    const IblBakeParams params = iblDefaultBakeParams();
+    makeIBLCubemaps(set, prd->cube_bake, params);
+    if (!prd->tex_brdf) {
+        prd->tex_brdf = makeBrdfLut(prd->vao_screen_triangle, params.brdf_lut_size);
+    }
 
     return set;
 }
 
-GLuint makeBrdfLut(GLuint vao_triangle) {
-    GLuint tex_brdf = 0;
-    auto prog_brdf = loadShader("shaders/integrate_brdf.glsl");
-    tex_brdf = createFramebufferTexture2d(512, 512, GL_RG16F);
-    GLuint fbo;
-    {
-        glGenFramebuffers(1, &fbo);
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, tex_brdf, 0);
-        GLenum draw_buffers[] = {
-            GL_COLOR_ATTACHMENT0,
-        };
-        glDrawBuffers(1, draw_buffers);
-        if (!glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE) {
-            LOG_ERR("gl/framebuffer", "Framebuffer is incomplete");
-            return -1;
-        }
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Specular prefilter runs, best of a few, glFinish() to glFinish()
+static double prefilterBenchRun(const CubeBakeResources& cube, GLuint environment, GLuint specular, const IblBakeParams& params, int sample_count) {
+    double best = 1e9;
+    for (int i = 0; i < 3; ++i) {
+        glFinish();
+        Stopwatch sw;
+        cubemapPrefilterConvolute(cube, cube.prog_prefilter, environment, specular, params.specular_size, sample_count, params.environment_size);
+        glFinish();
+        best = std::min(best, sw.elapsedMs());
+    }
+    return best;
+}
+
+// All six faces of one level, rgb floats
+static void prefilterBenchReadLevel(GLuint cubemap, int mip, int size, std::vector<float>& rgb) {
+    const size_t face_floats = (size_t)size * size * 3;
+    rgb.resize(face_floats * 6);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, cubemap);
+    for (int face = 0; face < 6; ++face) {
+        glGetTexImage(GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, mip, GL_RGB, GL_FLOAT, &rgb[face * face_floats]);
     }
-    glFrontFace(GL_CCW);
-    glViewport(0, 0, 512, 512);
-    glScissor(0, 0, 512, 512);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glUseProgram(prog_brdf);
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
-    glBindVertexArray(vao_triangle);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-    glUseProgram(0);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glBindVertexArray(0);
-    return tex_brdf;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+}
+
+// -prefilter_bench bakes the specular map of path with sample tables of growing size and compares every rough
+// mip against the shader's 1024 sample per texel loop. Errors are relative to the mean of the reference level
+void prefilterBench(RendererGlobalResources* prd, const char* path) {
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, ncomp;
+    float* data = stbi_loadf(path, &width, &height, &ncomp, 3);
+    if (!data) {
+        LOG_ERR("bench", "prefilter: failed to load " << path);
+        return;
+    }
+    const IblBakeParams params = iblDefaultBakeParams();
+    const GLuint environment = makeEnvironmentCubemap(prd->cube_bake, data, width, height, params.environment_size);
+    stbi_image_free(data);
+
+    const GLuint reference = createSpecularCubeMap(params.specular_size, params.specular_size, GL_RGB16F);
+    const GLuint specular = createSpecularCubeMap(params.specular_size, params.specular_size, GL_RGB16F);
+    const double reference_ms = prefilterBenchRun(prd->cube_bake, environment, reference, params, 0);
+    LOG("bench", "prefilter: " << path << ", reference " << PREFILTER_REFERENCE_SAMPLES << " samples per texel " << reference_ms << "ms");
+
+    std::vector<float> ref_rgb;
+    std::vector<float> rgb;
+    const int sample_counts[] = { 16, 32, 64, 128, 256, 512, 1024 };
+    for (int sample_count : sample_counts) {
+        const double ms = prefilterBenchRun(prd->cube_bake, environment, specular, params, sample_count);
+        std::ostringstream errors;
+        double worst_rms = .0;
+        double worst_max = .0;
+        // Mip 0 is the mirror, one sample along N either way
+        for (int mip = 1; mip < params.specular_mips; ++mip) {
+            const int size = std::max(1, params.specular_size >> mip);
+            prefilterBenchReadLevel(reference, mip, size, ref_rgb);
+            prefilterBenchReadLevel(specular, mip, size, rgb);
+            double mean = .0;
+            double squared_error_sum = .0;
+            double max_error = .0;
+            for (size_t i = 0; i < rgb.size(); ++i) {
+                const double d = (double)rgb[i] - (double)ref_rgb[i];
+                mean += ref_rgb[i];
+                squared_error_sum += d * d;
+                max_error = std::max(max_error, fabs(d));
+            }
+            mean = std::max(1e-6, mean / rgb.size());
+            const double rms = sqrt(squared_error_sum / rgb.size()) / mean;
+            worst_rms = std::max(worst_rms, rms);
+            worst_max = std::max(worst_max, max_error / mean);
+            errors << (mip == 1 ? "" : " ") << rms * 100. << "%";
+        }
+        LOG("bench", "prefilter: " << sample_count << " table samples " << ms << "ms (" << reference_ms / ms << "x), rms error by mip "
+            << errors.str() << ", worst rms " << worst_rms * 100. << "%, worst texel " << worst_max * 100. << "%");
+    }
+
+    glDeleteTextures(1, &environment);
+    glDeleteTextures(1, &reference);
+    glDeleteTextures(1, &specular);
 }
 
 class glxTexture {
@@ -1483,14 +1650,15 @@ void initPersistentRenderData(RendererGlobalResources* prd) {
 
         GLuint vbo_vertices = glxCreateArrayBuffer(sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-        glGenVertexArrays(1, &prd->vao_inverted_cube);
-        glBindVertexArray(prd->vao_inverted_cube);
+        GLuint vao_cube = 0;
+        glGenVertexArrays(1, &vao_cube);
+        glBindVertexArray(vao_cube);
         glxEnableVertexAttrib(0, vbo_vertices, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glBindVertexArray(0);
+        glxInitCubeBakeResources(&prd->cube_bake, vao_cube);
     }
 
-    // Generate brdf lookup texture
-    prd->tex_brdf = makeBrdfLut(prd->vao_screen_triangle);
+    // The brdf lookup texture comes with the first environment, baked or loaded from the IBL cache
 }
 
 struct glxMeshAttribLayout {
@@ -1752,7 +1920,8 @@ GLuint createGlCube(GLuint progid) {
     return vao;
 }
 
-GLuint createGlTorus(GLuint progid, int torus_segments, int pipe_segments) {
+// Welded into an indexed triangle list, lod_chain receives the simplified levels as ranges of its element buffer
+GLuint createGlTorus(GLuint progid, int torus_segments, int pipe_segments, MeshLodChain* lod_chain) {
     const float pipe_radius = .20f;
     GLuint vao_lines = 0;
     {
@@ -1818,10 +1987,10 @@ GLuint createGlTorus(GLuint progid, int torus_segments, int pipe_segments) {
                 bitangents.push_back(trZ0);
                 bitangents.push_back(trZ0);
                 bitangents.push_back(trZ0);
-                uvs.push_back(gfxm::vec2(th1 / -gfxm::pi2, t0 / gfxm::pi2 * 12.f * 2.f));
-                uvs.push_back(gfxm::vec2(th1 / -gfxm::pi2, t1 / gfxm::pi2 * 12.f * 2.f));
                 uvs.push_back(gfxm::vec2(th0 / -gfxm::pi2, t0 / gfxm::pi2 * 12.f * 2.f));
                 uvs.push_back(gfxm::vec2(th0 / -gfxm::pi2, t1 / gfxm::pi2 * 12.f * 2.f));
+                uvs.push_back(gfxm::vec2(th1 / -gfxm::pi2, t0 / gfxm::pi2 * 12.f * 2.f));
+                uvs.push_back(gfxm::vec2(th1 / -gfxm::pi2, t1 / gfxm::pi2 * 12.f * 2.f));
                 colors.push_back(hsv2rgb(sinf(t0 * .5f) * .1f + .1f, .9f, .80f));
                 colors.push_back(hsv2rgb(sinf(t1 * .5f) * .1f + .1f, .9f, .80f));
                 colors.push_back(hsv2rgb(sinf(t0 * .5f) * .1f + .1f, .9f, .80f));
@@ -1829,12 +1998,51 @@ GLuint createGlTorus(GLuint progid, int torus_segments, int pipe_segments) {
             }
         }
 
+        // Every quad is a separate 4 vertex strip, neighbours repeat the shared vertices.
+        // Weld on position, normal, uv and color so the simplifier sees connected surface,
+        // tangent frames differ slightly per quad and are taken from the first copy
+        struct WeldKey {
+            gfxm::vec3 position;
+            gfxm::vec3 normal;
+            gfxm::vec2 uv;
+            uint32_t color;
+        };
+        std::vector<WeldKey> weld_keys(vertices.size());
+        for (int i = 0; i < vertices.size(); ++i) {
+            weld_keys[i] = WeldKey{ vertices[i], normals[i], uvs[i], colors[i] };
+        }
+        std::vector<uint32_t> remap(vertices.size());
+        const size_t unique_count = meshGenerateVertexRemap(remap.data(), weld_keys.data(), weld_keys.size(), sizeof(WeldKey));
+        auto weld = [&remap, unique_count](auto& attrib) {
+            std::remove_reference_t<decltype(attrib)> welded(unique_count);
+            for (int i = (int)attrib.size() - 1; i >= 0; --i) {
+                welded[remap[i]] = attrib[i];
+            }
+            attrib.swap(welded);
+        };
+        weld(vertices);
+        weld(normals);
+        weld(tangents);
+        weld(bitangents);
+        weld(uvs);
+        weld(colors);
+
+        std::vector<uint32_t> indices;
+        indices.reserve(remap.size() / 4 * 6);
+        for (int i = 0; i < remap.size(); i += 4) {
+            indices.insert(indices.end(), { remap[i], remap[i + 1], remap[i + 2], remap[i + 2], remap[i + 1], remap[i + 3] });
+        }
+        meshBuildLodChain(lod_chain, indices.data(), indices.size(), vertices.data(), vertices.size());
+        LOG("lod", "Torus: " << indices.size() / 3 << " triangles, " << unique_count << " vertices, " << lod_chain->lod_count << " levels");
+
         GLuint vbo_vertices = glxCreateArrayBuffer(sizeof(vertices[0]) * vertices.size(), vertices.data(), GL_STATIC_DRAW);
         GLuint vbo_normals = glxCreateArrayBuffer(sizeof(normals[0]) * normals.size(), normals.data(), GL_STATIC_DRAW);
         GLuint vbo_tangents = glxCreateArrayBuffer(sizeof(tangents[0]) * tangents.size(), tangents.data(), GL_STATIC_DRAW);
         GLuint vbo_bitangents = glxCreateArrayBuffer(sizeof(bitangents[0]) * bitangents.size(), bitangents.data(), GL_STATIC_DRAW);
         GLuint vbo_uvs = glxCreateArrayBuffer(sizeof(uvs[0]) * uvs.size(), uvs.data(), GL_STATIC_DRAW);
         GLuint vbo_colors = glxCreateArrayBuffer(sizeof(colors[0]) * colors.size(), colors.data(), GL_STATIC_DRAW);
+        GLuint ibo = 0;
+        glGenBuffers(1, &ibo);
 
         glGenVertexArrays(1, &vao_lines);
         glBindVertexArray(vao_lines);
@@ -1844,114 +2052,164 @@ GLuint createGlTorus(GLuint progid, int torus_segments, int pipe_segments) {
         glxEnableVertexAttrib(3, vbo_bitangents, 3, GL_FLOAT, GL_FALSE, 0, 0);
         glxEnableVertexAttrib(4, vbo_uvs, 2, GL_FLOAT, GL_FALSE, 0, 0);
         glxEnableVertexAttrib(5, vbo_colors, 4, GL_UNSIGNED_BYTE, GL_TRUE, 0, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ibo);
+        glBufferData(GL_ELEMENT_ARRAY_BUFFER, lod_chain->indices.size() * sizeof(uint32_t), lod_chain->indices.data(), GL_STATIC_DRAW);
         glBindVertexArray(0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
     }
 
     return vao_lines;
 }
 
 struct RendererFrameResources {
-    GLuint fbtex_albedo;
-    GLuint fbtex_normal;
-    GLuint fbtex_worldpos;
-    GLuint fbtex_roughness;
-    GLuint fbtex_metallic;
-    GLuint fbtex_emission;
-    GLuint fbtex_lightness;
-    GLuint fbtex_depth;
-    GLuint fbtex_final;
+    // Transient targets, backed by render graph slots that are only valid after buildFrameGraph()
+    RgResource rt_albedo;
+    RgResource rt_normal;       // Octahedral
+    RgResource rt_material;     // Roughness, metallic, ambient occlusion
+    RgResource rt_lightness;
+    RgResource rt_depth;
+    RgResource rt_backbuffer;
+    // Reduced rate IBL, RG_NO_RESOURCE when the graph runs it at full rate
+    RgResource rt_ibl_irradiance_low;
+    RgResource rt_ibl_specular_low;
+    RgResource rt_ibl_guide_low;    // Linear depth, octahedral normal
+    RgResource rt_ibl_reference;    // Only while comparing against the full rate path
+    RgResource rt_ibl_reduced;
+    int gbuffer_width;
+    int gbuffer_height;
+
+    RenderGraph graph;
+    TexturePool target_pool;
+    int target_shrink_frames = 0;   // Frames the window has been small enough for smaller targets, see updateTargetSize()
+    int graph_key = -1;         // Toggles the graph was last built for, see frameGraphKey()
+
+    // Per frame inputs of the pass callbacks
+    const DrawCmdStream* frame_draw_stream;
+    int frame_render_width;
+    int frame_render_height;
 
     FramebufferDesc fbdGBuffer;
     FramebufferDesc fbdLighting;
-    FramebufferDesc fbdSkybox;
     FramebufferDesc fbdCompose;
     FramebufferDesc fbdPresent;
-
-    GLuint fbo;
-    GLuint fbo_lighting;
-    GLuint fbo_skybox;
-    GLuint fbo_compose;
+    FramebufferDesc fbdIblLowRes;
 
     ShaderProgram* prog_geom;
     ShaderProgram* prog_skybox;
     ShaderProgram* prog_light_direct;
+    ShaderProgram* prog_light_clustered;
     ShaderProgram* prog_environment;
+    ShaderProgram* prog_ibl_lowres;
+    ShaderProgram* prog_ibl_upsample;
+    ShaderProgram* prog_ibl_compare;
     ShaderProgram* prog_compose;
     ShaderProgram* prog_present;
     ShaderProgram* prog_present_depth;
+    ShaderProgram* prog_probe_capture;
 
     GlPbrTextures pbr_textures;
 
     GLuint ub_model;
     GLuint ub_common;
+    GLuint smp_linear_clamp;    // Overrides the pooled targets' GL_NEAREST where a pass upscales
+
+    DrawIndirectQueue indirect_queue;
+    AutoInstancer instancer;
+    ClusteredLights clustered_lights;
+    GpuTimer gpu_frame_timer;
+    IblCompareStats ibl_compare_stats;
+    bool ibl_compare_updated = false;   // ibl_compare_stats.last came back this frame
+
+    ReflectionProbes probes;
+    PrefilterSampleTables probe_prefilter_tables;
+    GLuint ub_probe_common;     // The capturing face's view, written per face
+    GLuint ub_probe_model;
 
     IBLTextureSet ibl_maps;
+    IBLTextureSet ibl_maps_next;    // Fading in over ibl_maps during an environment switch, the same maps otherwise
+    float ibl_fade = .0f;
     
     SamplerSet samplersGeom;
     SamplerSet samplersIBL;
+    SamplerSet samplersLighting;
     SamplerSet samplersCompose;
     SamplerSet samplersSkybox;
+    SamplerSet samplersProbeCapture;
 
     SamplerArray saGeom;
     SamplerArray saIBL;
+    SamplerArray saIBLLowRes;
+    SamplerArray saIBLUpsample;
+    SamplerArray saIBLCompare;
+    SamplerArray saLighting;
     SamplerArray saCompose;
     SamplerArray saSkybox;
+    SamplerArray saProbeCapture;
 };
 
+// World position is reconstructed from depth, see shaders/functions/gbuffer.glsl
+constexpr GLenum GBUFFER_FORMAT_ALBEDO = GL_RGBA8;
+constexpr GLenum GBUFFER_FORMAT_NORMAL = GL_RG16;
+constexpr GLenum GBUFFER_FORMAT_MATERIAL = GL_RGBA8;
+constexpr GLenum GBUFFER_FORMAT_LIGHTNESS = GL_R11F_G11F_B10F;
+constexpr GLenum GBUFFER_FORMAT_DEPTH = GL_DEPTH_COMPONENT24;
+constexpr GLenum FORMAT_IBL_LOW = GL_R11F_G11F_B10F;
+// Linear depth needs more than 11 bits of float
+constexpr GLenum FORMAT_IBL_GUIDE = GL_RGBA16F;
+
+// Probe captures are shaded with the scene's material textures and the global IBL maps
+void makeProbeCaptureSamplerArray(RendererGlobalResources* global_resources, RendererFrameResources* resources) {
+    resources->samplersProbeCapture = resources->samplersGeom;
+    resources->samplersProbeCapture
+        .setSampler("BrdfLut", GL_TEXTURE_2D, global_resources->tex_brdf)
+        .setSampler("CubemapSpecular", GL_TEXTURE_CUBE_MAP, resources->ibl_maps.specular)
+        .setSampler("CubemapSpecularNext", GL_TEXTURE_CUBE_MAP, resources->ibl_maps_next.specular);
+    resources->saProbeCapture = makeSamplerArray(resources->prog_probe_capture, &resources->samplersProbeCapture, 0, &resources->fbdLighting);
+}
+
 void initGlResources(RendererGlobalResources* global_resources, RendererFrameResources* resources, int gbuffer_width, int gbuffer_height) {
     glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 
-    resources->fbtex_albedo = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RGB);
-    resources->fbtex_normal = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RGB);
-    resources->fbtex_worldpos = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RGB32F);
-    resources->fbtex_roughness = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RED);
-    resources->fbtex_metallic = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RED);
-    resources->fbtex_emission = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RGB);
-    resources->fbtex_lightness = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RGB32F);
-    resources->fbtex_depth = createFramebufferDepthTexture2d(gbuffer_width, gbuffer_height);
-    resources->fbtex_final = createFramebufferTexture2d(gbuffer_width, gbuffer_height, GL_RGB);
-
-    resources->fbdGBuffer = { "outAlbedo", "outNormal", "outWorldPos", "outRoughness", "outMetallic", "outEmission", "outLightness" };
+    resources->gbuffer_width = gbuffer_width;
+    resources->gbuffer_height = gbuffer_height;
+
+    // Albedo, normal, position, roughness, metallic, emission, lightness and depth before packing
+    const GLenum gbuffer_formats[] = { GBUFFER_FORMAT_ALBEDO, GBUFFER_FORMAT_NORMAL, GBUFFER_FORMAT_MATERIAL, GBUFFER_FORMAT_LIGHTNESS, GBUFFER_FORMAT_DEPTH };
+    const GLenum unpacked_gbuffer_formats[] = { GL_RGB8, GL_RGB8, GL_RGB32F, GL_R8, GL_R8, GL_RGB8, GL_RGB32F, GL_DEPTH_COMPONENT24 };
+    int gbuffer_bpp = 0;
+    int unpacked_gbuffer_bpp = 0;
+    for (GLenum fmt : gbuffer_formats) {
+        gbuffer_bpp += glxFormatBytesPerPixel(fmt);
+    }
+    for (GLenum fmt : unpacked_gbuffer_formats) {
+        unpacked_gbuffer_bpp += glxFormatBytesPerPixel(fmt);
+    }
+    LOG("renderer", "G-buffer: " << gbuffer_bpp << " bytes per pixel (" << unpacked_gbuffer_bpp << " unpacked), "
+        << gbuffer_bpp * gbuffer_width * gbuffer_height / (1024 * 1024) << "MB at " << gbuffer_width << "x" << gbuffer_height);
+
+    resources->fbdGBuffer = { "outAlbedo", "outNormal", "outMaterial" };
     resources->fbdLighting = { "outLightness" };
-    resources->fbdSkybox = { "outFinal" };
     resources->fbdCompose = { "outFinal" };
     resources->fbdPresent = { "outAlbedo" };
-
-    resources->fbo = glxMakeFramebuffer(
-        &resources->fbdGBuffer,
-        resources->fbtex_depth, 
-        { 
-            resources->fbtex_albedo,
-            resources->fbtex_normal,
-            resources->fbtex_worldpos,
-            resources->fbtex_roughness,
-            resources->fbtex_metallic,
-            resources->fbtex_emission,
-            resources->fbtex_lightness
-        }
-    );
-    resources->fbo_lighting = glxMakeFramebuffer(
-        &resources->fbdLighting, 0, 
-        { resources->fbtex_lightness }
-    );
-    resources->fbo_skybox = glxMakeFramebuffer(
-        &resources->fbdSkybox, resources->fbtex_depth, 
-        { resources->fbtex_final }
-    );
-    resources->fbo_compose = glxMakeFramebuffer(
-        &resources->fbdCompose, 0, 
-        { resources->fbtex_final }
-    );
+    resources->fbdIblLowRes = { "outIrradiance", "outSpecular", "outGuide" };
 
     resources->prog_geom = loadShaderProgram("shaders/geometry.glsl", &resources->fbdGBuffer);
-    resources->prog_skybox = loadShaderProgram("shaders/skybox.glsl", &resources->fbdCompose);
+    resources->prog_skybox = loadShaderProgram("shaders/skybox.glsl", &resources->fbdLighting);
     resources->prog_light_direct = loadShaderProgram("shaders/light_direct.glsl", &resources->fbdLighting);
+    resources->prog_light_clustered = loadShaderProgram("shaders/light_clustered.glsl", &resources->fbdLighting);
     resources->prog_environment = loadShaderProgram("shaders/environment.glsl", &resources->fbdLighting);
+    resources->prog_ibl_lowres = loadShaderProgram("shaders/ibl_lowres.glsl", &resources->fbdIblLowRes);
+    resources->prog_ibl_upsample = loadShaderProgram("shaders/ibl_upsample.glsl", &resources->fbdLighting);
+    resources->prog_ibl_compare = loadShaderProgram("shaders/ibl_compare.glsl", &resources->fbdLighting);
     resources->prog_compose = loadShaderProgram("shaders/compose.glsl", &resources->fbdCompose);
     resources->prog_present = loadShaderProgram("shaders/present.glsl", &resources->fbdPresent);
     resources->prog_present_depth = loadShaderProgram("shaders/present_depth.glsl", &resources->fbdPresent);
+    resources->prog_probe_capture = loadShaderProgram("shaders/probe_capture.glsl", &resources->fbdLighting);
 
+    // Started here rather than with the persistent data, -prefilter_bench returns before this
+    glxInitTextureStream(&global_resources->texture_stream, TextureStreamParams());
     resources->pbr_textures = loadPbrTextures(
+        &global_resources->texture_stream,
         "textures/foil003/albedo.png",
         "textures/foil003/normal.png",
         "textures/foil003/roughness.png",
@@ -1962,53 +2220,442 @@ void initGlResources(RendererGlobalResources* global_resources, RendererFrameRes
 
     glGenBuffers(1, &resources->ub_model);
     glGenBuffers(1, &resources->ub_common);
+    glGenBuffers(1, &resources->ub_probe_common);
+    glGenBuffers(1, &resources->ub_probe_model);
+
+    glGenSamplers(1, &resources->smp_linear_clamp);
+    glSamplerParameteri(resources->smp_linear_clamp, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glSamplerParameteri(resources->smp_linear_clamp, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(resources->smp_linear_clamp, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glSamplerParameteri(resources->smp_linear_clamp, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 
     resources->ibl_maps = loadCubemapHDRI(global_resources, "hdri/belfast_sunset_puresky_1k.hdr");
 
     resources->samplersGeom = SamplerSet()
         .setSampler("Diffuse", GL_TEXTURE_2D, resources->pbr_textures.albedo)
         .setSampler("Normal", GL_TEXTURE_2D, resources->pbr_textures.normal)
-        .setSampler("Roughness", GL_TEXTURE_2D, resources->pbr_textures.roughness)
-        .setSampler("Metallic", GL_TEXTURE_2D, resources->pbr_textures.metallic)
-        .setSampler("AmbientOcclusion", GL_TEXTURE_2D, resources->pbr_textures.ao);
-    resources->samplersIBL = SamplerSet()
-        .setSampler("Diffuse", GL_TEXTURE_2D, resources->fbtex_albedo)
-        .setSampler("WorldPos", GL_TEXTURE_2D, resources->fbtex_worldpos)
-        .setSampler("Normal", GL_TEXTURE_2D, resources->fbtex_normal)
-        .setSampler("Roughness", GL_TEXTURE_2D, resources->fbtex_roughness)
-        .setSampler("Metallic", GL_TEXTURE_2D, resources->fbtex_metallic)
-        .setSampler("BrdfLut", GL_TEXTURE_2D, global_resources->tex_brdf)
-        .setSampler("CubemapIrradiance", GL_TEXTURE_CUBE_MAP, resources->ibl_maps.irradiance)
-        .setSampler("CubemapSpecular", GL_TEXTURE_CUBE_MAP, resources->ibl_maps.specular);
-    resources->samplersCompose = SamplerSet()
-        .setSampler("Diffuse", GL_TEXTURE_2D, resources->fbtex_albedo)
-        .setSampler("Normal", GL_TEXTURE_2D, resources->fbtex_normal)
-        .setSampler("Lightness", GL_TEXTURE_2D, resources->fbtex_lightness)
-        .setSampler("Emission", GL_TEXTURE_2D, resources->fbtex_emission)
-        .setSampler("Depth", GL_TEXTURE_2D, resources->fbtex_depth);
+        .setSampler("Material", GL_TEXTURE_2D, resources->pbr_textures.material);
+    resources->ibl_maps_next = resources->ibl_maps;
     resources->samplersSkybox = SamplerSet()
-        .setSampler("CubemapEnvironment", GL_TEXTURE_CUBE_MAP, resources->ibl_maps.environment);
+        .setSampler("CubemapEnvironment", GL_TEXTURE_CUBE_MAP, resources->ibl_maps.environment)
+        .setSampler("CubemapEnvironmentNext", GL_TEXTURE_CUBE_MAP, resources->ibl_maps_next.environment);
 
     resources->saGeom = makeSamplerArray(resources->prog_geom, &resources->samplersGeom, 0, &resources->fbdGBuffer);
-    resources->saIBL = makeSamplerArray(resources->prog_environment, &resources->samplersIBL, 0, &resources->fbdLighting);
-    resources->saCompose = makeSamplerArray(resources->prog_compose, &resources->samplersCompose, 0, &resources->fbdCompose);
-    resources->saSkybox = makeSamplerArray(resources->prog_skybox, &resources->samplersSkybox, 0, &resources->fbdSkybox);
+    resources->saSkybox = makeSamplerArray(resources->prog_skybox, &resources->samplersSkybox, 0, &resources->fbdLighting);
+    makeProbeCaptureSamplerArray(global_resources, resources);
+
+    glxInitReflectionProbes(&resources->probes, ReflectionProbeParams());
+    glxCreatePrefilterSampleTables(&resources->probe_prefilter_tables, resources->probes.params.prefilter_samples, resources->probes.params.capture_size);
+
+    glxInitDrawIndirectQueue(&resources->indirect_queue);
+    glxInitAutoInstancer(&resources->instancer);
+    glxInitClusteredLights(&resources->clustered_lights);
+    glxInitGpuTimer(&resources->gpu_frame_timer);
+    glxInitIblCompareStats(&resources->ibl_compare_stats);
 
     if (GL_NO_ERROR != glGetError()) {
         assert(false);
     }
 }
 
+gfxm::mat4 makeSpinTransform(float time) {
+    return gfxm::to_mat4(
+        gfxm::angle_axis(time, gfxm::vec3(.0f, 1.f, .0f))
+        * gfxm::angle_axis(time, gfxm::vec3(1.f, .0f, .0f))
+    );
+}
+
+void drawGBufferPass(RendererFrameResources* resources) {
+    const DrawCmdStream* draw_stream = resources->frame_draw_stream;
+    glViewport(0, 0, resources->frame_render_width, resources->frame_render_height);
+    glScissor(0, 0, resources->frame_render_width, resources->frame_render_height);
+
+    if (useMultiDrawIndirect) {
+        buildDrawIndirectQueue(&resources->indirect_queue, draw_stream);
+        glxUploadDrawIndirectQueue(&resources->indirect_queue);
+        // Geometry pass samplers are the same for every command
+        bindSamplers(&resources->saGeom);
+        glxSubmitDrawIndirectQueue(&resources->indirect_queue, draw_stream);
+        return;
+    }
+
+    for (int i = 0; i < draw_stream->order.size(); ++i) {
+        const uint32_t idx = draw_stream->order[i];
+        const DrawCmdState& state = draw_stream->states[idx];
+        const DrawCmdGeometry& geom = draw_stream->geometry[idx];
+
+        PROF_BEGIN("PrepareState");
+        glBindBufferBase(GL_UNIFORM_BUFFER, 1, state.ub_model);
+        glBindVertexArray(geom.vao);
+        bindSamplers(&resources->saGeom);
+        glxBindDrawBindingSet(draw_stream, state.bindings);
+        glUseProgram(state.progid);
+        PROF_END();
+
+        switch (state.type) {
+        case DRAW_CMD_ARRAY:
+            glDrawArrays(state.mode, geom.offset, geom.count);
+            break;
+        case DRAW_CMD_INDEXED:
+            glDrawElements(state.mode, geom.count, GL_UNSIGNED_INT, (const GLvoid*)(uintptr_t)geom.offset);
+            break;
+        case DRAW_CMD_ARRAY_INSTANCED:
+            glDrawArraysInstancedBaseInstance(state.mode, geom.offset, geom.count, geom.instance_count, geom.base_instance);
+            break;
+        case DRAW_CMD_INDEXED_INSTANCED:
+            glDrawElementsInstancedBaseVertexBaseInstance(state.mode, geom.count, GL_UNSIGNED_INT, (const GLvoid*)(uintptr_t)geom.offset, geom.instance_count, 0, geom.base_instance);
+            break;
+        default:
+            assert(false);
+        }
+    }
+}
+
+// Tonemaps lightness straight into the window, scaling the rendered area up to the window size
+void drawComposePass(RendererFrameResources* resources) {
+    const RenderGraph* g = &resources->graph;
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glEnable(GL_SCISSOR_TEST);
+    glViewport(0, 0, s_window_width, s_window_height);
+    glScissor(0, 0, s_window_width, s_window_height);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+    // Lightness is usually rendered below window size, filter the upscale
+    const int lightness_unit = resources->prog_compose->getSamplerIndex("texLightness");
+    glUseProgram(resources->prog_compose->id());
+    bindSamplers(&resources->saCompose);
+    glBindSampler(lightness_unit, resources->smp_linear_clamp);
+    if (!dbgShowGBuffer) {
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+        glBindSampler(lightness_unit, 0);
+        return;
+    }
+
+    // Composed image, albedo, normal on the bottom row, material, lightness, depth above
+    const int cell_width = s_window_width / 3;
+    const int cell_height = s_window_height / 3;
+    glViewport(0, 0, cell_width, cell_height);
+    glScissor(0, 0, cell_width, cell_height);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindSampler(lightness_unit, 0);
+
+    const RgResource grid[] = {
+        RG_NO_RESOURCE, resources->rt_albedo, resources->rt_normal,
+        resources->rt_material, resources->rt_lightness, resources->rt_depth
+    };
+    glUseProgram(resources->prog_present->id());
+    for (int i = 1; i < 6; ++i) {
+        if (grid[i] == resources->rt_depth) {
+            glUseProgram(resources->prog_present_depth->id());
+        }
+        glViewport(cell_width * (i % 3), cell_height * (i / 3), cell_width, cell_height);
+        glScissor(cell_width * (i % 3), cell_height * (i / 3), cell_width, cell_height);
+        glActiveTexture(GL_TEXTURE0);
+        glBindTexture(GL_TEXTURE_2D, rgTexture(g, grid[i]));
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+}
+
+// Everything that changes the shape of the frame graph
+int frameGraphKey() {
+    return (useClusteredLights ? 1 : 0) | (dbgShowGBuffer ? 2 : 0) | (iblQuality << 2) | (dbgIblCompare ? 16 : 0);
+}
+
+bool iblCompareActive() {
+    return dbgIblCompare && iblQuality != IBL_QUALITY_FULL;
+}
+
+void makeIblSamplerArrays(RendererFrameResources* resources) {
+    resources->saIBL = makeSamplerArray(resources->prog_environment, &resources->samplersIBL, 0, &resources->fbdLighting);
+    if (iblQuality != IBL_QUALITY_FULL) {
+        resources->saIBLLowRes = makeSamplerArray(resources->prog_ibl_lowres, &resources->samplersIBL, 0, &resources->fbdIblLowRes);
+        resources->saIBLUpsample = makeSamplerArray(resources->prog_ibl_upsample, &resources->samplersIBL, 0, &resources->fbdLighting);
+    }
+    if (iblCompareActive()) {
+        resources->saIBLCompare = makeSamplerArray(resources->prog_ibl_compare, &resources->samplersIBL, 0, &resources->fbdLighting);
+    }
+}
+
+// The environment changes without a frame graph rebuild during a switch, see env_switch.hpp.
+// maps_next is weighted by fade in the shaders and the SH
+void setIblMaps(RendererFrameResources* resources, const IBLTextureSet& maps, const IBLTextureSet& maps_next, float fade) {
+    resources->ibl_maps = maps;
+    resources->ibl_maps_next = maps_next;
+    resources->ibl_fade = fade;
+    resources->samplersSkybox = SamplerSet()
+        .setSampler("CubemapEnvironment", GL_TEXTURE_CUBE_MAP, maps.environment)
+        .setSampler("CubemapEnvironmentNext", GL_TEXTURE_CUBE_MAP, maps_next.environment);
+    resources->saSkybox = makeSamplerArray(resources->prog_skybox, &resources->samplersSkybox, 0, &resources->fbdLighting);
+    resources->samplersProbeCapture
+        .setSampler("CubemapSpecular", GL_TEXTURE_CUBE_MAP, maps.specular)
+        .setSampler("CubemapSpecularNext", GL_TEXTURE_CUBE_MAP, maps_next.specular);
+    resources->saProbeCapture = makeSamplerArray(resources->prog_probe_capture, &resources->samplersProbeCapture, 0, &resources->fbdLighting);
+    // Otherwise the first draw builds the graph along with the IBL sampler set
+    if (resources->graph_key != -1) {
+        resources->samplersIBL
+            .setSampler("CubemapSpecular", GL_TEXTURE_CUBE_MAP, maps.specular)
+            .setSampler("CubemapSpecularNext", GL_TEXTURE_CUBE_MAP, maps_next.specular);
+        makeIblSamplerArrays(resources);
+    }
+}
+
+// Fullscreen triangle with blending either off or adding into the target
+void beginFullscreenPass(RendererGlobalResources* global_resources, ShaderProgram* prog, bool additive, int width, int height) {
+    glDisable(GL_DEPTH_TEST);
+    if (additive) {
+        glBlendFunc(GL_ONE, GL_ONE);
+        glEnable(GL_BLEND);
+    } else {
+        glDisable(GL_BLEND);
+    }
+    glBindVertexArray(global_resources->vao_screen_triangle);
+    glUseProgram(prog->id());
+    glViewport(0, 0, width, height);
+    glScissor(0, 0, width, height);
+}
+
+// Full rate IBL, or the low rate lookups plus a depth and normal guided upsample.
+// When comparing, both paths run into their own targets and the compare pass adds the reduced one to lightness
+void declareIblPasses(RendererGlobalResources* global_resources, RendererFrameResources* resources) {
+    RenderGraph* g = &resources->graph;
+    const int w = resources->gbuffer_width;
+    const int h = resources->gbuffer_height;
+    const bool compare = iblCompareActive();
+    resources->rt_ibl_irradiance_low = RG_NO_RESOURCE;
+    resources->rt_ibl_specular_low = RG_NO_RESOURCE;
+    resources->rt_ibl_guide_low = RG_NO_RESOURCE;
+    resources->rt_ibl_reference = RG_NO_RESOURCE;
+    resources->rt_ibl_reduced = RG_NO_RESOURCE;
+
+    if (iblQuality == IBL_QUALITY_FULL || compare) {
+        RgResource target = resources->rt_lightness;
+        if (compare) {
+            resources->rt_ibl_reference = rgCreateTexture(g, "IBLReference", RgTextureDesc{ GBUFFER_FORMAT_LIGHTNESS, w, h });
+            target = resources->rt_ibl_reference;
+        }
+        int pass = rgAddPass(g, compare ? "IBLReference" : "IBL", [global_resources, resources, compare]() {
+            beginFullscreenPass(global_resources, resources->prog_environment, !compare, resources->frame_render_width, resources->frame_render_height);
+            bindSamplers(&resources->saIBL);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        });
+        rgRead(g, pass, resources->rt_albedo);
+        rgRead(g, pass, resources->rt_normal);
+        rgRead(g, pass, resources->rt_material);
+        rgRead(g, pass, resources->rt_depth);
+        rgWriteColor(g, pass, target, compare ? RG_WRITE_OVERWRITE : RG_WRITE_ACCUMULATE);
+        if (!compare) {
+            return;
+        }
+    }
+
+    const int downscale = iblDownscale(iblQuality);
+    const int low_w = (w + downscale - 1) / downscale;
+    const int low_h = (h + downscale - 1) / downscale;
+    resources->rt_ibl_irradiance_low = rgCreateTexture(g, "IBLIrradianceLow", RgTextureDesc{ FORMAT_IBL_LOW, low_w, low_h });
+    resources->rt_ibl_specular_low = rgCreateTexture(g, "IBLSpecularLow", RgTextureDesc{ FORMAT_IBL_LOW, low_w, low_h });
+    resources->rt_ibl_guide_low = rgCreateTexture(g, "IBLGuideLow", RgTextureDesc{ FORMAT_IBL_GUIDE, low_w, low_h });
+
+    int pass = rgAddPass(g, "IBLLowRes", [global_resources, resources, downscale]() {
+        const int width = (resources->frame_render_width + downscale - 1) / downscale;
+        const int height = (resources->frame_render_height + downscale - 1) / downscale;
+        beginFullscreenPass(global_resources, resources->prog_ibl_lowres, false, width, height);
+        glxSetUniform1i(resources->prog_ibl_lowres->id(), "downscale", downscale);
+        bindSamplers(&resources->saIBLLowRes);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+    rgRead(g, pass, resources->rt_normal);
+    rgRead(g, pass, resources->rt_material);
+    rgRead(g, pass, resources->rt_depth);
+    rgWriteColor(g, pass, resources->rt_ibl_irradiance_low, RG_WRITE_OVERWRITE);
+    rgWriteColor(g, pass, resources->rt_ibl_specular_low, RG_WRITE_OVERWRITE);
+    rgWriteColor(g, pass, resources->rt_ibl_guide_low, RG_WRITE_OVERWRITE);
+
+    RgResource target = resources->rt_lightness;
+    if (compare) {
+        resources->rt_ibl_reduced = rgCreateTexture(g, "IBLReduced", RgTextureDesc{ GBUFFER_FORMAT_LIGHTNESS, w, h });
+        target = resources->rt_ibl_reduced;
+    }
+    pass = rgAddPass(g, "IBLUpsample", [global_resources, resources, downscale, compare]() {
+        beginFullscreenPass(global_resources, resources->prog_ibl_upsample, !compare, resources->frame_render_width, resources->frame_render_height);
+        glxSetUniform1i(resources->prog_ibl_upsample->id(), "downscale", downscale);
+        glxSetUniform1i(resources->prog_ibl_upsample->id(), "collectStats", compare ? 1 : 0);
+        bindSamplers(&resources->saIBLUpsample);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+    rgRead(g, pass, resources->rt_albedo);
+    rgRead(g, pass, resources->rt_normal);
+    rgRead(g, pass, resources->rt_material);
+    rgRead(g, pass, resources->rt_depth);
+    rgRead(g, pass, resources->rt_ibl_irradiance_low);
+    rgRead(g, pass, resources->rt_ibl_specular_low);
+    rgRead(g, pass, resources->rt_ibl_guide_low);
+    rgWriteColor(g, pass, target, compare ? RG_WRITE_OVERWRITE : RG_WRITE_ACCUMULATE);
+    if (!compare) {
+        return;
+    }
+
+    // Error counters go to resources->ibl_compare_stats, bound by draw()
+    pass = rgAddPass(g, "IBLCompare", [global_resources, resources]() {
+        beginFullscreenPass(global_resources, resources->prog_ibl_compare, true, resources->frame_render_width, resources->frame_render_height);
+        bindSamplers(&resources->saIBLCompare);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+    rgRead(g, pass, resources->rt_ibl_reference);
+    rgRead(g, pass, resources->rt_ibl_reduced);
+    rgRead(g, pass, resources->rt_depth);
+    rgWriteColor(g, pass, resources->rt_lightness, RG_WRITE_ACCUMULATE);
+}
+
+void buildFrameGraph(RendererGlobalResources* global_resources, RendererFrameResources* resources) {
+    PROF_SCOPE_FN();
+    RenderGraph* g = &resources->graph;
+    rgReset(g);
+
+    const int w = resources->gbuffer_width;
+    const int h = resources->gbuffer_height;
+    resources->rt_albedo = rgCreateTexture(g, "Albedo", RgTextureDesc{ GBUFFER_FORMAT_ALBEDO, w, h });
+    resources->rt_normal = rgCreateTexture(g, "Normal", RgTextureDesc{ GBUFFER_FORMAT_NORMAL, w, h });
+    resources->rt_material = rgCreateTexture(g, "Material", RgTextureDesc{ GBUFFER_FORMAT_MATERIAL, w, h });
+    resources->rt_depth = rgCreateTexture(g, "Depth", RgTextureDesc{ GBUFFER_FORMAT_DEPTH, w, h });
+    resources->rt_lightness = rgCreateTexture(g, "Lightness", RgTextureDesc{ GBUFFER_FORMAT_LIGHTNESS, w, h });
+    resources->rt_backbuffer = rgImportBackbuffer(g, "Backbuffer");
+
+    int pass = rgAddPass(g, "GBuffer", [resources]() {
+        drawGBufferPass(resources);
+    });
+    rgWriteColor(g, pass, resources->rt_albedo, RG_WRITE_ACCUMULATE);
+    rgWriteColor(g, pass, resources->rt_normal, RG_WRITE_ACCUMULATE);
+    rgWriteColor(g, pass, resources->rt_material, RG_WRITE_ACCUMULATE);
+    rgWriteDepth(g, pass, resources->rt_depth, RG_WRITE_ACCUMULATE);
+
+    // Both lighting passes add into lightness, the graph clears it before whichever runs first
+    if (useClusteredLights) {
+        // Point and spot lights, binned by clusterLightsBin() before draw()
+        pass = rgAddPass(g, "ClusteredLighting", [global_resources, resources]() {
+            glDisable(GL_DEPTH_TEST);
+            glBlendFunc(GL_ONE, GL_ONE);
+            glEnable(GL_BLEND);
+            glBindVertexArray(global_resources->vao_screen_triangle);
+            glUseProgram(resources->prog_light_clustered->id());
+            glViewport(0, 0, resources->frame_render_width, resources->frame_render_height);
+            glScissor(0, 0, resources->frame_render_width, resources->frame_render_height);
+            glxUploadClusteredLights(&resources->clustered_lights);
+            bindSamplers(&resources->saLighting);
+            glDrawArrays(GL_TRIANGLES, 0, 3);
+        });
+        rgRead(g, pass, resources->rt_albedo);
+        rgRead(g, pass, resources->rt_normal);
+        rgRead(g, pass, resources->rt_material);
+        rgRead(g, pass, resources->rt_depth);
+        rgWriteColor(g, pass, resources->rt_lightness, RG_WRITE_ACCUMULATE);
+    }
+
+    declareIblPasses(global_resources, resources);
+
+    // Fills what the geometry left uncovered with environment radiance, a fullscreen triangle at the far plane
+    // depth tested against the G-buffer depth. Tonemapped by compose along with everything else
+    pass = rgAddPass(g, "Skybox", [global_resources, resources]() {
+        glEnable(GL_DEPTH_TEST);
+        glDisable(GL_STENCIL_TEST);
+        glEnable(GL_CULL_FACE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LEQUAL);
+        glDisable(GL_BLEND);
+        glBindVertexArray(global_resources->vao_screen_triangle);
+        glUseProgram(resources->prog_skybox->id());
+        glViewport(0, 0, resources->frame_render_width, resources->frame_render_height);
+        glScissor(0, 0, resources->frame_render_width, resources->frame_render_height);
+        bindSamplers(&resources->saSkybox);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    });
+    rgWriteColor(g, pass, resources->rt_lightness, RG_WRITE_ACCUMULATE);
+    rgWriteDepth(g, pass, resources->rt_depth, RG_WRITE_ACCUMULATE);
+
+    // Fog, tonemap and gamma written straight to the window, no intermediate final target
+    pass = rgAddPass(g, "Compose", [global_resources, resources]() {
+        glBindVertexArray(global_resources->vao_screen_triangle);
+        drawComposePass(resources);
+    });
+    rgRead(g, pass, resources->rt_lightness);
+    if (dbgShowGBuffer) {
+        rgRead(g, pass, resources->rt_depth);
+        rgRead(g, pass, resources->rt_albedo);
+        rgRead(g, pass, resources->rt_normal);
+        rgRead(g, pass, resources->rt_material);
+    }
+    rgWriteColor(g, pass, resources->rt_backbuffer, RG_WRITE_OVERWRITE);
+
+    if (!rgCompile(g) || !glxRealizeRenderGraph(g, &resources->target_pool)) {
+        LOG_ERR("renderer", "Failed to build the frame graph");
+        assert(false);
+        return;
+    }
+    rgLogMemoryReport(g);
+    texturePoolLogReport(&resources->target_pool);
+
+    // Slot textures may have moved, sampler arrays hold texture names
+    resources->samplersIBL = SamplerSet()
+        .setSampler("Diffuse", GL_TEXTURE_2D, rgTexture(g, resources->rt_albedo))
+        .setSampler("Normal", GL_TEXTURE_2D, rgTexture(g, resources->rt_normal))
+        .setSampler("Material", GL_TEXTURE_2D, rgTexture(g, resources->rt_material))
+        .setSampler("Depth", GL_TEXTURE_2D, rgTexture(g, resources->rt_depth))
+        .setSampler("BrdfLut", GL_TEXTURE_2D, global_resources->tex_brdf)
+        .setSampler("CubemapSpecular", GL_TEXTURE_CUBE_MAP, resources->ibl_maps.specular)
+        .setSampler("CubemapSpecularNext", GL_TEXTURE_CUBE_MAP, resources->ibl_maps_next.specular)
+        .setSampler("ProbeSpecular", GL_TEXTURE_CUBE_MAP_ARRAY, resources->probes.cube_array);
+    const std::pair<const char*, RgResource> ibl_targets[] = {
+        { "IrradianceLow", resources->rt_ibl_irradiance_low },
+        { "SpecularLow", resources->rt_ibl_specular_low },
+        { "GuideLow", resources->rt_ibl_guide_low },
+        { "Reference", resources->rt_ibl_reference },
+        { "Reduced", resources->rt_ibl_reduced }
+    };
+    for (const auto& t : ibl_targets) {
+        if (t.second != RG_NO_RESOURCE) {
+            resources->samplersIBL.setSampler(t.first, GL_TEXTURE_2D, rgTexture(g, t.second));
+        }
+    }
+    resources->samplersLighting = SamplerSet()
+        .setSampler("Diffuse", GL_TEXTURE_2D, rgTexture(g, resources->rt_albedo))
+        .setSampler("Normal", GL_TEXTURE_2D, rgTexture(g, resources->rt_normal))
+        .setSampler("Material", GL_TEXTURE_2D, rgTexture(g, resources->rt_material))
+        .setSampler("Depth", GL_TEXTURE_2D, rgTexture(g, resources->rt_depth));
+    resources->samplersCompose = SamplerSet()
+        .setSampler("Lightness", GL_TEXTURE_2D, rgTexture(g, resources->rt_lightness));
+
+    makeIblSamplerArrays(resources);
+    resources->saLighting = makeSamplerArray(resources->prog_light_clustered, &resources->samplersLighting, 0, &resources->fbdLighting);
+    resources->saCompose = makeSamplerArray(resources->prog_compose, &resources->samplersCompose, 0, &resources->fbdCompose);
+}
+
+// Irradiance is linear in the coefficients, blending them is blending the lighting
+void setIblUniforms(const RendererFrameResources* resources, UniformBufferCommon* ub) {
+    for (int i = 0; i < 9; ++i) {
+        const gfxm::vec4& from = resources->ibl_maps.irradiance_sh.coeffs[i];
+        ub->shIrradiance[i] = from + (resources->ibl_maps_next.irradiance_sh.coeffs[i] - from) * resources->ibl_fade;
+    }
+    ub->iblFade = resources->ibl_fade;
+}
+
 void draw(
     RendererGlobalResources* global_resources,
     RendererFrameResources* resources,
-    DrawCmd* draw_commands,
-    int draw_count,
-    int gbuffer_width, int gbuffer_height,
+    const DrawCmdStream* draw_stream,
+    int render_width, int render_height,
     const gfxm::mat4& view, const gfxm::mat4& projection, const gfxm::vec3& camPos,
     float znear, float zfar, float time
 ) {
-    PROF_BEGIN("PrepareStateAndClear");
+    if (resources->graph_key != frameGraphKey()) {
+        buildFrameGraph(global_resources, resources);
+        resources->graph_key = frameGraphKey();
+    }
+    const int gbuffer_width = resources->gbuffer_width;
+    const int gbuffer_height = resources->gbuffer_height;
+
+    glxGpuTimerBegin(&resources->gpu_frame_timer);
+
+    PROF_BEGIN("PrepareState");
     // #6b489f
     //glClearColor(0x2b / 255.f, 0x18 / 255.f, 0x3f / 255.f, 1.f);
     glClearColor(0, 0, 0, 0);
@@ -2030,207 +2677,690 @@ void draw(
     ub_common_data.matProjection = projection;
     ub_common_data.cameraPosition = camPos;
     ub_common_data.time = time;
-    ub_common_data.viewportSize = gfxm::vec2(s_window_width, s_window_height);
+    ub_common_data.viewportSize = gfxm::vec2(render_width, render_height);
     ub_common_data.zNear = znear;
     ub_common_data.zFar = zfar;
+    // Every pass up to compose renders into the lower left render_width x render_height of the targets
+    ub_common_data.uvScale = gfxm::vec2(render_width / (float)gbuffer_width, render_height / (float)gbuffer_height);
+    ub_common_data.uvMax = gfxm::vec2((render_width - .5f) / gbuffer_width, (render_height - .5f) / gbuffer_height);
+    ub_common_data.matProjectionInverse = gfxm::inverse(projection);
+    ub_common_data.matViewInverse = gfxm::inverse(view);
+    setIblUniforms(resources, &ub_common_data);
     glBindBuffer(GL_UNIFORM_BUFFER, resources->ub_common);
     glBufferData(GL_UNIFORM_BUFFER, sizeof(ub_common_data), &ub_common_data, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
         
     //ub_model_data.matModel = gfxm::mat4(1.0f);
-    ub_model_data.matModel = gfxm::to_mat4(
-        gfxm::angle_axis(time, gfxm::vec3(.0f, 1.f, .0f))
-        * gfxm::angle_axis(time, gfxm::vec3(1.f, .0f, .0f))
-    );
+    ub_model_data.matModel = makeSpinTransform(time);
     glBindBuffer(GL_UNIFORM_BUFFER, resources->ub_model);
     glBufferData(GL_UNIFORM_BUFFER, sizeof(ub_model_data), &ub_model_data, GL_DYNAMIC_DRAW);
     glBindBuffer(GL_UNIFORM_BUFFER, 0);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, resources->fbo);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, resources->ub_common);
+    glxUploadAutoInstancer(&resources->instancer);
+    reflectionProbesBin(&resources->probes, view, projection);
+    glxUploadReflectionProbes(&resources->probes);
+    PROF_END();
 
-    glViewport(0, 0, gbuffer_width, gbuffer_height);
-    glScissor(0, 0, gbuffer_width, gbuffer_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    resources->frame_draw_stream = draw_stream;
+    resources->frame_render_width = render_width;
+    resources->frame_render_height = render_height;
+    resources->ibl_compare_updated = iblCompareActive() && glxIblCompareStatsBegin(&resources->ibl_compare_stats);
+    glxExecuteRenderGraph(&resources->graph, render_width, render_height);
+    glxTexturePoolEndFrame(&resources->target_pool);
 
-    glBindBufferBase(GL_UNIFORM_BUFFER, 0, resources->ub_common);
+    glxGpuTimerEnd(&resources->gpu_frame_timer);
+    PROF_BEGIN("Present");
+    SwapBuffers(s_hdc);
     PROF_END();
+}
 
-    PROF_BEGIN("DrawCommands");
-    for (int i = 0; i < draw_count; ++i) {
-        const auto& cmd = draw_commands[i];
+// Targets are allocated in steps so dragging a window edge reallocates now and then rather than every frame.
+// Growing happens right away, shrinking waits until the window has stayed smaller for a while.
+// The old textures go back to the pool and are deleted a few frames later, see TexturePool
+constexpr int TARGET_SIZE_STEP = 256;
+constexpr int TARGET_SHRINK_DELAY_FRAMES = 60;
 
-        PROF_BEGIN("PrepareState");
-        glBindBufferBase(GL_UNIFORM_BUFFER, 1, cmd.ub_model);
-        glBindVertexArray(cmd.vao);
-        bindSamplers(&resources->saGeom);
-        glUseProgram(cmd.progid);
-        PROF_END();
+int targetSizeFor(int window_size) {
+    return std::max(TARGET_SIZE_STEP, (window_size + TARGET_SIZE_STEP - 1) / TARGET_SIZE_STEP * TARGET_SIZE_STEP);
+}
 
-        switch (cmd.type) {
-        case DRAW_CMD_ARRAY:
-            glDrawArrays(cmd.mode, cmd.offset, cmd.count);
-            break;
-        case DRAW_CMD_INDEXED:
-            glDrawElements(cmd.mode, cmd.count, GL_UNSIGNED_INT, (const GLvoid*)cmd.offset);
-            break;
-        case DRAW_CMD_ARRAY_INSTANCED:
-            glDrawArraysInstanced(cmd.mode, cmd.offset, cmd.count, cmd.instance_count);
-            break;
-        case DRAW_CMD_INDEXED_INSTANCED:
-            glDrawElementsInstanced(cmd.mode, cmd.count, GL_UNSIGNED_INT, (const GLvoid*)cmd.offset, cmd.instance_count);
-            break;
-        default:
-            assert(false);
-        }
+// Returns true if the targets change size, the frame graph is rebuilt by the next draw()
+bool updateTargetSize(RendererFrameResources* resources, int window_width, int window_height) {
+    const int w = targetSizeFor(window_width);
+    const int h = targetSizeFor(window_height);
+    if (w == resources->gbuffer_width && h == resources->gbuffer_height) {
+        resources->target_shrink_frames = 0;
+        return false;
     }
-    PROF_END();
+    const bool grow = w > resources->gbuffer_width || h > resources->gbuffer_height;
+    if (!grow && ++resources->target_shrink_frames < TARGET_SHRINK_DELAY_FRAMES) {
+        return false;
+    }
+    LOG("renderer", "Render targets " << resources->gbuffer_width << "x" << resources->gbuffer_height << " -> " << w << "x" << h);
+    resources->target_shrink_frames = 0;
+    resources->gbuffer_width = w;
+    resources->gbuffer_height = h;
+    resources->graph_key = -1;
+    return true;
+}
 
-    // Clear the lighting buffer
-    glBindFramebuffer(GL_FRAMEBUFFER, resources->fbo_lighting);
-    glViewport(0, 0, gbuffer_width, gbuffer_height);
-    glScissor(0, 0, gbuffer_width, gbuffer_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+// Rings of point lights around the scene with a few spots pointing at the center
+void makeSceneLights(std::vector<Light>& lights, int count) {
+    lights.resize(count);
+    for (int i = 0; i < count; ++i) {
+        Light& l = lights[i];
+        float hue = i / (float)count * 6.0f;
+        l.type = (i % 8 == 0) ? LIGHT_SPOT : LIGHT_POINT;
+        l.color = gfxm::vec3(
+            gfxm::clamp(fabsf(hue - 3.0f) - 1.0f, .0f, 1.0f),
+            gfxm::clamp(2.0f - fabsf(hue - 2.0f), .0f, 1.0f),
+            gfxm::clamp(2.0f - fabsf(hue - 4.0f), .0f, 1.0f)
+        );
+        l.intensity = 2.0f;
+        l.radius = 1.0f + (i % 4) * .5f;
+        l.inner_angle = gfxm::radian(15.f);
+        l.outer_angle = gfxm::radian(30.f);
+    }
+}
 
-    /*
-    PROF_BEGIN("Lighting");
-    glBlendFunc(GL_ONE, GL_ONE);
-    glEnable(GL_BLEND);
-    glBindVertexArray(persistent_data.vao_screen_triangle);
-    glUseProgram(prog_light_direct->id());
-    glBindFramebuffer(GL_FRAMEBUFFER, fbo_lighting);
-    glViewport(0, 0, gbuffer_width, gbuffer_height);
-    glScissor(0, 0, gbuffer_width, gbuffer_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, fbtex_albedo);
-    glActiveTexture(GL_TEXTURE0 + 2);
-    glBindTexture(GL_TEXTURE_2D, fbtex_worldpos);
-    glActiveTexture(GL_TEXTURE0 + 1);
-    glBindTexture(GL_TEXTURE_2D, fbtex_normal);
-    glActiveTexture(GL_TEXTURE0 + 3);
-    glBindTexture(GL_TEXTURE_2D, fbtex_roughness);
-    glActiveTexture(GL_TEXTURE0 + 4);
-    glBindTexture(GL_TEXTURE_2D, fbtex_metallic);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-    PROF_END();*/
+void animateSceneLights(std::vector<Light>& lights, float time) {
+    PROF_SCOPE_FN();
+    const int count = lights.size();
+    for (int i = 0; i < count; ++i) {
+        Light& l = lights[i];
+        float t = i / (float)count;
+        float ring = 2.5f + (i % 5) * .75f;
+        float angle = t * 6.2831853f * 7.0f + time * (.2f + (i % 3) * .1f);
+        l.position = gfxm::vec3(cosf(angle) * ring, sinf(t * 6.2831853f * 3.0f + time) * 1.5f, sinf(angle) * ring);
+        l.direction = gfxm::normalize(-l.position);
+    }
+}
 
-    // IBL lighting
-    glBlendFunc(GL_ONE, GL_ONE);
-    glEnable(GL_BLEND);
-    glBindVertexArray(global_resources->vao_screen_triangle);
-    glUseProgram(resources->prog_environment->id());
-    glBindFramebuffer(GL_FRAMEBUFFER, resources->fbo_lighting);
-    glViewport(0, 0, gbuffer_width, gbuffer_height);
-    glScissor(0, 0, gbuffer_width, gbuffer_height);
-    bindSamplers(&resources->saIBL);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-        
-    PROF_BEGIN("Compose");
-    glDisable(GL_DEPTH_TEST);
-    glDisable(GL_BLEND);
-    glDisable(GL_SCISSOR_TEST);
-    glBindVertexArray(global_resources->vao_screen_triangle);
-    glUseProgram(resources->prog_compose->id());
-    glBindFramebuffer(GL_FRAMEBUFFER, resources->fbo_compose);
-    glViewport(0, 0, gbuffer_width, gbuffer_height);
-    glScissor(0, 0, gbuffer_width, gbuffer_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-    bindSamplers(&resources->saCompose);
-    glDrawArrays(GL_TRIANGLES, 0, 3);
-    PROF_END();
+struct SceneObject {
+    DRAW_CMD_TYPE type;
+    GLenum mode;
+    GLuint vao;
+    GLuint progid;
+    GLuint ub_model;
+    GLuint count;
+    gfxm::aabb bounds; // World space, covers the spin draw() applies through ub_model
+    const MeshLodChain* lod_chain; // Indexed objects only, replaces offset and count with the selected level's range
+};
 
-    // Skybox
-    glEnable(GL_DEPTH_TEST);
+constexpr int MAX_RECORDED_COMMANDS_PER_THREAD = 16384;
+constexpr int SCENE_RECORD_CHUNK_SIZE = 256;
+
+void recordSceneDrawCommands(const SceneObject* objects, const int32_t* lods, const uint32_t* visible, int visible_count, DrawCmdRecorder* recorders, int recorder_count, DrawCmdStream* out_stream) {
+    PROF_SCOPE_FN();
+
+    assert(recorder_count >= getThreadPool()->threadCount());
+    for (int i = 0; i < recorder_count; ++i) {
+        drawCmdRecorderBegin(&recorders[i]);
+    }
+
+    const int chunk_count = (visible_count + SCENE_RECORD_CHUNK_SIZE - 1) / SCENE_RECORD_CHUNK_SIZE;
+    getThreadPool()->parallelFor(chunk_count, [=](int chunk, int worker) {
+        DrawCmdRecorder* rec = &recorders[worker];
+        drawCmdRecorderBeginChunk(rec, chunk);
+        const int begin = chunk * SCENE_RECORD_CHUNK_SIZE;
+        const int end = std::min(begin + SCENE_RECORD_CHUNK_SIZE, visible_count);
+        for (int i = begin; i < end; ++i) {
+            const SceneObject& o = objects[visible[i]];
+            GLuint offset = 0;
+            GLuint count = o.count;
+            if (o.lod_chain) {
+                const MeshLod& lod = o.lod_chain->lods[lods[visible[i]]];
+                offset = lod.index_offset * sizeof(uint32_t);
+                count = lod.index_count;
+            }
+            drawCmdRecorderPush(rec, o.type, o.mode, o.vao, o.progid, o.ub_model, offset, count, 0, 0, visible[i]);
+        }
+    });
+
+    drawCmdStreamClear(out_stream);
+    drawCmdStreamMerge(out_stream, recorders, recorder_count);
+    drawCmdStreamSort(out_stream);
+}
+
+constexpr float PROBE_CAPTURE_ZNEAR = .05f;
+constexpr float PROBE_CAPTURE_ZFAR = 100.f;
+
+// One face of the scene from the probe into capture_cube, forward shaded and skybox behind.
+// World z is mirrored so the faces come out in the flipped convention the environment is baked in,
+// which turns the winding around as well
+void captureProbeFace(RendererGlobalResources* global_resources, RendererFrameResources* resources, const SceneObject* objects, int object_count, const ReflectionProbe& probe, int face, float time) {
+    const ReflectionProbes& rp = resources->probes;
+    const int size = rp.params.capture_size;
+
+    UniformBufferCommon ub_common_data = {};
+    ub_common_data.matProjection = gfxm::perspective(gfxm::radian(90.0f), 1.0f, PROBE_CAPTURE_ZNEAR, PROBE_CAPTURE_ZFAR);
+    ub_common_data.matView = cubeFaceView(face)
+        * gfxm::scale(gfxm::mat4(1.0f), gfxm::vec3(1.f, 1.f, -1.f))
+        * gfxm::translate(gfxm::mat4(1.0f), -probe.position);
+    ub_common_data.cameraPosition = probe.position;
+    ub_common_data.time = time;
+    ub_common_data.viewportSize = gfxm::vec2(size, size);
+    ub_common_data.zNear = PROBE_CAPTURE_ZNEAR;
+    ub_common_data.zFar = PROBE_CAPTURE_ZFAR;
+    ub_common_data.uvScale = gfxm::vec2(1.f, 1.f);
+    ub_common_data.uvMax = gfxm::vec2((size - .5f) / size, (size - .5f) / size);
+    ub_common_data.matProjectionInverse = gfxm::inverse(ub_common_data.matProjection);
+    ub_common_data.matViewInverse = gfxm::inverse(ub_common_data.matView);
+    setIblUniforms(resources, &ub_common_data);
+    glBindBuffer(GL_UNIFORM_BUFFER, resources->ub_probe_common);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ub_common_data), &ub_common_data, GL_STREAM_DRAW);
+    // draw() writes the scene's ub_model later in the frame, the same spin goes into the capture's own
+    UniformBufferModel ub_model_data;
+    ub_model_data.matModel = makeSpinTransform(time);
+    glBindBuffer(GL_UNIFORM_BUFFER, resources->ub_probe_model);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(ub_model_data), &ub_model_data, GL_STREAM_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 0, resources->ub_probe_common);
+    glBindBufferBase(GL_UNIFORM_BUFFER, 1, resources->ub_probe_model);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, rp.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_CUBE_MAP_POSITIVE_X + face, rp.capture_cube, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, rp.capture_depth);
+    GLenum draw_buffers[] = {
+        GL_COLOR_ATTACHMENT0
+    };
+    glDrawBuffers(1, draw_buffers);
+    glViewport(0, 0, size, size);
+    glDisable(GL_SCISSOR_TEST);
     glDisable(GL_STENCIL_TEST);
+    glDisable(GL_BLEND);
+    glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
     glDepthMask(GL_TRUE);
     glDepthFunc(GL_LEQUAL);
-    glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
-    glBindVertexArray(global_resources->vao_inverted_cube);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    glFrontFace(GL_CW);
+    glUseProgram(resources->prog_probe_capture->id());
+    bindSamplers(&resources->saProbeCapture);
+    for (int i = 0; i < object_count; ++i) {
+        const SceneObject& o = objects[i];
+        glBindVertexArray(o.vao);
+        if (o.type == DRAW_CMD_ARRAY) {
+            glDrawArrays(o.mode, 0, o.count);
+            continue;
+        }
+        GLuint offset = 0;
+        GLuint count = o.count;
+        // A face this small can't resolve more than the coarsest level
+        if (o.lod_chain && o.lod_chain->lod_count > 0) {
+            const MeshLod& lod = o.lod_chain->lods[o.lod_chain->lod_count - 1];
+            offset = lod.index_offset * sizeof(uint32_t);
+            count = lod.index_count;
+        }
+        glDrawElements(o.mode, count, GL_UNSIGNED_INT, (const GLvoid*)(uintptr_t)offset);
+    }
+
+    // Clip space triangle, the mirror doesn't apply to it
+    glFrontFace(GL_CCW);
+    glBindVertexArray(global_resources->vao_screen_triangle);
     glUseProgram(resources->prog_skybox->id());
-    glBindFramebuffer(GL_FRAMEBUFFER, resources->fbo_skybox);
-    glViewport(0, 0, gbuffer_width, gbuffer_height);
-    glScissor(0, 0, gbuffer_width, gbuffer_height);
     bindSamplers(&resources->saSkybox);
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
 
-    // Present
-    glBindVertexArray(global_resources->vao_screen_triangle);
-    glUseProgram(resources->prog_present->id());
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
-    glViewport(0, 0, s_window_width, s_window_height);
-    glScissor(0, 0, s_window_width, s_window_height);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
-        
-    if (!dbgShowGBuffer) {
-        glViewport(0, 0, s_window_width, s_window_height);
-        glScissor(0, 0, s_window_width, s_window_height);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_final);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
-    } else {
-        glViewport(0, 0, s_window_width / 3, s_window_height / 3);
-        glScissor(0, 0, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_final);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+    glUseProgram(0);
+    glBindVertexArray(0);
+}
 
-        glViewport(s_window_width / 3, 0, s_window_width / 3, s_window_height / 3);
-        glScissor(s_window_width / 3, 0, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_albedo);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+// All six faces captured, mips for the prefilter's lod lookups and then every level into the probe's array layers
+void prefilterProbe(RendererGlobalResources* global_resources, RendererFrameResources* resources, int probe) {
+    const ReflectionProbes& rp = resources->probes;
+    const CubeBakeResources& cube = global_resources->cube_bake;
+    glBindTexture(GL_TEXTURE_CUBE_MAP, rp.capture_cube);
+    glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
-        glViewport(s_window_width / 3 * 2, 0, s_window_width / 3, s_window_height / 3);
-        glScissor(s_window_width / 3 * 2, 0, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_normal);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+    beginCubeBakePass(rp.fbo, cube.prog_prefilter);
+    // Left over from the capture, smaller levels would be depth tested against it
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, 0);
+    for (int mip = 0; mip < SPECULAR_MIP_COUNT; ++mip) {
+        prefilterSetupLevel(cube.prog_prefilter, resources->probe_prefilter_tables, rp.capture_cube, rp.params.size, mip);
+        glxDrawCubeArrayFaces(cube, rp.cube_array, probe, mip);
+    }
+    endCubeBakePass();
+}
 
-        glViewport(0, s_window_height / 3, s_window_width / 3, s_window_height / 3);
-        glScissor(0, s_window_height / 3, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_worldpos);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+// Once per frame before draw(), the bounded share of probe captures. draw() rebinds the uniform buffers
+void updateReflectionProbes(RendererGlobalResources* global_resources, RendererFrameResources* resources, const SceneObject* objects, int object_count, float time) {
+    ReflectionProbes* rp = &resources->probes;
+    glxUpdateReflectionProbes(rp, [=](const ReflectionProbeStep& step) {
+        if (step.kind == PROBE_STEP_CAPTURE_FACE) {
+            captureProbeFace(global_resources, resources, objects, object_count, rp->probes[step.probe], step.face, time);
+        } else {
+            prefilterProbe(global_resources, resources, step.probe);
+        }
+    });
+}
 
-        glViewport(s_window_width / 3, s_window_height / 3, s_window_width / 3, s_window_height / 3);
-        glScissor(s_window_width / 3, s_window_height / 3, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_roughness);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+// A probe over the whole scene and four tighter ones inside it, the tighter ones win where they overlap it
+void makeSceneProbes(ReflectionProbes* rp) {
+    reflectionProbeAdd(rp, gfxm::vec3(.0f, .0f, .0f), gfxm::aabb(gfxm::vec3(-2.25f, -2.25f, -2.25f), gfxm::vec3(2.25f, 2.25f, 2.25f)), .5f);
+    const float offsets[4][2] = { { 1.f, 1.f }, { -1.f, 1.f }, { 1.f, -1.f }, { -1.f, -1.f } };
+    for (const auto& o : offsets) {
+        const gfxm::vec3 p(o[0], .0f, o[1]);
+        reflectionProbeAdd(rp, p, gfxm::aabb(p - gfxm::vec3(1.25f, 1.25f, 1.25f), p + gfxm::vec3(1.25f, 1.25f, 1.25f)), .25f);
+    }
+}
 
-        glViewport(s_window_width / 3 * 2, s_window_height / 3, s_window_width / 3, s_window_height / 3);
-        glScissor(s_window_width / 3 * 2, s_window_height / 3, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_metallic);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+// Rows of the source image per upload slice
+constexpr int ENV_SWITCH_UPLOAD_ROWS = 64;
 
-        glViewport(0, s_window_height / 3 * 2, s_window_width / 3, s_window_height / 3);
-        glScissor(0, s_window_height / 3 * 2, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_emission);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+// Objects the bake slices of one switch share, the last slice deletes them
+struct EnvSwitchScratch {
+    GLuint tex_hdri = 0;
+    GLuint fbo = 0;
+    PrefilterSampleTables tables;
+};
 
-        glViewport(s_window_width / 3, s_window_height / 3 * 2, s_window_width / 3, s_window_height / 3);
-        glScissor(s_window_width / 3, s_window_height / 3 * 2, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_lightness);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+// Turns the worker's source into slices, the same steps as loadCubemapHDRI() broken up per band, face and mip.
+// Switches are not written to the IBL cache, reading the maps back would stall, iblbake fills it offline
+void planEnvSwitch(RendererGlobalResources* prd, EnvSwitch* s) {
+    const IblBakeParams& params = s->bake_params;
+    const CubeBakeResources& cube = prd->cube_bake;
+    if (!s->source.cache_file.empty()) {
+        s->maps = glxIblCacheCreateTextures(params);
+        s->maps.irradiance_sh = s->source.irradiance_sh;
+        for (const IblCacheImage& img : iblCacheLayout(params)) {
+            // The LUT is the same for every environment
+            if (img.map == IBL_CACHE_BRDF_LUT) {
+                continue;
+            }
+            s->slices.push_back(EnvSlice{ ENV_SLICE_UPLOAD, (double)img.width * img.height, [s, img]() {
+                glxIblCacheUploadImage(s->maps, 0, img, s->source.cache_file.data() + img.offset);
+            } });
+        }
+        return;
+    }
 
-        glUseProgram(resources->prog_present_depth->id());
-        glViewport(s_window_width / 3 * 2, s_window_height / 3 * 2, s_window_width / 3, s_window_height / 3);
-        glScissor(s_window_width / 3 * 2, s_window_height / 3 * 2, s_window_width / 3, s_window_height / 3);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, resources->fbtex_depth);
-        glDrawArrays(GL_TRIANGLES, 0, 3);
+    const int width = s->source.width;
+    const int height = s->source.height;
+    auto scratch = std::make_shared<EnvSwitchScratch>();
+    glGenTextures(1, &scratch->tex_hdri);
+    glBindTexture(GL_TEXTURE_2D, scratch->tex_hdri);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB16F, width, height, 0, GL_RGB, GL_FLOAT, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glGenFramebuffers(1, &scratch->fbo);
+    glxCreatePrefilterSampleTables(&scratch->tables, params.prefilter_samples, params.environment_size);
+    s->maps.environment = createCubeMap(params.environment_size, params.environment_size, GL_RGB16F);
+    s->maps.specular = createSpecularCubeMap(params.specular_size, params.specular_size, GL_RGB16F);
+    s->maps.irradiance_sh = s->source.irradiance_sh;
+
+    for (int y = 0; y < height; y += ENV_SWITCH_UPLOAD_ROWS) {
+        const int rows = std::min(ENV_SWITCH_UPLOAD_ROWS, height - y);
+        s->slices.push_back(EnvSlice{ ENV_SLICE_UPLOAD, (double)width * rows, [s, scratch, y, rows]() {
+            glBindTexture(GL_TEXTURE_2D, scratch->tex_hdri);
+            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, s->source.width, rows, GL_RGB, GL_FLOAT, &s->source.rgb[(size_t)y * s->source.width * 3]);
+            glBindTexture(GL_TEXTURE_2D, 0);
+        } });
+    }
+    s->slices.push_back(EnvSlice{ ENV_SLICE_DRAW, (double)width * height, [scratch]() {
+        glBindTexture(GL_TEXTURE_2D, scratch->tex_hdri);
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    } });
+
+    const int env_size = params.environment_size;
+    for (int face = 0; face < 6; ++face) {
+        s->slices.push_back(EnvSlice{ ENV_SLICE_DRAW, (double)env_size * env_size, [s, scratch, &cube, env_size, face]() {
+            beginCubeBakePass(scratch->fbo, cube.prog_hdri_to_cubemap);
+            glActiveTexture(GL_TEXTURE0 + 12);
+            glBindTexture(GL_TEXTURE_2D, scratch->tex_hdri);
+            glViewport(0, 0, env_size, env_size);
+            glxDrawCubeFaces(cube, s->maps.environment, 0, face, 1);
+            endCubeBakePass();
+        } });
+    }
+    s->slices.push_back(EnvSlice{ ENV_SLICE_DRAW, (double)env_size * env_size * 2, [s]() {
+        glBindTexture(GL_TEXTURE_CUBE_MAP, s->maps.environment);
+        glGenerateMipmap(GL_TEXTURE_CUBE_MAP);
+        glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+    } });
+
+    const int specular_size = params.specular_size;
+    for (int mip = 0; mip < SPECULAR_MIP_COUNT; ++mip) {
+        const int mip_size = std::max(1, specular_size >> mip);
+        const int samples = scratch->tables.ssbo ? scratch->tables.counts[mip] : PREFILTER_REFERENCE_SAMPLES;
+        for (int face = 0; face < 6; ++face) {
+            s->slices.push_back(EnvSlice{ ENV_SLICE_DRAW, (double)mip_size * mip_size * samples, [s, scratch, &cube, specular_size, mip, face]() {
+                beginCubeBakePass(scratch->fbo, cube.prog_prefilter);
+                prefilterSetupLevel(cube.prog_prefilter, scratch->tables, s->maps.environment, specular_size, mip);
+                glxDrawCubeFaces(cube, s->maps.specular, mip, face, 1);
+                endCubeBakePass();
+            } });
+        }
+    }
+    s->slices.push_back(EnvSlice{ ENV_SLICE_DRAW, 1.0, [scratch]() {
+        glDeleteTextures(1, &scratch->tex_hdri);
+        glDeleteFramebuffers(1, &scratch->fbo);
+        glxDestroyPrefilterSampleTables(&scratch->tables);
+    } });
+}
+
+void logEnvSwitchStats(const EnvSwitch* s) {
+    const EnvSwitchStats& st = s->stats;
+    LOG("renderer", "Environment " << s->path << (st.from_cache ? " from cache" : " baked") << " in " << st.total_ms << "ms including a "
+        << s->params.fade_ms << "ms fade, load " << st.load_ms << "ms on the worker, " << st.slices << " slices over " << st.frames
+        << " frames, per frame up to " << st.max_frame_cpu_ms << "ms cpu / " << st.max_frame_gpu_ms << "ms gpu against a "
+        << s->params.budget_ms << "ms budget, " << st.cpu_frames_over_budget << " cpu / " << st.gpu_frames_over_budget << " gpu over");
+}
+
+// Once per frame before draw(), swaps the maps into the frame resources as the switch progresses
+ENV_SWITCH_EVENT updateEnvSwitch(RendererGlobalResources* prd, RendererFrameResources* resources, EnvSwitch* s, double dt_ms) {
+    const ENV_SWITCH_EVENT event = glxEnvSwitchUpdate(s, dt_ms);
+    switch (event) {
+    case ENV_SWITCH_EVENT_SOURCE_READY:
+        planEnvSwitch(prd, s);
+        break;
+    case ENV_SWITCH_EVENT_BAKED:
+        setIblMaps(resources, resources->ibl_maps, s->maps, s->fade);
+        break;
+    case ENV_SWITCH_EVENT_FADED: {
+        // Deletion waits for draws still in flight, GL keeps the storage alive until they are done
+        const IBLTextureSet old_maps = resources->ibl_maps;
+        setIblMaps(resources, s->maps, s->maps, .0f);
+        glDeleteTextures(1, &old_maps.environment);
+        glDeleteTextures(1, &old_maps.specular);
+        // Captures are lit by the environment
+        reflectionProbesMarkAllDirty(&resources->probes);
+        logEnvSwitchStats(s);
+        break;
+    }
+    default:
+        break;
+    }
+    if (s->state == ENV_SWITCH_FADING) {
+        resources->ibl_fade = s->fade;
+    }
+    return event;
+}
+
+// Frames timed before the first switch, the first few are dropped while startup settles
+constexpr int ENV_SWITCH_BENCH_WARMUP_FRAMES = 30;
+constexpr int ENV_SWITCH_BENCH_BASELINE_FRAMES = 120;
+
+// One row of the table logged at the end of -env_switch_bench
+struct EnvSwitchBenchResult {
+    std::string path;
+    EnvSwitchStats stats;
+    double slowest_frame_ms;
+};
+
+// -env_switch_bench switches through every hdri/*.hdr in turn, logs each switch's own per frame cost and
+// the slowest whole frame during it against the median frame before the first switch, then quits
+struct EnvSwitchBench {
+    bool active = false;
+    int frame = 0;
+    std::vector<std::string> paths;
+    int next_path = 0;
+    std::vector<double> baseline_ms;
+    double baseline_median_ms = .0;
+    double slowest_frame_ms = .0;       // During the current switch
+    double worst_spike_ms = .0;         // Over all switches, against the median
+    std::vector<EnvSwitchBenchResult> results;
+};
+
+void envSwitchBenchStart(EnvSwitchBench* bench) {
+    bench->active = true;
+    bench->paths = fsFindAllFiles("hdri", "*.hdr");
+    LOG("renderer", "Switching through " << bench->paths.size() << " environments");
+}
+
+// frame_ms is the whole previous loop iteration. Returns false once every environment has faded in
+bool envSwitchBenchStep(EnvSwitchBench* bench, EnvSwitch* s, ENV_SWITCH_EVENT event, double frame_ms, const IblBakeParams& params) {
+    const int frame = bench->frame++;
+    if (frame < ENV_SWITCH_BENCH_WARMUP_FRAMES) {
+        return true;
+    }
+    if (frame < ENV_SWITCH_BENCH_WARMUP_FRAMES + ENV_SWITCH_BENCH_BASELINE_FRAMES) {
+        bench->baseline_ms.push_back(frame_ms);
+        return true;
+    }
+    if (bench->baseline_median_ms == .0) {
+        std::vector<double> sorted = bench->baseline_ms;
+        std::sort(sorted.begin(), sorted.end());
+        bench->baseline_median_ms = std::max(1e-3, sorted[sorted.size() / 2]);
+        LOG("renderer", "Switch bench: median frame " << bench->baseline_median_ms << "ms before switching");
+    }
+    if (s->state != ENV_SWITCH_IDLE || event != ENV_SWITCH_EVENT_NONE) {
+        bench->slowest_frame_ms = std::max(bench->slowest_frame_ms, frame_ms);
+    }
+    if (event == ENV_SWITCH_EVENT_FADED) {
+        const double spike_ms = bench->slowest_frame_ms - bench->baseline_median_ms;
+        LOG("renderer", "Switch bench: slowest frame " << bench->slowest_frame_ms << "ms, " << spike_ms << "ms over the median");
+        bench->worst_spike_ms = std::max(bench->worst_spike_ms, spike_ms);
+        bench->results.push_back(EnvSwitchBenchResult{ s->path, s->stats, bench->slowest_frame_ms });
+    }
+    if (s->state != ENV_SWITCH_IDLE) {
+        return true;
+    }
+    if (bench->next_path == (int)bench->paths.size()) {
+        // Every switch again in one place, the per switch lines above are interleaved with the rest of the log
+        double worst_cpu_ms = .0;
+        double worst_gpu_ms = .0;
+        int cpu_frames_over_budget = 0;
+        int gpu_frames_over_budget = 0;
+        LOG("renderer", "Switch bench: path, source, max_frame_cpu_ms, max_frame_gpu_ms, cpu_frames_over_budget, gpu_frames_over_budget, "
+            << "frames, slowest_frame_ms, budget_ms " << s->params.budget_ms);
+        for (const EnvSwitchBenchResult& r : bench->results) {
+            LOG("renderer", "Switch bench: " << r.path << ", " << (r.stats.from_cache ? "cache" : "bake") << ", " << r.stats.max_frame_cpu_ms
+                << ", " << r.stats.max_frame_gpu_ms << ", " << r.stats.cpu_frames_over_budget << ", " << r.stats.gpu_frames_over_budget
+                << ", " << r.stats.frames << ", " << r.slowest_frame_ms);
+            worst_cpu_ms = std::max(worst_cpu_ms, r.stats.max_frame_cpu_ms);
+            worst_gpu_ms = std::max(worst_gpu_ms, r.stats.max_frame_gpu_ms);
+            cpu_frames_over_budget += r.stats.cpu_frames_over_budget;
+            gpu_frames_over_budget += r.stats.gpu_frames_over_budget;
+        }
+        LOG("renderer", "Switch bench: " << bench->results.size() << " switches, per frame up to " << worst_cpu_ms << "ms cpu / "
+            << worst_gpu_ms << "ms gpu against a " << s->params.budget_ms << "ms budget, " << cpu_frames_over_budget << " cpu / "
+            << gpu_frames_over_budget << " gpu frames over, slowest frame " << bench->worst_spike_ms << "ms over the median");
+        return false;
+    }
+    bench->slowest_frame_ms = .0;
+    envSwitchStart(s, bench->paths[bench->next_path++].c_str(), params);
+    return true;
+}
+
+// Long enough for a shrink to go through and for the released targets to be deleted
+constexpr int RESIZE_BENCH_HOLD_FRAMES = TARGET_SHRINK_DELAY_FRAMES + TEXTURE_POOL_RETIRE_FRAMES + 30;
+constexpr int RESIZE_BENCH_DRAG_FRAMES = 120;
+
+// Window client size moving from one size to another over frames, a hold when both are the same
+struct ResizeBenchStep {
+    int from_width;
+    int from_height;
+    int to_width;
+    int to_height;
+    int frames;
+};
+
+// -resize_bench jumps and drags the window through a fixed list of sizes, writes every frame's time, sizes and
+// texture pool activity to resize_bench.csv, logs the slowest frame of each step against its median, then quits
+struct ResizeBench {
+    bool active = false;
+    std::vector<ResizeBenchStep> steps;
+    int step = -1;
+    int step_frame = 0;
+    int frame = 0;
+    FILE* csv = 0;
+    Stopwatch sw_frame;         // Call to call, covers the resize at the top of the loop and the realization in draw()
+    int last_created = 0;
+    int last_deleted = 0;
+    std::vector<double> step_ms;
+    double step_max_gpu_ms = .0;
+    int step_created = 0;
+    int step_deleted = 0;
+    double worst_spike_ms = .0;
+};
+
+void resizeBenchStart(ResizeBench* bench) {
+    const ResizeBenchStep steps[] = {
+        { 1280, 720, 1280, 720, RESIZE_BENCH_HOLD_FRAMES },     // Baseline
+        { 1920, 1080, 1920, 1080, RESIZE_BENCH_HOLD_FRAMES },   // Grow, immediate
+        { 1280, 720, 1280, 720, RESIZE_BENCH_HOLD_FRAMES },     // Shrink, delayed
+        { 1280, 720, 1920, 1080, RESIZE_BENCH_DRAG_FRAMES },
+        { 1920, 1080, 1920, 1080, RESIZE_BENCH_HOLD_FRAMES },
+        { 1920, 1080, 960, 540, RESIZE_BENCH_DRAG_FRAMES },
+        { 960, 540, 960, 540, RESIZE_BENCH_HOLD_FRAMES },
+        { 1280, 720, 1280, 720, RESIZE_BENCH_HOLD_FRAMES },
+    };
+    bench->active = true;
+    bench->steps.assign(steps, steps + sizeof(steps) / sizeof(steps[0]));
+    bench->csv = fopen("resize_bench.csv", "w");
+    if (!bench->csv) {
+        LOG_ERR("renderer", "Resize bench: failed to open resize_bench.csv");
+    } else {
+        fprintf(bench->csv, "frame,step,window_width,window_height,target_width,target_height,render_width,render_height,"
+            "frame_ms,gpu_ms,textures_created,textures_deleted,in_use_mb,idle_mb\n");
     }
-    PROF_BEGIN("Present");
-    SwapBuffers(s_hdc);
-    PROF_END();
 }
 
-int main() {
+// Call once per frame after draw(). Returns false once every step is done
+bool resizeBenchStep(ResizeBench* bench, const RendererFrameResources* resources, int render_width, int render_height) {
+    const double frame_ms = bench->sw_frame.elapsedMs();
+    bench->sw_frame.reset();
+    const TexturePool* pool = &resources->target_pool;
+    const int created = pool->created - bench->last_created;
+    const int deleted = pool->deleted - bench->last_deleted;
+    bench->last_created = pool->created;
+    bench->last_deleted = pool->deleted;
+    const float gpu_ms = resources->gpu_frame_timer.last_ms;
+
+    if (bench->step >= 0) {
+        const TexturePoolStats ps = texturePoolStats(pool);
+        const double mb = 1.0 / (1024.0 * 1024.0);
+        if (bench->csv) {
+            fprintf(bench->csv, "%d,%d,%d,%d,%d,%d,%d,%d,%.3f,%.3f,%d,%d,%.1f,%.1f\n", bench->frame, bench->step,
+                s_window_width, s_window_height, resources->gbuffer_width, resources->gbuffer_height, render_width, render_height,
+                frame_ms, gpu_ms, created, deleted, ps.in_use_bytes * mb, ps.idle_bytes * mb);
+        }
+        bench->step_ms.push_back(frame_ms);
+        bench->step_max_gpu_ms = std::max(bench->step_max_gpu_ms, (double)gpu_ms);
+        bench->step_created += created;
+        bench->step_deleted += deleted;
+        bench->frame++;
+    }
+
+    if (bench->step >= 0 && ++bench->step_frame < bench->steps[bench->step].frames) {
+        const ResizeBenchStep& st = bench->steps[bench->step];
+        const float t = bench->step_frame / (float)(st.frames - 1);
+        const int width = st.from_width + (int)((st.to_width - st.from_width) * t);
+        const int height = st.from_height + (int)((st.to_height - st.from_height) * t);
+        if (width != s_window_width || height != s_window_height) {
+            setWindowClientSize(width, height);
+        }
+        return true;
+    }
+
+    if (bench->step >= 0) {
+        const ResizeBenchStep& st = bench->steps[bench->step];
+        std::vector<double> sorted = bench->step_ms;
+        std::sort(sorted.begin(), sorted.end());
+        const double median_ms = sorted[sorted.size() / 2];
+        const double spike_ms = sorted.back() - median_ms;
+        bench->worst_spike_ms = std::max(bench->worst_spike_ms, spike_ms);
+        LOG("renderer", "Resize bench: " << st.from_width << "x" << st.from_height << " -> " << st.to_width << "x" << st.to_height
+            << " over " << st.frames << " frames, slowest frame " << sorted.back() << "ms, " << spike_ms << "ms over the median "
+            << median_ms << "ms, gpu up to " << bench->step_max_gpu_ms << "ms, " << bench->step_created << " textures created, "
+            << bench->step_deleted << " deleted");
+    }
+    if (++bench->step == (int)bench->steps.size()) {
+        LOG("renderer", "Resize bench: " << bench->steps.size() << " steps, " << bench->frame << " frames, slowest frame "
+            << bench->worst_spike_ms << "ms over its step's median, " << pool->created << " textures created, " << pool->deleted
+            << " deleted, peak " << pool->peak_bytes / (1024 * 1024) << "MB, per frame times in resize_bench.csv");
+        if (bench->csv) {
+            fclose(bench->csv);
+            bench->csv = 0;
+        }
+        return false;
+    }
+    bench->step_frame = 0;
+    bench->step_ms.clear();
+    bench->step_max_gpu_ms = .0;
+    bench->step_created = 0;
+    bench->step_deleted = 0;
+    setWindowClientSize(bench->steps[bench->step].from_width, bench->steps[bench->step].from_height);
+    return true;
+}
+
+// Frames each reduced IBL rate runs for under -ibl_compare, the first few are dropped while results from
+// the previous graph are still in flight
+constexpr int IBL_COMPARE_WARMUP_FRAMES = 30;
+constexpr int IBL_COMPARE_FRAMES = 300;
+
+// -ibl_compare runs every reduced IBL rate against the full rate path along a fixed camera orbit at full
+// render size, logs the summaries, writes them to ibl_compare.csv and quits
+struct IblCompareRun {
+    bool active = false;
+    int frame = 0;
+    IblCompareTotals totals[IBL_QUALITY_COUNT];
+};
+
+void iblCompareRunStart(IblCompareRun* run) {
+    run->active = true;
+    run->frame = 0;
+    std::fill(run->totals, run->totals + IBL_QUALITY_COUNT, IblCompareTotals());
+    useDynamicResolution = false;
+    dbgIblCompare = true;
+    iblQuality = IBL_QUALITY_HALF;
+    LOG("renderer", "Comparing reduced rate IBL against full rate, " << IBL_COMPARE_FRAMES << " frames per rate");
+}
+
+// Returns false once every rate is done
+bool iblCompareRunStep(IblCompareRun* run, RendererFrameResources* resources) {
+    camera_rotation_x = -.3f;
+    camera_rotation_y = run->frame * .02f;
+    if (run->frame >= IBL_COMPARE_WARMUP_FRAMES && resources->ibl_compare_updated) {
+        const double reduced_ms = rgPassGpuMs(&resources->graph, "IBLLowRes") + rgPassGpuMs(&resources->graph, "IBLUpsample");
+        iblCompareAccumulate(&run->totals[iblQuality], resources->ibl_compare_stats.last, rgPassGpuMs(&resources->graph, "IBLReference"), reduced_ms);
+    }
+    if (++run->frame < IBL_COMPARE_WARMUP_FRAMES + IBL_COMPARE_FRAMES) {
+        return true;
+    }
+    iblCompareLogSummary(&run->totals[iblQuality], iblQuality);
+    run->frame = 0;
+    iblQuality = (IBL_QUALITY)(iblQuality + 1);
+    if (iblQuality != IBL_QUALITY_COUNT) {
+        return true;
+    }
+    iblCompareWriteCsv("ibl_compare.csv", run->totals);
+    return false;
+}
+
+int main(int argc, char* argv[]) {
+    if (runBenchmarks(argc, argv)) {
+        return 0;
+    }
+
+    IblCompareRun ibl_compare_run;
+    EnvSwitchBench env_switch_bench;
+    ResizeBench resize_bench;
+    bool prefilter_bench = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-ibl_compare") == 0) {
+            iblCompareRunStart(&ibl_compare_run);
+        }
+        if (strcmp(argv[i], "-prefilter_bench") == 0) {
+            prefilter_bench = true;
+        }
+        if (strcmp(argv[i], "-env_switch_bench") == 0) {
+            envSwitchBenchStart(&env_switch_bench);
+        }
+        if (strcmp(argv[i], "-resize_bench") == 0) {
+            resizeBenchStart(&resize_bench);
+        }
+    }
+
     SetThreadPriority(GetCurrentThread(), THREAD_PRIORITY_TIME_CRITICAL);
 
 	LOG("startup", "Hello, World!");
@@ -2240,43 +3370,124 @@ int main() {
     //glCreateProgram()
     //glCreateShaderProgram();
 
-    const int gbuffer_width = 2560;
-    const int gbuffer_height = 1440;
-
     RendererGlobalResources global_resources;
     RendererFrameResources resources;
 
+    // Targets cover the window rounded up, dynamic resolution picks a sub-rectangle up to the window size every frame
     initPersistentRenderData(&global_resources);
-    initGlResources(&global_resources, &resources, gbuffer_width, gbuffer_height);
+    // Needs a GL context unlike -bench, so it runs here and exits
+    if (prefilter_bench) {
+        prefilterBench(&global_resources, "hdri/belfast_sunset_puresky_1k.hdr");
+        return 0;
+    }
+    initGlResources(&global_resources, &resources, targetSizeFor(s_window_width), targetSizeFor(s_window_height));
 
-    std::vector<DrawCmd> draw_commands;
-    draw_commands.push_back(DrawCmd{
+    std::vector<SceneObject> scene_objects;
+    scene_objects.push_back(SceneObject{
         .type = DRAW_CMD_ARRAY,
         .mode = GL_TRIANGLES,
         .vao = createGlCube(resources.prog_geom->id()),
         .progid = resources.prog_geom->id(),
-        .offset = 0,
-        .count = 36,
-        .instance_count = 0,
         .ub_model = resources.ub_model,
+        .count = 36,
+        .bounds = gfxm::aabb{ gfxm::vec3(-.87f, -.87f, -.87f), gfxm::vec3(.87f, .87f, .87f) },
+        .lod_chain = 0,
     });
 
     const int torus_segments = 200;
     const int pipe_segments = 16;
-    draw_commands.push_back(DrawCmd{
-        .type = DRAW_CMD_ARRAY,
-        .mode = GL_TRIANGLE_STRIP,
-        .vao = createGlTorus(resources.prog_geom->id(), torus_segments, pipe_segments),
+    MeshLodChain torus_lods;
+    GLuint torus_vao = createGlTorus(resources.prog_geom->id(), torus_segments, pipe_segments, &torus_lods);
+    scene_objects.push_back(SceneObject{
+        .type = DRAW_CMD_INDEXED,
+        .mode = GL_TRIANGLES,
+        .vao = torus_vao,
         .progid = resources.prog_geom->id(),
-        .offset = 0,
-        .count = torus_segments * pipe_segments * 4,
-        .instance_count = 0,
         .ub_model = resources.ub_model,
+        .count = torus_lods.lods[0].index_count,
+        .bounds = gfxm::aabb{ gfxm::vec3(-1.75f, -1.75f, -1.75f), gfxm::vec3(1.75f, 1.75f, 1.75f) },
+        .lod_chain = &torus_lods,
     });
+
+    AabbSoa scene_bounds;
+    aabbSoaResize(&scene_bounds, scene_objects.size());
+    for (int i = 0; i < scene_objects.size(); ++i) {
+        aabbSoaSet(&scene_bounds, i, scene_objects[i].bounds);
+    }
+    std::vector<uint32_t> visible_objects(scene_objects.size());
+    LodSelectSoa scene_lods;
+    lodSelectSoaResize(&scene_lods, scene_objects.size());
+    for (int i = 0; i < scene_objects.size(); ++i) {
+        lodSelectSoaSetChain(&scene_lods, i, scene_objects[i].lod_chain);
+    }
+
+    // The cube is solid, its own geometry is a good occluder
+    gfxm::vec3 cube_occluder_vertices[8];
+    uint32_t cube_occluder_indices[36];
+    makeOcclusionBox(gfxm::aabb(gfxm::vec3(-.5f, -.5f, -.5f), gfxm::vec3(.5f, .5f, .5f)), cube_occluder_vertices, cube_occluder_indices);
+    OcclusionMesh occluders[] = {
+        { cube_occluder_vertices, 8, cube_occluder_indices, 36, gfxm::mat4(1.0f) }
+    };
+    OcclusionCuller occlusion_culler;
+    occlusionInit(&occlusion_culler, 256, 128);
+
+    std::vector<DrawCmdRecorder> draw_recorders(getThreadPool()->threadCount());
+    for (auto& rec : draw_recorders) {
+        drawCmdRecorderInit(&rec, MAX_RECORDED_COMMANDS_PER_THREAD);
+    }
+    DrawCmdStream draw_stream;
+    DrawCmdStream batched_stream;
+    drawCmdStreamReserve(&batched_stream, MAX_RECORDED_COMMANDS_PER_THREAD);
+
+    // Per-object instance data, indexed by scene object
+    std::vector<DrawInstanceData> scene_instances(scene_objects.size());
+    for (auto& inst : scene_instances) {
+        inst.transform = gfxm::mat4(1.0f);
+        inst.color = gfxm::vec4(1.0f, 1.0f, 1.0f, 1.0f);
+    }
+    drawCmdStreamReserve(&draw_stream, MAX_RECORDED_COMMANDS_PER_THREAD);
     
+
+    std::vector<Light> scene_lights;
+    makeSceneLights(scene_lights, 512);
+
+    DynamicResolution dynres;
+    dynresInit(&dynres, s_window_width, s_window_height);
+
+    makeSceneProbes(&resources.probes);
+
+    // F12 steps through hdri/*.hdr
+    EnvSwitch env_switch;
+    glxInitEnvSwitch(&env_switch, EnvSwitchParams());
+    const IblBakeParams env_bake_params = iblDefaultBakeParams();
+    const std::vector<std::string> environment_paths = fsFindAllFiles("hdri", "*.hdr");
+    int next_environment = 0;
+
+    Stopwatch sw_frame;
     float time = .0f;
     while (pollMessages()) {
         PROF_SCOPE("GameLoop");
+        const double frame_ms = sw_frame.elapsedMs();
+        sw_frame.reset();
+
+        if (dbgNextEnvironment && !environment_paths.empty()) {
+            if (envSwitchStart(&env_switch, environment_paths[next_environment].c_str(), env_bake_params)) {
+                next_environment = (next_environment + 1) % environment_paths.size();
+            }
+            dbgNextEnvironment = false;
+        }
+        const ENV_SWITCH_EVENT env_event = updateEnvSwitch(&global_resources, &resources, &env_switch, frame_ms);
+        if (env_switch_bench.active && !envSwitchBenchStep(&env_switch_bench, &env_switch, env_event, frame_ms, env_bake_params)) {
+            break;
+        }
+
+        // Minimized windows report a zero size, keep the last one
+        if (s_window_width > 0 && s_window_height > 0) {
+            updateTargetSize(&resources, s_window_width, s_window_height);
+            if (dynres.max_width != s_window_width || dynres.max_height != s_window_height) {
+                dynresResize(&dynres, s_window_width, s_window_height);
+            }
+        }
 
         gfxm::vec3 camera_pivot = gfxm::vec3(0, 0, 0);
         float camera_distance = 5.0f;
@@ -2293,13 +3504,122 @@ int main() {
         gfxm::mat4 view = gfxm::inverse(matCamera);
         gfxm::mat4 proj = gfxm::perspective(gfxm::radian(60.f), s_window_width / (float)s_window_height, znear, zfar);
 
-        draw(&global_resources, &resources, draw_commands.data(), draw_commands.size(), gbuffer_width, gbuffer_height, view, proj, cameraPosition, znear, zfar, time);
+        int visible_count = frustumCullAabbsParallel(gfxm::make_frustum(proj, view), &scene_bounds, visible_objects.data(), getThreadPool());
+        if (useOcclusionCulling) {
+            PROF_SCOPE("OcclusionCulling");
+            occluders[0].transform = makeSpinTransform(time);
+            occlusionBeginFrame(&occlusion_culler, proj * view);
+            occlusionRasterize(&occlusion_culler, occluders, sizeof(occluders) / sizeof(occluders[0]), getThreadPool());
+            occlusionBuildPyramid(&occlusion_culler);
+            visible_count = occlusionCullList(&occlusion_culler, &scene_bounds, visible_objects.data(), visible_count, visible_objects.data(), getThreadPool());
+            if (dbgLogFrameStats) {
+                const OcclusionStats& s = occlusion_culler.stats;
+                LOG("renderer", "Occlusion: " << s.culled << "/" << s.tested << " culled ("
+                    << (s.tested ? 100.f * s.culled / s.tested : .0f) << "%), "
+                    << s.rasterized_triangles << "/" << s.occluder_triangles << " occluder triangles, raster "
+                    << s.raster_ms << "ms, test " << s.test_ms << "ms");
+            }
+        }
+
+        if (useClusteredLights) {
+            animateSceneLights(scene_lights, time);
+            clusterLightsBin(&resources.clustered_lights, scene_lights.data(), scene_lights.size(), view, proj, zfar, getThreadPool());
+            if (dbgLogFrameStats) {
+                const ClusterBinStats& s = resources.clustered_lights.stats;
+                LOG("renderer", "Clustered lights: " << s.binned_lights << "/" << s.lights << " visible, "
+                    << s.indices << " indices, up to " << s.max_cluster_lights << " per cluster, "
+                    << s.dropped_indices << " dropped, bin " << s.bin_ms << "ms");
+            }
+        }
+
+        LodSelectParams lod_params;
+        lod_params.camera_position = cameraPosition;
+        lod_params.projection_scale = lodProjectionScale(proj, dynres.height);
+        lod_params.max_error_px = useLod ? 1.0f : .0f;
+        lodSelect(&scene_lods, &scene_bounds, lod_params);
+
+        recordSceneDrawCommands(scene_objects.data(), scene_lods.lod.data(), visible_objects.data(), visible_count, draw_recorders.data(), draw_recorders.size(), &draw_stream);
+
+        resources.instancer.enabled = useAutoInstancing;
+        autoInstanceDrawCmds(&resources.instancer, &draw_stream, scene_instances.data(), &batched_stream);
+        if (dbgLogFrameStats) {
+            const AutoInstancingStats& s = resources.instancer.stats;
+            LOG("renderer", "Instancing: " << s.draws_before << " draws before, " << s.draws_after << " after, "
+                << s.instanced_batches << " instanced batches with " << s.instances << " instances");
+            int lod_histogram[MESH_LOD_MAX_LEVELS] = { 0 };
+            for (int i = 0; i < visible_count; ++i) {
+                lod_histogram[scene_lods.lod[visible_objects[i]]]++;
+            }
+            std::ostringstream lod_counts;
+            for (int i = 0; i < MESH_LOD_MAX_LEVELS; ++i) {
+                lod_counts << (i ? ", " : "") << lod_histogram[i];
+            }
+            LOG("renderer", "LOD: " << drawCmdStreamTriangleCount(&batched_stream) << " triangles submitted, objects per level: " << lod_counts.str());
+            LOG("renderer", "Render size: " << dynres.width << "x" << dynres.height << " (scale " << dynresScale(&dynres) << "), gpu "
+                << resources.gpu_frame_timer.last_ms << "ms, " << dynres.changes << " size changes so far");
+            rgLogTimings(&resources.graph);
+            const ReflectionProbeStats& ps = resources.probes.stats;
+            LOG("renderer", "Reflection probes: " << ps.visible << "/" << resources.probes.probes.size() << " on screen, " << ps.dirty << " dirty, "
+                << ps.updates << " captures so far, " << ps.steps << "/" << resources.probes.params.steps_per_frame << " steps last frame, cpu "
+                << ps.cpu_ms << "ms (max " << ps.max_cpu_ms << "ms), gpu " << ps.gpu_ms << "ms (max " << ps.max_gpu_ms << "ms), "
+                << ps.texture_bytes / 1024 << "KB");
+            texturePoolLogReport(&resources.target_pool);
+            if (iblCompareActive() && resources.ibl_compare_stats.has_result) {
+                IblCompareTotals last_frame;
+                const double reduced_ms = rgPassGpuMs(&resources.graph, "IBLLowRes") + rgPassGpuMs(&resources.graph, "IBLUpsample");
+                iblCompareAccumulate(&last_frame, resources.ibl_compare_stats.last, rgPassGpuMs(&resources.graph, "IBLReference"), reduced_ms);
+                iblCompareLogSummary(&last_frame, iblQuality);
+            }
+            dbgLogFrameStats = false;
+        }
+
+        // The objects spin, every probe they reach stays dirty and the captures run continuously within the budget
+        for (const SceneObject& o : scene_objects) {
+            reflectionProbesMarkDirty(&resources.probes, o.bounds);
+        }
+        updateReflectionProbes(&global_resources, &resources, scene_objects.data(), scene_objects.size(), time);
+        glxTextureStreamUpdate(&global_resources.texture_stream);
+
+        draw(&global_resources, &resources, &batched_stream, dynres.width, dynres.height, view, proj, cameraPosition, znear, zfar, time);
+
+        // The gpu time read here is a few frames old, the controller is tuned for that lag
+        if (glxGpuTimerResolve(&resources.gpu_frame_timer)) {
+            const float gpu_ms = resources.gpu_frame_timer.last_ms;
+            profilerRecordMs("GpuFrame", gpu_ms);
+            const int prev_width = dynres.width;
+            const int prev_height = dynres.height;
+            bool resized = false;
+            if (useDynamicResolution) {
+                resized = dynresUpdate(&dynres, gpu_ms);
+            } else if (dynres.width != dynres.max_width || dynres.height != dynres.max_height) {
+                dynresSetScale(&dynres, 1.0f);
+                resized = true;
+            }
+            if (resized) {
+                std::ostringstream ss;
+                ss << prev_width << "x" << prev_height << " -> " << dynres.width << "x" << dynres.height
+                    << ", gpu " << gpu_ms << "ms (filtered " << dynres.filtered_ms << "ms, target " << dynres.params.target_ms << "ms)";
+                profilerEvent("DynamicResolution", ss.str());
+            }
+        }
+
+        if (ibl_compare_run.active && !iblCompareRunStep(&ibl_compare_run, &resources)) {
+            break;
+        }
+        if (resize_bench.active && !resizeBenchStep(&resize_bench, &resources, dynres.width, dynres.height)) {
+            break;
+        }
 
         // TODO:
         time += 0.01f;
     }
+    glxDestroyEnvSwitch(&env_switch);
+    glxDestroyTextureStream(&global_resources.texture_stream);
+    glxDestroyReflectionProbes(&resources.probes);
+    glxDestroyPrefilterSampleTables(&resources.probe_prefilter_tables);
 
     profilerDump("profile.csv");
+    profilerDumpEvents("profile_events.csv");
 
 	return 0;
 }
@@ -0,0 +1,175 @@
+#include "mesh_lod.hpp"
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+#include <algorithm>
+#include "frustum_cull.hpp"
+#include "log/log.hpp"
+#include "math/simd.hpp"
+#include "mesh_simplify.hpp"
+#include "profiler/profiler.hpp"
+
+
+void meshBuildLodChain(
+    MeshLodChain* chain,
+    const uint32_t* indices, size_t index_count,
+    const gfxm::vec3* positions, size_t vertex_count,
+    float reduction,
+    size_t min_triangles
+) {
+    PROF_SCOPE_FN();
+
+    gfxm::vec3 min(FLT_MAX, FLT_MAX, FLT_MAX);
+    gfxm::vec3 max(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+    for (size_t i = 0; i < index_count; ++i) {
+        const gfxm::vec3& p = positions[indices[i]];
+        min = gfxm::vec3(std::min(min.x, p.x), std::min(min.y, p.y), std::min(min.z, p.z));
+        max = gfxm::vec3(std::max(max.x, p.x), std::max(max.y, p.y), std::max(max.z, p.z));
+    }
+    const gfxm::vec3 center = (min + max) * .5f;
+    float radius = .0f;
+    for (size_t i = 0; i < index_count; ++i) {
+        radius = std::max(radius, gfxm::length(positions[indices[i]] - center));
+    }
+    chain->radius = radius;
+
+    chain->indices.assign(indices, indices + index_count);
+    chain->lods[0] = MeshLod{ 0, (uint32_t)index_count, .0f };
+    chain->lod_count = 1;
+
+    std::vector<uint32_t> lod_indices(index_count);
+    size_t target = index_count;
+    for (int i = 1; i < MESH_LOD_MAX_LEVELS; ++i) {
+        const MeshLod& prev = chain->lods[i - 1];
+        target = (size_t)(target * reduction) / 3 * 3;
+        if (target / 3 < min_triangles) {
+            break;
+        }
+        float error = .0f;
+        size_t count = meshSimplify(lod_indices.data(), indices, index_count, positions, vertex_count, target, FLT_MAX, &error);
+        if (count > prev.index_count * 9 / 10) {
+            break;
+        }
+        MeshLod lod;
+        lod.index_offset = chain->indices.size();
+        lod.index_count = count;
+        // Simplifying from the source can land a lower error on a coarser level, selection needs it monotonic
+        lod.error = std::max(error, prev.error);
+        chain->indices.insert(chain->indices.end(), lod_indices.begin(), lod_indices.begin() + count);
+        chain->lods[chain->lod_count++] = lod;
+        target = count;
+    }
+
+    for (int i = 0; i < chain->lod_count; ++i) {
+        LOG_DBG("lod", "Level " << i << ": " << chain->lods[i].index_count / 3 << " triangles, error " << chain->lods[i].error);
+    }
+}
+
+void lodSelectSoaResize(LodSelectSoa* soa, int count) {
+    const int padded = (count + 7) & ~7;
+    soa->relative_error[0].resize(padded, .0f);
+    for (int i = 1; i < MESH_LOD_MAX_LEVELS; ++i) {
+        soa->relative_error[i].resize(padded, FLT_MAX);
+    }
+    soa->lod.resize(padded, 0);
+    soa->count = count;
+}
+
+void lodSelectSoaSetChain(LodSelectSoa* soa, int i, const MeshLodChain* chain) {
+    const int lod_count = chain ? chain->lod_count : 1;
+    soa->relative_error[0][i] = .0f;
+    for (int j = 1; j < MESH_LOD_MAX_LEVELS; ++j) {
+        soa->relative_error[j][i] = j < lod_count ? chain->lods[j].error / std::max(chain->radius, FLT_MIN) : FLT_MAX;
+    }
+    soa->lod[i] = std::min(soa->lod[i], lod_count - 1);
+}
+
+static void selectScalar(LodSelectSoa* soa, const AabbSoa* bounds, const LodSelectParams& params) {
+    const float bias_fine = 1.0f + params.hysteresis;
+    const float bias_coarse = 1.0f - params.hysteresis;
+    for (int i = 0; i < soa->count; ++i) {
+        const float cx = (bounds->min_x[i] + bounds->max_x[i]) * .5f - params.camera_position.x;
+        const float cy = (bounds->min_y[i] + bounds->max_y[i]) * .5f - params.camera_position.y;
+        const float cz = (bounds->min_z[i] + bounds->max_z[i]) * .5f - params.camera_position.z;
+        const float ex = bounds->max_x[i] - bounds->min_x[i];
+        const float ey = bounds->max_y[i] - bounds->min_y[i];
+        const float ez = bounds->max_z[i] - bounds->min_z[i];
+        const float radius = sqrtf(ex * ex + ey * ey + ez * ez) * .5f;
+        const float distance = sqrtf(cx * cx + cy * cy + cz * cz);
+        // Inside the sphere counts as touching it, the object covers the screen anyway
+        const float radius_px = radius * params.projection_scale / std::max(distance, radius);
+
+        // Levels ordered by error, so counting the acceptable ones gives the coarsest.
+        // Bumping the size up finds the level we may go coarser to, down the one we must go finer to
+        int lod_fine = 0;
+        int lod_coarse = 0;
+        for (int j = 1; j < MESH_LOD_MAX_LEVELS; ++j) {
+            const float error_px = soa->relative_error[j][i] * radius_px;
+            lod_fine += error_px * bias_fine <= params.max_error_px;
+            lod_coarse += error_px * bias_coarse <= params.max_error_px;
+        }
+        soa->lod[i] = std::min(std::max(soa->lod[i], lod_fine), lod_coarse);
+    }
+}
+
+#if SIMD_X86
+static void selectSse(LodSelectSoa* soa, const AabbSoa* bounds, const LodSelectParams& params) {
+    const __m128 half = _mm_set1_ps(.5f);
+    const __m128 cam_x = _mm_set1_ps(params.camera_position.x);
+    const __m128 cam_y = _mm_set1_ps(params.camera_position.y);
+    const __m128 cam_z = _mm_set1_ps(params.camera_position.z);
+    const __m128 scale = _mm_set1_ps(params.projection_scale);
+    const __m128 max_error = _mm_set1_ps(params.max_error_px);
+    const __m128 bias_fine = _mm_set1_ps(1.0f + params.hysteresis);
+    const __m128 bias_coarse = _mm_set1_ps(1.0f - params.hysteresis);
+    for (int i = 0; i < soa->count; i += 4) {
+        const __m128 min_x = _mm_loadu_ps(&bounds->min_x[i]);
+        const __m128 min_y = _mm_loadu_ps(&bounds->min_y[i]);
+        const __m128 min_z = _mm_loadu_ps(&bounds->min_z[i]);
+        const __m128 max_x = _mm_loadu_ps(&bounds->max_x[i]);
+        const __m128 max_y = _mm_loadu_ps(&bounds->max_y[i]);
+        const __m128 max_z = _mm_loadu_ps(&bounds->max_z[i]);
+        // Same operation order as selectScalar() so both pick the same levels
+        const __m128 cx = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(min_x, max_x), half), cam_x);
+        const __m128 cy = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(min_y, max_y), half), cam_y);
+        const __m128 cz = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(min_z, max_z), half), cam_z);
+        const __m128 ex = _mm_sub_ps(max_x, min_x);
+        const __m128 ey = _mm_sub_ps(max_y, min_y);
+        const __m128 ez = _mm_sub_ps(max_z, min_z);
+        const __m128 radius = _mm_mul_ps(_mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, ex), _mm_mul_ps(ey, ey)), _mm_mul_ps(ez, ez))), half);
+        const __m128 distance = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, cx), _mm_mul_ps(cy, cy)), _mm_mul_ps(cz, cz)));
+        const __m128 radius_px = _mm_div_ps(_mm_mul_ps(radius, scale), _mm_max_ps(distance, radius));
+
+        // Compare masks are -1 where true
+        __m128i lod_fine = _mm_setzero_si128();
+        __m128i lod_coarse = _mm_setzero_si128();
+        for (int j = 1; j < MESH_LOD_MAX_LEVELS; ++j) {
+            const __m128 error_px = _mm_mul_ps(_mm_loadu_ps(&soa->relative_error[j][i]), radius_px);
+            lod_fine = _mm_sub_epi32(lod_fine, _mm_castps_si128(_mm_cmple_ps(_mm_mul_ps(error_px, bias_fine), max_error)));
+            lod_coarse = _mm_sub_epi32(lod_coarse, _mm_castps_si128(_mm_cmple_ps(_mm_mul_ps(error_px, bias_coarse), max_error)));
+        }
+
+        // min(max(lod, fine), coarse) without SSE4.1
+        __m128i lod = _mm_loadu_si128((const __m128i*)&soa->lod[i]);
+        __m128i below = _mm_cmplt_epi32(lod, lod_fine);
+        lod = _mm_or_si128(_mm_and_si128(below, lod_fine), _mm_andnot_si128(below, lod));
+        __m128i above = _mm_cmpgt_epi32(lod, lod_coarse);
+        lod = _mm_or_si128(_mm_and_si128(above, lod_coarse), _mm_andnot_si128(above, lod));
+        _mm_storeu_si128((__m128i*)&soa->lod[i], lod);
+    }
+}
+#endif
+
+void lodSelect(LodSelectSoa* soa, const AabbSoa* bounds, const LodSelectParams& params, LOD_SELECT_PATH path) {
+    PROF_SCOPE_FN();
+
+    assert(bounds->count == soa->count);
+#if SIMD_X86
+    if (path != LOD_SELECT_SCALAR) {
+        selectSse(soa, bounds, params);
+        return;
+    }
+#endif
+    selectScalar(soa, bounds, params);
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+
+
+struct AabbSoa;
+
+constexpr int MESH_LOD_MAX_LEVELS = 6;
+
+struct MeshLod {
+	uint32_t index_offset;	// In indices, into MeshLodChain::indices
+	uint32_t index_count;
+	float error;			// Object space deviation from level 0
+};
+
+// Levels share the vertex buffer, all index ranges live back to back in one index buffer, level 0 first
+struct MeshLodChain {
+	std::vector<uint32_t> indices;
+	MeshLod lods[MESH_LOD_MAX_LEVELS];
+	int lod_count = 0;
+	float radius = .0f;		// Bounding sphere of the vertices around their box center
+};
+
+// Level 0 is the source mesh, every next level aims at reduction times the triangles of the previous one.
+// Each level is simplified from the source so its error is measured against level 0.
+// The chain ends early once a level fails to lose at least 10% of the triangles or drops under min_triangles
+void meshBuildLodChain(
+	MeshLodChain* chain,
+	const uint32_t* indices, size_t index_count,
+	const gfxm::vec3* positions, size_t vertex_count,
+	float reduction = .5f,
+	size_t min_triangles = 64
+);
+
+// Per object selection state, one array per field padded to a multiple of 8 like AabbSoa
+struct LodSelectSoa {
+	// Error of each level relative to the object's bounding sphere radius,
+	// FLT_MAX for the levels an object does not have
+	std::vector<float> relative_error[MESH_LOD_MAX_LEVELS];
+	// Selected level, kept between frames for the hysteresis
+	std::vector<int32_t> lod;
+	int count = 0;
+};
+
+void lodSelectSoaResize(LodSelectSoa* soa, int count);
+// Objects without a chain always stay at level 0
+void lodSelectSoaSetChain(LodSelectSoa* soa, int i, const MeshLodChain* chain);
+
+struct LodSelectParams {
+	gfxm::vec3 camera_position;
+	// Pixels covered by one unit at unit distance: viewport height * proj[1][1] / 2
+	float projection_scale;
+	// Largest allowed projected deviation in pixels
+	float max_error_px = 1.0f;
+	// Relative change in projected size needed before moving away from the current level
+	float hysteresis = .15f;
+};
+
+inline float lodProjectionScale(const gfxm::mat4& proj, int viewport_height) {
+	return viewport_height * proj[1][1] * .5f;
+}
+
+enum LOD_SELECT_PATH {
+	LOD_SELECT_AUTO,
+	LOD_SELECT_SCALAR,
+	LOD_SELECT_SSE
+};
+
+// Picks the coarsest level whose error, scaled by the projected radius of the object's bounding sphere,
+// stays under max_error_px. Spheres come from the world space boxes.
+// A level change only happens once the projected size moved past the switch point by the hysteresis margin
+void lodSelect(LodSelectSoa* soa, const AabbSoa* bounds, const LodSelectParams& params, LOD_SELECT_PATH path = LOD_SELECT_AUTO);
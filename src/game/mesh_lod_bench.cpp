@@ -0,0 +1,129 @@
+#include "benchmarks.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "frustum_cull.hpp"
+#include "log/log.hpp"
+#include "mesh_lod.hpp"
+#include "profiler/stopwatch.hpp"
+
+
+// Closed torus with a bumpy surface, indices wrap around so there are no borders or seams
+static void makeLodBenchMesh(std::vector<gfxm::vec3>& positions, std::vector<uint32_t>& indices, int rings, int sides) {
+    positions.resize(rings * sides);
+    for (int i = 0; i < rings; ++i) {
+        float u = i / (float)rings * gfxm::pi2;
+        for (int j = 0; j < sides; ++j) {
+            float v = j / (float)sides * gfxm::pi2;
+            float r = .3f + .02f * sinf(u * 7.f) * cosf(v * 3.f);
+            positions[i * sides + j] = gfxm::vec3((1.f + r * cosf(v)) * cosf(u), r * sinf(v), (1.f + r * cosf(v)) * sinf(u));
+        }
+    }
+    indices.clear();
+    for (int i = 0; i < rings; ++i) {
+        for (int j = 0; j < sides; ++j) {
+            uint32_t a = i * sides + j;
+            uint32_t b = ((i + 1) % rings) * sides + j;
+            uint32_t c = ((i + 1) % rings) * sides + (j + 1) % sides;
+            uint32_t d = i * sides + (j + 1) % sides;
+            indices.insert(indices.end(), { a, b, c, a, c, d });
+        }
+    }
+}
+
+void benchMeshLod() {
+    const int OBJECT_COUNT = 1000000;
+    const int ITERATIONS = 20;
+
+    std::vector<gfxm::vec3> positions;
+    std::vector<uint32_t> indices;
+    makeLodBenchMesh(positions, indices, 400, 64);
+
+    MeshLodChain chain;
+    Stopwatch sw;
+    meshBuildLodChain(&chain, indices.data(), indices.size(), positions.data(), positions.size());
+    LOG("bench", "mesh_lod: built " << chain.lod_count << " levels from " << indices.size() / 3 << " triangles in " << sw.elapsedMs() << "ms");
+    for (int i = 0; i < chain.lod_count; ++i) {
+        LOG("bench", "mesh_lod:   level " << i << ": " << chain.lods[i].index_count / 3 << " triangles, error "
+            << chain.lods[i].error << " (" << chain.lods[i].error / chain.radius * 100.f << "% of radius)");
+    }
+
+    uint32_t seed = 0xBADF00D;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+    AabbSoa bounds;
+    aabbSoaResize(&bounds, OBJECT_COUNT);
+    LodSelectSoa lods;
+    lodSelectSoaResize(&lods, OBJECT_COUNT);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        gfxm::vec3 c((rnd01() * 2.f - 1.f) * 1000.f, .0f, (rnd01() * 2.f - 1.f) * 1000.f);
+        gfxm::vec3 h(1.3f, .4f, 1.3f);
+        aabbSoaSet(&bounds, i, gfxm::aabb{ c - h, c + h });
+        lodSelectSoaSetChain(&lods, i, (i % 8) ? &chain : 0);
+    }
+    LodSelectParams params;
+    params.camera_position = gfxm::vec3(0, 2.f, 0);
+    params.projection_scale = lodProjectionScale(gfxm::perspective(gfxm::radian(60.f), 16.f / 9.f, .01f, 1000.f), 1440);
+
+    // Both paths must agree, starting from the same state
+    LodSelectSoa lods_scalar = lods;
+    lodSelect(&lods, &bounds, params, LOD_SELECT_SSE);
+    lodSelect(&lods_scalar, &bounds, params, LOD_SELECT_SCALAR);
+    if (lods.lod != lods_scalar.lod) {
+        LOG_ERR("bench", "mesh_lod: SSE and scalar selection disagree");
+    }
+    int histogram[MESH_LOD_MAX_LEVELS] = { 0 };
+    uint64_t triangles = 0;
+    uint64_t triangles_full = 0;
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        histogram[lods.lod[i]]++;
+        if (i % 8) {
+            triangles += chain.lods[lods.lod[i]].index_count / 3;
+            triangles_full += chain.lods[0].index_count / 3;
+        }
+    }
+    for (int i = 0; i < chain.lod_count; ++i) {
+        LOG("bench", "mesh_lod:   " << histogram[i] << " objects at level " << i);
+    }
+    LOG("bench", "mesh_lod: " << triangles / 1000000 << "M triangles submitted instead of " << triangles_full / 1000000 << "M");
+
+    const LOD_SELECT_PATH paths[] = { LOD_SELECT_SCALAR, LOD_SELECT_SSE };
+    for (auto path : paths) {
+        double best = 1e9;
+        for (int it = 0; it < ITERATIONS; ++it) {
+            Stopwatch sw;
+            lodSelect(&lods, &bounds, params, path);
+            best = std::min(best, sw.elapsedMs());
+        }
+        LOG("bench", "mesh_lod: select " << OBJECT_COUNT << " objects, " << (path == LOD_SELECT_SSE ? "sse" : "scalar") << ": " << best << "ms");
+    }
+
+    // Camera shaking back and forth across a switch point, count level changes with and without hysteresis
+    const float hysteresis_values[] = { .0f, params.hysteresis };
+    for (float hysteresis : hysteresis_values) {
+        LodSelectSoa single;
+        lodSelectSoaResize(&single, 1);
+        lodSelectSoaSetChain(&single, 0, &chain);
+        AabbSoa single_bounds;
+        aabbSoaResize(&single_bounds, 1);
+        aabbSoaSet(&single_bounds, 0, gfxm::aabb{ gfxm::vec3(-1.3f, -.4f, -1.3f), gfxm::vec3(1.3f, .4f, 1.3f) });
+
+        LodSelectParams p = params;
+        p.hysteresis = hysteresis;
+        // Distance at which level 1 becomes acceptable without a margin
+        const float radius = sqrtf(1.3f * 1.3f * 2.f + .4f * .4f);
+        const float switch_distance = chain.lods[1].error / chain.radius * radius * p.projection_scale / p.max_error_px;
+        int changes = 0;
+        int last = single.lod[0];
+        for (int frame = 0; frame < 1000; ++frame) {
+            p.camera_position = gfxm::vec3(0, 0, switch_distance * (1.f + .05f * sinf(frame * .7f)));
+            lodSelect(&single, &single_bounds, p);
+            changes += single.lod[0] != last;
+            last = single.lod[0];
+        }
+        LOG("bench", "mesh_lod: hysteresis " << hysteresis << ": " << changes << " level changes over 1000 jittering frames");
+    }
+}
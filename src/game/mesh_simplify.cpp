@@ -0,0 +1,265 @@
+#include "mesh_simplify.hpp"
+
+#include <assert.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "profiler/profiler.hpp"
+
+
+size_t meshGenerateVertexRemap(uint32_t* remap, const void* vertices, size_t vertex_count, size_t vertex_size) {
+    PROF_SCOPE_FN();
+
+    const uint8_t* bytes = (const uint8_t*)vertices;
+    auto hashVertex = [bytes, vertex_size](uint32_t v)->size_t {
+        // FNV-1a
+        const uint8_t* p = bytes + v * vertex_size;
+        uint64_t h = 14695981039346656037ull;
+        for (size_t i = 0; i < vertex_size; ++i) {
+            h = (h ^ p[i]) * 1099511628211ull;
+        }
+        return (size_t)h;
+    };
+    auto equalVertex = [bytes, vertex_size](uint32_t a, uint32_t b)->bool {
+        return memcmp(bytes + a * vertex_size, bytes + b * vertex_size, vertex_size) == 0;
+    };
+    std::unordered_map<uint32_t, uint32_t, decltype(hashVertex), decltype(equalVertex)> unique(vertex_count, hashVertex, equalVertex);
+
+    size_t unique_count = 0;
+    for (size_t i = 0; i < vertex_count; ++i) {
+        auto it = unique.emplace((uint32_t)i, (uint32_t)unique_count);
+        if (it.second) {
+            ++unique_count;
+        }
+        remap[i] = it.first->second;
+    }
+    return unique_count;
+}
+
+// Symmetric 4x4 matrix of the summed squared plane distances, weighted by triangle area
+struct Quadric {
+    double a2, b2, c2, d2;
+    double ab, ac, ad;
+    double bc, bd;
+    double cd;
+    double w;
+};
+
+static void quadricFromPlane(Quadric& q, double a, double b, double c, double d, double w) {
+    q.a2 = a * a * w; q.b2 = b * b * w; q.c2 = c * c * w; q.d2 = d * d * w;
+    q.ab = a * b * w; q.ac = a * c * w; q.ad = a * d * w;
+    q.bc = b * c * w; q.bd = b * d * w;
+    q.cd = c * d * w;
+    q.w = w;
+}
+
+static void quadricAdd(Quadric& q, const Quadric& o) {
+    q.a2 += o.a2; q.b2 += o.b2; q.c2 += o.c2; q.d2 += o.d2;
+    q.ab += o.ab; q.ac += o.ac; q.ad += o.ad;
+    q.bc += o.bc; q.bd += o.bd;
+    q.cd += o.cd;
+    q.w += o.w;
+}
+
+// Squared distance to the planes, averaged by their weight
+static double quadricError(const Quadric& q, const gfxm::vec3& v) {
+    const double x = v.x, y = v.y, z = v.z;
+    double e = q.a2 * x * x + q.b2 * y * y + q.c2 * z * z
+        + 2.0 * (q.ab * x * y + q.ac * x * z + q.bc * y * z)
+        + 2.0 * (q.ad * x + q.bd * y + q.cd * z)
+        + q.d2;
+    return q.w > .0 ? std::max(e, .0) / q.w : .0;
+}
+
+static gfxm::vec3 triangleNormal(const gfxm::vec3& a, const gfxm::vec3& b, const gfxm::vec3& c) {
+    return gfxm::cross(b - a, c - a);
+}
+
+struct Collapse {
+    uint32_t from;
+    uint32_t to;
+    double error;
+};
+
+size_t meshSimplify(
+    uint32_t* dst,
+    const uint32_t* indices, size_t index_count,
+    const gfxm::vec3* positions, size_t vertex_count,
+    size_t target_index_count,
+    float target_error,
+    float* out_error
+) {
+    PROF_SCOPE_FN();
+
+    assert(index_count % 3 == 0);
+    std::vector<uint32_t> tris(indices, indices + index_count);
+
+    std::vector<Quadric> quadrics(vertex_count);
+    memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+    for (size_t i = 0; i < tris.size(); i += 3) {
+        const gfxm::vec3& p0 = positions[tris[i]];
+        const gfxm::vec3& p1 = positions[tris[i + 1]];
+        const gfxm::vec3& p2 = positions[tris[i + 2]];
+        gfxm::vec3 n = triangleNormal(p0, p1, p2);
+        float len = gfxm::length(n);
+        if (len == .0f) {
+            continue;
+        }
+        n = n / len;
+        Quadric q;
+        quadricFromPlane(q, n.x, n.y, n.z, -gfxm::dot(n, p0), len * .5f);
+        quadricAdd(quadrics[tris[i]], q);
+        quadricAdd(quadrics[tris[i + 1]], q);
+        quadricAdd(quadrics[tris[i + 2]], q);
+    }
+
+    // An edge without a matching opposite half-edge is open
+    std::vector<uint8_t> locked(vertex_count, 0);
+    {
+        std::vector<uint64_t> half_edges;
+        half_edges.reserve(tris.size());
+        for (size_t i = 0; i < tris.size(); i += 3) {
+            for (int e = 0; e < 3; ++e) {
+                uint64_t a = tris[i + e], b = tris[i + (e + 1) % 3];
+                half_edges.push_back((a << 32) | b);
+            }
+        }
+        std::sort(half_edges.begin(), half_edges.end());
+        for (uint64_t he : half_edges) {
+            uint64_t twin = (he << 32) | (he >> 32);
+            if (!std::binary_search(half_edges.begin(), half_edges.end(), twin)) {
+                locked[he >> 32] = 1;
+                locked[he & 0xFFFFFFFF] = 1;
+            }
+        }
+    }
+
+    const double max_error_sq = (double)target_error * (double)target_error;
+    double result_error_sq = .0;
+
+    std::vector<uint32_t> adjacency_offsets(vertex_count + 1);
+    std::vector<uint32_t> adjacency;
+    std::vector<Collapse> collapses;
+    std::vector<uint32_t> remap(vertex_count);
+    std::vector<uint8_t> touched(vertex_count);
+
+    while (tris.size() > target_index_count) {
+        // Triangles around every vertex
+        std::fill(adjacency_offsets.begin(), adjacency_offsets.end(), 0);
+        for (uint32_t v : tris) {
+            adjacency_offsets[v + 1]++;
+        }
+        for (size_t i = 0; i < vertex_count; ++i) {
+            adjacency_offsets[i + 1] += adjacency_offsets[i];
+        }
+        adjacency.resize(tris.size());
+        {
+            std::vector<uint32_t> fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+            for (size_t i = 0; i < tris.size(); ++i) {
+                adjacency[fill[tris[i]]++] = (uint32_t)(i / 3);
+            }
+        }
+
+        // Cheaper direction of every edge, each edge shows up once per adjacent triangle
+        collapses.clear();
+        for (size_t i = 0; i < tris.size(); i += 3) {
+            for (int e = 0; e < 3; ++e) {
+                uint32_t a = tris[i + e], b = tris[i + (e + 1) % 3];
+                if (a > b || (locked[a] && locked[b])) {
+                    continue;
+                }
+                Quadric q = quadrics[a];
+                quadricAdd(q, quadrics[b]);
+                double err_ab = locked[a] ? INFINITY : quadricError(q, positions[b]);
+                double err_ba = locked[b] ? INFINITY : quadricError(q, positions[a]);
+                if (err_ab <= err_ba) {
+                    collapses.push_back(Collapse{ a, b, err_ab });
+                } else {
+                    collapses.push_back(Collapse{ b, a, err_ba });
+                }
+            }
+        }
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        for (size_t i = 0; i < vertex_count; ++i) {
+            remap[i] = (uint32_t)i;
+        }
+        std::fill(touched.begin(), touched.end(), 0);
+
+        size_t triangle_count = tris.size() / 3;
+        const size_t target_triangles = target_index_count / 3;
+        int collapsed = 0;
+        for (const Collapse& c : collapses) {
+            if (triangle_count <= target_triangles || c.error > max_error_sq) {
+                break;
+            }
+            if (touched[c.from] || touched[c.to]) {
+                continue;
+            }
+
+            // Reject collapses that would flip a remaining triangle around the moving vertex
+            bool flips = false;
+            int removed = 0;
+            for (uint32_t k = adjacency_offsets[c.from]; k < adjacency_offsets[c.from + 1]; ++k) {
+                const uint32_t* t = &tris[adjacency[k] * 3];
+                if (t[0] == c.to || t[1] == c.to || t[2] == c.to) {
+                    ++removed;
+                    continue;
+                }
+                gfxm::vec3 p[3] = { positions[t[0]], positions[t[1]], positions[t[2]] };
+                gfxm::vec3 n0 = triangleNormal(p[0], p[1], p[2]);
+                for (int j = 0; j < 3; ++j) {
+                    if (t[j] == c.from) {
+                        p[j] = positions[c.to];
+                    }
+                }
+                gfxm::vec3 n1 = triangleNormal(p[0], p[1], p[2]);
+                if (gfxm::dot(n0, n1) <= .0f) {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) {
+                continue;
+            }
+
+            // Neighbours stay put for the rest of the pass so the flip test above sees final positions
+            for (uint32_t k = adjacency_offsets[c.from]; k < adjacency_offsets[c.from + 1]; ++k) {
+                const uint32_t* t = &tris[adjacency[k] * 3];
+                touched[t[0]] = touched[t[1]] = touched[t[2]] = 1;
+            }
+            touched[c.to] = 1;
+
+            remap[c.from] = c.to;
+            quadricAdd(quadrics[c.to], quadrics[c.from]);
+            result_error_sq = std::max(result_error_sq, c.error);
+            triangle_count -= removed;
+            ++collapsed;
+        }
+        if (collapsed == 0) {
+            break;
+        }
+
+        size_t write = 0;
+        for (size_t i = 0; i < tris.size(); i += 3) {
+            uint32_t a = remap[tris[i]], b = remap[tris[i + 1]], c = remap[tris[i + 2]];
+            if (a == b || b == c || c == a) {
+                continue;
+            }
+            tris[write++] = a;
+            tris[write++] = b;
+            tris[write++] = c;
+        }
+        tris.resize(write);
+    }
+
+    memcpy(dst, tris.data(), tris.size() * sizeof(uint32_t));
+    if (out_error) {
+        *out_error = (float)sqrt(result_error_sq);
+    }
+    return tris.size();
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+
+
+// Finds bitwise identical vertices in an unindexed stream of vertex_size byte keys.
+// remap receives the new index of every input vertex, unique vertices keep their first-seen order.
+// Returns the unique vertex count
+size_t meshGenerateVertexRemap(uint32_t* remap, const void* vertices, size_t vertex_count, size_t vertex_size);
+
+// Reduces an indexed triangle list by edge collapses in order of quadric error (Garland & Heckbert).
+// Vertices collapse onto other existing vertices, so the result indexes the same vertex buffer.
+// Vertices on open edges (mesh borders and attribute seams left by welding) never move.
+// Stops at target_index_count or once the cheapest collapse would deviate more than target_error
+// from the source surface, in object space units.
+// dst needs room for index_count indices and may alias indices. Returns the index count written,
+// out_error (optional) receives the largest deviation introduced
+size_t meshSimplify(
+	uint32_t* dst,
+	const uint32_t* indices, size_t index_count,
+	const gfxm::vec3* positions, size_t vertex_count,
+	size_t target_index_count,
+	float target_error,
+	float* out_error = 0
+);
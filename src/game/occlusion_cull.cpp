@@ -0,0 +1,406 @@
+#include "occlusion_cull.hpp"
+
+#include <assert.h>
+#include <float.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include "frustum_cull.hpp"
+#include "math/simd.hpp"
+#include "thread/thread_pool.hpp"
+
+// No profiler or log in here, this file only depends on the standard library
+// so it can be built and tested on its own, stats carry the timings instead
+
+
+constexpr float OCCLUSION_MIN_W = 1e-4f;
+constexpr int OCCLUSION_TEST_CHUNK_SIZE = 1024;
+
+static double msSince(std::chrono::steady_clock::time_point t) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+void makeOcclusionBox(const gfxm::aabb& box, gfxm::vec3* out_vertices, uint32_t* out_indices) {
+    for (int i = 0; i < 8; ++i) {
+        out_vertices[i] = gfxm::vec3(
+            (i & 1) ? box.to.x : box.from.x,
+            (i & 2) ? box.to.y : box.from.y,
+            (i & 4) ? box.to.z : box.from.z
+        );
+    }
+    // Counter-clockwise seen from outside
+    static const uint32_t indices[36] = {
+        0, 2, 1,  1, 2, 3, // -z
+        4, 5, 6,  5, 7, 6, // +z
+        0, 4, 2,  2, 4, 6, // -x
+        1, 3, 5,  3, 7, 5, // +x
+        0, 1, 4,  1, 5, 4, // -y
+        2, 6, 3,  3, 6, 7  // +y
+    };
+    memcpy(out_indices, indices, sizeof(indices));
+}
+
+void occlusionInit(OcclusionCuller* oc, int width, int height) {
+    oc->tiles_x = (width + OCCLUSION_TILE_WIDTH - 1) / OCCLUSION_TILE_WIDTH;
+    oc->tiles_y = (height + OCCLUSION_TILE_HEIGHT - 1) / OCCLUSION_TILE_HEIGHT;
+    oc->width = oc->tiles_x * OCCLUSION_TILE_WIDTH;
+    oc->height = oc->tiles_y * OCCLUSION_TILE_HEIGHT;
+
+    oc->levels.clear();
+    oc->level_widths.clear();
+    oc->level_heights.clear();
+    int w = oc->width;
+    int h = oc->height;
+    while (true) {
+        oc->levels.push_back(std::vector<float>(w * h, 1.0f));
+        oc->level_widths.push_back(w);
+        oc->level_heights.push_back(h);
+        if (w == 1 && h == 1) {
+            break;
+        }
+        w = std::max(1, (w + 1) / 2);
+        h = std::max(1, (h + 1) / 2);
+    }
+}
+
+void occlusionBeginFrame(OcclusionCuller* oc, const gfxm::mat4& view_proj) {
+    oc->view_proj = view_proj;
+    std::fill(oc->levels[0].begin(), oc->levels[0].end(), 1.0f);
+    oc->stats = OcclusionStats();
+}
+
+struct ScreenVertex {
+    float x, y, z;
+    bool valid;
+};
+
+static ScreenVertex toScreen(const OcclusionCuller* oc, const gfxm::mat4& mvp, const gfxm::vec3& v) {
+    gfxm::vec4 c = mvp * gfxm::vec4(v.x, v.y, v.z, 1.0f);
+    ScreenVertex sv;
+    sv.valid = c.w > OCCLUSION_MIN_W;
+    if (!sv.valid) {
+        return sv;
+    }
+    const float inv_w = 1.0f / c.w;
+    sv.x = (c.x * inv_w * .5f + .5f) * oc->width;
+    sv.y = (c.y * inv_w * .5f + .5f) * oc->height;
+    sv.z = c.z * inv_w * .5f + .5f;
+    return sv;
+}
+
+// Returns false for triangles that can't occlude anything: back facing, degenerate,
+// off screen or crossing the near plane. Skipping an occluder is always safe
+static bool setupTriangle(const OcclusionCuller* oc, const ScreenVertex& v0, const ScreenVertex& v1, const ScreenVertex& v2, OcclusionTri* out) {
+    if (!v0.valid || !v1.valid || !v2.valid) {
+        return false;
+    }
+    const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+    if (area <= .0f) {
+        return false;
+    }
+
+    const float fmin_x = std::min(v0.x, std::min(v1.x, v2.x));
+    const float fmax_x = std::max(v0.x, std::max(v1.x, v2.x));
+    const float fmin_y = std::min(v0.y, std::min(v1.y, v2.y));
+    const float fmax_y = std::max(v0.y, std::max(v1.y, v2.y));
+    // Pixel centers are at +.5
+    out->min_x = std::max(0, (int)ceilf(fmin_x - .5f));
+    out->max_x = std::min(oc->width - 1, (int)floorf(fmax_x - .5f));
+    out->min_y = std::max(0, (int)ceilf(fmin_y - .5f));
+    out->max_y = std::min(oc->height - 1, (int)floorf(fmax_y - .5f));
+    if (out->min_x > out->max_x || out->min_y > out->max_y) {
+        return false;
+    }
+
+    const ScreenVertex* v[3] = { &v0, &v1, &v2 };
+    for (int i = 0; i < 3; ++i) {
+        const ScreenVertex& a = *v[i];
+        const ScreenVertex& b = *v[(i + 1) % 3];
+        // Positive on the inside of a counter-clockwise edge
+        out->ea[i] = a.y - b.y;
+        out->eb[i] = b.x - a.x;
+        out->ec[i] = a.x * b.y - a.y * b.x;
+    }
+
+    const float inv_area = 1.0f / area;
+    const float dz1 = v1.z - v0.z;
+    const float dz2 = v2.z - v0.z;
+    out->za = (dz1 * (v2.y - v0.y) - dz2 * (v1.y - v0.y)) * inv_area;
+    out->zb = (dz2 * (v1.x - v0.x) - dz1 * (v2.x - v0.x)) * inv_area;
+    out->zc = v0.z - out->za * v0.x - out->zb * v0.y;
+    return true;
+}
+
+static void rasterizeTriScalar(float* depth, int stride, const OcclusionTri& t, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y <= y1; ++y) {
+        const float py = y + .5f;
+        float* row = depth + y * stride;
+        for (int x = x0; x <= x1; ++x) {
+            const float px = x + .5f;
+            float e0 = t.ea[0] * px + t.eb[0] * py + t.ec[0];
+            float e1 = t.ea[1] * px + t.eb[1] * py + t.ec[1];
+            float e2 = t.ea[2] * px + t.eb[2] * py + t.ec[2];
+            if (e0 >= .0f && e1 >= .0f && e2 >= .0f) {
+                float z = t.za * px + t.zb * py + t.zc;
+                row[x] = std::min(row[x], z);
+            }
+        }
+    }
+}
+
+#if SIMD_X86
+// 4 pixels at a time, x0 is aligned down to a group of 4,
+// tile widths are a multiple of 4 so the group never leaves the tile
+static void rasterizeTriSse(float* depth, int stride, const OcclusionTri& t, int x0, int y0, int x1, int y1) {
+    x0 &= ~3;
+    const __m128 lane = _mm_setr_ps(.5f, 1.5f, 2.5f, 3.5f);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 ea0 = _mm_set1_ps(t.ea[0]), ea1 = _mm_set1_ps(t.ea[1]), ea2 = _mm_set1_ps(t.ea[2]);
+    const __m128 za = _mm_set1_ps(t.za);
+    for (int y = y0; y <= y1; ++y) {
+        const float py = y + .5f;
+        const __m128 row0 = _mm_set1_ps(t.eb[0] * py + t.ec[0]);
+        const __m128 row1 = _mm_set1_ps(t.eb[1] * py + t.ec[1]);
+        const __m128 row2 = _mm_set1_ps(t.eb[2] * py + t.ec[2]);
+        const __m128 rowz = _mm_set1_ps(t.zb * py + t.zc);
+        float* row = depth + y * stride;
+        for (int x = x0; x <= x1; x += 4) {
+            const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), lane);
+            __m128 e0 = _mm_add_ps(_mm_mul_ps(ea0, px), row0);
+            __m128 e1 = _mm_add_ps(_mm_mul_ps(ea1, px), row1);
+            __m128 e2 = _mm_add_ps(_mm_mul_ps(ea2, px), row2);
+            __m128 inside = _mm_and_ps(_mm_cmpge_ps(e0, zero), _mm_and_ps(_mm_cmpge_ps(e1, zero), _mm_cmpge_ps(e2, zero)));
+            if (_mm_movemask_ps(inside) == 0) {
+                continue;
+            }
+            __m128 z = _mm_add_ps(_mm_mul_ps(za, px), rowz);
+            __m128 d = _mm_loadu_ps(row + x);
+            __m128 nd = _mm_min_ps(d, z);
+            _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nd), _mm_andnot_ps(inside, d)));
+        }
+    }
+}
+#endif
+
+static void rasterizeTri(float* depth, int stride, const OcclusionTri& t, int x0, int y0, int x1, int y1) {
+#if SIMD_X86
+    rasterizeTriSse(depth, stride, t, x0, y0, x1, y1);
+#else
+    rasterizeTriScalar(depth, stride, t, x0, y0, x1, y1);
+#endif
+}
+
+void occlusionRasterize(OcclusionCuller* oc, const OcclusionMesh* meshes, int mesh_count, ThreadPool* pool) {
+    auto t_start = std::chrono::steady_clock::now();
+
+    struct BinJob {
+        int mesh;
+        int first_tri;
+        int tri_count;
+        int out_offset;
+    };
+    std::vector<BinJob> jobs;
+    int total_tris = 0;
+    for (int i = 0; i < mesh_count; ++i) {
+        const int mesh_tris = meshes[i].index_count / 3;
+        for (int t = 0; t < mesh_tris; t += OCCLUSION_BIN_JOB_TRIANGLES) {
+            BinJob job;
+            job.mesh = i;
+            job.first_tri = t;
+            job.tri_count = std::min(OCCLUSION_BIN_JOB_TRIANGLES, mesh_tris - t);
+            job.out_offset = total_tris;
+            jobs.push_back(job);
+            total_tris += job.tri_count;
+        }
+    }
+    oc->stats.occluder_triangles = total_tris;
+    oc->tris.resize(total_tris);
+
+    const int workers = pool->threadCount();
+    const int tile_count = oc->tiles_x * oc->tiles_y;
+    if (oc->bin_workers != workers || oc->bins.size() != workers * tile_count) {
+        oc->bins.clear();
+        oc->bins.resize(workers * tile_count);
+        oc->bin_workers = workers;
+    }
+    for (auto& bin : oc->bins) {
+        bin.clear();
+    }
+
+    // Setup and binning
+    std::atomic<int> rasterized = 0;
+    pool->parallelFor(jobs.size(), [&](int job_idx, int worker) {
+        const BinJob& job = jobs[job_idx];
+        const OcclusionMesh& mesh = meshes[job.mesh];
+        const gfxm::mat4 mvp = oc->view_proj * mesh.transform;
+        std::vector<uint32_t>* bins = &oc->bins[worker * tile_count];
+        int accepted = 0;
+        for (int i = 0; i < job.tri_count; ++i) {
+            const uint32_t* idx = &mesh.indices[(job.first_tri + i) * 3];
+            ScreenVertex v0 = toScreen(oc, mvp, mesh.vertices[idx[0]]);
+            ScreenVertex v1 = toScreen(oc, mvp, mesh.vertices[idx[1]]);
+            ScreenVertex v2 = toScreen(oc, mvp, mesh.vertices[idx[2]]);
+            const uint32_t tri_idx = job.out_offset + i;
+            OcclusionTri& tri = oc->tris[tri_idx];
+            if (!setupTriangle(oc, v0, v1, v2, &tri)) {
+                continue;
+            }
+            ++accepted;
+            const int tx0 = tri.min_x / OCCLUSION_TILE_WIDTH;
+            const int tx1 = tri.max_x / OCCLUSION_TILE_WIDTH;
+            const int ty0 = tri.min_y / OCCLUSION_TILE_HEIGHT;
+            const int ty1 = tri.max_y / OCCLUSION_TILE_HEIGHT;
+            for (int ty = ty0; ty <= ty1; ++ty) {
+                for (int tx = tx0; tx <= tx1; ++tx) {
+                    bins[ty * oc->tiles_x + tx].push_back(tri_idx);
+                }
+            }
+        }
+        rasterized += accepted;
+    });
+    oc->stats.rasterized_triangles = rasterized;
+
+    // Tiles don't overlap, each one is owned by a single job
+    float* depth = oc->levels[0].data();
+    pool->parallelFor(tile_count, [&](int tile, int) {
+        const int tx = tile % oc->tiles_x;
+        const int ty = tile / oc->tiles_x;
+        const int tile_x0 = tx * OCCLUSION_TILE_WIDTH;
+        const int tile_y0 = ty * OCCLUSION_TILE_HEIGHT;
+        const int tile_x1 = tile_x0 + OCCLUSION_TILE_WIDTH - 1;
+        const int tile_y1 = tile_y0 + OCCLUSION_TILE_HEIGHT - 1;
+        for (int w = 0; w < workers; ++w) {
+            const std::vector<uint32_t>& bin = oc->bins[w * tile_count + tile];
+            for (uint32_t tri_idx : bin) {
+                const OcclusionTri& t = oc->tris[tri_idx];
+                rasterizeTri(
+                    depth, oc->width, t,
+                    std::max(t.min_x, tile_x0), std::max(t.min_y, tile_y0),
+                    std::min(t.max_x, tile_x1), std::min(t.max_y, tile_y1)
+                );
+            }
+        }
+    });
+
+    oc->stats.raster_ms += msSince(t_start);
+}
+
+void occlusionBuildPyramid(OcclusionCuller* oc) {
+    auto t_start = std::chrono::steady_clock::now();
+    for (int l = 1; l < oc->levels.size(); ++l) {
+        const std::vector<float>& src = oc->levels[l - 1];
+        std::vector<float>& dst = oc->levels[l];
+        const int sw = oc->level_widths[l - 1];
+        const int sh = oc->level_heights[l - 1];
+        const int dw = oc->level_widths[l];
+        const int dh = oc->level_heights[l];
+        for (int y = 0; y < dh; ++y) {
+            const int sy0 = std::min(y * 2, sh - 1);
+            const int sy1 = std::min(y * 2 + 1, sh - 1);
+            for (int x = 0; x < dw; ++x) {
+                const int sx0 = std::min(x * 2, sw - 1);
+                const int sx1 = std::min(x * 2 + 1, sw - 1);
+                dst[y * dw + x] = std::max(
+                    std::max(src[sy0 * sw + sx0], src[sy0 * sw + sx1]),
+                    std::max(src[sy1 * sw + sx0], src[sy1 * sw + sx1])
+                );
+            }
+        }
+    }
+    oc->stats.raster_ms += msSince(t_start);
+}
+
+bool occlusionTestAabb(const OcclusionCuller* oc, const gfxm::aabb& box) {
+    float min_x = FLT_MAX, min_y = FLT_MAX, min_z = FLT_MAX;
+    float max_x = -FLT_MAX, max_y = -FLT_MAX;
+    // One full transform, the other corners are the origin plus projected edge vectors
+    const gfxm::mat4& m = oc->view_proj;
+    const gfxm::vec4 origin = m * gfxm::vec4(box.from.x, box.from.y, box.from.z, 1.0f);
+    const gfxm::vec4 ex = m[0] * (box.to.x - box.from.x);
+    const gfxm::vec4 ey = m[1] * (box.to.y - box.from.y);
+    const gfxm::vec4 ez = m[2] * (box.to.z - box.from.z);
+    for (int i = 0; i < 8; ++i) {
+        gfxm::vec4 c = origin;
+        if (i & 1) c = c + ex;
+        if (i & 2) c = c + ey;
+        if (i & 4) c = c + ez;
+        if (c.w <= OCCLUSION_MIN_W) {
+            // Crosses the near plane, assume visible
+            return true;
+        }
+        const float inv_w = 1.0f / c.w;
+        const float sx = (c.x * inv_w * .5f + .5f) * oc->width;
+        const float sy = (c.y * inv_w * .5f + .5f) * oc->height;
+        const float sz = c.z * inv_w * .5f + .5f;
+        min_x = std::min(min_x, sx);
+        max_x = std::max(max_x, sx);
+        min_y = std::min(min_y, sy);
+        max_y = std::max(max_y, sy);
+        min_z = std::min(min_z, sz);
+    }
+    if (min_z <= .0f) {
+        return true;
+    }
+
+    // Depth is only known at pixel centers, take every center needed to enclose the rectangle,
+    // otherwise an occluder edge passing between a center and the box border would hide a visible sliver
+    int x0 = std::max(0, (int)floorf(min_x - .5f));
+    int y0 = std::max(0, (int)floorf(min_y - .5f));
+    int x1 = std::min(oc->width - 1, (int)ceilf(max_x - .5f));
+    int y1 = std::min(oc->height - 1, (int)ceilf(max_y - .5f));
+    if (x0 > x1 || y0 > y1) {
+        // Off screen, that's for the frustum test to decide
+        return true;
+    }
+
+    // Coarsest level where the rectangle spans at most 4x4 texels,
+    // going coarser reads fewer texels but drags in more depth from outside the box
+    int level = 0;
+    while (level + 1 < oc->levels.size() && ((x1 >> level) - (x0 >> level) > 3 || (y1 >> level) - (y0 >> level) > 3)) {
+        ++level;
+    }
+    const std::vector<float>& depth = oc->levels[level];
+    const int lw = oc->level_widths[level];
+    for (int y = y0 >> level; y <= (y1 >> level); ++y) {
+        for (int x = x0 >> level; x <= (x1 >> level); ++x) {
+            if (min_z <= depth[y * lw + x]) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+int occlusionCullList(OcclusionCuller* oc, const AabbSoa* boxes, const uint32_t* in, int count, uint32_t* out, ThreadPool* pool) {
+    auto t_start = std::chrono::steady_clock::now();
+
+    const int chunk_count = (count + OCCLUSION_TEST_CHUNK_SIZE - 1) / OCCLUSION_TEST_CHUNK_SIZE;
+    std::vector<int> chunk_kept(chunk_count);
+    // Each chunk compacts within its own range, safe when in == out
+    pool->parallelFor(chunk_count, [&](int chunk, int) {
+        const int begin = chunk * OCCLUSION_TEST_CHUNK_SIZE;
+        const int end = std::min(begin + OCCLUSION_TEST_CHUNK_SIZE, count);
+        int n = 0;
+        for (int i = begin; i < end; ++i) {
+            const uint32_t idx = in[i];
+            if (occlusionTestAabb(oc, aabbSoaGet(boxes, idx))) {
+                out[begin + n++] = idx;
+            }
+        }
+        chunk_kept[chunk] = n;
+    });
+
+    int total = 0;
+    for (int i = 0; i < chunk_count; ++i) {
+        const int n = chunk_kept[i];
+        if (n && total != i * OCCLUSION_TEST_CHUNK_SIZE) {
+            memmove(out + total, out + i * OCCLUSION_TEST_CHUNK_SIZE, n * sizeof(uint32_t));
+        }
+        total += n;
+    }
+
+    oc->stats.tested += count;
+    oc->stats.culled += count - total;
+    oc->stats.test_ms += msSince(t_start);
+    return total;
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+
+
+class ThreadPool;
+struct AabbSoa;
+
+// Occluder geometry, triangles wound counter-clockwise like everything else we draw.
+// Should lie inside the visible mesh, an occluder bigger than what's drawn hides things that are visible
+struct OcclusionMesh {
+	const gfxm::vec3* vertices;
+	int vertex_count;
+	const uint32_t* indices;
+	int index_count;
+	gfxm::mat4 transform;
+};
+
+// 8 vertices and 36 indices, for a quick occluder from a box known to be solid
+void makeOcclusionBox(const gfxm::aabb& box, gfxm::vec3* out_vertices, uint32_t* out_indices);
+
+constexpr int OCCLUSION_TILE_WIDTH = 64;
+constexpr int OCCLUSION_TILE_HEIGHT = 32;
+constexpr int OCCLUSION_BIN_JOB_TRIANGLES = 1024;
+
+struct OcclusionTri {
+	// Edge functions e = a * x + b * y + c, inside where all three are >= 0
+	float ea[3];
+	float eb[3];
+	float ec[3];
+	// Depth plane, z = za * x + zb * y + zc
+	float za, zb, zc;
+	int min_x, min_y, max_x, max_y;
+};
+
+struct OcclusionStats {
+	int occluder_triangles = 0;
+	int rasterized_triangles = 0;
+	int tested = 0;
+	int culled = 0;
+	double raster_ms = .0;
+	double test_ms = .0;
+};
+
+// Low resolution depth buffer for the current view plus a max-depth pyramid over it.
+// Depth is window z in [0, 1], 1 where nothing was drawn
+struct OcclusionCuller {
+	int width = 0;
+	int height = 0;
+	int tiles_x = 0;
+	int tiles_y = 0;
+	gfxm::mat4 view_proj;
+
+	// Level 0 is the rasterized depth, every next level holds the max of 2x2 texels
+	std::vector<std::vector<float>> levels;
+	std::vector<int> level_widths;
+	std::vector<int> level_heights;
+
+	// Binning, one list per worker per tile so setup needs no locks
+	std::vector<OcclusionTri> tris;
+	std::vector<std::vector<uint32_t>> bins;
+	int bin_workers = 0;
+
+	OcclusionStats stats;
+};
+
+// Size is rounded up to whole tiles
+void occlusionInit(OcclusionCuller* oc, int width, int height);
+void occlusionBeginFrame(OcclusionCuller* oc, const gfxm::mat4& view_proj);
+// Transforms and bins triangles, then rasterizes tiles in parallel
+void occlusionRasterize(OcclusionCuller* oc, const OcclusionMesh* meshes, int mesh_count, ThreadPool* pool);
+void occlusionBuildPyramid(OcclusionCuller* oc);
+
+// False if the box is certainly hidden behind occluders
+bool occlusionTestAabb(const OcclusionCuller* oc, const gfxm::aabb& box);
+// Filters an index list, e.g. the output of frustum culling. in and out may be the same array.
+// Returns the number of indices kept, order is preserved
+int occlusionCullList(OcclusionCuller* oc, const AabbSoa* boxes, const uint32_t* in, int count, uint32_t* out, ThreadPool* pool);
@@ -0,0 +1,149 @@
+#include "benchmarks.hpp"
+
+#include <float.h>
+#include <algorithm>
+#include <vector>
+#include "frustum_cull.hpp"
+#include "log/log.hpp"
+#include "occlusion_cull.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+
+
+static gfxm::vec3 projectToWindow(const gfxm::mat4& view_proj, const gfxm::vec3& p, int w, int h) {
+    gfxm::vec4 c = view_proj * gfxm::vec4(p.x, p.y, p.z, 1.0f);
+    return gfxm::vec3((c.x / c.w * .5f + .5f) * w, (c.y / c.w * .5f + .5f) * h, c.z / c.w * .5f + .5f);
+}
+
+// One wall facing the camera and boxes scattered around and behind it.
+// A box is hidden only if its screen rectangle is inside the wall's and it's further away,
+// the culler must never hide anything else
+static bool validateOcclusion(OcclusionCuller* oc) {
+    const gfxm::mat4 proj = gfxm::perspective(gfxm::radian(60.f), 2.f, .1f, 500.f);
+    const gfxm::mat4 view_proj = proj; // Camera at the origin looking down -z
+
+    gfxm::vec3 wall_verts[8];
+    uint32_t wall_indices[36];
+    const gfxm::aabb wall(gfxm::vec3(-10.f, -5.f, -21.f), gfxm::vec3(10.f, 5.f, -20.f));
+    makeOcclusionBox(wall, wall_verts, wall_indices);
+    OcclusionMesh mesh = { wall_verts, 8, wall_indices, 36, gfxm::mat4(1.0f) };
+
+    occlusionBeginFrame(oc, view_proj);
+    occlusionRasterize(oc, &mesh, 1, getThreadPool());
+    occlusionBuildPyramid(oc);
+
+    const gfxm::vec3 wall_lo = projectToWindow(view_proj, gfxm::vec3(wall.from.x, wall.from.y, wall.to.z), oc->width, oc->height);
+    const gfxm::vec3 wall_hi = projectToWindow(view_proj, gfxm::vec3(wall.to.x, wall.to.y, wall.to.z), oc->width, oc->height);
+
+    uint32_t seed = 0x5EED;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+
+    int wrongly_culled = 0;
+    int expected_hidden = 0;
+    int hidden = 0;
+    for (int i = 0; i < 20000; ++i) {
+        gfxm::vec3 c((rnd01() * 2.f - 1.f) * 30.f, (rnd01() * 2.f - 1.f) * 15.f, -5.f - rnd01() * 60.f);
+        gfxm::vec3 e(.2f + rnd01(), .2f + rnd01(), .2f + rnd01());
+        gfxm::aabb box(c - e, c + e);
+
+        bool behind_wall = box.to.z < wall.to.z;
+        float min_x = FLT_MAX, min_y = FLT_MAX, max_x = -FLT_MAX, max_y = -FLT_MAX;
+        for (int k = 0; k < 8; ++k) {
+            gfxm::vec3 p = projectToWindow(view_proj, gfxm::vec3(
+                (k & 1) ? box.to.x : box.from.x, (k & 2) ? box.to.y : box.from.y, (k & 4) ? box.to.z : box.from.z
+            ), oc->width, oc->height);
+            min_x = std::min(min_x, p.x); max_x = std::max(max_x, p.x);
+            min_y = std::min(min_y, p.y); max_y = std::max(max_y, p.y);
+        }
+        // Two pixels of slack, coverage is sampled at pixel centers
+        bool inside_wall = min_x >= wall_lo.x + 2.f && max_x <= wall_hi.x - 2.f
+            && min_y >= wall_lo.y + 2.f && max_y <= wall_hi.y - 2.f;
+        bool must_be_visible = !behind_wall || min_x < wall_lo.x || max_x > wall_hi.x || min_y < wall_lo.y || max_y > wall_hi.y;
+
+        bool visible = occlusionTestAabb(oc, box);
+        if (!visible && must_be_visible) {
+            ++wrongly_culled;
+        }
+        if (behind_wall && inside_wall) {
+            ++expected_hidden;
+            hidden += visible ? 0 : 1;
+        }
+    }
+
+    LOG("bench", "occlusion: validation " << wrongly_culled << " visible boxes culled, "
+        << hidden << "/" << expected_hidden << " boxes hidden behind the wall were culled");
+    if (oc->stats.rasterized_triangles == 0) {
+        LOG_ERR("bench", "occlusion: wall produced no triangles, check winding");
+        return false;
+    }
+    return wrongly_culled == 0;
+}
+
+void benchOcclusionCull() {
+    const int OBJECT_COUNT = 100000;
+    const int BUILDING_COUNT = 400;
+    const int FRAMES = 30;
+
+    OcclusionCuller oc;
+    occlusionInit(&oc, 256, 128);
+    bool ok = validateOcclusion(&oc);
+    LOG("bench", "occlusion: correctness " << (ok ? "passed" : "FAILED"));
+
+    // A city block: buildings as occluders, small props everywhere
+    uint32_t seed = 0xC17;
+    auto rnd01 = [&seed]()->float {
+        seed = seed * 1664525u + 1013904223u;
+        return (seed >> 8) / (float)(1 << 24);
+    };
+    std::vector<gfxm::vec3> building_verts(BUILDING_COUNT * 8);
+    std::vector<uint32_t> building_indices(BUILDING_COUNT * 36);
+    std::vector<OcclusionMesh> occluders(BUILDING_COUNT);
+    for (int i = 0; i < BUILDING_COUNT; ++i) {
+        float x = (i % 20) * 25.f - 250.f + rnd01() * 5.f;
+        float z = (i / 20) * 25.f - 250.f + rnd01() * 5.f;
+        float h = 10.f + rnd01() * 40.f;
+        makeOcclusionBox(gfxm::aabb(gfxm::vec3(x, 0, z), gfxm::vec3(x + 15.f, h, z + 15.f)), &building_verts[i * 8], &building_indices[i * 36]);
+        occluders[i] = OcclusionMesh{ &building_verts[i * 8], 8, &building_indices[i * 36], 36, gfxm::mat4(1.0f) };
+    }
+
+    AabbSoa boxes;
+    aabbSoaResize(&boxes, OBJECT_COUNT);
+    for (int i = 0; i < OBJECT_COUNT; ++i) {
+        gfxm::vec3 c((rnd01() * 2.f - 1.f) * 250.f, rnd01() * 3.f, (rnd01() * 2.f - 1.f) * 250.f);
+        aabbSoaSet(&boxes, i, gfxm::aabb(c - gfxm::vec3(.5f, .5f, .5f), c + gfxm::vec3(.5f, .5f, .5f)));
+    }
+    std::vector<uint32_t> visible(OBJECT_COUNT);
+
+    const gfxm::mat4 proj = gfxm::perspective(gfxm::radian(60.f), 2.f, .1f, 1000.f);
+    double frustum_ms = .0, raster_ms = .0, test_ms = .0;
+    int in_frustum = 0, after_occlusion = 0;
+    for (int frame = 0; frame < FRAMES; ++frame) {
+        // Walking down a street
+        gfxm::mat4 cam = gfxm::translate(gfxm::mat4(1.0f), gfxm::vec3(-237.f, 1.7f, 240.f - frame * 5.f));
+        cam = cam * gfxm::to_mat4(gfxm::angle_axis(gfxm::radian(-20.f), gfxm::vec3(0, 1, 0)));
+        const gfxm::mat4 view_proj = proj * gfxm::inverse(cam);
+
+        Stopwatch sw;
+        int n = frustumCullAabbsParallel(gfxm::make_frustum(view_proj), &boxes, visible.data(), getThreadPool());
+        frustum_ms += sw.elapsedMs();
+        in_frustum += n;
+
+        occlusionBeginFrame(&oc, view_proj);
+        occlusionRasterize(&oc, occluders.data(), occluders.size(), getThreadPool());
+        occlusionBuildPyramid(&oc);
+        n = occlusionCullList(&oc, &boxes, visible.data(), n, visible.data(), getThreadPool());
+        after_occlusion += n;
+        raster_ms += oc.stats.raster_ms;
+        test_ms += oc.stats.test_ms;
+    }
+
+    LOG("bench", "occlusion: " << oc.width << "x" << oc.height << " depth, " << BUILDING_COUNT * 12 << " occluder triangles, "
+        << OBJECT_COUNT << " objects, " << getThreadPool()->threadCount() << " threads");
+    LOG("bench", "occlusion: per frame " << in_frustum / FRAMES << " in frustum, " << after_occlusion / FRAMES << " after occlusion, "
+        << (100.0 * (in_frustum - after_occlusion) / std::max(1, in_frustum)) << "% of frustum-visible objects culled");
+    LOG("bench", "occlusion: per frame frustum " << frustum_ms / FRAMES << "ms, rasterize+pyramid " << raster_ms / FRAMES
+        << "ms, occlusion test " << test_ms / FRAMES << "ms");
+}
@@ -0,0 +1,51 @@
+#include "prefilter_samples.hpp"
+
+#include <math.h>
+#include <algorithm>
+
+
+constexpr float PREFILTER_PI = 3.14159265359f;
+
+static float radicalInverseVdC(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float)(bits * 2.3283064365386963e-10);
+}
+
+void prefilterBuildSamples(std::vector<PrefilterSample>* out, float roughness, int sample_count, int source_size) {
+    out->clear();
+    if (roughness == .0f) {
+        out->push_back(PrefilterSample{ .0f, .0f, 1.f, .0f });
+        return;
+    }
+    const float a = roughness * roughness;
+    const float a2 = a * a;
+    const float sa_texel = 4.f * PREFILTER_PI / (6.f * source_size * source_size);
+    for (int i = 0; i < sample_count; ++i) {
+        // GGX half vector, then the light direction it reflects V = N into
+        const float phi = 2.f * PREFILTER_PI * (float)i / (float)sample_count;
+        const float xi = radicalInverseVdC((uint32_t)i);
+        const float cos_theta = sqrtf((1.f - xi) / (1.f + (a2 - 1.f) * xi));
+        const float sin_theta = sqrtf(std::max(.0f, 1.f - cos_theta * cos_theta));
+        const float hx = cosf(phi) * sin_theta;
+        const float hy = sinf(phi) * sin_theta;
+        const float hz = cos_theta;
+        const float lx = 2.f * hz * hx;
+        const float ly = 2.f * hz * hy;
+        const float lz = 2.f * hz * hz - 1.f;
+        if (lz <= .0f) {
+            continue;
+        }
+        const float len = sqrtf(lx * lx + ly * ly + lz * lz);
+
+        // pdf of L is D * NdotH / (4 * HdotV), with V = N that leaves D / 4
+        const float denom = hz * hz * (a2 - 1.f) + 1.f;
+        const float d = a2 / (PREFILTER_PI * denom * denom);
+        const float pdf = d / 4.f + .0001f;
+        const float sa_sample = 1.f / ((float)sample_count * pdf + .0001f);
+        out->push_back(PrefilterSample{ lx / len, ly / len, lz / len, std::max(.0f, .5f * log2f(sa_sample / sa_texel)) });
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+
+// Filtered importance sampling for the specular prefilter, see shaders/prefilter_convolute_cubemap.glsl.
+// The prefilter assumes V = N, so every texel of a mip takes the same GGX samples in its own tangent frame.
+// Directions, weights and source lods are computed here once per mip instead of per texel and sample
+
+// Matches bufPrefilterSamples in shaders/prefilter_convolute_cubemap.glsl
+constexpr uint32_t SSBO_BINDING_PREFILTER_SAMPLES = 5;
+
+// Sample count of the shader's per texel loop, the reference the tables are measured against
+constexpr int PREFILTER_REFERENCE_SAMPLES = 1024;
+
+// Light direction in the tangent frame around N = +z, z doubles as the NdotL weight
+struct PrefilterSample {
+	float x;
+	float y;
+	float z;
+	float lod;		// Source mip whose texels cover about the solid angle this sample stands for
+};
+
+// Hammersley points over sample_count, the ones with NdotL <= 0 are dropped so fewer can come back.
+// Fewer samples each cover more solid angle and read a blurrier source mip, which keeps the noise down.
+// Roughness 0 is the single sample along N
+void prefilterBuildSamples(std::vector<PrefilterSample>* out, float roughness, int sample_count, int source_size);
@@ -0,0 +1,276 @@
+#include "reflection_probes.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+#include "profiler/stopwatch.hpp"
+
+
+constexpr int PROBE_PREFILTER_STEP = 6;
+constexpr size_t PROBE_BUFFER_HEADER_SIZE = 4 * sizeof(uint32_t);
+
+// Textures only, the buffers are a few KB
+static size_t reflectionProbesTextureBytes(const ReflectionProbeParams& params) {
+    size_t bytes = 0;
+    for (int mip = 0; mip < REFLECTION_PROBE_MIPS; ++mip) {
+        const size_t s = std::max(1, params.size >> mip);
+        bytes += s * s * 6 * params.max_probes * 4;
+    }
+    for (int s = params.capture_size; s > 0; s >>= 1) {
+        bytes += (size_t)s * s * 6 * 4;
+    }
+    bytes += (size_t)params.capture_size * params.capture_size * 4;
+    return bytes;
+}
+
+void glxInitReflectionProbes(ReflectionProbes* rp, const ReflectionProbeParams& params) {
+    rp->params = params;
+    rp->params.max_probes = std::min(params.max_probes, REFLECTION_PROBE_MAX);
+    rp->probes.clear();
+    rp->current = -1;
+    rp->next_face = 0;
+    rp->round_robin = 0;
+    rp->stats = ReflectionProbeStats();
+
+    glGenTextures(1, &rp->cube_array);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, rp->cube_array);
+    glTexStorage3D(GL_TEXTURE_CUBE_MAP_ARRAY, REFLECTION_PROBE_MIPS, FORMAT_REFLECTION_PROBE, rp->params.size, rp->params.size, rp->params.max_probes * 6);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP_ARRAY, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP_ARRAY, 0);
+
+    int capture_levels = 0;
+    while ((params.capture_size >> capture_levels) > 0) {
+        ++capture_levels;
+    }
+    glGenTextures(1, &rp->capture_cube);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, rp->capture_cube);
+    glTexStorage2D(GL_TEXTURE_CUBE_MAP, capture_levels, FORMAT_REFLECTION_PROBE, params.capture_size, params.capture_size);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
+
+    // One face is rendered at a time, they share the depth buffer
+    glGenRenderbuffers(1, &rp->capture_depth);
+    glBindRenderbuffer(GL_RENDERBUFFER, rp->capture_depth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, params.capture_size, params.capture_size);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+    glGenFramebuffers(1, &rp->fbo);
+
+    glGenBuffers(1, &rp->probe_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rp->probe_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, PROBE_BUFFER_HEADER_SIZE + rp->params.max_probes * sizeof(GpuReflectionProbe), 0, GL_STREAM_DRAW);
+    glGenBuffers(1, &rp->tile_buffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rp->tile_buffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(rp->tile_masks), 0, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    memset(rp->tile_masks, 0, sizeof(rp->tile_masks));
+
+    glxInitGpuTimer(&rp->gpu_timer);
+    rp->stats.texture_bytes = reflectionProbesTextureBytes(rp->params);
+    LOG("renderer", "Reflection probes: up to " << rp->params.max_probes << " at " << rp->params.size << "x" << rp->params.size
+        << " captured at " << params.capture_size << "x" << params.capture_size << ", " << rp->stats.texture_bytes / 1024 << "KB of textures, "
+        << rp->params.steps_per_frame << " steps per frame");
+}
+
+void glxDestroyReflectionProbes(ReflectionProbes* rp) {
+    glDeleteTextures(1, &rp->cube_array);
+    glDeleteTextures(1, &rp->capture_cube);
+    glDeleteRenderbuffers(1, &rp->capture_depth);
+    glDeleteFramebuffers(1, &rp->fbo);
+    glDeleteBuffers(1, &rp->probe_buffer);
+    glDeleteBuffers(1, &rp->tile_buffer);
+    rp->cube_array = rp->capture_cube = rp->capture_depth = rp->fbo = rp->probe_buffer = rp->tile_buffer = 0;
+    glxDestroyGpuTimer(&rp->gpu_timer);
+    rp->probes.clear();
+    rp->gpu_probes.clear();
+}
+
+int reflectionProbeAdd(ReflectionProbes* rp, const gfxm::vec3& position, const gfxm::aabb& box, float blend_distance) {
+    if ((int)rp->probes.size() >= rp->params.max_probes) {
+        LOG_WARN("renderer", "Reflection probe limit of " << rp->params.max_probes << " reached");
+        return -1;
+    }
+    ReflectionProbe probe;
+    probe.position = position;
+    probe.box = box;
+    probe.blend_distance = blend_distance;
+    rp->probes.push_back(probe);
+    return (int)rp->probes.size() - 1;
+}
+
+static bool aabbOverlap(const gfxm::aabb& a, const gfxm::aabb& b) {
+    return a.from.x <= b.to.x && a.to.x >= b.from.x
+        && a.from.y <= b.to.y && a.to.y >= b.from.y
+        && a.from.z <= b.to.z && a.to.z >= b.from.z;
+}
+
+void reflectionProbesMarkDirty(ReflectionProbes* rp, const gfxm::aabb& changed) {
+    for (ReflectionProbe& probe : rp->probes) {
+        if (aabbOverlap(probe.box, changed)) {
+            probe.dirty = true;
+        }
+    }
+}
+
+void reflectionProbesMarkAllDirty(ReflectionProbes* rp) {
+    for (ReflectionProbe& probe : rp->probes) {
+        probe.dirty = true;
+    }
+}
+
+// The dirty flag is cleared when a capture starts, a change during the capture queues the probe again
+static bool reflectionProbesNextStep(ReflectionProbes* rp, ReflectionProbeStep* step) {
+    if (rp->current < 0) {
+        const int count = (int)rp->probes.size();
+        for (int i = 0; i < count; ++i) {
+            const int idx = (rp->round_robin + i) % count;
+            if (rp->probes[idx].dirty) {
+                rp->current = idx;
+                break;
+            }
+        }
+        if (rp->current < 0) {
+            return false;
+        }
+        rp->probes[rp->current].dirty = false;
+        rp->round_robin = (rp->current + 1) % count;
+        rp->next_face = 0;
+    }
+    step->probe = rp->current;
+    step->face = rp->next_face;
+    step->kind = rp->next_face == PROBE_PREFILTER_STEP ? PROBE_STEP_PREFILTER : PROBE_STEP_CAPTURE_FACE;
+    if (++rp->next_face > PROBE_PREFILTER_STEP) {
+        rp->probes[rp->current].captured = true;
+        rp->current = -1;
+        rp->stats.updates++;
+    }
+    return true;
+}
+
+void glxUpdateReflectionProbes(ReflectionProbes* rp, const std::function<void(const ReflectionProbeStep&)>& run) {
+    PROF_SCOPE_FN();
+    Stopwatch sw;
+    ReflectionProbeStep step;
+    int steps = 0;
+    while (steps < rp->params.steps_per_frame && reflectionProbesNextStep(rp, &step)) {
+        if (steps == 0) {
+            glxGpuTimerBegin(&rp->gpu_timer);
+        }
+        run(step);
+        ++steps;
+    }
+    if (steps > 0) {
+        glxGpuTimerEnd(&rp->gpu_timer);
+        rp->stats.cpu_ms = sw.elapsedMs();
+        rp->stats.max_cpu_ms = std::max(rp->stats.max_cpu_ms, rp->stats.cpu_ms);
+    }
+    rp->stats.steps = steps;
+    rp->stats.dirty = rp->current < 0 ? 0 : 1;
+    for (int i = 0; i < (int)rp->probes.size(); ++i) {
+        rp->stats.dirty += (rp->probes[i].dirty && i != rp->current) ? 1 : 0;
+    }
+    if (glxGpuTimerResolve(&rp->gpu_timer)) {
+        rp->stats.gpu_ms = rp->gpu_timer.last_ms;
+        rp->stats.max_gpu_ms = std::max(rp->stats.max_gpu_ms, rp->stats.gpu_ms);
+    }
+}
+
+// Tiles covered by the box's screen rectangle, conservative: a box reaching behind the eye covers everything.
+// Returns false if the box is off screen
+static bool probeTileRect(const gfxm::aabb& box, const gfxm::mat4& view_proj, int* x0, int* y0, int* x1, int* y1) {
+    float min_x = 1.f, min_y = 1.f, max_x = -1.f, max_y = -1.f;
+    bool behind = false;
+    for (int i = 0; i < 8; ++i) {
+        const gfxm::vec3 corner(
+            (i & 1) ? box.to.x : box.from.x,
+            (i & 2) ? box.to.y : box.from.y,
+            (i & 4) ? box.to.z : box.from.z
+        );
+        const gfxm::vec4 clip = view_proj * gfxm::vec4(corner, 1.0f);
+        if (clip.w <= 1e-4f) {
+            behind = true;
+            break;
+        }
+        min_x = std::min(min_x, clip.x / clip.w);
+        min_y = std::min(min_y, clip.y / clip.w);
+        max_x = std::max(max_x, clip.x / clip.w);
+        max_y = std::max(max_y, clip.y / clip.w);
+    }
+    if (behind) {
+        *x0 = 0;
+        *y0 = 0;
+        *x1 = PROBE_TILES_X - 1;
+        *y1 = PROBE_TILES_Y - 1;
+        return true;
+    }
+    if (max_x < -1.f || max_y < -1.f || min_x > 1.f || min_y > 1.f) {
+        return false;
+    }
+    *x0 = std::clamp((int)floorf((min_x * .5f + .5f) * PROBE_TILES_X), 0, PROBE_TILES_X - 1);
+    *y0 = std::clamp((int)floorf((min_y * .5f + .5f) * PROBE_TILES_Y), 0, PROBE_TILES_Y - 1);
+    *x1 = std::clamp((int)floorf((max_x * .5f + .5f) * PROBE_TILES_X), 0, PROBE_TILES_X - 1);
+    *y1 = std::clamp((int)floorf((max_y * .5f + .5f) * PROBE_TILES_Y), 0, PROBE_TILES_Y - 1);
+    return true;
+}
+
+void reflectionProbesBin(ReflectionProbes* rp, const gfxm::mat4& view, const gfxm::mat4& proj) {
+    PROF_SCOPE_FN();
+    std::vector<int> order;
+    for (int i = 0; i < (int)rp->probes.size(); ++i) {
+        if (rp->probes[i].captured) {
+            order.push_back(i);
+        }
+    }
+    std::sort(order.begin(), order.end(), [rp](int a, int b) {
+        return gfxm::volume(rp->probes[a].box) < gfxm::volume(rp->probes[b].box);
+    });
+
+    memset(rp->tile_masks, 0, sizeof(rp->tile_masks));
+    rp->gpu_probes.clear();
+    rp->stats.visible = 0;
+    const gfxm::mat4 view_proj = proj * view;
+    for (int idx : order) {
+        const ReflectionProbe& probe = rp->probes[idx];
+        int x0, y0, x1, y1;
+        if (!probeTileRect(probe.box, view_proj, &x0, &y0, &x1, &y1)) {
+            continue;
+        }
+        const uint32_t bit = 1u << rp->gpu_probes.size();
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                rp->tile_masks[y * PROBE_TILES_X + x] |= bit;
+            }
+        }
+        GpuReflectionProbe gpu;
+        gpu.box_min_blend = gfxm::vec4(probe.box.from, probe.blend_distance);
+        gpu.box_max_layer = gfxm::vec4(probe.box.to, (float)idx);
+        gpu.position = gfxm::vec4(probe.position, 1.0f);
+        rp->gpu_probes.push_back(gpu);
+        rp->stats.visible++;
+    }
+}
+
+void glxUploadReflectionProbes(ReflectionProbes* rp) {
+    PROF_SCOPE_FN();
+    const uint32_t header[4] = { PROBE_TILES_X, PROBE_TILES_Y, (uint32_t)rp->gpu_probes.size(), 0 };
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rp->probe_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(header), header);
+    if (!rp->gpu_probes.empty()) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, PROBE_BUFFER_HEADER_SIZE, rp->gpu_probes.size() * sizeof(GpuReflectionProbe), rp->gpu_probes.data());
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, rp->tile_buffer);
+    glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(rp->tile_masks), rp->tile_masks);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_PROBES, rp->probe_buffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, SSBO_BINDING_PROBE_TILES, rp->tile_buffer);
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stdint.h>
+#include <functional>
+#include <vector>
+#include "math/gfxm.hpp"
+#include "platform/win32/gl/glextutil.h"
+#include "gpu_timer.hpp"
+
+
+// Local reflection probes. Each probe is a low resolution cubemap captured from a point in the scene and
+// prefiltered like the environment, inside its influence box it takes over from the global IBL maps.
+// Probes are only captured while dirty, a few faces per frame round-robin over the dirty ones, so the
+// per frame cost stays bounded however many probes change. The renderer runs the capture and prefilter
+// passes, this keeps the probes, the schedule, the textures and the per tile probe masks
+
+// Matches ProbeData in data/shaders/uniform_blocks/probes.glsl (std430)
+struct GpuReflectionProbe {
+	gfxm::vec4 box_min_blend;		// Influence box min, blend distance inwards from its faces
+	gfxm::vec4 box_max_layer;		// Influence box max, cube index in the array
+	gfxm::vec4 position;			// Capture point, reflections are parallax corrected from it
+};
+static_assert(sizeof(GpuReflectionProbe) == 48, "GpuReflectionProbe must match the std430 layout");
+
+constexpr GLuint SSBO_BINDING_PROBES = 6;
+constexpr GLuint SSBO_BINDING_PROBE_TILES = 7;
+
+constexpr int REFLECTION_PROBE_MAX = 32;	// One bit each in the tile masks
+// Matches SPECULAR_MIP_COUNT, the shaders pick the level with the same MAX_REFLECTION_LOD
+constexpr int REFLECTION_PROBE_MIPS = 5;
+constexpr int PROBE_TILES_X = 16;
+constexpr int PROBE_TILES_Y = 9;
+constexpr int PROBE_TILE_COUNT = PROBE_TILES_X * PROBE_TILES_Y;
+// R11F_G11F_B10F, 4 bytes per texel for the captures as well as the prefiltered cubes
+constexpr GLenum FORMAT_REFLECTION_PROBE = GL_R11F_G11F_B10F;
+
+struct ReflectionProbeParams {
+	int capture_size = 64;			// Faces are rendered at this size, then prefiltered
+	int size = 32;					// Level 0 of the prefiltered cubes
+	int max_probes = 8;				// Cube map array layers are allocated for this many up front
+	int steps_per_frame = 2;		// Capture faces, a probe's prefilter counts as one more
+	int prefilter_samples = 32;
+};
+
+struct ReflectionProbe {
+	gfxm::vec3 position;
+	gfxm::aabb box;
+	float blend_distance;
+	bool dirty = true;
+	bool captured = false;			// Probes are left out of the lighting until their first capture is done
+};
+
+enum PROBE_STEP_KIND {
+	PROBE_STEP_CAPTURE_FACE,		// Render one face of the scene into capture_cube
+	PROBE_STEP_PREFILTER			// capture_cube complete, generate its mips and prefilter it into the probe's layers
+};
+
+struct ReflectionProbeStep {
+	PROBE_STEP_KIND kind;
+	int probe;
+	int face;
+};
+
+struct ReflectionProbeStats {
+	int updates = 0;				// Captures completed since startup
+	int dirty = 0;					// Waiting, including the one in progress
+	int steps = 0;					// Last frame
+	int visible = 0;				// Probes touching at least one tile, last bin
+	double cpu_ms = .0;				// Last frame that ran steps
+	double max_cpu_ms = .0;
+	double gpu_ms = .0;
+	double max_gpu_ms = .0;
+	size_t texture_bytes = 0;
+};
+
+struct ReflectionProbes {
+	ReflectionProbeParams params;
+	std::vector<ReflectionProbe> probes;
+	int current = -1;				// Probe being captured, -1 between captures
+	int next_face = 0;				// 6 is the prefilter step
+	int round_robin = 0;			// Where the search for the next dirty probe starts
+
+	GLuint cube_array = 0;			// Prefiltered probes, 6 layers each
+	GLuint capture_cube = 0;		// Full mip chain, the prefilter picks lods from it
+	GLuint capture_depth = 0;
+	GLuint fbo = 0;
+	GLuint probe_buffer = 0;
+	GLuint tile_buffer = 0;
+
+	// Captured probes, smallest box first so the tighter probes take precedence in the blend
+	std::vector<GpuReflectionProbe> gpu_probes;
+	uint32_t tile_masks[PROBE_TILE_COUNT];
+
+	GpuTimer gpu_timer;
+	ReflectionProbeStats stats;
+};
+
+void glxInitReflectionProbes(ReflectionProbes* rp, const ReflectionProbeParams& params);
+void glxDestroyReflectionProbes(ReflectionProbes* rp);
+
+// Returns the probe index, -1 once params.max_probes are placed
+int reflectionProbeAdd(ReflectionProbes* rp, const gfxm::vec3& position, const gfxm::aabb& box, float blend_distance);
+// Probes whose influence box overlaps changed get captured again
+void reflectionProbesMarkDirty(ReflectionProbes* rp, const gfxm::aabb& changed);
+void reflectionProbesMarkAllDirty(ReflectionProbes* rp);
+
+// Once per frame before drawing, runs up to params.steps_per_frame steps through run and times them
+void glxUpdateReflectionProbes(ReflectionProbes* rp, const std::function<void(const ReflectionProbeStep&)>& run);
+
+// Assigns the captured probes to screen tiles of the view, only touches CPU memory
+void reflectionProbesBin(ReflectionProbes* rp, const gfxm::mat4& view, const gfxm::mat4& proj);
+// Uploads the last binning result and binds it at the SSBO_BINDING_ slots above
+void glxUploadReflectionProbes(ReflectionProbes* rp);
@@ -0,0 +1,476 @@
+#include "render_graph.hpp"
+
+#include <assert.h>
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+static uint64_t descBytes(const RgTextureDesc& desc) {
+    return (uint64_t)glxFormatBytesPerPixel(desc.format) * desc.width * desc.height * desc.samples;
+}
+
+bool rgCanAlias(const RgTextureDesc& slot, const RgTextureDesc& desc) {
+    if (slot.width != desc.width || slot.height != desc.height || slot.samples != desc.samples) {
+        return false;
+    }
+    if (slot.format == desc.format) {
+        return true;
+    }
+    const int view_class = glxFormatViewClass(slot.format);
+    return view_class != 0 && view_class == glxFormatViewClass(desc.format);
+}
+
+void rgReset(RenderGraph* g) {
+    g->resources.clear();
+    g->passes.clear();
+    g->order.clear();
+    g->slots.clear();
+    g->stats = RgMemoryStats();
+    g->compiled = false;
+}
+
+RgResource rgCreateTexture(RenderGraph* g, const char* name, const RgTextureDesc& desc) {
+    RgResourceNode node;
+    node.name = name;
+    node.desc = desc;
+    g->resources.push_back(node);
+    return g->resources.size() - 1;
+}
+
+RgResource rgImportTexture(RenderGraph* g, const char* name, GLuint texture, const RgTextureDesc& desc) {
+    RgResource res = rgCreateTexture(g, name, desc);
+    g->resources[res].imported = true;
+    g->resources[res].imported_texture = texture;
+    return res;
+}
+
+RgResource rgImportBackbuffer(RenderGraph* g, const char* name) {
+    RgResource res = rgImportTexture(g, name, 0, RgTextureDesc{ GL_RGBA8, 0, 0 });
+    g->resources[res].backbuffer = true;
+    return res;
+}
+
+int rgAddPass(RenderGraph* g, const char* name, std::function<void()> execute) {
+    RgPassNode node;
+    node.name = name;
+    node.execute = execute;
+    g->passes.push_back(node);
+    g->compiled = false;
+    return g->passes.size() - 1;
+}
+
+void rgRead(RenderGraph* g, int pass, RgResource res) {
+    assert(res >= 0 && res < g->resources.size());
+    g->passes[pass].reads.push_back(res);
+}
+
+void rgWriteColor(RenderGraph* g, int pass, RgResource res, RG_WRITE_MODE mode) {
+    assert(res >= 0 && res < g->resources.size());
+    g->passes[pass].color.push_back(RgAttachment{ res, mode });
+}
+
+void rgWriteDepth(RenderGraph* g, int pass, RgResource res, RG_WRITE_MODE mode) {
+    assert(res >= 0 && res < g->resources.size());
+    g->passes[pass].depth = RgAttachment{ res, mode };
+}
+
+template<typename FN>
+static void forEachWrite(const RgPassNode& pass, FN fn) {
+    for (int i = 0; i < pass.color.size(); ++i) {
+        fn(pass.color[i], GL_COLOR_ATTACHMENT0 + i);
+    }
+    if (pass.depth.resource != RG_NO_RESOURCE) {
+        fn(pass.depth, GL_DEPTH_ATTACHMENT);
+    }
+}
+
+static bool writesBackbuffer(const RenderGraph* g, const RgPassNode& pass) {
+    for (auto& a : pass.color) {
+        if (g->resources[a.resource].backbuffer) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool rgCompile(RenderGraph* g) {
+    PROF_SCOPE_FN();
+    g->order.clear();
+    g->slots.clear();
+    g->stats = RgMemoryStats();
+    for (auto& r : g->resources) {
+        r.ref_count = 0;
+        r.first_pass = -1;
+        r.last_pass = -1;
+        r.slot = -1;
+        r.view = 0;
+    }
+
+    // Reads must see an earlier write, anything else is a declaration bug
+    std::vector<bool> written(g->resources.size(), false);
+    for (int i = 0; i < g->resources.size(); ++i) {
+        written[i] = g->resources[i].imported;
+    }
+    for (auto& p : g->passes) {
+        for (RgResource r : p.reads) {
+            if (!written[r]) {
+                LOG_ERR("render_graph", "Pass '" << p.name << "' reads '" << g->resources[r].name << "' before anything writes it");
+                return false;
+            }
+        }
+        if (p.depth.resource != RG_NO_RESOURCE && g->resources[p.depth.resource].backbuffer) {
+            LOG_ERR("render_graph", "Pass '" << p.name << "' uses the backbuffer as a depth attachment");
+            return false;
+        }
+        if (writesBackbuffer(g, p) && (p.color.size() > 1 || p.depth.resource != RG_NO_RESOURCE)) {
+            LOG_ERR("render_graph", "Pass '" << p.name << "' mixes the backbuffer with other attachments");
+            return false;
+        }
+        forEachWrite(p, [&written](const RgAttachment& a, GLenum) {
+            written[a.resource] = true;
+        });
+    }
+
+    // Culling. Imported resources outlive the frame so writing one keeps a pass alive,
+    // otherwise a pass lives as long as something reads one of its outputs.
+    // Resources are not versioned: every writer of a resource that is read survives
+    for (auto& p : g->passes) {
+        p.culled = false;
+        p.ref_count = 0;
+        forEachWrite(p, [g, &p](const RgAttachment& a, GLenum) {
+            p.ref_count += g->resources[a.resource].imported ? 2 : 1;
+        });
+        for (RgResource r : p.reads) {
+            g->resources[r].ref_count++;
+        }
+    }
+    std::vector<std::vector<int>> writers(g->resources.size());
+    for (int i = 0; i < g->passes.size(); ++i) {
+        forEachWrite(g->passes[i], [&writers, i](const RgAttachment& a, GLenum) {
+            writers[a.resource].push_back(i);
+        });
+    }
+    std::vector<RgResource> unreferenced;
+    for (int i = 0; i < g->resources.size(); ++i) {
+        if (g->resources[i].ref_count == 0 && !g->resources[i].imported) {
+            unreferenced.push_back(i);
+        }
+    }
+    while (!unreferenced.empty()) {
+        RgResource r = unreferenced.back();
+        unreferenced.pop_back();
+        for (int writer : writers[r]) {
+            RgPassNode& p = g->passes[writer];
+            if (p.culled || --p.ref_count > 0) {
+                continue;
+            }
+            p.culled = true;
+            for (RgResource read : p.reads) {
+                if (--g->resources[read].ref_count == 0 && !g->resources[read].imported) {
+                    unreferenced.push_back(read);
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < g->passes.size(); ++i) {
+        if (!g->passes[i].culled) {
+            g->order.push_back(i);
+        } else {
+            g->stats.culled_passes++;
+        }
+    }
+    g->stats.passes = g->order.size();
+
+    // Lifetimes in execution positions
+    auto touch = [g](RgResource r, int pos) {
+        RgResourceNode& node = g->resources[r];
+        if (node.first_pass < 0) {
+            node.first_pass = pos;
+        }
+        node.last_pass = pos;
+    };
+    for (int pos = 0; pos < g->order.size(); ++pos) {
+        RgPassNode& p = g->passes[g->order[pos]];
+        for (RgResource r : p.reads) {
+            touch(r, pos);
+        }
+        forEachWrite(p, [&touch, pos](const RgAttachment& a, GLenum) {
+            touch(a.resource, pos);
+        });
+    }
+
+    // Slots are handed out in execution order, a slot frees up after the last position using it
+    std::vector<std::vector<RgResource>> starting(g->order.size());
+    for (int i = 0; i < g->resources.size(); ++i) {
+        if (!g->resources[i].imported && g->resources[i].first_pass >= 0) {
+            starting[g->resources[i].first_pass].push_back(i);
+        }
+    }
+    for (int pos = 0; pos < g->order.size(); ++pos) {
+        for (RgResource i : starting[pos]) {
+            RgResourceNode& r = g->resources[i];
+            g->stats.transient_resources++;
+            g->stats.transient_bytes += descBytes(r.desc);
+            // An exact match keeps its texture across rebuilds and needs no view
+            for (int s = 0; s < g->slots.size() && r.slot < 0; ++s) {
+                if (g->slots[s].busy_until < pos && g->slots[s].desc == r.desc) {
+                    r.slot = s;
+                }
+            }
+            for (int s = 0; s < g->slots.size() && r.slot < 0; ++s) {
+                if (g->slots[s].busy_until < pos && rgCanAlias(g->slots[s].desc, r.desc)) {
+                    r.slot = s;
+                }
+            }
+            if (r.slot < 0) {
+                g->slots.push_back(RgSlot{ r.desc, -1, 0 });
+                r.slot = g->slots.size() - 1;
+                g->stats.allocated_bytes += descBytes(r.desc);
+            }
+            g->slots[r.slot].busy_until = r.last_pass;
+        }
+    }
+
+    // Transient contents are undefined when their lifetime starts, the first writer either needs
+    // a clear or tells the driver not to bother preserving anything. After the last use nothing needs them
+    for (int pos = 0; pos < g->order.size(); ++pos) {
+        RgPassNode& p = g->passes[g->order[pos]];
+        p.clear_color.clear();
+        p.clear_depth = false;
+        p.invalidate_before.clear();
+        p.invalidate_after.clear();
+        p.invalidate_textures_after.clear();
+        forEachWrite(p, [g, &p, pos](const RgAttachment& a, GLenum attachment) {
+            const RgResourceNode& r = g->resources[a.resource];
+            if (r.imported) {
+                return;
+            }
+            if (r.first_pass == pos) {
+                if (a.mode == RG_WRITE_ACCUMULATE) {
+                    if (attachment == GL_DEPTH_ATTACHMENT) {
+                        p.clear_depth = true;
+                    } else {
+                        p.clear_color.push_back(attachment - GL_COLOR_ATTACHMENT0);
+                    }
+                } else {
+                    p.invalidate_before.push_back(attachment);
+                }
+            }
+            if (r.last_pass == pos) {
+                p.invalidate_after.push_back(attachment);
+            }
+        });
+        for (RgResource read : p.reads) {
+            const RgResourceNode& r = g->resources[read];
+            if (r.imported || r.last_pass != pos) {
+                continue;
+            }
+            bool attached = false;
+            forEachWrite(p, [read, &attached](const RgAttachment& a, GLenum) {
+                attached |= a.resource == read;
+            });
+            if (!attached) {
+                p.invalidate_textures_after.push_back(read);
+            }
+        }
+    }
+
+    g->compiled = true;
+    return true;
+}
+
+static void releaseTextures(RenderGraph* g, TexturePool* pool) {
+    for (GLuint view : g->views) {
+        glxTexturePoolForgetTexture(pool, view);
+    }
+    if (!g->views.empty()) {
+        glDeleteTextures(g->views.size(), g->views.data());
+    }
+    g->views.clear();
+    for (GLuint tex : g->pooled_textures) {
+        texturePoolRelease(pool, tex);
+    }
+    g->pooled_textures.clear();
+}
+
+// Same sampling state as the pool's textures, views don't share it with their storage
+static GLuint createView(const RgSlot& slot, GLenum format) {
+    const GLenum target = slot.desc.samples > 1 ? GL_TEXTURE_2D_MULTISAMPLE : GL_TEXTURE_2D;
+    GLuint view;
+    glGenTextures(1, &view);
+    glTextureView(view, target, slot.texture, format, 0, 1, 0, 1);
+    if (target == GL_TEXTURE_2D) {
+        glBindTexture(GL_TEXTURE_2D, view);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glBindTexture(GL_TEXTURE_2D, 0);
+    }
+    return view;
+}
+
+bool glxRealizeRenderGraph(RenderGraph* g, TexturePool* pool) {
+    PROF_SCOPE_FN();
+    if (!g->compiled) {
+        LOG_ERR("render_graph", "glxRealizeRenderGraph: graph is not compiled");
+        return false;
+    }
+
+    // Released first so slots with unchanged descs get their old textures back
+    releaseTextures(g, pool);
+    for (auto& slot : g->slots) {
+        slot.texture = glxTexturePoolAcquire(pool, slot.desc);
+        g->pooled_textures.push_back(slot.texture);
+    }
+    for (auto& r : g->resources) {
+        r.view = 0;
+        if (r.slot >= 0 && r.desc.format != g->slots[r.slot].desc.format) {
+            r.view = createView(g->slots[r.slot], r.desc.format);
+            g->views.push_back(r.view);
+        }
+    }
+
+    for (int idx : g->order) {
+        RgPassNode& p = g->passes[idx];
+        p.fbo = 0;
+        if (writesBackbuffer(g, p) || (p.color.empty() && p.depth.resource == RG_NO_RESOURCE)) {
+            continue;
+        }
+
+        std::vector<GLuint> color;
+        for (auto& a : p.color) {
+            color.push_back(rgTexture(g, a.resource));
+        }
+        GLuint depth = p.depth.resource == RG_NO_RESOURCE ? 0 : rgTexture(g, p.depth.resource);
+        p.fbo = glxTexturePoolFramebuffer(pool, color.data(), color.size(), depth);
+        if (!p.fbo) {
+            LOG_ERR("render_graph", "Pass '" << p.name << "' has no framebuffer");
+            return false;
+        }
+    }
+    return true;
+}
+
+void glxDestroyRenderGraph(RenderGraph* g, TexturePool* pool) {
+    releaseTextures(g, pool);
+    for (auto& it : g->timers) {
+        glxDestroyGpuTimer(&it.second.timer);
+    }
+    g->timers.clear();
+    rgReset(g);
+}
+
+void glxExecuteRenderGraph(RenderGraph* g, int render_width, int render_height) {
+    if (!g->compiled) {
+        LOG_ERR("render_graph", "glxExecuteRenderGraph: graph is not compiled");
+        return;
+    }
+
+    const GLfloat clear_color[4] = { .0f, .0f, .0f, .0f };
+    const GLfloat clear_depth = 1.0f;
+    for (int idx : g->order) {
+        RgPassNode& p = g->passes[idx];
+        RgPassTimer& t = g->timers[p.name];
+        if (t.scope_name.empty()) {
+            t.scope_name = "GPU " + p.name;
+            glxInitGpuTimer(&t.timer);
+        }
+
+        profilerScopeBegin(p.name.c_str());
+        glxGpuTimerBegin(&t.timer);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+        if (!p.invalidate_before.empty()) {
+            glInvalidateFramebuffer(GL_FRAMEBUFFER, p.invalidate_before.size(), p.invalidate_before.data());
+        }
+        if (!p.clear_color.empty() || p.clear_depth) {
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(0, 0, render_width, render_height);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            for (int buffer : p.clear_color) {
+                glClearBufferfv(GL_COLOR, buffer, clear_color);
+            }
+            if (p.clear_depth) {
+                glDepthMask(GL_TRUE);
+                glClearBufferfv(GL_DEPTH, 0, &clear_depth);
+            }
+        }
+
+        p.execute();
+
+        if (!p.invalidate_after.empty()) {
+            glBindFramebuffer(GL_FRAMEBUFFER, p.fbo);
+            glInvalidateFramebuffer(GL_FRAMEBUFFER, p.invalidate_after.size(), p.invalidate_after.data());
+        }
+        for (RgResource r : p.invalidate_textures_after) {
+            glInvalidateTexImage(rgTexture(g, r), 0);
+        }
+
+        glxGpuTimerEnd(&t.timer);
+        profilerScopeEnd();
+    }
+
+    for (int idx : g->order) {
+        RgPassTimer& t = g->timers[g->passes[idx].name];
+        if (glxGpuTimerResolve(&t.timer)) {
+            profilerRecordMs(t.scope_name.c_str(), t.timer.last_ms);
+        }
+    }
+}
+
+GLuint rgTexture(const RenderGraph* g, RgResource res) {
+    const RgResourceNode& r = g->resources[res];
+    if (r.imported) {
+        return r.imported_texture;
+    }
+    if (r.slot < 0) {
+        return 0;
+    }
+    return r.view ? r.view : g->slots[r.slot].texture;
+}
+
+void rgLogMemoryReport(const RenderGraph* g) {
+    const RgMemoryStats& s = g->stats;
+    LOG("render_graph", s.passes << " passes, " << s.culled_passes << " culled, " << s.transient_resources << " transient textures in "
+        << g->slots.size() << " slots: " << s.allocated_bytes / (1024 * 1024) << "MB allocated instead of " << s.transient_bytes / (1024 * 1024)
+        << "MB, aliasing saves " << (s.transient_bytes - s.allocated_bytes) / (1024 * 1024) << "MB");
+    for (int i = 0; i < g->passes.size(); ++i) {
+        if (g->passes[i].culled) {
+            LOG("render_graph", "  culled pass '" << g->passes[i].name << "'");
+        }
+    }
+    for (int s = 0; s < g->slots.size(); ++s) {
+        std::string users;
+        for (auto& r : g->resources) {
+            if (r.slot == s) {
+                users += (users.empty() ? "" : ", ") + r.name + " [" + std::to_string(r.first_pass) + ".." + std::to_string(r.last_pass) + "]";
+            }
+        }
+        LOG("render_graph", "  slot " << s << " (" << g->slots[s].desc.width << "x" << g->slots[s].desc.height << ", format 0x" << std::hex
+            << g->slots[s].desc.format << std::dec << ", " << descBytes(g->slots[s].desc) / (1024 * 1024) << "MB): " << users);
+    }
+}
+
+void rgLogTimings(const RenderGraph* g) {
+    double total = .0;
+    for (int idx : g->order) {
+        auto it = g->timers.find(g->passes[idx].name);
+        if (it == g->timers.end() || !it->second.timer.has_result) {
+            continue;
+        }
+        LOG("render_graph", "  " << g->passes[idx].name << ": " << it->second.timer.last_ms << "ms");
+        total += it->second.timer.last_ms;
+    }
+    LOG("render_graph", "GPU passes total: " << total << "ms");
+}
+
+double rgPassGpuMs(const RenderGraph* g, const char* pass_name) {
+    auto it = g->timers.find(pass_name);
+    if (it == g->timers.end() || !it->second.timer.has_result) {
+        return .0;
+    }
+    return it->second.timer.last_ms;
+}
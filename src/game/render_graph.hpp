@@ -0,0 +1,133 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+#include "gpu_timer.hpp"
+#include "texture_pool.hpp"
+
+
+// Index into RenderGraph::resources
+typedef int RgResource;
+constexpr RgResource RG_NO_RESOURCE = -1;
+
+enum RG_WRITE_MODE {
+	RG_WRITE_OVERWRITE,		// Every pixel of the render area is written, previous contents are not needed
+	RG_WRITE_ACCUMULATE		// Blending, depth testing or partial coverage, previous contents are needed
+};
+
+// Slots are backed by TexturePool textures, a desc is their key
+typedef TexturePoolKey RgTextureDesc;
+
+struct RgResourceNode {
+	std::string name;
+	RgTextureDesc desc;
+	bool imported = false;		// Lives outside the graph, never aliased, cleared or invalidated
+	GLuint imported_texture = 0;
+	bool backbuffer = false;	// Framebuffer 0
+
+	// Filled by rgCompile()
+	int ref_count = 0;
+	int first_pass = -1;		// Execution order positions
+	int last_pass = -1;
+	int slot = -1;				// Physical texture, transient resources only
+
+	// Filled by glxRealizeRenderGraph() when the slot's storage has another format
+	GLuint view = 0;
+};
+
+struct RgAttachment {
+	RgResource resource;
+	RG_WRITE_MODE mode;
+};
+
+struct RgPassNode {
+	std::string name;
+	std::function<void()> execute;
+	std::vector<RgResource> reads;		// Sampled
+	std::vector<RgAttachment> color;	// In draw buffer order, must match the program's FramebufferDesc
+	RgAttachment depth = { RG_NO_RESOURCE, RG_WRITE_ACCUMULATE };
+
+	// Filled by rgCompile()
+	bool culled = false;
+	int ref_count = 0;
+	std::vector<int> clear_color;		// Draw buffer indices cleared before the pass
+	bool clear_depth = false;
+	std::vector<GLenum> invalidate_before;
+	std::vector<GLenum> invalidate_after;
+	std::vector<RgResource> invalidate_textures_after;	// Last use was a read, not attached
+
+	// Filled by glxRealizeRenderGraph(), owned by the TexturePool
+	GLuint fbo = 0;
+};
+
+// A physical texture shared by transient resources with disjoint lifetimes, see rgCanAlias()
+struct RgSlot {
+	RgTextureDesc desc;		// Of the first resource using it, the storage format
+	int busy_until = -1;	// Last execution position using it
+	GLuint texture = 0;
+};
+
+struct RgMemoryStats {
+	int passes = 0;
+	int culled_passes = 0;
+	int transient_resources = 0;
+	uint64_t transient_bytes = 0;	// Every transient with its own texture
+	uint64_t allocated_bytes = 0;	// What the slots actually take
+};
+
+struct RgPassTimer {
+	GpuTimer timer;
+	std::string scope_name;
+};
+
+// Passes are declared in submission order, then compiled once and executed every frame until the
+// declarations change. Compiling culls passes whose results nobody reads, assigns transient textures
+// to shared slots by lifetime and works out where attachments need a clear or can be invalidated
+struct RenderGraph {
+	std::vector<RgResourceNode> resources;
+	std::vector<RgPassNode> passes;
+	std::vector<int> order;		// Passes that survived culling
+	std::vector<RgSlot> slots;
+	std::vector<GLuint> pooled_textures;	// Acquired by the last realize, released by the next one
+	std::vector<GLuint> views;				// Created by the last realize, deleted by the next one
+	std::unordered_map<std::string, RgPassTimer> timers;	// By pass name, survive rgReset()
+	RgMemoryStats stats;
+	bool compiled = false;
+};
+
+// Drops all declarations, keeps timers. Textures go back to the pool on the next realize or destroy
+void rgReset(RenderGraph* g);
+RgResource rgCreateTexture(RenderGraph* g, const char* name, const RgTextureDesc& desc);
+RgResource rgImportTexture(RenderGraph* g, const char* name, GLuint texture, const RgTextureDesc& desc);
+RgResource rgImportBackbuffer(RenderGraph* g, const char* name);
+
+int rgAddPass(RenderGraph* g, const char* name, std::function<void()> execute);
+void rgRead(RenderGraph* g, int pass, RgResource res);
+void rgWriteColor(RenderGraph* g, int pass, RgResource res, RG_WRITE_MODE mode);
+void rgWriteDepth(RenderGraph* g, int pass, RgResource res, RG_WRITE_MODE mode);
+
+// Same size and samples, and either the same format or formats of one glTextureView() class.
+// Slots prefer an exact match, a resource with another format gets a view of the slot's storage
+bool rgCanAlias(const RgTextureDesc& slot, const RgTextureDesc& desc);
+
+// Culling, lifetimes, slot assignment and clear/invalidate placement, no GL calls
+bool rgCompile(RenderGraph* g);
+// Returns the previous slot textures to the pool, then gets textures and per pass framebuffers for the new slots.
+// A rebuild with the same descs gets the same textures and framebuffers back, views are made anew
+bool glxRealizeRenderGraph(RenderGraph* g, TexturePool* pool);
+void glxDestroyRenderGraph(RenderGraph* g, TexturePool* pool);
+
+// Clears only touch the lower left render_width x render_height, see DynamicResolution
+void glxExecuteRenderGraph(RenderGraph* g, int render_width, int render_height);
+
+// Physical texture backing a resource, valid after glxRealizeRenderGraph()
+GLuint rgTexture(const RenderGraph* g, RgResource res);
+
+void rgLogMemoryReport(const RenderGraph* g);
+void rgLogTimings(const RenderGraph* g);
+// Latest GPU time of a pass by name, 0 before its first result
+double rgPassGpuMs(const RenderGraph* g, const char* pass_name);
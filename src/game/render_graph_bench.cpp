@@ -0,0 +1,238 @@
+#include "benchmarks.hpp"
+
+#include <algorithm>
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+#include "render_graph.hpp"
+
+
+// Transient resources sharing a slot must fit its storage and not be alive at the same time
+static bool checkAliasing(const RenderGraph* g) {
+    for (int i = 0; i < g->resources.size(); ++i) {
+        const RgResourceNode& a = g->resources[i];
+        if (a.slot < 0) {
+            continue;
+        }
+        if (!rgCanAlias(g->slots[a.slot].desc, a.desc)) {
+            LOG_ERR("bench", "render_graph: '" << a.name << "' doesn't fit the storage of slot " << a.slot);
+            return false;
+        }
+        for (int j = i + 1; j < g->resources.size(); ++j) {
+            const RgResourceNode& b = g->resources[j];
+            if (b.slot != a.slot) {
+                continue;
+            }
+            if (!(a.last_pass < b.first_pass || b.last_pass < a.first_pass)) {
+                LOG_ERR("bench", "render_graph: '" << a.name << "' and '" << b.name << "' share slot " << a.slot << " while both alive");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+// Same shape as buildFrameGraph() in main.cpp, reduced_ibl is the half rate path of declareIblPasses()
+static void declareFrameGraph(RenderGraph* g, bool clustered_lights, bool show_gbuffer, bool reduced_ibl) {
+    const int w = 2560;
+    const int h = 1440;
+    rgReset(g);
+    RgResource albedo = rgCreateTexture(g, "Albedo", RgTextureDesc{ GL_RGBA8, w, h });
+    RgResource normal = rgCreateTexture(g, "Normal", RgTextureDesc{ GL_RG16, w, h });
+    RgResource material = rgCreateTexture(g, "Material", RgTextureDesc{ GL_RGBA8, w, h });
+    RgResource depth = rgCreateTexture(g, "Depth", RgTextureDesc{ GL_DEPTH_COMPONENT24, w, h });
+    RgResource lightness = rgCreateTexture(g, "Lightness", RgTextureDesc{ GL_R11F_G11F_B10F, w, h });
+    RgResource backbuffer = rgImportBackbuffer(g, "Backbuffer");
+    auto nop = []() {};
+
+    int pass = rgAddPass(g, "GBuffer", nop);
+    rgWriteColor(g, pass, albedo, RG_WRITE_ACCUMULATE);
+    rgWriteColor(g, pass, normal, RG_WRITE_ACCUMULATE);
+    rgWriteColor(g, pass, material, RG_WRITE_ACCUMULATE);
+    rgWriteDepth(g, pass, depth, RG_WRITE_ACCUMULATE);
+    const char* lighting_passes[] = { "ClusteredLighting", "IBL" };
+    for (int i = clustered_lights ? 0 : 1; i < (reduced_ibl ? 1 : 2); ++i) {
+        pass = rgAddPass(g, lighting_passes[i], nop);
+        rgRead(g, pass, albedo);
+        rgRead(g, pass, normal);
+        rgRead(g, pass, material);
+        rgRead(g, pass, depth);
+        rgWriteColor(g, pass, lightness, RG_WRITE_ACCUMULATE);
+    }
+    if (reduced_ibl) {
+        RgResource irradiance_low = rgCreateTexture(g, "IBLIrradianceLow", RgTextureDesc{ GL_R11F_G11F_B10F, w / 2, h / 2 });
+        RgResource specular_low = rgCreateTexture(g, "IBLSpecularLow", RgTextureDesc{ GL_R11F_G11F_B10F, w / 2, h / 2 });
+        RgResource guide_low = rgCreateTexture(g, "IBLGuideLow", RgTextureDesc{ GL_RGBA16F, w / 2, h / 2 });
+        pass = rgAddPass(g, "IBLLowRes", nop);
+        rgRead(g, pass, normal);
+        rgRead(g, pass, material);
+        rgRead(g, pass, depth);
+        rgWriteColor(g, pass, irradiance_low, RG_WRITE_OVERWRITE);
+        rgWriteColor(g, pass, specular_low, RG_WRITE_OVERWRITE);
+        rgWriteColor(g, pass, guide_low, RG_WRITE_OVERWRITE);
+        pass = rgAddPass(g, "IBLUpsample", nop);
+        const RgResource upsample_reads[] = { albedo, normal, material, depth, irradiance_low, specular_low, guide_low };
+        for (RgResource r : upsample_reads) {
+            rgRead(g, pass, r);
+        }
+        rgWriteColor(g, pass, lightness, RG_WRITE_ACCUMULATE);
+    }
+    pass = rgAddPass(g, "Skybox", nop);
+    rgWriteColor(g, pass, lightness, RG_WRITE_ACCUMULATE);
+    rgWriteDepth(g, pass, depth, RG_WRITE_ACCUMULATE);
+    pass = rgAddPass(g, "Compose", nop);
+    rgRead(g, pass, lightness);
+    if (show_gbuffer) {
+        const RgResource debug_reads[] = { depth, albedo, normal, material };
+        for (RgResource r : debug_reads) {
+            rgRead(g, pass, r);
+        }
+    }
+    rgWriteColor(g, pass, backbuffer, RG_WRITE_OVERWRITE);
+
+    // A chain nobody consumes, both passes should go
+    RgResource unused_a = rgCreateTexture(g, "UnusedA", RgTextureDesc{ GL_RGBA16F, w / 2, h / 2 });
+    RgResource unused_b = rgCreateTexture(g, "UnusedB", RgTextureDesc{ GL_RGBA16F, w / 2, h / 2 });
+    pass = rgAddPass(g, "UnusedDownsample", nop);
+    rgRead(g, pass, lightness);
+    rgWriteColor(g, pass, unused_a, RG_WRITE_OVERWRITE);
+    pass = rgAddPass(g, "UnusedBlur", nop);
+    rgRead(g, pass, unused_a);
+    rgWriteColor(g, pass, unused_b, RG_WRITE_OVERWRITE);
+}
+
+// The frame graph followed by a bloom, tonemap and FXAA stack. The post targets start after the G-buffer is dead,
+// so they land in its slots, Combined (R11G11B10) through a view of an RGBA8 one
+static void declarePostFrameGraph(RenderGraph* g) {
+    const int w = 2560;
+    const int h = 1440;
+    rgReset(g);
+    RgResource albedo = rgCreateTexture(g, "Albedo", RgTextureDesc{ GL_RGBA8, w, h });
+    RgResource normal = rgCreateTexture(g, "Normal", RgTextureDesc{ GL_RG16, w, h });
+    RgResource material = rgCreateTexture(g, "Material", RgTextureDesc{ GL_RGBA8, w, h });
+    RgResource depth = rgCreateTexture(g, "Depth", RgTextureDesc{ GL_DEPTH_COMPONENT24, w, h });
+    RgResource lightness = rgCreateTexture(g, "Lightness", RgTextureDesc{ GL_R11F_G11F_B10F, w, h });
+    RgResource backbuffer = rgImportBackbuffer(g, "Backbuffer");
+    auto nop = []() {};
+
+    int pass = rgAddPass(g, "GBuffer", nop);
+    rgWriteColor(g, pass, albedo, RG_WRITE_ACCUMULATE);
+    rgWriteColor(g, pass, normal, RG_WRITE_ACCUMULATE);
+    rgWriteColor(g, pass, material, RG_WRITE_ACCUMULATE);
+    rgWriteDepth(g, pass, depth, RG_WRITE_ACCUMULATE);
+    pass = rgAddPass(g, "IBL", nop);
+    const RgResource gbuffer_reads[] = { albedo, normal, material, depth };
+    for (RgResource r : gbuffer_reads) {
+        rgRead(g, pass, r);
+    }
+    rgWriteColor(g, pass, lightness, RG_WRITE_ACCUMULATE);
+    pass = rgAddPass(g, "Skybox", nop);
+    rgWriteColor(g, pass, lightness, RG_WRITE_ACCUMULATE);
+    rgWriteDepth(g, pass, depth, RG_WRITE_ACCUMULATE);
+
+    // Bright pass, then down and back up a mip chain
+    const int BLOOM_LEVELS = 4;
+    RgResource down[BLOOM_LEVELS];
+    RgResource prev = lightness;
+    for (int i = 0; i < BLOOM_LEVELS; ++i) {
+        down[i] = rgCreateTexture(g, "BloomDown", RgTextureDesc{ GL_R11F_G11F_B10F, w >> (i + 1), h >> (i + 1) });
+        pass = rgAddPass(g, "BloomDownsample", nop);
+        rgRead(g, pass, prev);
+        rgWriteColor(g, pass, down[i], RG_WRITE_OVERWRITE);
+        prev = down[i];
+    }
+    for (int i = BLOOM_LEVELS - 2; i >= 0; --i) {
+        RgResource up = rgCreateTexture(g, "BloomUp", RgTextureDesc{ GL_R11F_G11F_B10F, w >> (i + 1), h >> (i + 1) });
+        pass = rgAddPass(g, "BloomUpsample", nop);
+        rgRead(g, pass, prev);
+        rgRead(g, pass, down[i]);
+        rgWriteColor(g, pass, up, RG_WRITE_OVERWRITE);
+        prev = up;
+    }
+    RgResource combined = rgCreateTexture(g, "Combined", RgTextureDesc{ GL_R11F_G11F_B10F, w, h });
+    pass = rgAddPass(g, "BloomCombine", nop);
+    rgRead(g, pass, lightness);
+    rgRead(g, pass, prev);
+    rgWriteColor(g, pass, combined, RG_WRITE_OVERWRITE);
+    RgResource ldr = rgCreateTexture(g, "LDR", RgTextureDesc{ GL_RGBA8, w, h });
+    pass = rgAddPass(g, "Tonemap", nop);
+    rgRead(g, pass, combined);
+    rgWriteColor(g, pass, ldr, RG_WRITE_OVERWRITE);
+    pass = rgAddPass(g, "FXAA", nop);
+    rgRead(g, pass, ldr);
+    rgWriteColor(g, pass, backbuffer, RG_WRITE_OVERWRITE);
+}
+
+void benchRenderGraph() {
+    RenderGraph g;
+    for (int mode = 0; mode < 8; ++mode) {
+        bool clustered = mode & 1;
+        bool show_gbuffer = mode & 2;
+        bool reduced_ibl = mode & 4;
+        declareFrameGraph(&g, clustered, show_gbuffer, reduced_ibl);
+        if (!rgCompile(&g)) {
+            LOG_ERR("bench", "render_graph: frame graph failed to compile");
+            return;
+        }
+        LOG("bench", "render_graph: frame graph, clustered lights " << (clustered ? "on" : "off") << ", G-buffer view " << (show_gbuffer ? "on" : "off")
+            << ", IBL " << (reduced_ibl ? "half rate" : "full rate"));
+        rgLogMemoryReport(&g);
+        checkAliasing(&g);
+        if (g.stats.culled_passes != 2) {
+            LOG_ERR("bench", "render_graph: expected the 2 unused passes to be culled, got " << g.stats.culled_passes);
+        }
+        const RgPassNode& gbuffer = g.passes[0];
+        if (gbuffer.clear_color.size() != 3 || !gbuffer.clear_depth) {
+            LOG_ERR("bench", "render_graph: G-buffer pass should clear all of its attachments");
+        }
+    }
+
+    declarePostFrameGraph(&g);
+    if (rgCompile(&g)) {
+        int views = 0;
+        for (const auto& r : g.resources) {
+            views += r.slot >= 0 && r.desc.format != g.slots[r.slot].desc.format;
+        }
+        LOG("bench", "render_graph: frame graph with bloom, tonemap and FXAA, " << views << " transients through a view");
+        rgLogMemoryReport(&g);
+        checkAliasing(&g);
+    }
+
+    // Long chains of fullscreen passes with a handful of formats, like a post processing stack
+    const int PASS_COUNTS[] = { 64, 512, 4096 };
+    const GLenum formats[] = { GL_RGBA8, GL_RGBA16F, GL_R11F_G11F_B10F, GL_RG16F };
+    for (int pass_count : PASS_COUNTS) {
+        rgReset(&g);
+        uint32_t seed = 0x1234567;
+        auto rnd = [&seed](int n)->int {
+            seed = seed * 1664525u + 1013904223u;
+            return (seed >> 8) % n;
+        };
+        std::vector<RgResource> live;
+        RgResource backbuffer = rgImportBackbuffer(&g, "Backbuffer");
+        for (int i = 0; i < pass_count; ++i) {
+            int size = 2048 >> rnd(3);
+            RgResource out = rgCreateTexture(&g, "Target", RgTextureDesc{ formats[rnd(4)], size, size });
+            int pass = rgAddPass(&g, "Pass", []() {});
+            for (int k = 0; k < 2 && !live.empty(); ++k) {
+                rgRead(&g, pass, live[live.size() - 1 - rnd(std::min<int>(live.size(), 4))]);
+            }
+            rgWriteColor(&g, pass, out, RG_WRITE_OVERWRITE);
+            live.push_back(out);
+        }
+        int pass = rgAddPass(&g, "Present", []() {});
+        rgRead(&g, pass, live.back());
+        rgWriteColor(&g, pass, backbuffer, RG_WRITE_OVERWRITE);
+
+        double best = 1e9;
+        for (int it = 0; it < 5; ++it) {
+            Stopwatch sw;
+            rgCompile(&g);
+            best = std::min(best, sw.elapsedMs());
+        }
+        bool ok = checkAliasing(&g);
+        LOG("bench", "render_graph: " << pass_count << " passes, compile " << best << "ms, " << g.stats.passes << " kept, "
+            << g.stats.transient_resources << " transients in " << g.slots.size() << " slots, "
+            << g.stats.allocated_bytes / (1024 * 1024) << "MB instead of " << g.stats.transient_bytes / (1024 * 1024) << "MB"
+            << (ok ? "" : ", ALIASING BROKEN"));
+    }
+}
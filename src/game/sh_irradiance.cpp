@@ -0,0 +1,266 @@
+#include "sh_irradiance.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "math/simd.hpp"
+#include "profiler/profiler.hpp"
+#include "thread/thread_pool.hpp"
+
+
+constexpr int SH_PROJECT_ROWS_PER_JOB = 8;
+constexpr double SH_PI = 3.14159265358979323846;
+
+// Real SH basis constants
+constexpr float SH_C0 = .282095f;	// 1 / (2 sqrt(pi))
+constexpr float SH_C1 = .488603f;	// sqrt(3 / (4 pi))
+constexpr float SH_C2 = 1.092548f;	// sqrt(15 / (4 pi))
+constexpr float SH_C3 = .315392f;	// sqrt(5 / (16 pi))
+constexpr float SH_C4 = .546274f;	// sqrt(15 / (16 pi))
+// Clamped cosine convolution of each band (pi, 2pi/3, pi/4) over pi
+static const float SH_BAND_SCALE[9] = { 1.f, 2.f / 3.f, 2.f / 3.f, 2.f / 3.f, .25f, .25f, .25f, .25f, .25f };
+
+// Sums along one equirect row. y is constant there, the y terms of the basis are applied once per row
+enum SH_ROW_TERM {
+    SH_ROW_1,
+    SH_ROW_X,
+    SH_ROW_Z,
+    SH_ROW_XZ,
+    SH_ROW_XX,
+    SH_ROW_ZZ,
+    SH_ROW_TERM_COUNT
+};
+
+struct ShRowSums {
+    float s[SH_ROW_TERM_COUNT][3];
+};
+
+static void shBasis(float b[9], const gfxm::vec3& n) {
+    b[0] = SH_C0;
+    b[1] = SH_C1 * n.y;
+    b[2] = SH_C1 * n.z;
+    b[3] = SH_C1 * n.x;
+    b[4] = SH_C2 * n.x * n.y;
+    b[5] = SH_C2 * n.y * n.z;
+    b[6] = SH_C3 * (3.f * n.z * n.z - 1.f);
+    b[7] = SH_C2 * n.x * n.z;
+    b[8] = SH_C4 * (n.x * n.x - n.y * n.y);
+}
+
+static void shFinalize(ShIrradiance* out, const double acc[9][3]) {
+    for (int k = 0; k < 9; ++k) {
+        out->coeffs[k] = gfxm::vec4(
+            (float)acc[k][0] * SH_BAND_SCALE[k],
+            (float)acc[k][1] * SH_BAND_SCALE[k],
+            (float)acc[k][2] * SH_BAND_SCALE[k],
+            .0f
+        );
+    }
+}
+
+// hdri_to_cubemap.glsl reads the equirect at atan(d.z, d.x), asin(d.y) for cubemap direction d,
+// and every cubemap lookup flips z, so world direction is d * (1, 1, -1)
+static void equirectPhiTables(std::vector<float>& cos_phi, std::vector<float>& sin_phi, int width) {
+    cos_phi.resize(width);
+    sin_phi.resize(width);
+    for (int i = 0; i < width; ++i) {
+        const double phi = ((i + .5) / width - .5) * 2. * SH_PI;
+        cos_phi[i] = (float)cos(phi);
+        sin_phi[i] = (float)sin(phi);
+    }
+}
+
+static double equirectLatitude(int row, int height) {
+    return ((row + .5) / height - .5) * SH_PI;
+}
+
+static void sumRowScalar(ShRowSums* rs, const float* row, const float* cos_phi, const float* sin_phi, float cos_lat, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        const float x = cos_lat * cos_phi[i];
+        const float z = -cos_lat * sin_phi[i];
+        const float terms[SH_ROW_TERM_COUNT] = { 1.f, x, z, x * z, x * x, z * z };
+        for (int t = 0; t < SH_ROW_TERM_COUNT; ++t) {
+            for (int c = 0; c < 3; ++c) {
+                rs->s[t][c] += terms[t] * row[i * 3 + c];
+            }
+        }
+    }
+}
+
+#if SIMD_X86
+static float horizontalSum(__m128 v) {
+    alignas(16) float f[4];
+    _mm_store_ps(f, v);
+    return (f[0] + f[1]) + (f[2] + f[3]);
+}
+
+// 4 texels per iteration, the tail goes through the scalar path
+static void sumRowSse(ShRowSums* rs, const float* row, const float* cos_phi, const float* sin_phi, float cos_lat, int width) {
+    __m128 acc[SH_ROW_TERM_COUNT][3];
+    for (int t = 0; t < SH_ROW_TERM_COUNT; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            acc[t][c] = _mm_setzero_ps();
+        }
+    }
+    const __m128 cl = _mm_set1_ps(cos_lat);
+    const __m128 neg_cl = _mm_set1_ps(-cos_lat);
+    int i = 0;
+    for (; i + 4 <= width; i += 4) {
+        const float* p = row + i * 3;
+        const __m128 p0 = _mm_loadu_ps(p);
+        const __m128 p1 = _mm_loadu_ps(p + 4);
+        const __m128 p2 = _mm_loadu_ps(p + 8);
+        // r0 g0 b0 r1 | g1 b1 r2 g2 | b2 r3 g3 b3 to one register per channel
+        __m128 col[3];
+        col[0] = _mm_shuffle_ps(p0, _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(0, 1, 2, 0)), _MM_SHUFFLE(2, 1, 3, 0));
+        col[1] = _mm_shuffle_ps(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(0, 0, 1, 1)), _mm_shuffle_ps(p1, p2, _MM_SHUFFLE(2, 2, 3, 3)), _MM_SHUFFLE(2, 0, 2, 0));
+        col[2] = _mm_shuffle_ps(_mm_shuffle_ps(p0, p1, _MM_SHUFFLE(1, 1, 2, 2)), _mm_shuffle_ps(p2, p2, _MM_SHUFFLE(3, 3, 0, 0)), _MM_SHUFFLE(2, 0, 2, 0));
+
+        const __m128 x = _mm_mul_ps(cl, _mm_loadu_ps(cos_phi + i));
+        const __m128 z = _mm_mul_ps(neg_cl, _mm_loadu_ps(sin_phi + i));
+        const __m128 terms[SH_ROW_TERM_COUNT - 1] = { x, z, _mm_mul_ps(x, z), _mm_mul_ps(x, x), _mm_mul_ps(z, z) };
+        for (int c = 0; c < 3; ++c) {
+            acc[SH_ROW_1][c] = _mm_add_ps(acc[SH_ROW_1][c], col[c]);
+            for (int t = 1; t < SH_ROW_TERM_COUNT; ++t) {
+                acc[t][c] = _mm_add_ps(acc[t][c], _mm_mul_ps(terms[t - 1], col[c]));
+            }
+        }
+    }
+    for (int t = 0; t < SH_ROW_TERM_COUNT; ++t) {
+        for (int c = 0; c < 3; ++c) {
+            rs->s[t][c] += horizontalSum(acc[t][c]);
+        }
+    }
+    sumRowScalar(rs, row, cos_phi, sin_phi, cos_lat, i, width);
+}
+#endif
+
+// Row sums to SH, weight is the solid angle of one texel in the row
+static void addRow(double acc[9][3], const ShRowSums& rs, float y, double weight) {
+    for (int c = 0; c < 3; ++c) {
+        const double s1 = rs.s[SH_ROW_1][c];
+        const double sx = rs.s[SH_ROW_X][c];
+        const double sz = rs.s[SH_ROW_Z][c];
+        acc[0][c] += weight * SH_C0 * s1;
+        acc[1][c] += weight * SH_C1 * y * s1;
+        acc[2][c] += weight * SH_C1 * sz;
+        acc[3][c] += weight * SH_C1 * sx;
+        acc[4][c] += weight * SH_C2 * y * sx;
+        acc[5][c] += weight * SH_C2 * y * sz;
+        acc[6][c] += weight * SH_C3 * (3. * rs.s[SH_ROW_ZZ][c] - s1);
+        acc[7][c] += weight * SH_C2 * rs.s[SH_ROW_XZ][c];
+        acc[8][c] += weight * SH_C4 * (rs.s[SH_ROW_XX][c] - (double)y * y * s1);
+    }
+}
+
+void shProjectEquirect(ShIrradiance* out, const float* rgb, int width, int height, ThreadPool* pool, SH_PROJECT_PATH path) {
+    PROF_SCOPE_FN();
+    std::vector<float> cos_phi;
+    std::vector<float> sin_phi;
+    equirectPhiTables(cos_phi, sin_phi, width);
+    const double texel_angle = (2. * SH_PI / width) * (SH_PI / height);
+
+    // One partial sum per job, added up in job order afterwards
+    const int job_count = (height + SH_PROJECT_ROWS_PER_JOB - 1) / SH_PROJECT_ROWS_PER_JOB;
+    std::vector<double> partials(job_count * 9 * 3, .0);
+    pool->parallelFor(job_count, [&](int job, int) {
+        double (*acc)[3] = (double(*)[3])&partials[job * 9 * 3];
+        const int end = std::min(height, (job + 1) * SH_PROJECT_ROWS_PER_JOB);
+        for (int r = job * SH_PROJECT_ROWS_PER_JOB; r < end; ++r) {
+            const double lat = equirectLatitude(r, height);
+            const float cos_lat = (float)cos(lat);
+            const float* row = rgb + (size_t)r * width * 3;
+            ShRowSums rs = { 0 };
+#if SIMD_X86
+            if (path != SH_PROJECT_SCALAR) {
+                sumRowSse(&rs, row, cos_phi.data(), sin_phi.data(), cos_lat, width);
+                addRow(acc, rs, (float)sin(lat), texel_angle * cos_lat);
+                continue;
+            }
+#endif
+            sumRowScalar(&rs, row, cos_phi.data(), sin_phi.data(), cos_lat, 0, width);
+            addRow(acc, rs, (float)sin(lat), texel_angle * cos_lat);
+        }
+    });
+
+    double acc[9][3] = { 0 };
+    for (int job = 0; job < job_count; ++job) {
+        for (int k = 0; k < 9 * 3; ++k) {
+            acc[k / 3][k % 3] += partials[job * 9 * 3 + k];
+        }
+    }
+    shFinalize(out, acc);
+}
+
+void shProjectCubeFaces(ShIrradiance* out, const float* const faces[6], int size) {
+    PROF_SCOPE_FN();
+    double acc[9][3] = { 0 };
+    for (int face = 0; face < 6; ++face) {
+        for (int j = 0; j < size; ++j) {
+            const float tc = (j + .5f) / size * 2.f - 1.f;
+            for (int i = 0; i < size; ++i) {
+                const float sc = (i + .5f) / size * 2.f - 1.f;
+                // GL cubemap face layout, see the cube map selection table in the spec
+                gfxm::vec3 d;
+                switch (face) {
+                case 0: d = gfxm::vec3(1.f, -tc, -sc); break;
+                case 1: d = gfxm::vec3(-1.f, -tc, sc); break;
+                case 2: d = gfxm::vec3(sc, 1.f, tc); break;
+                case 3: d = gfxm::vec3(sc, -1.f, -tc); break;
+                case 4: d = gfxm::vec3(sc, -tc, 1.f); break;
+                default: d = gfxm::vec3(-sc, -tc, -1.f); break;
+                }
+                const float len2 = 1.f + sc * sc + tc * tc;
+                const double weight = 4. / ((double)size * size * len2 * sqrtf(len2));
+                const gfxm::vec3 n = gfxm::normalize(gfxm::vec3(d.x, d.y, -d.z));
+                float b[9];
+                shBasis(b, n);
+                const float* texel = faces[face] + ((size_t)j * size + i) * 3;
+                for (int k = 0; k < 9; ++k) {
+                    for (int c = 0; c < 3; ++c) {
+                        acc[k][c] += weight * b[k] * texel[c];
+                    }
+                }
+            }
+        }
+    }
+    shFinalize(out, acc);
+}
+
+gfxm::vec3 shEvalIrradiance(const ShIrradiance& sh, const gfxm::vec3& n) {
+    float b[9];
+    shBasis(b, n);
+    gfxm::vec3 e(.0f, .0f, .0f);
+    for (int k = 0; k < 9; ++k) {
+        e.x += sh.coeffs[k].x * b[k];
+        e.y += sh.coeffs[k].y * b[k];
+        e.z += sh.coeffs[k].z * b[k];
+    }
+    // Ringing can push it below zero opposite a strong light, the shader clamps the same way
+    return gfxm::vec3(std::max(e.x, .0f), std::max(e.y, .0f), std::max(e.z, .0f));
+}
+
+gfxm::vec3 shReferenceIrradiance(const float* rgb, int width, int height, const gfxm::vec3& n) {
+    std::vector<float> cos_phi;
+    std::vector<float> sin_phi;
+    equirectPhiTables(cos_phi, sin_phi, width);
+    const double texel_angle = (2. * SH_PI / width) * (SH_PI / height);
+    double sum[3] = { 0 };
+    for (int r = 0; r < height; ++r) {
+        const double lat = equirectLatitude(r, height);
+        const double cos_lat = cos(lat);
+        const double y = sin(lat);
+        for (int i = 0; i < width; ++i) {
+            const double cos_theta = n.x * cos_lat * cos_phi[i] + n.y * y - n.z * cos_lat * sin_phi[i];
+            if (cos_theta <= .0) {
+                continue;
+            }
+            const double weight = texel_angle * cos_lat * cos_theta;
+            const float* texel = rgb + ((size_t)r * width + i) * 3;
+            for (int c = 0; c < 3; ++c) {
+                sum[c] += weight * texel[c];
+            }
+        }
+    }
+    return gfxm::vec3((float)(sum[0] / SH_PI), (float)(sum[1] / SH_PI), (float)(sum[2] / SH_PI));
+}
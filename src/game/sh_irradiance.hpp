@@ -0,0 +1,31 @@
+#pragma once
+
+#include "math/gfxm.hpp"
+
+
+class ThreadPool;
+
+// Order 2 (9 coefficient) spherical harmonics of the diffuse environment, evaluated in shaders/functions/ibl.glsl.
+// Coefficients are in Y00, Y1-1, Y10, Y11, Y2-2, Y2-1, Y20, Y21, Y22 order with rgb in xyz, w is padding so
+// the array goes into ubCommon as is. The clamped cosine convolution and the 1/pi are already applied,
+// evaluating gives the same cosine weighted average radiance the irradiance cubemap used to hold
+struct ShIrradiance {
+	gfxm::vec4 coeffs[9];
+};
+
+enum SH_PROJECT_PATH {
+	SH_PROJECT_AUTO,
+	SH_PROJECT_SCALAR,
+	SH_PROJECT_SSE
+};
+
+// Directions are world space, the image is mapped the way hdri_to_cubemap.glsl and the z flipped cubemap lookups see it.
+// rgb is the equirectangular image as stbi_loadf() returns it with vertical flip on, bottom row first.
+// Rows are split between pool workers, the result does not depend on the thread count
+void shProjectEquirect(ShIrradiance* out, const float* rgb, int width, int height, ThreadPool* pool, SH_PROJECT_PATH path = SH_PROJECT_AUTO);
+// faces are rgb, size x size, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order, top row first
+void shProjectCubeFaces(ShIrradiance* out, const float* const faces[6], int size);
+
+gfxm::vec3 shEvalIrradiance(const ShIrradiance& sh, const gfxm::vec3& n);
+// Brute force cosine weighted average of radiance over every texel, for checking the projection
+gfxm::vec3 shReferenceIrradiance(const float* rgb, int width, int height, const gfxm::vec3& n);
@@ -0,0 +1,118 @@
+#include "benchmarks.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include <vector>
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+#include "sh_irradiance.hpp"
+#include "stb_image.h"
+#include "thread/thread_pool.hpp"
+
+
+// Blue gradient sky, dark ground and a small bright sun, the worst case for 9 coefficients
+static void makeSyntheticSky(std::vector<float>& rgb, int width, int height) {
+    rgb.resize((size_t)width * height * 3);
+    const gfxm::vec3 sun_dir = gfxm::normalize(gfxm::vec3(.3f, .5f, -.8f));
+    for (int r = 0; r < height; ++r) {
+        const float lat = ((r + .5f) / height - .5f) * 3.14159265f;
+        for (int i = 0; i < width; ++i) {
+            const float phi = ((i + .5f) / width - .5f) * 2.f * 3.14159265f;
+            const gfxm::vec3 n(cosf(lat) * cosf(phi), sinf(lat), -cosf(lat) * sinf(phi));
+            gfxm::vec3 c = n.y > .0f
+                ? gfxm::vec3(.3f, .5f, 1.f) * (1.f - n.y * .5f)
+                : gfxm::vec3(.15f, .12f, .1f);
+            if (gfxm::dot(n, sun_dir) > .9995f) {
+                c = gfxm::vec3(800.f, 700.f, 600.f);
+            }
+            float* texel = &rgb[((size_t)r * width + i) * 3];
+            texel[0] = c.x;
+            texel[1] = c.y;
+            texel[2] = c.z;
+        }
+    }
+}
+
+static double bestOf(int runs, const std::function<void()>& fn) {
+    double best = 1e9;
+    for (int i = 0; i < runs; ++i) {
+        Stopwatch sw;
+        fn();
+        best = std::min(best, sw.elapsedMs());
+    }
+    return best;
+}
+
+static float luminance(const gfxm::vec3& c) {
+    return c.x * .2126f + c.y * .7152f + c.z * .0722f;
+}
+
+static void benchImage(const char* name, const float* rgb, int width, int height) {
+    ThreadPool single(1);
+    ShIrradiance scalar;
+    ShIrradiance simd;
+    ShIrradiance parallel;
+    const double scalar_ms = bestOf(5, [&]() { shProjectEquirect(&scalar, rgb, width, height, &single, SH_PROJECT_SCALAR); });
+    const double simd_ms = bestOf(5, [&]() { shProjectEquirect(&simd, rgb, width, height, &single, SH_PROJECT_SSE); });
+    const double parallel_ms = bestOf(5, [&]() { shProjectEquirect(&parallel, rgb, width, height, getThreadPool()); });
+
+    // Relative to the constant term, the others can be close to zero
+    const float scale = std::max(1e-3f, fabsf(scalar.coeffs[0].x) + fabsf(scalar.coeffs[0].y) + fabsf(scalar.coeffs[0].z));
+    float max_diff = .0f;
+    for (int k = 0; k < 9; ++k) {
+        const gfxm::vec4 a = scalar.coeffs[k];
+        const gfxm::vec4 b = simd.coeffs[k];
+        max_diff = std::max(max_diff, (fabsf(a.x - b.x) + fabsf(a.y - b.y) + fabsf(a.z - b.z)) / scale);
+    }
+    const double mtexels = (double)width * height / 1e6;
+    LOG("bench", "sh_irradiance: " << name << " " << width << "x" << height
+        << ", scalar " << scalar_ms << "ms, sse " << simd_ms << "ms, sse on " << getThreadPool()->threadCount() << " threads " << parallel_ms
+        << "ms (" << mtexels / (parallel_ms / 1000.) << " Mtexel/s), paths differ by " << max_diff * 100.f << "%");
+    if (max_diff > 1e-3f) {
+        LOG_ERR("bench", "sh_irradiance: " << name << " SIMD projection disagrees with scalar");
+    }
+    if (memcmp(&simd, &parallel, sizeof(ShIrradiance)) != 0) {
+        LOG_ERR("bench", "sh_irradiance: " << name << " result depends on the thread count");
+    }
+
+    // Against brute force cosine convolution on a spread of normals, relative to the average irradiance
+    const int DIRECTION_COUNT = 64;
+    const float golden_angle = 2.39996323f;
+    double error_sum = .0;
+    double max_error = .0;
+    double mean_lum = .0;
+    for (int d = 0; d < DIRECTION_COUNT; ++d) {
+        const float y = 1.f - (d + .5f) / DIRECTION_COUNT * 2.f;
+        const float radius = sqrtf(1.f - y * y);
+        const gfxm::vec3 n(cosf(golden_angle * d) * radius, y, sinf(golden_angle * d) * radius);
+        const float ref = luminance(shReferenceIrradiance(rgb, width, height, n));
+        const float sh = luminance(shEvalIrradiance(parallel, n));
+        error_sum += fabsf(sh - ref);
+        max_error = std::max<double>(max_error, fabsf(sh - ref));
+        mean_lum += ref / DIRECTION_COUNT;
+    }
+    LOG("bench", "sh_irradiance: " << name << " vs brute force convolution, mean error " << (error_sum / DIRECTION_COUNT) / mean_lum * 100.
+        << "%, max " << max_error / mean_lum * 100. << "% of average irradiance " << mean_lum);
+}
+
+void benchShIrradiance() {
+    std::vector<float> sky;
+    const int SKY_WIDTH = 2048;
+    const int SKY_HEIGHT = 1024;
+    makeSyntheticSky(sky, SKY_WIDTH, SKY_HEIGHT);
+    benchImage("synthetic sky", sky.data(), SKY_WIDTH, SKY_HEIGHT);
+
+    // Same path and flip the renderer loads with, skipped when not run from data/
+    const char* hdri_path = "hdri/belfast_sunset_puresky_1k.hdr";
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, ncomp;
+    float* hdri = stbi_loadf(hdri_path, &width, &height, &ncomp, 3);
+    if (!hdri) {
+        LOG_WARN("bench", "sh_irradiance: " << hdri_path << " not found, run from data/ to include it");
+        return;
+    }
+    benchImage(hdri_path, hdri, width, height);
+    stbi_image_free(hdri);
+}
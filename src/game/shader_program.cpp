@@ -137,6 +137,7 @@ bool ShaderProgram::_load(const char* filename, FramebufferDesc* output_textures
             case GL_SAMPLER_2D_MULTISAMPLE:
             case GL_SAMPLER_2D_MULTISAMPLE_ARRAY:
             case GL_SAMPLER_CUBE_SHADOW:
+            case GL_SAMPLER_CUBE_MAP_ARRAY:
             case GL_SAMPLER_BUFFER:
             case GL_SAMPLER_2D_RECT:
             //case GL_SAMPLER_2D_RECT_ARB:
@@ -0,0 +1,665 @@
+#include "texture_compress.hpp"
+
+#include <float.h>
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "math/simd.hpp"
+#include "profiler/profiler.hpp"
+
+
+// The 4x4 block being encoded, one array per channel, values 0..255
+struct BlockTexels {
+    alignas(32) float c[4][16];
+};
+
+// Positions of a codec's interpolated values along the line between the endpoints, first to last
+struct IndexLevels {
+    int count;
+    alignas(32) float weights[16];
+};
+
+static const uint8_t BC7_WEIGHTS4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static IndexLevels makeUniformLevels(int count) {
+    IndexLevels levels = {};
+    levels.count = count;
+    for (int i = 0; i < count; ++i) {
+        levels.weights[i] = i / (float)(count - 1);
+    }
+    return levels;
+}
+
+static IndexLevels makeBc7Levels() {
+    IndexLevels levels = {};
+    levels.count = 16;
+    for (int i = 0; i < 16; ++i) {
+        levels.weights[i] = BC7_WEIGHTS4[i] / 64.f;
+    }
+    return levels;
+}
+
+static const IndexLevels LEVELS_BC1 = makeUniformLevels(4);
+static const IndexLevels LEVELS_BC4 = makeUniformLevels(8);
+static const IndexLevels LEVELS_BC7 = makeBc7Levels();
+
+// Picks the level closest to each texel's projection on the line e0 -> e1 and returns the squared error
+// of the reconstruction. Projection and rounding assume evenly spaced levels, BC7's are off by less than
+// a level so the result can be one index away from the nearest, never more
+typedef float(*fit_fn_t)(const float (*texels)[16], int channels, const float* e0, const float* e1, const IndexLevels& levels, uint8_t* indices);
+
+static float fitIndicesScalar(const float (*texels)[16], int channels, const float* e0, const float* e1, const IndexLevels& levels, uint8_t* indices) {
+    float d[4];
+    float dd = .0f;
+    for (int c = 0; c < channels; ++c) {
+        d[c] = e1[c] - e0[c];
+        dd += d[c] * d[c];
+    }
+    const float scale = dd > .0f ? (levels.count - 1) / dd : .0f;
+    const float max_level = (float)(levels.count - 1);
+    float error = .0f;
+    for (int i = 0; i < 16; ++i) {
+        float t = .0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (texels[c][i] - e0[c]) * d[c];
+        }
+        const int idx = (int)std::min(max_level, std::max(.0f, floorf(t * scale + .5f)));
+        indices[i] = (uint8_t)idx;
+        const float w = levels.weights[idx];
+        for (int c = 0; c < channels; ++c) {
+            const float r = e0[c] + d[c] * w - texels[c][i];
+            error += r * r;
+        }
+    }
+    return error;
+}
+
+#if SIMD_X86
+SIMD_TARGET_AVX2
+static float fitIndicesAvx2(const float (*texels)[16], int channels, const float* e0, const float* e1, const IndexLevels& levels, uint8_t* indices) {
+    float d[4];
+    float dd = .0f;
+    for (int c = 0; c < channels; ++c) {
+        d[c] = e1[c] - e0[c];
+        dd += d[c] * d[c];
+    }
+    const __m256 scale = _mm256_set1_ps(dd > .0f ? (levels.count - 1) / dd : .0f);
+    const __m256 max_level = _mm256_set1_ps((float)(levels.count - 1));
+    const __m256 half = _mm256_set1_ps(.5f);
+    __m256 error = _mm256_setzero_ps();
+    for (int h = 0; h < 16; h += 8) {
+        __m256 px[4];
+        __m256 t = _mm256_setzero_ps();
+        for (int c = 0; c < channels; ++c) {
+            px[c] = _mm256_load_ps(&texels[c][h]);
+            t = _mm256_add_ps(t, _mm256_mul_ps(_mm256_sub_ps(px[c], _mm256_set1_ps(e0[c])), _mm256_set1_ps(d[c])));
+        }
+        __m256 level = _mm256_floor_ps(_mm256_add_ps(_mm256_mul_ps(t, scale), half));
+        level = _mm256_min_ps(max_level, _mm256_max_ps(_mm256_setzero_ps(), level));
+        const __m256i idx = _mm256_cvttps_epi32(level);
+        const __m256 w = _mm256_i32gather_ps(levels.weights, idx, 4);
+        for (int c = 0; c < channels; ++c) {
+            const __m256 r = _mm256_sub_ps(_mm256_add_ps(_mm256_set1_ps(e0[c]), _mm256_mul_ps(_mm256_set1_ps(d[c]), w)), px[c]);
+            error = _mm256_add_ps(error, _mm256_mul_ps(r, r));
+        }
+        alignas(32) int32_t idx_out[8];
+        _mm256_store_si256((__m256i*)idx_out, idx);
+        for (int i = 0; i < 8; ++i) {
+            indices[h + i] = (uint8_t)idx_out[i];
+        }
+    }
+    alignas(32) float sums[8];
+    _mm256_store_ps(sums, error);
+    return ((sums[0] + sums[1]) + (sums[2] + sums[3])) + ((sums[4] + sums[5]) + (sums[6] + sums[7]));
+}
+#endif
+
+static TEXTURE_ENCODE_PATH resolveEncodePath(TEXTURE_ENCODE_PATH path) {
+#if SIMD_X86
+    if (path == TEXTURE_ENCODE_SCALAR) {
+        return path;
+    }
+    return simdHasAvx2() ? TEXTURE_ENCODE_AVX2 : TEXTURE_ENCODE_SCALAR;
+#else
+    return TEXTURE_ENCODE_SCALAR;
+#endif
+}
+
+static fit_fn_t pickFitFn(TEXTURE_ENCODE_PATH path) {
+#if SIMD_X86
+    if (resolveEncodePath(path) == TEXTURE_ENCODE_AVX2) {
+        return &fitIndicesAvx2;
+    }
+#endif
+    return &fitIndicesScalar;
+}
+
+static float clampTexel(float v) {
+    return std::min(255.f, std::max(.0f, v));
+}
+
+// Endpoints at the extremes of the texels projected on their principal axis
+static void lineEndpoints(const float (*texels)[16], int channels, float* e0, float* e1) {
+    float mean[4] = { 0 };
+    float lo[4], hi[4];
+    for (int c = 0; c < channels; ++c) {
+        lo[c] = FLT_MAX;
+        hi[c] = -FLT_MAX;
+        for (int i = 0; i < 16; ++i) {
+            mean[c] += texels[c][i];
+            lo[c] = std::min(lo[c], texels[c][i]);
+            hi[c] = std::max(hi[c], texels[c][i]);
+        }
+        mean[c] /= 16.f;
+    }
+    float cov[4][4] = { 0 };
+    for (int i = 0; i < 16; ++i) {
+        for (int a = 0; a < channels; ++a) {
+            for (int b = a; b < channels; ++b) {
+                cov[a][b] += (texels[a][i] - mean[a]) * (texels[b][i] - mean[b]);
+            }
+        }
+    }
+    for (int a = 0; a < channels; ++a) {
+        for (int b = 0; b < a; ++b) {
+            cov[a][b] = cov[b][a];
+        }
+    }
+    // Power iteration, started from the bounding box diagonal which is usually close already
+    float axis[4];
+    for (int c = 0; c < channels; ++c) {
+        axis[c] = hi[c] - lo[c];
+    }
+    for (int iter = 0; iter < 8; ++iter) {
+        float next[4] = { 0 };
+        float largest = .0f;
+        for (int a = 0; a < channels; ++a) {
+            for (int b = 0; b < channels; ++b) {
+                next[a] += cov[a][b] * axis[b];
+            }
+            largest = std::max(largest, fabsf(next[a]));
+        }
+        if (largest < 1e-6f) {
+            break;
+        }
+        for (int c = 0; c < channels; ++c) {
+            axis[c] = next[c] / largest;
+        }
+    }
+    float len = .0f;
+    for (int c = 0; c < channels; ++c) {
+        len += axis[c] * axis[c];
+    }
+    if (len < 1e-12f) {
+        // Flat block
+        for (int c = 0; c < channels; ++c) {
+            e0[c] = e1[c] = mean[c];
+        }
+        return;
+    }
+    len = sqrtf(len);
+    float t_min = FLT_MAX;
+    float t_max = -FLT_MAX;
+    for (int i = 0; i < 16; ++i) {
+        float t = .0f;
+        for (int c = 0; c < channels; ++c) {
+            t += (texels[c][i] - mean[c]) * axis[c] / len;
+        }
+        t_min = std::min(t_min, t);
+        t_max = std::max(t_max, t);
+    }
+    for (int c = 0; c < channels; ++c) {
+        e0[c] = clampTexel(mean[c] + axis[c] / len * t_min);
+        e1[c] = clampTexel(mean[c] + axis[c] / len * t_max);
+    }
+}
+
+// Endpoints that minimize the squared error for the given indices, false if they can't be solved for
+static bool leastSquaresEndpoints(const float (*texels)[16], int channels, const uint8_t* indices, const IndexLevels& levels, float* e0, float* e1) {
+    float aa = .0f, bb = .0f, ab = .0f;
+    float ax[4] = { 0 };
+    float bx[4] = { 0 };
+    for (int i = 0; i < 16; ++i) {
+        const float b = levels.weights[indices[i]];
+        const float a = 1.f - b;
+        aa += a * a;
+        bb += b * b;
+        ab += a * b;
+        for (int c = 0; c < channels; ++c) {
+            ax[c] += a * texels[c][i];
+            bx[c] += b * texels[c][i];
+        }
+    }
+    const float det = aa * bb - ab * ab;
+    if (fabsf(det) < 1e-6f) {
+        return false;
+    }
+    for (int c = 0; c < channels; ++c) {
+        e0[c] = clampTexel((ax[c] * bb - bx[c] * ab) / det);
+        e1[c] = clampTexel((bx[c] * aa - ax[c] * ab) / det);
+    }
+    return true;
+}
+
+static int roundToInt(float v) {
+    return (int)floorf(v + .5f);
+}
+
+// BC1
+
+static uint16_t packRgb565(const float* c) {
+    const int r = std::min(31, roundToInt(c[0] * 31.f / 255.f));
+    const int g = std::min(63, roundToInt(c[1] * 63.f / 255.f));
+    const int b = std::min(31, roundToInt(c[2] * 31.f / 255.f));
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static void unpackRgb565(uint16_t v, int* c) {
+    const int r = v >> 11;
+    const int g = (v >> 5) & 63;
+    const int b = v & 31;
+    c[0] = (r << 3) | (r >> 2);
+    c[1] = (g << 2) | (g >> 4);
+    c[2] = (b << 3) | (b >> 2);
+}
+
+struct Bc1Candidate {
+    uint16_t color_a;
+    uint16_t color_b;
+    uint8_t indices[16];	// 0 is color_a, 3 is color_b
+    float error;
+};
+
+static void bc1Fit(const BlockTexels& b, const float* ea, const float* eb, fit_fn_t fit, Bc1Candidate* out) {
+    out->color_a = packRgb565(ea);
+    out->color_b = packRgb565(eb);
+    int qa[3], qb[3];
+    unpackRgb565(out->color_a, qa);
+    unpackRgb565(out->color_b, qb);
+    const float fa[3] = { (float)qa[0], (float)qa[1], (float)qa[2] };
+    const float fb[3] = { (float)qb[0], (float)qb[1], (float)qb[2] };
+    out->error = fit(b.c, 3, fa, fb, LEVELS_BC1, out->indices);
+}
+
+static void encodeBc1(const BlockTexels& b, fit_fn_t fit, uint8_t* out) {
+    float e0[3], e1[3];
+    lineEndpoints(b.c, 3, e0, e1);
+    Bc1Candidate best;
+    bc1Fit(b, e0, e1, fit, &best);
+    if (leastSquaresEndpoints(b.c, 3, best.indices, LEVELS_BC1, e0, e1)) {
+        Bc1Candidate refined;
+        bc1Fit(b, e0, e1, fit, &refined);
+        if (refined.error < best.error) {
+            best = refined;
+        }
+    }
+    // Four color mode needs color0 > color1, equal colors fall into three color mode where index 0 is still color0
+    static const uint8_t BC1_INDEX[4] = { 0, 2, 3, 1 };
+    uint16_t color0 = best.color_a;
+    uint16_t color1 = best.color_b;
+    const bool swap = color0 < color1;
+    if (swap) {
+        std::swap(color0, color1);
+    }
+    uint32_t bits = 0;
+    if (color0 != color1) {
+        for (int i = 0; i < 16; ++i) {
+            const int level = swap ? 3 - best.indices[i] : best.indices[i];
+            bits |= (uint32_t)BC1_INDEX[level] << (i * 2);
+        }
+    }
+    memcpy(out, &color0, 2);
+    memcpy(out + 2, &color1, 2);
+    memcpy(out + 4, &bits, 4);
+}
+
+static void decodeBc1(const uint8_t* block, uint8_t rgba[16][4]) {
+    uint16_t color0, color1;
+    uint32_t bits;
+    memcpy(&color0, block, 2);
+    memcpy(&color1, block + 2, 2);
+    memcpy(&bits, block + 4, 4);
+    int palette[4][4];
+    unpackRgb565(color0, palette[0]);
+    unpackRgb565(color1, palette[1]);
+    for (int c = 0; c < 3; ++c) {
+        if (color0 > color1) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        } else {
+            palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+            palette[3][c] = 0;
+        }
+    }
+    palette[0][3] = palette[1][3] = palette[2][3] = 255;
+    palette[3][3] = color0 > color1 ? 255 : 0;
+    for (int i = 0; i < 16; ++i) {
+        const int idx = (bits >> (i * 2)) & 3;
+        for (int c = 0; c < 4; ++c) {
+            rgba[i][c] = (uint8_t)palette[idx][c];
+        }
+    }
+}
+
+// BC4, BC5 is two of these
+
+static void encodeBc4(const BlockTexels& b, int channel, fit_fn_t fit, uint8_t* out) {
+    const float* values = b.c[channel];
+    float lo = values[0];
+    float hi = values[0];
+    for (int i = 1; i < 16; ++i) {
+        lo = std::min(lo, values[i]);
+        hi = std::max(hi, values[i]);
+    }
+    // Eight value mode, red0 > red1
+    const int red0 = roundToInt(hi);
+    const int red1 = roundToInt(lo);
+    out[0] = (uint8_t)red0;
+    out[1] = (uint8_t)red1;
+    uint64_t bits = 0;
+    if (red0 != red1) {
+        const float e0 = (float)red1;
+        const float e1 = (float)red0;
+        uint8_t levels[16];
+        fit(&b.c[channel], 1, &e0, &e1, LEVELS_BC4, levels);
+        for (int i = 0; i < 16; ++i) {
+            // Level 7 is red0 (index 0), level 0 is red1 (index 1), in between index 2 is closest to red0
+            const int idx = levels[i] == 7 ? 0 : (levels[i] == 0 ? 1 : 8 - levels[i]);
+            bits |= (uint64_t)idx << (i * 3);
+        }
+    }
+    for (int i = 0; i < 6; ++i) {
+        out[2 + i] = (uint8_t)(bits >> (i * 8));
+    }
+}
+
+static void decodeBc4(const uint8_t* block, uint8_t values[16]) {
+    const int red0 = block[0];
+    const int red1 = block[1];
+    int palette[8] = { red0, red1 };
+    if (red0 > red1) {
+        for (int i = 2; i < 8; ++i) {
+            palette[i] = ((8 - i) * red0 + (i - 1) * red1) / 7;
+        }
+    } else {
+        for (int i = 2; i < 6; ++i) {
+            palette[i] = ((6 - i) * red0 + (i - 1) * red1) / 5;
+        }
+        palette[6] = 0;
+        palette[7] = 255;
+    }
+    uint64_t bits = 0;
+    for (int i = 0; i < 6; ++i) {
+        bits |= (uint64_t)block[2 + i] << (i * 8);
+    }
+    for (int i = 0; i < 16; ++i) {
+        values[i] = (uint8_t)palette[(bits >> (i * 3)) & 7];
+    }
+}
+
+// BC7 mode 6: RGBA endpoints with 7 bits per channel plus one shared lowest bit per endpoint
+
+struct Bc7Candidate {
+    uint8_t q[2][4];		// 7 bit endpoints
+    int p[2];
+    uint8_t indices[16];
+    float error;
+};
+
+// Tries every combination of the two p-bits, keeps the best in out if it beats out->error
+static void bc7Fit(const BlockTexels& b, const float* ea, const float* eb, fit_fn_t fit, Bc7Candidate* out) {
+    const float* ends[2] = { ea, eb };
+    for (int pbits = 0; pbits < 4; ++pbits) {
+        Bc7Candidate cand;
+        float expanded[2][4];
+        for (int e = 0; e < 2; ++e) {
+            cand.p[e] = (pbits >> e) & 1;
+            for (int c = 0; c < 4; ++c) {
+                const int q = std::min(127, std::max(0, roundToInt((ends[e][c] - cand.p[e]) * .5f)));
+                cand.q[e][c] = (uint8_t)q;
+                expanded[e][c] = (float)((q << 1) | cand.p[e]);
+            }
+        }
+        cand.error = fit(b.c, 4, expanded[0], expanded[1], LEVELS_BC7, cand.indices);
+        if (cand.error < out->error) {
+            *out = cand;
+        }
+    }
+}
+
+struct BitWriter {
+    uint64_t words[2] = { 0, 0 };
+    int pos = 0;
+    void write(uint32_t value, int bits) {
+        for (int i = 0; i < bits; ++i, ++pos) {
+            words[pos >> 6] |= (uint64_t)((value >> i) & 1) << (pos & 63);
+        }
+    }
+};
+
+struct BitReader {
+    uint64_t words[2];
+    int pos = 0;
+    uint32_t read(int bits) {
+        uint32_t value = 0;
+        for (int i = 0; i < bits; ++i, ++pos) {
+            value |= (uint32_t)((words[pos >> 6] >> (pos & 63)) & 1) << i;
+        }
+        return value;
+    }
+};
+
+static void encodeBc7(const BlockTexels& b, fit_fn_t fit, uint8_t* out) {
+    float e0[4], e1[4];
+    lineEndpoints(b.c, 4, e0, e1);
+    Bc7Candidate best;
+    best.error = FLT_MAX;
+    bc7Fit(b, e0, e1, fit, &best);
+    if (leastSquaresEndpoints(b.c, 4, best.indices, LEVELS_BC7, e0, e1)) {
+        bc7Fit(b, e0, e1, fit, &best);
+    }
+    // The first index is stored without its top bit, swapping the endpoints clears it.
+    // The weight table is symmetric so the texels come out the same
+    if (best.indices[0] >= 8) {
+        std::swap(best.q[0], best.q[1]);
+        std::swap(best.p[0], best.p[1]);
+        for (int i = 0; i < 16; ++i) {
+            best.indices[i] = (uint8_t)(15 - best.indices[i]);
+        }
+    }
+    BitWriter w;
+    w.write(1 << 6, 7);
+    for (int c = 0; c < 4; ++c) {
+        w.write(best.q[0][c], 7);
+        w.write(best.q[1][c], 7);
+    }
+    w.write(best.p[0], 1);
+    w.write(best.p[1], 1);
+    w.write(best.indices[0], 3);
+    for (int i = 1; i < 16; ++i) {
+        w.write(best.indices[i], 4);
+    }
+    memcpy(out, w.words, 16);
+}
+
+static void decodeBc7(const uint8_t* block, uint8_t rgba[16][4]) {
+    BitReader r;
+    memcpy(r.words, block, 16);
+    if (r.read(7) != (1 << 6)) {
+        for (int i = 0; i < 16; ++i) {
+            rgba[i][0] = 255;
+            rgba[i][1] = 0;
+            rgba[i][2] = 255;
+            rgba[i][3] = 255;
+        }
+        return;
+    }
+    int q[2][4];
+    for (int c = 0; c < 4; ++c) {
+        q[0][c] = r.read(7);
+        q[1][c] = r.read(7);
+    }
+    const int p0 = r.read(1);
+    const int p1 = r.read(1);
+    int ends[2][4];
+    for (int c = 0; c < 4; ++c) {
+        ends[0][c] = (q[0][c] << 1) | p0;
+        ends[1][c] = (q[1][c] << 1) | p1;
+    }
+    for (int i = 0; i < 16; ++i) {
+        const int w = BC7_WEIGHTS4[r.read(i == 0 ? 3 : 4)];
+        for (int c = 0; c < 4; ++c) {
+            rgba[i][c] = (uint8_t)(((64 - w) * ends[0][c] + w * ends[1][c] + 32) >> 6);
+        }
+    }
+}
+
+const char* textureCodecName(TEXTURE_CODEC codec) {
+    switch (codec) {
+    case TEXTURE_CODEC_BC1: return "bc1";
+    case TEXTURE_CODEC_BC4: return "bc4";
+    case TEXTURE_CODEC_BC5: return "bc5";
+    case TEXTURE_CODEC_BC7: return "bc7";
+    default: return "none";
+    }
+}
+
+int textureCodecBlockBytes(TEXTURE_CODEC codec) {
+    switch (codec) {
+    case TEXTURE_CODEC_BC1:
+    case TEXTURE_CODEC_BC4:
+        return 8;
+    case TEXTURE_CODEC_BC5:
+    case TEXTURE_CODEC_BC7:
+        return 16;
+    default:
+        return 0;
+    }
+}
+
+GLenum textureCodecGlFormat(TEXTURE_CODEC codec) {
+    switch (codec) {
+    case TEXTURE_CODEC_BC1: return GL_COMPRESSED_RGB_S3TC_DXT1_EXT;
+    case TEXTURE_CODEC_BC4: return GL_COMPRESSED_RED_RGTC1;
+    case TEXTURE_CODEC_BC5: return GL_COMPRESSED_RG_RGTC2;
+    case TEXTURE_CODEC_BC7: return GL_COMPRESSED_RGBA_BPTC_UNORM;
+    default: return 0;
+    }
+}
+
+size_t textureEncodedSize(TEXTURE_CODEC codec, int width, int height) {
+    return (size_t)((width + 3) / 4) * ((height + 3) / 4) * textureCodecBlockBytes(codec);
+}
+
+static void loadBlock(const uint8_t* texels, int width, int height, int channels, int bx, int by, BlockTexels* b) {
+    for (int y = 0; y < 4; ++y) {
+        const int sy = std::min(by * 4 + y, height - 1);
+        for (int x = 0; x < 4; ++x) {
+            const int sx = std::min(bx * 4 + x, width - 1);
+            const uint8_t* p = texels + ((size_t)sy * width + sx) * channels;
+            for (int c = 0; c < 4; ++c) {
+                b->c[c][y * 4 + x] = c < channels ? (float)p[c] : (c == 3 ? 255.f : .0f);
+            }
+        }
+    }
+}
+
+void textureEncode(
+    TEXTURE_CODEC codec,
+    const uint8_t* texels, int width, int height, int channels,
+    uint8_t* out,
+    ThreadPool* pool,
+    TEXTURE_ENCODE_PATH path
+) {
+    PROF_SCOPE_FN();
+    const fit_fn_t fit = pickFitFn(path);
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const int block_bytes = textureCodecBlockBytes(codec);
+    pool->parallelFor(blocks_y, [&](int by, int) {
+        BlockTexels b;
+        uint8_t* dst = out + (size_t)by * blocks_x * block_bytes;
+        for (int bx = 0; bx < blocks_x; ++bx, dst += block_bytes) {
+            loadBlock(texels, width, height, channels, bx, by, &b);
+            switch (codec) {
+            case TEXTURE_CODEC_BC1:
+                encodeBc1(b, fit, dst);
+                break;
+            case TEXTURE_CODEC_BC4:
+                encodeBc4(b, 0, fit, dst);
+                break;
+            case TEXTURE_CODEC_BC5:
+                encodeBc4(b, 0, fit, dst);
+                encodeBc4(b, 1, fit, dst + 8);
+                break;
+            case TEXTURE_CODEC_BC7:
+                encodeBc7(b, fit, dst);
+                break;
+            default:
+                break;
+            }
+        }
+    });
+}
+
+void textureDecode(TEXTURE_CODEC codec, const uint8_t* blocks, int width, int height, int channels, uint8_t* out) {
+    const int blocks_x = (width + 3) / 4;
+    const int blocks_y = (height + 3) / 4;
+    const int block_bytes = textureCodecBlockBytes(codec);
+    uint8_t rgba[16][4];
+    for (int by = 0; by < blocks_y; ++by) {
+        for (int bx = 0; bx < blocks_x; ++bx) {
+            const uint8_t* block = blocks + ((size_t)by * blocks_x + bx) * block_bytes;
+            if (codec == TEXTURE_CODEC_BC1) {
+                decodeBc1(block, rgba);
+            } else if (codec == TEXTURE_CODEC_BC7) {
+                decodeBc7(block, rgba);
+            } else {
+                uint8_t r[16];
+                uint8_t g[16] = { 0 };
+                decodeBc4(block, r);
+                if (codec == TEXTURE_CODEC_BC5) {
+                    decodeBc4(block + 8, g);
+                }
+                for (int i = 0; i < 16; ++i) {
+                    rgba[i][0] = r[i];
+                    rgba[i][1] = g[i];
+                    rgba[i][2] = 0;
+                    rgba[i][3] = 255;
+                }
+            }
+            for (int y = 0; y < 4 && by * 4 + y < height; ++y) {
+                for (int x = 0; x < 4 && bx * 4 + x < width; ++x) {
+                    uint8_t* dst = out + ((size_t)(by * 4 + y) * width + bx * 4 + x) * channels;
+                    memcpy(dst, rgba[y * 4 + x], channels);
+                }
+            }
+        }
+    }
+}
+
+double textureCompressPsnr(TEXTURE_CODEC codec, const uint8_t* texels, int width, int height, int channels, const uint8_t* blocks) {
+    static const int STORED_CHANNELS[] = { 4, 3, 1, 2, 4 };
+    const int compared = std::min(channels, STORED_CHANNELS[codec]);
+    std::vector<uint8_t> decoded((size_t)width * height * channels);
+    textureDecode(codec, blocks, width, height, channels, decoded.data());
+    double sum = .0;
+    const size_t count = (size_t)width * height;
+    for (size_t i = 0; i < count; ++i) {
+        for (int c = 0; c < compared; ++c) {
+            const double d = (double)texels[i * channels + c] - decoded[i * channels + c];
+            sum += d * d;
+        }
+    }
+    const double mse = sum / ((double)count * compared);
+    // Lossless, capped so averages stay finite
+    if (mse < 1e-10) {
+        return 99.0;
+    }
+    return 10.0 * log10(255.0 * 255.0 / mse);
+}
+
+const char* textureEncodePathName(TEXTURE_ENCODE_PATH path) {
+    return resolveEncodePath(path) == TEXTURE_ENCODE_AVX2 ? "avx2" : "scalar";
+}
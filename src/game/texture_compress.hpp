@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include "platform/win32/gl/glextutil.h"
+#include "thread/thread_pool.hpp"
+
+
+// CPU block compression for the texture import. Every codec fits a line through the block's texels
+// (principal axis, then a least squares pass over the chosen indices), the index search over the 16
+// texels is the hot loop and has an AVX2 path. Blocks are independent, levels split rows across the pool
+enum TEXTURE_CODEC {
+	TEXTURE_CODEC_NONE,		// 8 bit texels
+	TEXTURE_CODEC_BC1,		// RGB, 4 bits per texel
+	TEXTURE_CODEC_BC4,		// R, 4 bits per texel
+	TEXTURE_CODEC_BC5,		// RG, 8 bits per texel, two BC4 blocks
+	TEXTURE_CODEC_BC7		// RGBA, 8 bits per texel, mode 6 only: one subset, 4 bit indices
+};
+
+enum TEXTURE_ENCODE_PATH {
+	TEXTURE_ENCODE_AUTO,
+	TEXTURE_ENCODE_SCALAR,
+	TEXTURE_ENCODE_AVX2
+};
+
+const char* textureCodecName(TEXTURE_CODEC codec);
+// 0 for TEXTURE_CODEC_NONE
+int textureCodecBlockBytes(TEXTURE_CODEC codec);
+GLenum textureCodecGlFormat(TEXTURE_CODEC codec);
+// Whole blocks, levels smaller than 4x4 still take one
+size_t textureEncodedSize(TEXTURE_CODEC codec, int width, int height);
+
+// texels are rows of width x height, channels bytes each. Missing channels read as 0, alpha as 255,
+// blocks over the right and bottom edges repeat the last column and row.
+// out needs textureEncodedSize() bytes, blocks row by row like glCompressedTexSubImage2D takes them
+void textureEncode(
+	TEXTURE_CODEC codec,
+	const uint8_t* texels, int width, int height, int channels,
+	uint8_t* out,
+	ThreadPool* pool,
+	TEXTURE_ENCODE_PATH path = TEXTURE_ENCODE_AUTO
+);
+// Back to channels bytes per texel, for measuring. BC7 blocks in other modes than 6 decode as magenta
+void textureDecode(TEXTURE_CODEC codec, const uint8_t* blocks, int width, int height, int channels, uint8_t* out);
+// Over the channels the codec stores, in dB
+double textureCompressPsnr(TEXTURE_CODEC codec, const uint8_t* texels, int width, int height, int channels, const uint8_t* blocks);
+
+const char* textureEncodePathName(TEXTURE_ENCODE_PATH path);
@@ -0,0 +1,111 @@
+#include "benchmarks.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "filesystem/filesystem.hpp"
+#include "log/log.hpp"
+#include "profiler/stopwatch.hpp"
+#include "stb_image.h"
+#include "texture_compress.hpp"
+#include "texture_import.hpp"
+#include "thread/thread_pool.hpp"
+
+
+// Smooth gradients with noise and a hard edge, some of everything a block encoder struggles with
+static void makeSyntheticImage(std::vector<uint8_t>& texels, int width, int height, int channels) {
+    texels.resize((size_t)width * height * channels);
+    uint32_t rng = 12345;
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            rng = rng * 1664525u + 1013904223u;
+            const int noise = (int)(rng >> 28) - 8;
+            for (int c = 0; c < channels; ++c) {
+                float v = 128.f + 100.f * sinf(x * .02f * (c + 1) + y * .013f);
+                if ((x / 64 + y / 64) % 2) {
+                    v = 255.f - v;
+                }
+                texels[((size_t)y * width + x) * channels + c] = (uint8_t)std::min(255, std::max(0, (int)v + noise));
+            }
+        }
+    }
+}
+
+struct CodecTotals {
+    double mb = .0;
+    double ms[2] = { .0, .0 };		// Scalar, AVX2
+    double psnr_sum = .0;
+    int images = 0;
+};
+
+static void benchImage(const char* name, const uint8_t* texels, int width, int height, int channels, TEXTURE_CODEC codec, CodecTotals* totals) {
+    ThreadPool* pool = getThreadPool();
+    std::vector<uint8_t> blocks(textureEncodedSize(codec, width, height));
+    const double mb = (double)width * height * channels / (1024.0 * 1024.0);
+    const TEXTURE_ENCODE_PATH paths[] = { TEXTURE_ENCODE_SCALAR, TEXTURE_ENCODE_AVX2 };
+    double ms[2];
+    for (int i = 0; i < 2; ++i) {
+        Stopwatch sw;
+        textureEncode(codec, texels, width, height, channels, blocks.data(), pool, paths[i]);
+        ms[i] = sw.elapsedMs();
+        totals->ms[i] += ms[i];
+    }
+    const double psnr = textureCompressPsnr(codec, texels, width, height, channels, blocks.data());
+    totals->mb += mb;
+    totals->psnr_sum += psnr;
+    totals->images++;
+    LOG("bench", "texture_compress: " << name << " " << width << "x" << height << " " << textureCodecName(codec)
+        << " psnr " << psnr << "dB, scalar " << mb / (ms[0] * .001) << "MB/s, "
+        << textureEncodePathName(TEXTURE_ENCODE_AVX2) << " " << mb / (ms[1] * .001) << "MB/s");
+}
+
+void benchTextureCompress() {
+    const TEXTURE_CODEC codecs[] = { TEXTURE_CODEC_BC1, TEXTURE_CODEC_BC4, TEXTURE_CODEC_BC5, TEXTURE_CODEC_BC7 };
+    CodecTotals totals[5];
+    LOG("bench", "texture_compress: " << getThreadPool()->threadCount() << " threads, MB/s of uncompressed source texels");
+
+    std::vector<uint8_t> synthetic;
+    makeSyntheticImage(synthetic, 1024, 1024, 4);
+    for (TEXTURE_CODEC codec : codecs) {
+        benchImage("synthetic", synthetic.data(), 1024, 1024, 4, codec, &totals[codec]);
+    }
+
+    // Every source the import tool would take, skipped when not run from data/
+    std::vector<std::string> paths = fsFindAllFiles("textures", "*.png");
+    const std::vector<std::string> jpgs = fsFindAllFiles("textures", "*.jpg");
+    paths.insert(paths.end(), jpgs.begin(), jpgs.end());
+    if (paths.empty()) {
+        LOG_WARN("bench", "texture_compress: no textures found, run from data/ to include them");
+    }
+    stbi_set_flip_vertically_on_load_thread(true);
+    for (const std::string& path : paths) {
+        TEXTURE_ROLE role;
+        if (!textureRoleFromPath(path, &role)) {
+            continue;
+        }
+        const int channels = textureRoleChannels(role);
+        int width, height, comp;
+        stbi_uc* texels = stbi_load(path.c_str(), &width, &height, &comp, channels);
+        if (!texels) {
+            continue;
+        }
+        // Albedo compared in both of its codecs
+        benchImage(path.c_str(), texels, width, height, channels, textureRoleDefaultCodec(role), &totals[textureRoleDefaultCodec(role)]);
+        if (role == TEXTURE_ROLE_ALBEDO) {
+            benchImage(path.c_str(), texels, width, height, channels, TEXTURE_CODEC_BC1, &totals[TEXTURE_CODEC_BC1]);
+        }
+        stbi_image_free(texels);
+    }
+
+    for (TEXTURE_CODEC codec : codecs) {
+        const CodecTotals& t = totals[codec];
+        if (t.images == 0) {
+            continue;
+        }
+        LOG("bench", "texture_compress: " << textureCodecName(codec) << " over " << t.images << " images, mean psnr "
+            << t.psnr_sum / t.images << "dB, scalar " << t.mb / (t.ms[0] * .001) << "MB/s, "
+            << textureEncodePathName(TEXTURE_ENCODE_AVX2) << " " << t.mb / (t.ms[1] * .001) << "MB/s ("
+            << t.ms[0] / t.ms[1] << "x)");
+    }
+}
@@ -0,0 +1,302 @@
+#include "texture_import.hpp"
+
+#include <ctype.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <iomanip>
+#include "filesystem/filesystem.hpp"
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+#include "profiler/stopwatch.hpp"
+#include "ibl_cache.hpp"
+#include "stb_image.h"
+
+
+constexpr uint64_t LEVEL_ALIGNMENT = 16;
+
+int textureRoleChannels(TEXTURE_ROLE role) {
+    switch (role) {
+    case TEXTURE_ROLE_ALBEDO: return 4;
+    case TEXTURE_ROLE_MASK: return 1;
+    default: return 3;
+    }
+}
+
+TEXTURE_CODEC textureRoleDefaultCodec(TEXTURE_ROLE role) {
+    switch (role) {
+    case TEXTURE_ROLE_ALBEDO: return TEXTURE_CODEC_BC7;
+    case TEXTURE_ROLE_NORMAL: return TEXTURE_CODEC_BC5;
+    case TEXTURE_ROLE_MASK: return TEXTURE_CODEC_BC4;
+    case TEXTURE_ROLE_MATERIAL: return TEXTURE_CODEC_BC7;
+    default: return TEXTURE_CODEC_BC1;
+    }
+}
+
+TEXTURE_MIP_SPACE textureRoleMipSpace(TEXTURE_ROLE role) {
+    switch (role) {
+    case TEXTURE_ROLE_ALBEDO: return TEXTURE_MIP_SRGB;
+    case TEXTURE_ROLE_EMISSION: return TEXTURE_MIP_SRGB;
+    case TEXTURE_ROLE_NORMAL: return TEXTURE_MIP_NORMAL;
+    default: return TEXTURE_MIP_LINEAR;
+    }
+}
+
+const char* textureRoleName(TEXTURE_ROLE role) {
+    switch (role) {
+    case TEXTURE_ROLE_ALBEDO: return "albedo";
+    case TEXTURE_ROLE_NORMAL: return "normal";
+    case TEXTURE_ROLE_MASK: return "mask";
+    case TEXTURE_ROLE_MATERIAL: return "material";
+    default: return "emission";
+    }
+}
+
+// Words of the file name, "red-plaid_ao.png" is red, plaid and ao
+static std::vector<std::string> fileNameWords(const std::string& path) {
+    const size_t name_begin = path.find_last_of("/\\") + 1;
+    const size_t name_end = path.find_last_of('.');
+    std::string name = path.substr(name_begin, name_end == std::string::npos || name_end < name_begin ? std::string::npos : name_end - name_begin);
+    std::transform(name.begin(), name.end(), name.begin(), [](char c) { return (char)tolower(c); });
+    std::vector<std::string> words;
+    std::string word;
+    for (char c : name + "_") {
+        if (c == '_' || c == '-' || c == ' ' || c == '.') {
+            if (!word.empty()) {
+                words.push_back(word);
+            }
+            word.clear();
+        } else {
+            word += c;
+        }
+    }
+    return words;
+}
+
+static bool startsWith(const std::string& s, const char* prefix) {
+    return s.compare(0, strlen(prefix), prefix) == 0;
+}
+
+bool textureRoleFromPath(const std::string& path, TEXTURE_ROLE* out) {
+    for (const std::string& w : fileNameWords(path)) {
+        if (startsWith(w, "normal") || w == "nrm") {
+            *out = TEXTURE_ROLE_NORMAL;
+            return true;
+        }
+        if (startsWith(w, "albedo") || startsWith(w, "diffuse") || startsWith(w, "basecolor") || w == "color") {
+            *out = TEXTURE_ROLE_ALBEDO;
+            return true;
+        }
+        if (startsWith(w, "emissi")) {
+            *out = TEXTURE_ROLE_EMISSION;
+            return true;
+        }
+        if (startsWith(w, "rough") || startsWith(w, "metal") || w == "ao" || startsWith(w, "occlusion")
+            || startsWith(w, "displacement") || startsWith(w, "height")) {
+            *out = TEXTURE_ROLE_MASK;
+            return true;
+        }
+    }
+    return false;
+}
+
+int textureMaterialChannel(const std::string& path) {
+    for (const std::string& w : fileNameWords(path)) {
+        if (startsWith(w, "rough")) {
+            return 0;
+        }
+        if (startsWith(w, "metal")) {
+            return 1;
+        }
+        if (w == "ao" || startsWith(w, "occlusion")) {
+            return 2;
+        }
+    }
+    return -1;
+}
+
+bool textureHashSources(const std::vector<std::string>& paths, uint64_t* out_hash) {
+    uint64_t hash = 0;
+    for (const std::string& path : paths) {
+        if (path.empty()) {
+            // A channel left at its default, still has to move the hash
+            const uint32_t missing = 0xffffffffu;
+            hash = iblHash(&missing, sizeof(missing), hash);
+            continue;
+        }
+        uint64_t file_hash = 0;
+        if (!iblHashFile(path.c_str(), &file_hash)) {
+            return false;
+        }
+        hash = iblHash(&file_hash, sizeof(file_hash), hash);
+    }
+    *out_hash = hash;
+    return true;
+}
+
+bool textureLoadSources(const std::vector<std::string>& paths, TEXTURE_ROLE role, std::vector<uint8_t>* out_texels, int* out_width, int* out_height) {
+    // Only this thread, the stream workers and the import decode in parallel
+    stbi_set_flip_vertically_on_load_thread(true);
+    if (role != TEXTURE_ROLE_MATERIAL) {
+        const int channels = textureRoleChannels(role);
+        int comp;
+        stbi_uc* data = stbi_load(paths[0].c_str(), out_width, out_height, &comp, channels);
+        if (!data) {
+            LOG_ERR("texture_import", "Failed to decode " << paths[0] << ": " << stbi_failure_reason());
+            return false;
+        }
+        out_texels->assign(data, data + (size_t)*out_width * *out_height * channels);
+        stbi_image_free(data);
+        return true;
+    }
+
+    int width = 0;
+    int height = 0;
+    std::vector<stbi_uc*> sources(3, nullptr);
+    bool ok = true;
+    for (int i = 0; i < 3 && ok; ++i) {
+        if (i >= (int)paths.size() || paths[i].empty()) {
+            continue;
+        }
+        int w, h, comp;
+        sources[i] = stbi_load(paths[i].c_str(), &w, &h, &comp, 1);
+        if (!sources[i]) {
+            LOG_ERR("texture_import", "Failed to decode " << paths[i] << ": " << stbi_failure_reason());
+            ok = false;
+        } else if (width && (w != width || h != height)) {
+            LOG_ERR("texture_import", paths[i] << " is " << w << "x" << h << ", the other material sources are " << width << "x" << height);
+            ok = false;
+        } else {
+            width = w;
+            height = h;
+        }
+    }
+    if (ok && !width) {
+        LOG_ERR("texture_import", "Material without any sources");
+        ok = false;
+    }
+    if (ok) {
+        const size_t texel_count = (size_t)width * height;
+        out_texels->resize(texel_count * 3);
+        for (int c = 0; c < 3; ++c) {
+            for (size_t i = 0; i < texel_count; ++i) {
+                (*out_texels)[i * 3 + c] = sources[c] ? sources[c][i] : TEXTURE_MATERIAL_DEFAULTS[c];
+            }
+        }
+        *out_width = width;
+        *out_height = height;
+    }
+    for (stbi_uc* data : sources) {
+        if (data) {
+            stbi_image_free(data);
+        }
+    }
+    return ok;
+}
+
+std::string textureFilePath(uint64_t source_hash, TEXTURE_ROLE role) {
+    const uint32_t key[] = { (uint32_t)role, TEXTURE_FILE_VERSION };
+    std::ostringstream ss;
+    ss << "cache/textures/" << std::hex << std::setw(16) << std::setfill('0') << iblHash(key, sizeof(key), source_hash) << ".btex";
+    return ss.str();
+}
+
+static bool textureFileValidate(const uint8_t* data, size_t size, uint64_t source_hash, TEXTURE_ROLE role) {
+    if (size < sizeof(TextureFileHeader)) {
+        return false;
+    }
+    const TextureFileHeader* header = (const TextureFileHeader*)data;
+    if (header->magic != TEXTURE_FILE_MAGIC
+        || header->version != TEXTURE_FILE_VERSION
+        || header->source_hash != source_hash
+        || header->role != (uint32_t)role
+        || textureCodecBlockBytes((TEXTURE_CODEC)header->codec) == 0
+        || header->level_count == 0 || header->level_count > 32
+        || size < sizeof(TextureFileHeader) + header->level_count * sizeof(TextureFileLevel)) {
+        return false;
+    }
+    // Sizes follow from the header, a table that disagrees means a broken file
+    const TextureFileLevel* levels = (const TextureFileLevel*)(data + sizeof(TextureFileHeader));
+    for (uint32_t i = 0; i < header->level_count; ++i) {
+        const TextureFileLevel& level = levels[i];
+        if (level.width != std::max(1u, header->width >> i)
+            || level.height != std::max(1u, header->height >> i)
+            || level.size != textureEncodedSize((TEXTURE_CODEC)header->codec, level.width, level.height)
+            || level.offset + level.size > size) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool textureFileRead(const char* file_path, uint64_t source_hash, TEXTURE_ROLE role, std::vector<uint8_t>* out) {
+    std::vector<uint8_t> data;
+    if (!fsSlurpFile(file_path, data)) {
+        return false;
+    }
+    if (!textureFileValidate(data.data(), data.size(), source_hash, role)) {
+        LOG_WARN("texture_import", "Ignoring stale or malformed texture file " << file_path);
+        return false;
+    }
+    *out = std::move(data);
+    return true;
+}
+
+bool textureFileWrite(const char* file_path, const std::vector<uint8_t>& data) {
+    // Same temporary name and rename as the IBL cache files
+    return iblCacheWriteFile(file_path, data);
+}
+
+bool textureImport(const std::vector<std::string>& paths, TEXTURE_ROLE role, TEXTURE_CODEC codec, ThreadPool* pool, std::vector<uint8_t>* out_file, TextureImportStats* stats) {
+    PROF_SCOPE_FN();
+    *stats = TextureImportStats();
+    uint64_t source_hash = 0;
+    if (!textureHashSources(paths, &source_hash)) {
+        LOG_ERR("texture_import", "Can't read the sources of " << paths[0]);
+        return false;
+    }
+    Stopwatch sw;
+    const int channels = textureRoleChannels(role);
+    int width, height;
+    std::vector<std::vector<uint8_t>> levels(1);
+    if (!textureLoadSources(paths, role, &levels[0], &width, &height)) {
+        return false;
+    }
+    stats->decode_ms = sw.elapsedMs();
+
+    sw.reset();
+    textureBuildMips(&levels, width, height, channels, textureRoleMipSpace(role), pool);
+    stats->mip_ms = sw.elapsedMs();
+
+    std::vector<TextureFileLevel> table(levels.size());
+    uint64_t offset = sizeof(TextureFileHeader) + table.size() * sizeof(TextureFileLevel);
+    for (size_t i = 0; i < table.size(); ++i) {
+        offset = (offset + LEVEL_ALIGNMENT - 1) / LEVEL_ALIGNMENT * LEVEL_ALIGNMENT;
+        table[i].width = std::max(1, width >> i);
+        table[i].height = std::max(1, height >> i);
+        table[i].offset = offset;
+        table[i].size = textureEncodedSize(codec, table[i].width, table[i].height);
+        offset += table[i].size;
+        stats->uncompressed_bytes += levels[i].size();
+        stats->compressed_bytes += table[i].size;
+    }
+    std::vector<uint8_t>& file = *out_file;
+    file.assign(offset, 0);
+    TextureFileHeader header = {
+        TEXTURE_FILE_MAGIC, TEXTURE_FILE_VERSION, source_hash, (uint32_t)role, (uint32_t)codec,
+        (uint32_t)width, (uint32_t)height, (uint32_t)levels.size(), 0
+    };
+    memcpy(file.data(), &header, sizeof(header));
+    memcpy(file.data() + sizeof(header), table.data(), table.size() * sizeof(TextureFileLevel));
+
+    sw.reset();
+    for (size_t i = 0; i < table.size(); ++i) {
+        textureEncode(codec, levels[i].data(), table[i].width, table[i].height, channels, &file[table[i].offset], pool);
+    }
+    stats->encode_ms = sw.elapsedMs();
+    stats->psnr = textureCompressPsnr(codec, levels[0].data(), width, height, channels, &file[table[0].offset]);
+    stats->width = width;
+    stats->height = height;
+    stats->level_count = (int)levels.size();
+    return true;
+}
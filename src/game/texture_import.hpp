@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "texture_compress.hpp"
+#include "texture_mips.hpp"
+
+
+// What a texture is used for, decides its channels and how it gets compressed
+enum TEXTURE_ROLE {
+	TEXTURE_ROLE_ALBEDO,		// RGBA
+	TEXTURE_ROLE_NORMAL,		// Tangent space, z is rebuilt from xy in the shader
+	TEXTURE_ROLE_MASK,			// Roughness, metallic, AO and the like, one channel
+	TEXTURE_ROLE_EMISSION,		// RGB
+	TEXTURE_ROLE_MATERIAL		// Roughness, metallic and AO packed into RGB, one source each
+};
+
+// Missing material sources read as fully rough, not metallic and not occluded
+constexpr uint8_t TEXTURE_MATERIAL_DEFAULTS[3] = { 255, 0, 255 };
+
+// Channels of the texture when it is loaded uncompressed
+int textureRoleChannels(TEXTURE_ROLE role);
+// BC7 for albedo and the packed material, BC5 for normals, BC4 for masks, BC1 for emission
+TEXTURE_CODEC textureRoleDefaultCodec(TEXTURE_ROLE role);
+TEXTURE_MIP_SPACE textureRoleMipSpace(TEXTURE_ROLE role);
+// From the file name, "albedo", "normal", "emissi" and so on, false if it says nothing
+bool textureRoleFromPath(const std::string& path, TEXTURE_ROLE* out);
+// Where a mask goes in the packed material, 0 roughness, 1 metallic, 2 AO, -1 for other files
+int textureMaterialChannel(const std::string& path);
+const char* textureRoleName(TEXTURE_ROLE role);
+
+// One path for most roles, roughness, metallic and AO for TEXTURE_ROLE_MATERIAL where any can be empty.
+// The hash covers the contents of every source and which ones are missing
+bool textureHashSources(const std::vector<std::string>& paths, uint64_t* out_hash);
+// Level 0 of the texture, flipped vertically. Material sources have to be the same size
+bool textureLoadSources(const std::vector<std::string>& paths, TEXTURE_ROLE role, std::vector<uint8_t>* out_texels, int* out_width, int* out_height);
+
+// Imported texture file, all little endian:
+//   TextureFileHeader
+//   TextureFileLevel[level_count], level 0 first
+//   level data, blocks row by row, each level 16 byte aligned
+// Level 0 is the source image flipped vertically, like the uncompressed loaders upload it
+constexpr uint32_t TEXTURE_FILE_MAGIC = 0x58455442;	// "BTEX"
+constexpr uint32_t TEXTURE_FILE_VERSION = 2;
+
+struct TextureFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t source_hash;	// textureHashSources()
+	uint32_t role;			// TEXTURE_ROLE
+	uint32_t codec;			// TEXTURE_CODEC, never TEXTURE_CODEC_NONE
+	uint32_t width;
+	uint32_t height;
+	uint32_t level_count;
+	uint32_t reserved;
+};
+
+struct TextureFileLevel {
+	uint32_t width;
+	uint32_t height;
+	uint64_t offset;		// From the start of the file
+	uint64_t size;
+};
+
+// Keyed by the textureHashSources() result and role like the IBL cache, the codec is whatever the import picked
+std::string textureFilePath(uint64_t source_hash, TEXTURE_ROLE role);
+// Whole file into memory and validated, no GL calls so it can run on a loader thread
+bool textureFileRead(const char* file_path, uint64_t source_hash, TEXTURE_ROLE role, std::vector<uint8_t>* out);
+// Written under a temporary name and renamed, creates the directory
+bool textureFileWrite(const char* file_path, const std::vector<uint8_t>& data);
+
+struct TextureImportStats {
+	int width = 0;
+	int height = 0;
+	int level_count = 0;
+	double decode_ms = .0;
+	double mip_ms = .0;
+	double encode_ms = .0;
+	size_t uncompressed_bytes = 0;		// All levels
+	size_t compressed_bytes = 0;
+	double psnr = .0;					// Level 0
+};
+
+// Decode, mips and encode, the whole file ready for textureFileWrite()
+bool textureImport(const std::vector<std::string>& paths, TEXTURE_ROLE role, TEXTURE_CODEC codec, ThreadPool* pool, std::vector<uint8_t>* out_file, TextureImportStats* stats);
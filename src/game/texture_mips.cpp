@@ -0,0 +1,222 @@
+#include "texture_mips.hpp"
+
+#include <math.h>
+#include <algorithm>
+#include "math/simd.hpp"
+#include "profiler/profiler.hpp"
+
+
+constexpr float KAISER_RADIUS = 3.f;	// In texels of the smaller level
+constexpr float KAISER_ALPHA = 4.f;
+
+static double besselI0(double x) {
+    double sum = 1.0;
+    double term = 1.0;
+    for (int k = 1; k < 32; ++k) {
+        term *= (x * .5 / k) * (x * .5 / k);
+        sum += term;
+        if (term < sum * 1e-12) {
+            break;
+        }
+    }
+    return sum;
+}
+
+static float kaiserSinc(float x) {
+    if (fabsf(x) >= KAISER_RADIUS) {
+        return .0f;
+    }
+    const double pi_x = 3.14159265358979 * x;
+    const double sinc = fabs(pi_x) < 1e-6 ? 1.0 : sin(pi_x) / pi_x;
+    const double r = x / KAISER_RADIUS;
+    return (float)(sinc * besselI0(KAISER_ALPHA * sqrt(1.0 - r * r)) / besselI0(KAISER_ALPHA));
+}
+
+// Source texels and their weights for every texel along one axis of the smaller level
+struct FilterAxis {
+    int taps;
+    std::vector<int> first;			// Unwrapped, can be negative or past the end
+    std::vector<float> weights;		// taps per texel, add up to 1
+};
+
+static FilterAxis makeFilterAxis(int src_size, int dst_size) {
+    FilterAxis axis;
+    if (src_size == dst_size) {
+        // An axis already down to 1 while the other one still shrinks
+        axis.taps = 1;
+        for (int i = 0; i < dst_size; ++i) {
+            axis.first.push_back(i);
+            axis.weights.push_back(1.f);
+        }
+        return axis;
+    }
+    const float scale = src_size / (float)dst_size;
+    const float src_radius = KAISER_RADIUS * scale;
+    axis.taps = (int)ceilf(src_radius * 2.f) + 1;
+    axis.first.resize(dst_size);
+    axis.weights.resize((size_t)dst_size * axis.taps);
+    for (int i = 0; i < dst_size; ++i) {
+        const float center = (i + .5f) * scale;
+        const int first = (int)floorf(center - src_radius);
+        float* w = &axis.weights[(size_t)i * axis.taps];
+        float sum = .0f;
+        for (int k = 0; k < axis.taps; ++k) {
+            w[k] = kaiserSinc((first + k + .5f - center) / scale);
+            sum += w[k];
+        }
+        for (int k = 0; k < axis.taps; ++k) {
+            w[k] /= sum;
+        }
+        axis.first[i] = first;
+    }
+    return axis;
+}
+
+static int wrapIndex(int i, int size) {
+    return ((i % size) + size) % size;
+}
+
+static void addScaledRowScalar(float* dst, const float* src, float w, int n) {
+    for (int i = 0; i < n; ++i) {
+        dst[i] += src[i] * w;
+    }
+}
+
+#if SIMD_X86
+SIMD_TARGET_AVX2
+static void addScaledRowAvx2(float* dst, const float* src, float w, int n) {
+    const __m256 vw = _mm256_set1_ps(w);
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        _mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), _mm256_mul_ps(_mm256_loadu_ps(src + i), vw)));
+    }
+    addScaledRowScalar(dst + i, src + i, w, n - i);
+}
+#endif
+
+typedef void(*add_scaled_row_fn_t)(float* dst, const float* src, float w, int n);
+
+static add_scaled_row_fn_t pickAddScaledRow() {
+#if SIMD_X86
+    if (simdHasAvx2()) {
+        return &addScaledRowAvx2;
+    }
+#endif
+    return &addScaledRowScalar;
+}
+
+static float srgbToLinear(float v) {
+    return v <= .04045f ? v / 12.92f : powf((v + .055f) / 1.055f, 2.4f);
+}
+
+static float linearToSrgb(float v) {
+    return v <= .0031308f ? v * 12.92f : 1.055f * powf(v, 1.f / 2.4f) - .055f;
+}
+
+// Channels that go through the sRGB curve, alpha never does
+static int srgbChannels(int channels) {
+    return channels == 4 ? 3 : channels;
+}
+
+static void unpackLevel(const std::vector<uint8_t>& texels, int channels, TEXTURE_MIP_SPACE space, std::vector<float>* out) {
+    float srgb_lut[256];
+    for (int i = 0; i < 256; ++i) {
+        srgb_lut[i] = srgbToLinear(i / 255.f);
+    }
+    out->resize(texels.size());
+    const int color = srgbChannels(channels);
+    for (size_t i = 0; i < texels.size(); ++i) {
+        const int c = (int)(i % channels);
+        const float v = texels[i] / 255.f;
+        if (space == TEXTURE_MIP_SRGB && c < color) {
+            (*out)[i] = srgb_lut[texels[i]];
+        } else if (space == TEXTURE_MIP_NORMAL) {
+            (*out)[i] = v * 2.f - 1.f;
+        } else {
+            (*out)[i] = v;
+        }
+    }
+}
+
+static uint8_t quantize(float v) {
+    return (uint8_t)std::min(255, std::max(0, (int)floorf(v * 255.f + .5f)));
+}
+
+// Filtered values are written back into texel so the next level starts from them
+static void packTexel(float* texel, int channels, TEXTURE_MIP_SPACE space, uint8_t* out) {
+    if (space == TEXTURE_MIP_NORMAL && channels >= 3) {
+        const float len = sqrtf(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+        if (len > 1e-6f) {
+            texel[0] /= len;
+            texel[1] /= len;
+            texel[2] /= len;
+        } else {
+            texel[0] = texel[1] = .0f;
+            texel[2] = 1.f;
+        }
+    }
+    const int color = srgbChannels(channels);
+    for (int c = 0; c < channels; ++c) {
+        // Negative lobes overshoot at hard edges
+        if (space == TEXTURE_MIP_NORMAL) {
+            texel[c] = std::min(1.f, std::max(-1.f, texel[c]));
+            out[c] = quantize(texel[c] * .5f + .5f);
+        } else {
+            texel[c] = std::min(1.f, std::max(.0f, texel[c]));
+            out[c] = quantize(space == TEXTURE_MIP_SRGB && c < color ? linearToSrgb(texel[c]) : texel[c]);
+        }
+    }
+}
+
+void textureBuildMips(std::vector<std::vector<uint8_t>>* levels, int width, int height, int channels, TEXTURE_MIP_SPACE space, ThreadPool* pool) {
+    PROF_SCOPE_FN();
+    const add_scaled_row_fn_t addScaledRow = pickAddScaledRow();
+    std::vector<float> src;
+    unpackLevel(levels->back(), channels, space, &src);
+    int w = width;
+    int h = height;
+    const int worker_count = pool ? pool->threadCount() : 1;
+    std::vector<std::vector<float>> column_rows(worker_count);
+    while (w > 1 || h > 1) {
+        const int next_w = std::max(1, w / 2);
+        const int next_h = std::max(1, h / 2);
+        const FilterAxis axis_x = makeFilterAxis(w, next_w);
+        const FilterAxis axis_y = makeFilterAxis(h, next_h);
+        std::vector<float> dst((size_t)next_w * next_h * channels);
+        std::vector<uint8_t> level(dst.size());
+        const int row_floats = w * channels;
+
+        // Vertical taps over whole source rows first, the wide pass that vectorizes well, then horizontal
+        auto filterRow = [&](int y, int worker) {
+            std::vector<float>& column = column_rows[worker];
+            column.assign(row_floats, .0f);
+            const float* wy = &axis_y.weights[(size_t)y * axis_y.taps];
+            for (int k = 0; k < axis_y.taps; ++k) {
+                const int sy = wrapIndex(axis_y.first[y] + k, h);
+                addScaledRow(column.data(), &src[(size_t)sy * row_floats], wy[k], row_floats);
+            }
+            for (int x = 0; x < next_w; ++x) {
+                float* texel = &dst[((size_t)y * next_w + x) * channels];
+                const float* wx = &axis_x.weights[(size_t)x * axis_x.taps];
+                for (int k = 0; k < axis_x.taps; ++k) {
+                    const float* s = &column[(size_t)wrapIndex(axis_x.first[x] + k, w) * channels];
+                    for (int c = 0; c < channels; ++c) {
+                        texel[c] += s[c] * wx[k];
+                    }
+                }
+                packTexel(texel, channels, space, &level[((size_t)y * next_w + x) * channels]);
+            }
+        };
+        if (pool) {
+            pool->parallelFor(next_h, filterRow);
+        } else {
+            for (int y = 0; y < next_h; ++y) {
+                filterRow(y, 0);
+            }
+        }
+        levels->push_back(std::move(level));
+        src = std::move(dst);
+        w = next_w;
+        h = next_h;
+    }
+}
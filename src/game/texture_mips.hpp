@@ -0,0 +1,19 @@
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "thread/thread_pool.hpp"
+
+
+// What the texels mean, decides the space they are filtered in
+enum TEXTURE_MIP_SPACE {
+	TEXTURE_MIP_LINEAR,		// Masks and the packed material
+	TEXTURE_MIP_SRGB,		// Color is linearized for filtering and encoded again after, alpha is linear already
+	TEXTURE_MIP_NORMAL		// Unpacked to [-1, 1] and renormalized after filtering
+};
+
+// Appends levels down to 1x1, levels[0] has to hold the width x height source.
+// Kaiser windowed sinc over 3 texels of the smaller level each side, wrapping at the edges like the
+// REPEAT samplers the textures are used with. Every level is filtered from the unrounded result of
+// the one above. pool splits the rows of each level, null runs everything on the calling thread
+void textureBuildMips(std::vector<std::vector<uint8_t>>* levels, int width, int height, int channels, TEXTURE_MIP_SPACE space, ThreadPool* pool = 0);
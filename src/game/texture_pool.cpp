@@ -0,0 +1,239 @@
+#include "texture_pool.hpp"
+
+#include <algorithm>
+#include <map>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+
+
+int glxFormatBytesPerPixel(GLenum internal_format) {
+    switch (internal_format) {
+    case GL_R8: return 1;
+    case GL_RG8: return 2;
+    case GL_RGB8: return 3;
+    case GL_RGBA8: return 4;
+    case GL_RG16: return 4;
+    case GL_RG16F: return 4;
+    case GL_R11F_G11F_B10F: return 4;
+    case GL_RGB16F: return 6;
+    case GL_RGBA16F: return 8;
+    case GL_RGB32F: return 12;
+    case GL_RGBA32F: return 16;
+    case GL_DEPTH_COMPONENT24: return 4;
+    case GL_DEPTH_COMPONENT32F: return 4;
+    default:
+        LOG_WARN("gl", "glxFormatBytesPerPixel: unknown format " << internal_format);
+        return 0;
+    }
+}
+
+bool glxIsDepthFormat(GLenum internal_format) {
+    return internal_format == GL_DEPTH_COMPONENT24
+        || internal_format == GL_DEPTH_COMPONENT32F
+        || internal_format == GL_DEPTH_COMPONENT16;
+}
+
+int glxFormatViewClass(GLenum internal_format) {
+    switch (internal_format) {
+    case GL_R8: return 8;
+    case GL_RG8: return 16;
+    case GL_RGB8: return 24;
+    case GL_RGBA8: case GL_RG16: case GL_RG16F: case GL_R11F_G11F_B10F: return 32;
+    case GL_RGB16F: return 48;
+    case GL_RGBA16F: return 64;
+    case GL_RGB32F: return 96;
+    case GL_RGBA32F: return 128;
+    default: return 0;
+    }
+}
+
+static uint64_t keyBytes(const TexturePoolKey& key) {
+    return (uint64_t)glxFormatBytesPerPixel(key.format) * key.width * key.height * key.samples;
+}
+
+static GLuint createTexture(const TexturePoolKey& key) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glActiveTexture(GL_TEXTURE0);
+    if (key.samples > 1) {
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, tex);
+        glTexStorage2DMultisample(GL_TEXTURE_2D_MULTISAMPLE, key.samples, key.format, key.width, key.height, GL_TRUE);
+        glBindTexture(GL_TEXTURE_2D_MULTISAMPLE, 0);
+        return tex;
+    }
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexStorage2D(GL_TEXTURE_2D, 1, key.format, key.width, key.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    return tex;
+}
+
+GLuint glxTexturePoolAcquire(TexturePool* pool, const TexturePoolKey& key) {
+    // Most recently released first, it is the most likely to be resident
+    TexturePoolTexture* best = 0;
+    for (auto& t : pool->textures) {
+        if (!t.in_use && t.key == key && (!best || t.released_frame > best->released_frame)) {
+            best = &t;
+        }
+    }
+    if (best) {
+        best->in_use = true;
+        return best->texture;
+    }
+
+    PROF_SCOPE_FN();
+    GLuint tex = createTexture(key);
+    pool->textures.push_back(TexturePoolTexture{ key, tex, true, pool->frame });
+    pool->created++;
+    const TexturePoolStats stats = texturePoolStats(pool);
+    pool->peak_bytes = std::max(pool->peak_bytes, stats.in_use_bytes + stats.idle_bytes);
+    return tex;
+}
+
+void texturePoolRelease(TexturePool* pool, GLuint texture) {
+    for (auto& t : pool->textures) {
+        if (t.texture == texture) {
+            if (!t.in_use) {
+                LOG_WARN("texture_pool", "Texture " << texture << " released twice");
+            }
+            t.in_use = false;
+            t.released_frame = pool->frame;
+            return;
+        }
+    }
+    LOG_WARN("texture_pool", "Released texture " << texture << " does not belong to the pool");
+}
+
+static const TexturePoolTexture* findTexture(const TexturePool* pool, GLuint texture) {
+    for (auto& t : pool->textures) {
+        if (t.texture == texture) {
+            return &t;
+        }
+    }
+    return 0;
+}
+
+GLuint glxTexturePoolFramebuffer(TexturePool* pool, const GLuint* color, int color_count, GLuint depth) {
+    if (color_count > TEXTURE_POOL_MAX_COLOR_ATTACHMENTS) {
+        LOG_ERR("texture_pool", "glxTexturePoolFramebuffer: " << color_count << " color attachments, at most " << TEXTURE_POOL_MAX_COLOR_ATTACHMENTS << " supported");
+        return 0;
+    }
+    for (auto& f : pool->framebuffers) {
+        if (f.color_count == color_count && f.depth == depth && std::equal(color, color + color_count, f.color)) {
+            return f.fbo;
+        }
+    }
+
+    TexturePoolFramebuffer f = {};
+    f.color_count = color_count;
+    f.depth = depth;
+    std::copy(color, color + color_count, f.color);
+    glGenFramebuffers(1, &f.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, f.fbo);
+    GLenum draw_buffers[TEXTURE_POOL_MAX_COLOR_ATTACHMENTS];
+    for (int i = 0; i < color_count; ++i) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, color[i], 0);
+        draw_buffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    }
+    if (depth) {
+        glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, depth, 0);
+    }
+    if (color_count == 0) {
+        glDrawBuffer(GL_NONE);
+    } else {
+        glDrawBuffers(color_count, draw_buffers);
+    }
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        LOG_ERR("texture_pool", "Framebuffer is incomplete (" << status << ")");
+        glDeleteFramebuffers(1, &f.fbo);
+        return 0;
+    }
+    pool->framebuffers.push_back(f);
+    return f.fbo;
+}
+
+static void deleteFramebuffersUsing(TexturePool* pool, GLuint texture) {
+    for (int i = pool->framebuffers.size() - 1; i >= 0; --i) {
+        const TexturePoolFramebuffer& f = pool->framebuffers[i];
+        if (f.depth == texture || std::find(f.color, f.color + f.color_count, texture) != f.color + f.color_count) {
+            glDeleteFramebuffers(1, &f.fbo);
+            pool->framebuffers.erase(pool->framebuffers.begin() + i);
+        }
+    }
+}
+
+void glxTexturePoolForgetTexture(TexturePool* pool, GLuint texture) {
+    deleteFramebuffersUsing(pool, texture);
+}
+
+void glxTexturePoolEndFrame(TexturePool* pool) {
+    for (int i = pool->textures.size() - 1; i >= 0; --i) {
+        const TexturePoolTexture& t = pool->textures[i];
+        if (t.in_use || pool->frame - t.released_frame < TEXTURE_POOL_RETIRE_FRAMES) {
+            continue;
+        }
+        deleteFramebuffersUsing(pool, t.texture);
+        glDeleteTextures(1, &t.texture);
+        pool->textures.erase(pool->textures.begin() + i);
+        pool->deleted++;
+    }
+    pool->frame++;
+}
+
+void glxDestroyTexturePool(TexturePool* pool) {
+    for (auto& f : pool->framebuffers) {
+        glDeleteFramebuffers(1, &f.fbo);
+    }
+    pool->framebuffers.clear();
+    for (auto& t : pool->textures) {
+        if (t.in_use) {
+            LOG_WARN("texture_pool", "Texture " << t.texture << " still in use when the pool is destroyed");
+        }
+        glDeleteTextures(1, &t.texture);
+    }
+    pool->deleted += pool->textures.size();
+    pool->textures.clear();
+}
+
+TexturePoolStats texturePoolStats(const TexturePool* pool) {
+    TexturePoolStats s;
+    for (auto& t : pool->textures) {
+        if (t.in_use) {
+            s.textures_in_use++;
+            s.in_use_bytes += keyBytes(t.key);
+        } else {
+            s.textures_idle++;
+            s.idle_bytes += keyBytes(t.key);
+        }
+    }
+    s.framebuffers = pool->framebuffers.size();
+    return s;
+}
+
+void texturePoolLogReport(const TexturePool* pool) {
+    const TexturePoolStats s = texturePoolStats(pool);
+    LOG("texture_pool", s.textures_in_use << " textures in use (" << s.in_use_bytes / (1024 * 1024) << "MB), "
+        << s.textures_idle << " idle (" << s.idle_bytes / (1024 * 1024) << "MB), " << s.framebuffers << " framebuffers, peak "
+        << pool->peak_bytes / (1024 * 1024) << "MB, " << pool->created << " created and " << pool->deleted << " deleted so far");
+
+    // Per format totals, the report sorts by format so it reads the same from frame to frame
+    struct FormatTotal {
+        int count = 0;
+        uint64_t bytes = 0;
+    };
+    std::map<GLenum, FormatTotal> formats;
+    for (auto& t : pool->textures) {
+        FormatTotal& f = formats[t.key.format];
+        f.count++;
+        f.bytes += keyBytes(t.key);
+    }
+    for (auto& kv : formats) {
+        LOG("texture_pool", "  format 0x" << std::hex << kv.first << std::dec << ": " << kv.second.count << " textures, "
+            << kv.second.bytes / (1024 * 1024) << "MB");
+    }
+}
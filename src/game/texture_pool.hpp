@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "platform/win32/gl/glextutil.h"
+
+
+// Nominal storage per texel of the sized formats used for render targets, drivers may pad 3 byte formats
+int glxFormatBytesPerPixel(GLenum internal_format);
+bool glxIsDepthFormat(GLenum internal_format);
+// Bits per texel of the glTextureView() compatibility class, formats of one class can view each other's storage.
+// 0 for depth and unknown formats, they only view their own format
+int glxFormatViewClass(GLenum internal_format);
+
+struct TexturePoolKey {
+	GLenum format;
+	int width;
+	int height;
+	int samples = 1;	// More than 1 makes a GL_TEXTURE_2D_MULTISAMPLE
+};
+inline bool operator==(const TexturePoolKey& a, const TexturePoolKey& b) {
+	return a.format == b.format && a.width == b.width && a.height == b.height && a.samples == b.samples;
+}
+
+// Frames a released texture waits before it is deleted. Covers the frames the GPU may still be working on,
+// and lets a resize or rebuild that comes back to the same size pick the texture up again
+constexpr int TEXTURE_POOL_RETIRE_FRAMES = 8;
+
+struct TexturePoolTexture {
+	TexturePoolKey key;
+	GLuint texture;
+	bool in_use;
+	int released_frame;
+};
+
+constexpr int TEXTURE_POOL_MAX_COLOR_ATTACHMENTS = 8;
+
+struct TexturePoolFramebuffer {
+	GLuint color[TEXTURE_POOL_MAX_COLOR_ATTACHMENTS];
+	int color_count;
+	GLuint depth;
+	GLuint fbo;
+};
+
+struct TexturePoolStats {
+	int textures_in_use = 0;
+	int textures_idle = 0;			// Released, waiting for reuse or deletion
+	uint64_t in_use_bytes = 0;
+	uint64_t idle_bytes = 0;
+	int framebuffers = 0;
+};
+
+// Immutable render target textures shared by everything that needs one for a while, matched by exact key.
+// Textures and framebuffers outlive their users by a few frames so resizes and graph rebuilds never
+// delete something the GPU is still reading, and going back and forth between sizes reuses them
+struct TexturePool {
+	std::vector<TexturePoolTexture> textures;
+	std::vector<TexturePoolFramebuffer> framebuffers;	// Cached by attachments
+	int frame = 0;
+	int created = 0;		// Since init
+	int deleted = 0;
+	uint64_t peak_bytes = 0;
+};
+
+// An idle texture with the same key, or a new one with glTexStorage2D. Nearest filtering, clamped
+GLuint glxTexturePoolAcquire(TexturePool* pool, const TexturePoolKey& key);
+void texturePoolRelease(TexturePool* pool, GLuint texture);
+// Framebuffer with exactly these attachments, draw buffers enabled for each color attachment in order.
+// Created on first use and deleted together with any of its textures
+GLuint glxTexturePoolFramebuffer(TexturePool* pool, const GLuint* color, int color_count, GLuint depth);
+// Deletes the cached framebuffers attaching a texture the pool doesn't own, such as a view, before it is deleted
+void glxTexturePoolForgetTexture(TexturePool* pool, GLuint texture);
+// Deletes what was released more than TEXTURE_POOL_RETIRE_FRAMES ago, call once per frame
+void glxTexturePoolEndFrame(TexturePool* pool);
+void glxDestroyTexturePool(TexturePool* pool);
+
+TexturePoolStats texturePoolStats(const TexturePool* pool);
+void texturePoolLogReport(const TexturePool* pool);
@@ -0,0 +1,370 @@
+#include "texture_stream.hpp"
+
+#include <algorithm>
+#include <string.h>
+#include "log/log.hpp"
+#include "profiler/profiler.hpp"
+#include "stb_image.h"
+
+
+static void textureStreamFormat(const TextureStreamJob* job, GLenum* internal_format, GLenum* format) {
+    if (job->codec != TEXTURE_CODEC_NONE) {
+        *internal_format = textureCodecGlFormat(job->codec);
+        *format = 0;
+        return;
+    }
+    switch (job->channels) {
+    case 1:
+        *internal_format = GL_R8;
+        *format = GL_RED;
+        break;
+    case 3:
+        *internal_format = GL_RGB8;
+        *format = GL_RGB;
+        break;
+    default:
+        *internal_format = GL_RGBA8;
+        *format = GL_RGBA;
+        break;
+    }
+}
+
+// The import tool's file for these sources and role, if there is one and it is up to date
+static bool textureStreamReadImported(TextureStreamJob* job) {
+    uint64_t source_hash = 0;
+    std::vector<uint8_t> file;
+    if (!textureHashSources(job->paths, &source_hash)
+        || !textureFileRead(textureFilePath(source_hash, job->role).c_str(), source_hash, job->role, &file)) {
+        return false;
+    }
+    const TextureFileHeader* header = (const TextureFileHeader*)file.data();
+    const TextureFileLevel* levels = (const TextureFileLevel*)(file.data() + sizeof(TextureFileHeader));
+    job->codec = (TEXTURE_CODEC)header->codec;
+    job->width = header->width;
+    job->height = header->height;
+    for (uint32_t i = 0; i < header->level_count; ++i) {
+        const uint8_t* data = file.data() + levels[i].offset;
+        job->levels.emplace_back(data, data + levels[i].size);
+    }
+    return true;
+}
+
+static void textureStreamDecode(TextureStreamJob* job) {
+    Stopwatch sw;
+    if (textureStreamReadImported(job)) {
+        for (const auto& level : job->levels) {
+            job->decoded_bytes += level.size();
+        }
+        job->decode_ms = sw.elapsedMs();
+        return;
+    }
+    // Same filter as the import, on this worker alone since the others have textures of their own
+    job->levels.resize(1);
+    if (!textureLoadSources(job->paths, job->role, &job->levels[0], &job->width, &job->height)) {
+        LOG_ERR("gl/textures", "Failed to load texture " << job->paths[0]);
+        job->levels.clear();
+        job->failed = true;
+        return;
+    }
+    textureBuildMips(&job->levels, job->width, job->height, job->channels, textureRoleMipSpace(job->role));
+    for (const auto& level : job->levels) {
+        job->decoded_bytes += level.size();
+    }
+    job->decode_ms = sw.elapsedMs();
+}
+
+static void textureStreamWorker(TextureStream* ts) {
+    // Only for this thread, the render thread's loaders keep using the global flag
+    stbi_set_flip_vertically_on_load_thread(true);
+    for (;;) {
+        TextureStreamJob* job = 0;
+        {
+            std::unique_lock<std::mutex> lock(ts->mtx);
+            ts->cv.wait(lock, [ts]() { return ts->quit || !ts->queue.empty(); });
+            if (ts->quit) {
+                return;
+            }
+            job = ts->queue.front();
+            ts->queue.pop_front();
+        }
+        textureStreamDecode(job);
+        job->decoded = true;
+    }
+}
+
+void glxInitTextureStream(TextureStream* ts, const TextureStreamParams& params) {
+    ts->params = params;
+    ts->params.workers = std::max(1, params.workers);
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &ts->pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, ts->params.ring_bytes, 0, flags);
+    ts->ring = (uint8_t*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, ts->params.ring_bytes, flags);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (!ts->ring) {
+        LOG_ERR("texture_stream", "Failed to map the upload ring, every band goes up from client memory");
+    }
+    ts->quit = false;
+    for (int i = 0; i < ts->params.workers; ++i) {
+        ts->workers.emplace_back(textureStreamWorker, ts);
+    }
+}
+
+void glxDestroyTextureStream(TextureStream* ts) {
+    {
+        std::lock_guard<std::mutex> lock(ts->mtx);
+        ts->quit = true;
+    }
+    ts->cv.notify_all();
+    for (auto& worker : ts->workers) {
+        worker.join();
+    }
+    ts->workers.clear();
+    ts->queue.clear();
+    ts->jobs.clear();
+    for (const auto& f : ts->fences) {
+        glDeleteSync(f.fence);
+    }
+    ts->fences.clear();
+    if (ts->ring) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        ts->ring = 0;
+    }
+    glDeleteBuffers(1, &ts->pbo);
+    ts->pbo = 0;
+}
+
+static GLuint textureStreamRequest(TextureStream* ts, const std::vector<std::string>& paths, TEXTURE_ROLE role) {
+    auto job = std::make_unique<TextureStreamJob>();
+    job->paths = paths;
+    job->role = role;
+    job->channels = textureRoleChannels(role);
+    glGenTextures(1, &job->texture);
+    if (ts->jobs.empty()) {
+        ts->sw_batch.reset();
+        ts->stats = TextureStreamStats();
+    }
+    ts->stats.requested++;
+    const GLuint texture = job->texture;
+    {
+        std::lock_guard<std::mutex> lock(ts->mtx);
+        ts->queue.push_back(job.get());
+    }
+    ts->jobs.push_back(std::move(job));
+    ts->cv.notify_one();
+    return texture;
+}
+
+GLuint glxTextureStreamLoad(TextureStream* ts, const char* path, TEXTURE_ROLE role) {
+    return textureStreamRequest(ts, { path }, role);
+}
+
+GLuint glxTextureStreamLoadMaterial(TextureStream* ts, const char* roughness, const char* metallic, const char* ao) {
+    return textureStreamRequest(ts, { roughness ? roughness : "", metallic ? metallic : "", ao ? ao : "" }, TEXTURE_ROLE_MATERIAL);
+}
+
+static void textureStreamRetireFences(TextureStream* ts) {
+    while (!ts->fences.empty()) {
+        const TextureStreamFence& f = ts->fences.front();
+        const GLenum status = glClientWaitSync(f.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            break;
+        }
+        ts->ring_used -= f.bytes;
+        glDeleteSync(f.fence);
+        ts->fences.pop_front();
+    }
+    if (ts->ring_used == 0) {
+        ts->ring_head = 0;
+    }
+}
+
+// FIFO, the tail end is skipped when a region doesn't fit before the wrap. false while the GPU
+// still reads the space, the caller waits for a later frame instead of stalling on the fence
+static bool textureStreamRingAlloc(TextureStream* ts, size_t size, size_t* offset) {
+    const size_t ring_bytes = ts->params.ring_bytes;
+    size = (size + 3) & ~(size_t)3;
+    const bool wrap = ts->ring_head + size > ring_bytes;
+    const size_t skip = wrap ? ring_bytes - ts->ring_head : 0;
+    if (ts->ring_used + skip + size > ring_bytes) {
+        return false;
+    }
+    if (wrap) {
+        ts->ring_head = 0;
+    }
+    *offset = ts->ring_head;
+    ts->ring_head += size;
+    ts->ring_used += skip + size;
+    ts->frame_bytes += skip + size;
+    return true;
+}
+
+static void textureStreamAllocate(TextureStreamJob* job) {
+    GLenum internal_format, format;
+    textureStreamFormat(job, &internal_format, &format);
+    const int level_count = (int)job->levels.size();
+    glBindTexture(GL_TEXTURE_2D, job->texture);
+    glTexStorage2D(GL_TEXTURE_2D, level_count, internal_format, job->width, job->height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    // Lowered as levels complete, until then sampling only sees the ones that are in
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level_count - 1);
+    job->allocated = true;
+}
+
+static void textureStreamSubImage(const TextureStreamJob* job, int level_w, int y, int band_h, size_t bytes, const void* data) {
+    GLenum internal_format, format;
+    textureStreamFormat(job, &internal_format, &format);
+    glBindTexture(GL_TEXTURE_2D, job->texture);
+    if (job->codec != TEXTURE_CODEC_NONE) {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, job->level, 0, y, level_w, band_h, internal_format, (GLsizei)bytes, data);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, job->level, 0, y, level_w, band_h, format, GL_UNSIGNED_BYTE, data);
+    }
+}
+
+// Uploads bands of the job's levels until the budget is used up or the ring is full, false on the latter
+static bool textureStreamUploadJob(TextureStream* ts, TextureStreamJob* job, size_t* frame_uploaded) {
+    const size_t budget = ts->params.budget_bytes;
+    const bool compressed = job->codec != TEXTURE_CODEC_NONE;
+    // Compressed bands are whole rows of 4x4 blocks
+    const int row_h = compressed ? 4 : 1;
+    while (job->level >= 0) {
+        const int level_w = std::max(1, job->width >> job->level);
+        const int level_h = std::max(1, job->height >> job->level);
+        const int level_rows = (level_h + row_h - 1) / row_h;
+        const size_t row_bytes = compressed
+            ? (size_t)((level_w + 3) / 4) * textureCodecBlockBytes(job->codec)
+            : (size_t)level_w * job->channels;
+        const size_t budget_left = budget > *frame_uploaded ? budget - *frame_uploaded : 0;
+        // At least one row per frame so a budget smaller than a row still gets through
+        if (*frame_uploaded > 0 && budget_left < row_bytes) {
+            return true;
+        }
+        int rows = (int)std::min<size_t>(level_rows - job->next_row, std::max<size_t>(1, budget_left / row_bytes));
+        const uint8_t* src = job->levels[job->level].data() + job->next_row * row_bytes;
+
+        const bool from_ring = ts->ring && row_bytes <= ts->params.ring_bytes;
+        size_t offset = 0;
+        if (from_ring) {
+            rows = std::min(rows, (int)(ts->params.ring_bytes / row_bytes));
+            if (!textureStreamRingAlloc(ts, rows * row_bytes, &offset)) {
+                return false;
+            }
+            memcpy(ts->ring + offset, src, rows * row_bytes);
+        }
+        if (!job->allocated) {
+            textureStreamAllocate(job);
+        }
+        const int y = job->next_row * row_h;
+        const int band_h = std::min(level_h - y, rows * row_h);
+        if (from_ring) {
+            textureStreamSubImage(job, level_w, y, band_h, rows * row_bytes, (const void*)offset);
+        } else {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            textureStreamSubImage(job, level_w, y, band_h, rows * row_bytes, src);
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo);
+            ts->stats.direct_uploads++;
+        }
+        *frame_uploaded += rows * row_bytes;
+        job->next_row += rows;
+        if (job->next_row == level_rows) {
+            glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, job->level);
+            // Nothing reads the level again, the upload came from the ring or has been copied by the driver
+            std::vector<uint8_t>().swap(job->levels[job->level]);
+            job->level--;
+            job->next_row = 0;
+        }
+    }
+    job->done = true;
+    return true;
+}
+
+static void textureStreamLogStats(TextureStream* ts) {
+    const TextureStreamStats& st = ts->stats;
+    const double wall_ms = ts->sw_batch.elapsedMs();
+    const double mb = 1.0 / (1024.0 * 1024.0);
+    LOG("texture_stream", st.completed << " textures in " << wall_ms << "ms (" << st.failed << " failed, "
+        << st.imported << " block compressed), " << ts->params.workers << " workers");
+    LOG("texture_stream", "Decode " << st.decoded_bytes * mb << "MB with mips, "
+        << (st.decode_ms > .0 ? st.decoded_bytes * mb / (st.decode_ms * .001) : .0) << "MB/s per worker, "
+        << (wall_ms > .0 ? st.decoded_bytes * mb / (wall_ms * .001) : .0) << "MB/s overall");
+    LOG("texture_stream", "Upload " << st.uploaded_bytes * mb << "MB over " << st.upload_frames << " frames in "
+        << st.upload_ms << "ms render thread time, "
+        << (st.upload_ms > .0 ? st.uploaded_bytes * mb / (st.upload_ms * .001) : .0) << "MB/s, max "
+        << st.max_frame_bytes * mb << "MB per frame, budget " << ts->params.budget_bytes * mb << "MB");
+    LOG("texture_stream", st.ring_full_frames << " frames waited on the ring, " << st.direct_uploads << " direct uploads");
+}
+
+void glxTextureStreamUpdate(TextureStream* ts) {
+    PROF_SCOPE_FN();
+    textureStreamRetireFences(ts);
+    if (ts->jobs.empty()) {
+        return;
+    }
+
+    Stopwatch sw;
+    size_t frame_uploaded = 0;
+    bool ring_full = false;
+    ts->frame_bytes = 0;
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, ts->pbo);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto& job : ts->jobs) {
+        if (job->done || !job->decoded) {
+            continue;
+        }
+        if (job->level < 0) {
+            ts->stats.decode_ms += job->decode_ms;
+            ts->stats.decoded_bytes += job->decoded_bytes;
+            if (job->failed) {
+                ts->stats.failed++;
+                job->done = true;
+                continue;
+            }
+            if (job->codec != TEXTURE_CODEC_NONE) {
+                ts->stats.imported++;
+            }
+            job->level = (int)job->levels.size() - 1;
+        }
+        if (!textureStreamUploadJob(ts, job.get(), &frame_uploaded)) {
+            ring_full = true;
+            break;
+        }
+        if (frame_uploaded >= ts->params.budget_bytes) {
+            break;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (ts->frame_bytes > 0) {
+        ts->fences.push_back(TextureStreamFence{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), ts->frame_bytes });
+    }
+
+    if (frame_uploaded > 0) {
+        ts->stats.uploaded_bytes += frame_uploaded;
+        ts->stats.upload_ms += sw.elapsedMs();
+        ts->stats.upload_frames++;
+        ts->stats.max_frame_bytes = std::max(ts->stats.max_frame_bytes, frame_uploaded);
+    }
+    if (ring_full) {
+        ts->stats.ring_full_frames++;
+    }
+
+    for (const auto& job : ts->jobs) {
+        if (job->done && !job->failed) {
+            ts->stats.completed++;
+        }
+    }
+    ts->jobs.erase(
+        std::remove_if(ts->jobs.begin(), ts->jobs.end(), [](const std::unique_ptr<TextureStreamJob>& job) { return job->done; }),
+        ts->jobs.end()
+    );
+    if (ts->jobs.empty()) {
+        textureStreamLogStats(ts);
+    }
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "platform/win32/gl/glextutil.h"
+#include "profiler/stopwatch.hpp"
+#include "texture_import.hpp"
+
+
+// Texture loading off the render thread. Workers read the block compressed file the import tool made for
+// the sources, or decode them and filter the mip chain the way the import does when there is none. The
+// render thread copies finished levels into a persistently mapped pixel unpack buffer and uploads them from
+// there, smallest level first and only as many bytes per frame as the budget allows. Texture names are
+// handed out right away, they sample black until their first level is in and sharpen from there
+
+struct TextureStreamParams {
+	int workers = 2;
+	size_t ring_bytes = 12 << 20;		// A few frames worth, regions are reused once the frame's fence signals
+	size_t budget_bytes = 4 << 20;		// Per frame, large levels go up in bands of rows
+};
+
+// Written by a worker until decoded is set, the render thread's from then on
+struct TextureStreamJob {
+	std::vector<std::string> paths;		// See textureHashSources()
+	TEXTURE_ROLE role;
+	GLuint texture = 0;
+	int channels = 0;
+	TEXTURE_CODEC codec = TEXTURE_CODEC_NONE;	// Set when an imported file was found
+	int width = 0;
+	int height = 0;
+	std::vector<std::vector<uint8_t>> levels;	// Level 0 first, tightly packed rows or blocks
+	size_t decoded_bytes = 0;					// All levels
+	double decode_ms = .0;						// Mips included
+	bool failed = false;
+	std::atomic<bool> decoded = false;
+
+	bool allocated = false;			// Storage is created along with the first band
+	int level = -1;					// Being uploaded, counts down to 0 once the render thread picks the job up
+	int next_row = 0;				// Block rows for compressed levels
+	bool done = false;
+};
+
+// Ring bytes taken by one frame's uploads, free again once fence has signaled
+struct TextureStreamFence {
+	GLsync fence;
+	size_t bytes;
+};
+
+struct TextureStreamStats {
+	int requested = 0;
+	int completed = 0;
+	int failed = 0;
+	int imported = 0;				// Loaded from block compressed files
+	size_t decoded_bytes = 0;
+	double decode_ms = .0;			// Summed over the workers
+	size_t uploaded_bytes = 0;
+	double upload_ms = .0;			// Render thread time in the copies and upload calls
+	int upload_frames = 0;
+	size_t max_frame_bytes = 0;
+	int ring_full_frames = 0;		// Stopped short of the budget because the GPU still had the ring
+	int direct_uploads = 0;			// Bands larger than the ring, uploaded from client memory
+};
+
+struct TextureStream {
+	TextureStreamParams params;
+	GLuint pbo = 0;
+	uint8_t* ring = 0;				// Persistently mapped, coherent
+	size_t ring_head = 0;
+	size_t ring_used = 0;			// Including the space skipped at wrap-around
+	size_t frame_bytes = 0;
+	std::deque<TextureStreamFence> fences;
+
+	std::vector<std::thread> workers;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<TextureStreamJob*> queue;	// Waiting for a worker
+	bool quit = false;
+
+	// Until fully uploaded, in request order so earlier requests finish first
+	std::vector<std::unique_ptr<TextureStreamJob>> jobs;
+	Stopwatch sw_batch;				// Since the first request after the queue last drained
+	TextureStreamStats stats;
+};
+
+void glxInitTextureStream(TextureStream* ts, const TextureStreamParams& params);
+// Joins the workers, textures keep the levels that made it
+void glxDestroyTextureStream(TextureStream* ts);
+
+// Flipped vertically like the rest of the loaders do
+GLuint glxTextureStreamLoad(TextureStream* ts, const char* path, TEXTURE_ROLE role);
+// Packed into one RGB texture, null leaves a channel at its TEXTURE_MATERIAL_DEFAULTS value
+GLuint glxTextureStreamLoadMaterial(TextureStream* ts, const char* roughness, const char* metallic, const char* ao);
+// Once per frame, uploads within the budget and logs the throughput when everything requested is in
+void glxTextureStreamUpdate(TextureStream* ts);
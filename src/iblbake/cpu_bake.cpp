@@ -0,0 +1,474 @@
+#include "cpu_bake.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <functional>
+#include "math/simd.hpp"
+#include "profiler/profiler.hpp"
+#include "thread/thread_pool.hpp"
+#include "prefilter_samples.hpp"
+
+
+constexpr float BAKE_PI = 3.14159265359f;
+// Same as integrate_brdf.glsl
+constexpr uint32_t BAKE_SAMPLE_COUNT = 1024;
+
+static float radicalInverseVdC(uint32_t bits) {
+    bits = (bits << 16u) | (bits >> 16u);
+    bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+    bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+    bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+    bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+    return (float)(bits * 2.3283064365386963e-10);
+}
+
+// GGX half vector around +z
+static gfxm::vec3 importanceSampleGgx(uint32_t i, float roughness) {
+    const float a = roughness * roughness;
+    const float xi_x = (float)i / (float)BAKE_SAMPLE_COUNT;
+    const float xi_y = radicalInverseVdC(i);
+    const float phi = 2.f * BAKE_PI * xi_x;
+    const float cos_theta = sqrtf((1.f - xi_y) / (1.f + (a * a - 1.f) * xi_y));
+    const float sin_theta = sqrtf(std::max(.0f, 1.f - cos_theta * cos_theta));
+    return gfxm::vec3(cosf(phi) * sin_theta, sinf(phi) * sin_theta, cos_theta);
+}
+
+static float geometrySchlickGgx(float n_dot_v, float roughness) {
+    const float k = roughness * roughness / 2.f;
+    return n_dot_v / (n_dot_v * (1.f - k) + k);
+}
+
+// Inverse of the GL cube map face selection table
+gfxm::vec3 bakeCubeTexelDirection(int face, int x, int y, int size) {
+    const float sc = (x + .5f) / size * 2.f - 1.f;
+    const float tc = (y + .5f) / size * 2.f - 1.f;
+    switch (face) {
+    case 0: return gfxm::vec3(1.f, -tc, -sc);
+    case 1: return gfxm::vec3(-1.f, -tc, sc);
+    case 2: return gfxm::vec3(sc, 1.f, tc);
+    case 3: return gfxm::vec3(sc, -1.f, -tc);
+    case 4: return gfxm::vec3(sc, -tc, 1.f);
+    default: return gfxm::vec3(-sc, -tc, -1.f);
+    }
+}
+
+static void cubeFaceCoords(const gfxm::vec3& d, int* face, float* s, float* t) {
+    const float ax = fabsf(d.x);
+    const float ay = fabsf(d.y);
+    const float az = fabsf(d.z);
+    float sc, tc, ma;
+    if (ax >= ay && ax >= az) {
+        *face = d.x > .0f ? 0 : 1;
+        sc = d.x > .0f ? -d.z : d.z;
+        tc = -d.y;
+        ma = ax;
+    } else if (ay >= az) {
+        *face = d.y > .0f ? 2 : 3;
+        sc = d.x;
+        tc = d.y > .0f ? d.z : -d.z;
+        ma = ay;
+    } else {
+        *face = d.z > .0f ? 4 : 5;
+        sc = d.z > .0f ? d.x : -d.x;
+        tc = -d.y;
+        ma = az;
+    }
+    *s = sc / ma * .5f + .5f;
+    *t = tc / ma * .5f + .5f;
+}
+
+static void sampleBilinear(const float* texels, int width, int height, float u, float v, float out[3]) {
+    const float x = std::min(std::max(u * width - .5f, .0f), (float)(width - 1));
+    const float y = std::min(std::max(v * height - .5f, .0f), (float)(height - 1));
+    const int x0 = (int)x;
+    const int y0 = (int)y;
+    const int x1 = std::min(x0 + 1, width - 1);
+    const int y1 = std::min(y0 + 1, height - 1);
+    const float fx = x - x0;
+    const float fy = y - y0;
+    const float* t00 = texels + ((size_t)y0 * width + x0) * 3;
+    const float* t10 = texels + ((size_t)y0 * width + x1) * 3;
+    const float* t01 = texels + ((size_t)y1 * width + x0) * 3;
+    const float* t11 = texels + ((size_t)y1 * width + x1) * 3;
+    for (int c = 0; c < 3; ++c) {
+        const float top = t00[c] + (t10[c] - t00[c]) * fx;
+        const float bottom = t01[c] + (t11[c] - t01[c]) * fx;
+        out[c] = top + (bottom - top) * fy;
+    }
+}
+
+static void sampleCubeFace(const BakeCubemap& cube, int face, float s, float t, float lod, float out[3]) {
+    const int max_level = (int)cube.levels.size() - 1;
+    lod = std::min(std::max(lod, .0f), (float)max_level);
+    const int l0 = (int)lod;
+    const int l1 = std::min(l0 + 1, max_level);
+    const int size0 = std::max(1, cube.size >> l0);
+    sampleBilinear(&cube.levels[l0][(size_t)face * size0 * size0 * 3], size0, size0, s, t, out);
+    const float f = lod - l0;
+    if (f > .0f && l1 != l0) {
+        const int size1 = std::max(1, cube.size >> l1);
+        float upper[3];
+        sampleBilinear(&cube.levels[l1][(size_t)face * size1 * size1 * 3], size1, size1, s, t, upper);
+        for (int c = 0; c < 3; ++c) {
+            out[c] += (upper[c] - out[c]) * f;
+        }
+    }
+}
+
+gfxm::vec3 bakeSampleCube(const BakeCubemap& cube, const gfxm::vec3& dir, float lod) {
+    int face;
+    float s, t;
+    cubeFaceCoords(dir, &face, &s, &t);
+    float c[3];
+    sampleCubeFace(cube, face, s, t, lod, c);
+    return gfxm::vec3(c[0], c[1], c[2]);
+}
+
+// Every face row is a job
+static void forEachCubeTexel(ThreadPool* pool, int size, float* faces, const std::function<void(int face, int x, int y, float* texel)>& fn) {
+    pool->parallelFor(6 * size, [&](int row, int) {
+        const int face = row / size;
+        const int y = row % size;
+        float* texel = faces + ((size_t)face * size * size + (size_t)y * size) * 3;
+        for (int x = 0; x < size; ++x, texel += 3) {
+            fn(face, x, y, texel);
+        }
+    });
+}
+
+void bakeCubemapFromEquirect(BakeCubemap* out, const float* rgb, int width, int height, int size, ThreadPool* pool) {
+    PROF_SCOPE_FN();
+    out->size = size;
+    out->levels.assign(1, std::vector<float>((size_t)6 * size * size * 3));
+    forEachCubeTexel(pool, size, out->levels[0].data(), [rgb, width, height, size](int face, int x, int y, float* texel) {
+        const gfxm::vec3 d = gfxm::normalize(bakeCubeTexelDirection(face, x, y, size));
+        const float u = atan2f(d.z, d.x) * .1591f + .5f;
+        const float v = asinf(d.y) * .3183f + .5f;
+        sampleBilinear(rgb, width, height, u, v, texel);
+    });
+}
+
+void bakeGenerateMips(BakeCubemap* cube, ThreadPool* pool) {
+    PROF_SCOPE_FN();
+    cube->levels.resize(1);
+    for (int size = cube->size / 2; size >= 1; size /= 2) {
+        const std::vector<float>& src = cube->levels.back();
+        std::vector<float> dst((size_t)6 * size * size * 3);
+        const int src_size = size * 2;
+        forEachCubeTexel(pool, size, dst.data(), [&src, size, src_size](int face, int x, int y, float* texel) {
+            const float* face_src = &src[(size_t)face * src_size * src_size * 3];
+            const float* t00 = face_src + ((size_t)(y * 2) * src_size + x * 2) * 3;
+            const float* t01 = t00 + (size_t)src_size * 3;
+            for (int c = 0; c < 3; ++c) {
+                texel[c] = (t00[c] + t00[c + 3] + t01[c] + t01[c + 3]) * .25f;
+            }
+        });
+        cube->levels.push_back(std::move(dst));
+    }
+}
+
+// prefilterBuildSamples() in SoA form, padded to a multiple of 4
+struct GgxSampleTable {
+    std::vector<float> x;
+    std::vector<float> y;
+    std::vector<float> z;
+    std::vector<float> weight;		// NdotL
+    std::vector<float> lod;
+    int count = 0;
+};
+
+static void makeGgxSampleTable(GgxSampleTable* table, float roughness, int sample_count, int source_size) {
+    *table = GgxSampleTable();
+    std::vector<PrefilterSample> samples;
+    prefilterBuildSamples(&samples, roughness, sample_count, source_size);
+    for (const PrefilterSample& s : samples) {
+        table->x.push_back(s.x);
+        table->y.push_back(s.y);
+        table->z.push_back(s.z);
+        table->weight.push_back(s.z);
+        table->lod.push_back(s.lod);
+    }
+    table->count = (int)table->x.size();
+    const size_t padded = (table->count + 3) & ~3;
+    table->x.resize(padded, .0f);
+    table->y.resize(padded, .0f);
+    table->z.resize(padded, 1.f);
+    table->weight.resize(padded, .0f);
+    table->lod.resize(padded, .0f);
+}
+
+static void tangentFrame(const gfxm::vec3& n, gfxm::vec3* tangent, gfxm::vec3* bitangent) {
+    const gfxm::vec3 up = fabsf(n.z) < .999f ? gfxm::vec3(.0f, .0f, 1.f) : gfxm::vec3(1.f, .0f, .0f);
+    *tangent = gfxm::normalize(gfxm::cross(up, n));
+    *bitangent = gfxm::cross(n, *tangent);
+}
+
+#if !SIMD_X86
+static void prefilterTexelScalar(const BakeCubemap& env, const GgxSampleTable& table, const gfxm::vec3& n, float out[3]) {
+    gfxm::vec3 tangent, bitangent;
+    tangentFrame(n, &tangent, &bitangent);
+    float sum[3] = { 0 };
+    float total_weight = .0f;
+    for (int i = 0; i < table.count; ++i) {
+        const gfxm::vec3 l = tangent * table.x[i] + bitangent * table.y[i] + n * table.z[i];
+        int face;
+        float s, t;
+        cubeFaceCoords(l, &face, &s, &t);
+        float c[3];
+        sampleCubeFace(env, face, s, t, table.lod[i], c);
+        for (int k = 0; k < 3; ++k) {
+            sum[k] += c[k] * table.weight[i];
+        }
+        total_weight += table.weight[i];
+    }
+    for (int k = 0; k < 3; ++k) {
+        out[k] = sum[k] / total_weight;
+    }
+}
+#endif
+
+#if SIMD_X86
+static inline __m128 selectPs(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// Rotation and face selection 4 samples at a time, the fetches stay scalar
+static void prefilterTexelSse(const BakeCubemap& env, const GgxSampleTable& table, const gfxm::vec3& n, float out[3]) {
+    gfxm::vec3 tangent, bitangent;
+    tangentFrame(n, &tangent, &bitangent);
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 half = _mm_set1_ps(.5f);
+    const __m128 abs_mask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+    float sum[3] = { 0 };
+    float total_weight = .0f;
+    alignas(16) int faces[4];
+    alignas(16) float s[4];
+    alignas(16) float t[4];
+    for (int i = 0; i < table.count; i += 4) {
+        const __m128 lx = _mm_loadu_ps(&table.x[i]);
+        const __m128 ly = _mm_loadu_ps(&table.y[i]);
+        const __m128 lz = _mm_loadu_ps(&table.z[i]);
+        const __m128 dx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.x), lx), _mm_mul_ps(_mm_set1_ps(bitangent.x), ly)), _mm_mul_ps(_mm_set1_ps(n.x), lz));
+        const __m128 dy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.y), lx), _mm_mul_ps(_mm_set1_ps(bitangent.y), ly)), _mm_mul_ps(_mm_set1_ps(n.y), lz));
+        const __m128 dz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(tangent.z), lx), _mm_mul_ps(_mm_set1_ps(bitangent.z), ly)), _mm_mul_ps(_mm_set1_ps(n.z), lz));
+        const __m128 ax = _mm_and_ps(dx, abs_mask);
+        const __m128 ay = _mm_and_ps(dy, abs_mask);
+        const __m128 az = _mm_and_ps(dz, abs_mask);
+        const __m128 is_x = _mm_and_ps(_mm_cmpge_ps(ax, ay), _mm_cmpge_ps(ax, az));
+        const __m128 is_y = _mm_andnot_ps(is_x, _mm_cmpge_ps(ay, az));
+        const __m128 pos_x = _mm_cmpgt_ps(dx, zero);
+        const __m128 pos_y = _mm_cmpgt_ps(dy, zero);
+        const __m128 pos_z = _mm_cmpgt_ps(dz, zero);
+        const __m128 neg_x = _mm_sub_ps(zero, dx);
+        const __m128 neg_y = _mm_sub_ps(zero, dy);
+        const __m128 neg_z = _mm_sub_ps(zero, dz);
+
+        const __m128 ma = selectPs(is_x, ax, selectPs(is_y, ay, az));
+        const __m128 sc = selectPs(is_x, selectPs(pos_x, neg_z, dz), selectPs(is_y, dx, selectPs(pos_z, dx, neg_x)));
+        const __m128 tc = selectPs(is_y, selectPs(pos_y, dz, neg_z), neg_y);
+        const __m128 positive = selectPs(is_x, pos_x, selectPs(is_y, pos_y, pos_z));
+        const __m128 face_base = selectPs(is_x, zero, selectPs(is_y, _mm_set1_ps(2.f), _mm_set1_ps(4.f)));
+        const __m128 face = _mm_add_ps(face_base, _mm_andnot_ps(positive, _mm_set1_ps(1.f)));
+        const __m128 scale = _mm_div_ps(half, ma);
+        _mm_store_si128((__m128i*)faces, _mm_cvttps_epi32(face));
+        _mm_store_ps(s, _mm_add_ps(_mm_mul_ps(sc, scale), half));
+        _mm_store_ps(t, _mm_add_ps(_mm_mul_ps(tc, scale), half));
+
+        const int lanes = std::min(4, table.count - i);
+        for (int k = 0; k < lanes; ++k) {
+            float c[3];
+            sampleCubeFace(env, faces[k], s[k], t[k], table.lod[i + k], c);
+            const float w = table.weight[i + k];
+            sum[0] += c[0] * w;
+            sum[1] += c[1] * w;
+            sum[2] += c[2] * w;
+            total_weight += w;
+        }
+    }
+    for (int k = 0; k < 3; ++k) {
+        out[k] = sum[k] / total_weight;
+    }
+}
+#endif
+
+void bakePrefilterGgx(BakeCubemap* out, const BakeCubemap& env, int size, int mips, int sample_count, ThreadPool* pool) {
+    PROF_SCOPE_FN();
+    out->size = size;
+    out->levels.resize(mips);
+    for (int mip = 0; mip < mips; ++mip) {
+        const int mip_size = std::max(1, size >> mip);
+        const float roughness = (float)mip / (float)(mips - 1);
+        GgxSampleTable table;
+        makeGgxSampleTable(&table, roughness, sample_count, env.size);
+        out->levels[mip].assign((size_t)6 * mip_size * mip_size * 3, .0f);
+        forEachCubeTexel(pool, mip_size, out->levels[mip].data(), [&env, &table, mip_size](int face, int x, int y, float* texel) {
+            const gfxm::vec3 n = gfxm::normalize(bakeCubeTexelDirection(face, x, y, mip_size));
+#if SIMD_X86
+            prefilterTexelSse(env, table, n, texel);
+#else
+            prefilterTexelScalar(env, table, n, texel);
+#endif
+        });
+    }
+}
+
+static float distributionGgx(float n_dot_h, float roughness) {
+    const float a = roughness * roughness;
+    const float a2 = a * a;
+    const float denom = n_dot_h * n_dot_h * (a2 - 1.f) + 1.f;
+    return a2 / (BAKE_PI * denom * denom);
+}
+
+// prefilterReference() in prefilter_convolute_cubemap.glsl, V = N
+static void prefilterTexelReference(const BakeCubemap& env, float roughness, const gfxm::vec3& n, float out[3]) {
+    gfxm::vec3 tangent, bitangent;
+    tangentFrame(n, &tangent, &bitangent);
+    const float resolution = 512.f;
+    const float sa_texel = 4.f * BAKE_PI / (6.f * resolution * resolution);
+    float sum[3] = { 0 };
+    float total_weight = .0f;
+    for (uint32_t i = 0; i < BAKE_SAMPLE_COUNT; ++i) {
+        const gfxm::vec3 ht = importanceSampleGgx(i, roughness);
+        const gfxm::vec3 h = gfxm::normalize(tangent * ht.x + bitangent * ht.y + n * ht.z);
+        const gfxm::vec3 l = gfxm::normalize(h * (2.f * gfxm::dot(n, h)) - n);
+        const float n_dot_l = std::max(gfxm::dot(n, l), .0f);
+        if (n_dot_l <= .0f) {
+            continue;
+        }
+        const float n_dot_h = std::max(gfxm::dot(n, h), .0f);
+        const float h_dot_v = n_dot_h;
+        const float pdf = distributionGgx(n_dot_h, roughness) * n_dot_h / (4.f * h_dot_v) + .0001f;
+        const float sa_sample = 1.f / ((float)BAKE_SAMPLE_COUNT * pdf + .0001f);
+        const float lod = roughness == .0f ? .0f : .5f * log2f(sa_sample / sa_texel);
+        const gfxm::vec3 c = bakeSampleCube(env, l, lod);
+        sum[0] += c.x * n_dot_l;
+        sum[1] += c.y * n_dot_l;
+        sum[2] += c.z * n_dot_l;
+        total_weight += n_dot_l;
+    }
+    for (int k = 0; k < 3; ++k) {
+        out[k] = sum[k] / total_weight;
+    }
+}
+
+void bakePrefilterGgxReference(BakeCubemap* out, const BakeCubemap& env, int size, int mips, ThreadPool* pool) {
+    PROF_SCOPE_FN();
+    out->size = size;
+    out->levels.resize(mips);
+    for (int mip = 0; mip < mips; ++mip) {
+        const int mip_size = std::max(1, size >> mip);
+        const float roughness = (float)mip / (float)(mips - 1);
+        out->levels[mip].assign((size_t)6 * mip_size * mip_size * 3, .0f);
+        forEachCubeTexel(pool, mip_size, out->levels[mip].data(), [&env, roughness, mip_size](int face, int x, int y, float* texel) {
+            prefilterTexelReference(env, roughness, gfxm::normalize(bakeCubeTexelDirection(face, x, y, mip_size)), texel);
+        });
+    }
+}
+
+// One row shares roughness and so the half vectors, the 4 lanes are 4 NdotV values
+static void integrateBrdfRow(float* out, int size, float roughness) {
+    // Same frame around N = +z as the shader, it decides where the samples fall relative to V
+    const gfxm::vec3 n(.0f, .0f, 1.f);
+    gfxm::vec3 tangent, bitangent;
+    tangentFrame(n, &tangent, &bitangent);
+    gfxm::vec3 h[BAKE_SAMPLE_COUNT];
+    for (uint32_t i = 0; i < BAKE_SAMPLE_COUNT; ++i) {
+        const gfxm::vec3 ht = importanceSampleGgx(i, roughness);
+        h[i] = tangent * ht.x + bitangent * ht.y + n * ht.z;
+    }
+    int x = 0;
+#if SIMD_X86
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.f);
+    const __m128 k = _mm_set1_ps(roughness * roughness / 2.f);
+    const __m128 one_minus_k = _mm_sub_ps(one, k);
+    const __m128 inv_count = _mm_set1_ps(1.f / BAKE_SAMPLE_COUNT);
+    for (; x + 4 <= size; x += 4) {
+        const __m128 n_dot_v = _mm_set_ps((x + 3.5f) / size, (x + 2.5f) / size, (x + 1.5f) / size, (x + .5f) / size);
+        const __m128 vx = _mm_sqrt_ps(_mm_sub_ps(one, _mm_mul_ps(n_dot_v, n_dot_v)));
+        const __m128 vz = n_dot_v;
+        const __m128 g_v = _mm_div_ps(n_dot_v, _mm_add_ps(_mm_mul_ps(n_dot_v, one_minus_k), k));
+        __m128 a = zero;
+        __m128 b = zero;
+        for (uint32_t i = 0; i < BAKE_SAMPLE_COUNT; ++i) {
+            const __m128 hx = _mm_set1_ps(h[i].x);
+            const __m128 hz = _mm_set1_ps(h[i].z);
+            const __m128 v_dot_h_raw = _mm_add_ps(_mm_mul_ps(vx, hx), _mm_mul_ps(vz, hz));
+            const __m128 lz = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(v_dot_h_raw, v_dot_h_raw), hz), vz);
+            const __m128 mask = _mm_cmpgt_ps(lz, zero);
+            const __m128 v_dot_h = _mm_max_ps(v_dot_h_raw, zero);
+            const __m128 g_l = _mm_div_ps(lz, _mm_add_ps(_mm_mul_ps(lz, one_minus_k), k));
+            const __m128 g_vis = _mm_div_ps(_mm_mul_ps(_mm_mul_ps(g_l, g_v), v_dot_h), _mm_mul_ps(hz, n_dot_v));
+            const __m128 f1 = _mm_sub_ps(one, v_dot_h);
+            const __m128 f2 = _mm_mul_ps(f1, f1);
+            const __m128 fc = _mm_mul_ps(_mm_mul_ps(f2, f2), f1);
+            a = _mm_add_ps(a, _mm_and_ps(mask, _mm_mul_ps(_mm_sub_ps(one, fc), g_vis)));
+            b = _mm_add_ps(b, _mm_and_ps(mask, _mm_mul_ps(fc, g_vis)));
+        }
+        alignas(16) float as[4];
+        alignas(16) float bs[4];
+        _mm_store_ps(as, _mm_mul_ps(a, inv_count));
+        _mm_store_ps(bs, _mm_mul_ps(b, inv_count));
+        for (int lane = 0; lane < 4; ++lane) {
+            out[(x + lane) * 2] = as[lane];
+            out[(x + lane) * 2 + 1] = bs[lane];
+        }
+    }
+#endif
+    for (; x < size; ++x) {
+        const float n_dot_v = (x + .5f) / size;
+        const gfxm::vec3 v(sqrtf(1.f - n_dot_v * n_dot_v), .0f, n_dot_v);
+        float a = .0f;
+        float b = .0f;
+        for (uint32_t i = 0; i < BAKE_SAMPLE_COUNT; ++i) {
+            const float v_dot_h_raw = gfxm::dot(v, h[i]);
+            const float lz = 2.f * v_dot_h_raw * h[i].z - v.z;
+            if (lz <= .0f) {
+                continue;
+            }
+            const float v_dot_h = std::max(v_dot_h_raw, .0f);
+            const float g = geometrySchlickGgx(lz, roughness) * geometrySchlickGgx(n_dot_v, roughness);
+            const float g_vis = g * v_dot_h / (h[i].z * n_dot_v);
+            const float fc = powf(1.f - v_dot_h, 5.f);
+            a += (1.f - fc) * g_vis;
+            b += fc * g_vis;
+        }
+        out[x * 2] = a / BAKE_SAMPLE_COUNT;
+        out[x * 2 + 1] = b / BAKE_SAMPLE_COUNT;
+    }
+}
+
+void bakeBrdfLut(std::vector<float>* rg, int size, ThreadPool* pool) {
+    PROF_SCOPE_FN();
+    rg->assign((size_t)size * size * 2, .0f);
+    pool->parallelFor(size, [rg, size](int y, int) {
+        integrateBrdfRow(&(*rg)[(size_t)y * size * 2], size, (y + .5f) / size);
+    });
+}
+
+void bakeFloatToHalf(uint16_t* out, const float* in, size_t count) {
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t bits;
+        memcpy(&bits, &in[i], sizeof(bits));
+        const uint16_t sign = (bits >> 16) & 0x8000;
+        const uint32_t abs = bits & 0x7fffffff;
+        if (abs > 0x7f800000) {
+            out[i] = sign | 0x7e00;		// NaN
+        } else if (abs >= 0x477ff000) {
+            out[i] = sign | 0x7bff;		// Would round to 65520 or more
+        } else if (abs < 0x38800000) {
+            // Below the smallest normal half, 2^24 scales to subnormal half units
+            float f;
+            memcpy(&f, &abs, sizeof(f));
+            out[i] = sign | (uint16_t)lrintf(f * 16777216.f);
+        } else {
+            uint32_t h = (abs - 0x38000000) >> 13;
+            const uint32_t rest = abs & 0x1fff;
+            if (rest > 0x1000 || (rest == 0x1000 && (h & 1))) {
+                ++h;
+            }
+            out[i] = sign | (uint16_t)h;
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+#include "math/gfxm.hpp"
+
+
+class ThreadPool;
+
+// CPU versions of the GL bake passes in game/main.cpp. Directions follow the GL cube map face table
+// and rows are in glTexSubImage2D order, so levels go into the cache file as they are
+
+// Float rgb cubemap, faces in GL_TEXTURE_CUBE_MAP_POSITIVE_X + i order
+struct BakeCubemap {
+	int size = 0;
+	std::vector<std::vector<float>> levels;		// levels[mip] holds the 6 faces back to back
+};
+
+gfxm::vec3 bakeCubeTexelDirection(int face, int x, int y, int size);
+// Bilinear within a face, clamped at the edges rather than seamless, linear between levels
+gfxm::vec3 bakeSampleCube(const BakeCubemap& cube, const gfxm::vec3& dir, float lod);
+
+// hdri_to_cubemap.glsl, rgb as stbi_loadf() returns it with vertical flip on
+void bakeCubemapFromEquirect(BakeCubemap* out, const float* rgb, int width, int height, int size, ThreadPool* pool);
+// 2x2 box filter down to 1x1, what glGenerateMipmap() does for power of two sizes
+void bakeGenerateMips(BakeCubemap* cube, ThreadPool* pool);
+// prefilter_convolute_cubemap.glsl with prefilterBuildSamples() tables, mip m gets roughness m / (mips - 1).
+// env needs its mip chain
+void bakePrefilterGgx(BakeCubemap* out, const BakeCubemap& env, int size, int mips, int sample_count, ThreadPool* pool);
+// The shader's per texel reference loop, PREFILTER_REFERENCE_SAMPLES half vectors generated for every texel
+// and lods from a 512 texel source like the shader assumes. Slow, it is what the tables are measured against
+void bakePrefilterGgxReference(BakeCubemap* out, const BakeCubemap& env, int size, int mips, ThreadPool* pool);
+// integrate_brdf.glsl, rg with NdotV along x and roughness along y
+void bakeBrdfLut(std::vector<float>* rg, int size, ThreadPool* pool);
+
+// Round to nearest even, values past the half range clamp to the largest finite half
+void bakeFloatToHalf(uint16_t* out, const float* in, size_t count);
@@ -0,0 +1,186 @@
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "log/log.hpp"
+#include "filesystem/filesystem.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+#include "ibl_cache.hpp"
+#include "sh_irradiance.hpp"
+#include "prefilter_samples.hpp"
+#include "cpu_bake.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+
+// Copies one cubemap level per face into its cache images
+static void writeCubeImages(std::vector<uint8_t>& file, const std::vector<IblCacheImage>& layout, IBL_CACHE_MAP map, const BakeCubemap& cube) {
+    for (const IblCacheImage& img : layout) {
+        if (img.map != map) {
+            continue;
+        }
+        const size_t face_floats = (size_t)img.width * img.height * 3;
+        bakeFloatToHalf((uint16_t*)&file[img.offset], &cube.levels[img.mip][img.face * face_floats], face_floats);
+    }
+}
+
+static bool bakeFile(const char* path, const IblBakeParams& params, const std::vector<float>& brdf_lut, ThreadPool* pool) {
+    Stopwatch sw_total;
+    uint64_t source_hash = 0;
+    if (!iblHashFile(path, &source_hash)) {
+        LOG_ERR("iblbake", "Can't read " << path);
+        return false;
+    }
+    // Same flip loadCubemapHDRI() uploads with
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, ncomp;
+    float* rgb = stbi_loadf(path, &width, &height, &ncomp, 3);
+    if (!rgb) {
+        LOG_ERR("iblbake", "Failed to decode " << path << ": " << stbi_failure_reason());
+        return false;
+    }
+    const double decode_ms = sw_total.elapsedMs();
+
+    Stopwatch sw;
+    ShIrradiance irradiance_sh;
+    shProjectEquirect(&irradiance_sh, rgb, width, height, pool);
+    const double sh_ms = sw.elapsedMs();
+
+    sw.reset();
+    BakeCubemap environment;
+    bakeCubemapFromEquirect(&environment, rgb, width, height, params.environment_size, pool);
+    bakeGenerateMips(&environment, pool);
+    stbi_image_free(rgb);
+    const double cube_ms = sw.elapsedMs();
+
+    sw.reset();
+    BakeCubemap specular;
+    if (params.prefilter_samples > 0) {
+        bakePrefilterGgx(&specular, environment, params.specular_size, params.specular_mips, params.prefilter_samples, pool);
+    } else {
+        bakePrefilterGgxReference(&specular, environment, params.specular_size, params.specular_mips, pool);
+    }
+    const double prefilter_ms = sw.elapsedMs();
+
+    const std::vector<IblCacheImage> layout = iblCacheLayout(params);
+    std::vector<uint8_t> file = iblCacheCreateFile(source_hash, params, irradiance_sh);
+    writeCubeImages(file, layout, IBL_CACHE_ENVIRONMENT, environment);
+    writeCubeImages(file, layout, IBL_CACHE_SPECULAR, specular);
+    const IblCacheImage& lut = layout.back();
+    bakeFloatToHalf((uint16_t*)&file[lut.offset], brdf_lut.data(), brdf_lut.size());
+
+    const std::string cache_path = iblCachePath(source_hash, params);
+    if (!iblCacheWriteFile(cache_path.c_str(), file)) {
+        return false;
+    }
+    LOG("iblbake", path << " " << width << "x" << height << " in " << sw_total.elapsedMs() << "ms: decode " << decode_ms
+        << "ms, sh " << sh_ms << "ms, cubemap " << cube_ms << "ms, prefilter " << prefilter_ms << "ms");
+    return true;
+}
+
+// The game's -prefilter_bench without a GPU: bakes the specular map of path with sample tables of growing size
+// and compares every rough mip against the reference loop. Errors are relative to the mean of the reference level
+static bool prefilterBench(const char* path, const IblBakeParams& params, ThreadPool* pool) {
+    stbi_set_flip_vertically_on_load(true);
+    int width, height, ncomp;
+    float* rgb = stbi_loadf(path, &width, &height, &ncomp, 3);
+    if (!rgb) {
+        LOG_ERR("iblbake", "prefilter: failed to decode " << path);
+        return false;
+    }
+    BakeCubemap environment;
+    bakeCubemapFromEquirect(&environment, rgb, width, height, params.environment_size, pool);
+    bakeGenerateMips(&environment, pool);
+    stbi_image_free(rgb);
+
+    Stopwatch sw;
+    BakeCubemap reference;
+    bakePrefilterGgxReference(&reference, environment, params.specular_size, params.specular_mips, pool);
+    const double reference_ms = sw.elapsedMs();
+    LOG("iblbake", "prefilter: " << path << ", reference " << PREFILTER_REFERENCE_SAMPLES << " samples per texel " << reference_ms << "ms");
+
+    const int sample_counts[] = { 16, 32, 64, 128, 256, 512, 1024 };
+    for (int sample_count : sample_counts) {
+        sw.reset();
+        BakeCubemap specular;
+        bakePrefilterGgx(&specular, environment, params.specular_size, params.specular_mips, sample_count, pool);
+        const double ms = sw.elapsedMs();
+        std::ostringstream errors;
+        double worst_rms = .0;
+        double worst_max = .0;
+        // Mip 0 is the mirror, one sample along N either way
+        for (int mip = 1; mip < params.specular_mips; ++mip) {
+            const std::vector<float>& ref_level = reference.levels[mip];
+            const std::vector<float>& level = specular.levels[mip];
+            double mean = .0;
+            double squared_error_sum = .0;
+            double max_error = .0;
+            for (size_t i = 0; i < level.size(); ++i) {
+                const double d = (double)level[i] - (double)ref_level[i];
+                mean += ref_level[i];
+                squared_error_sum += d * d;
+                max_error = std::max(max_error, fabs(d));
+            }
+            mean = std::max(1e-6, mean / level.size());
+            const double rms = sqrt(squared_error_sum / level.size()) / mean;
+            worst_rms = std::max(worst_rms, rms);
+            worst_max = std::max(worst_max, max_error / mean);
+            errors << (mip == 1 ? "" : " ") << rms * 100. << "%";
+        }
+        LOG("iblbake", "prefilter: " << sample_count << " table samples " << ms << "ms (" << reference_ms / ms << "x), rms error by mip "
+            << errors.str() << ", worst rms " << worst_rms * 100. << "%, worst texel " << worst_max * 100. << "%");
+    }
+    return true;
+}
+
+// Bakes IBL cache files without a GPU, run from data/ like the game:
+//   iblbake                        every hdri/*.hdr
+//   iblbake a.hdr b.hdr            just these
+//   iblbake -prefilter_bench [a.hdr]   table sample counts against the reference loop, writes nothing
+// Files go to cache/ibl under the keys loadCubemapHDRI() looks up, so the game loads them instead of baking
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    bool prefilter_bench = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-prefilter_bench") == 0) {
+            prefilter_bench = true;
+            continue;
+        }
+        paths.push_back(argv[i]);
+    }
+    if (prefilter_bench) {
+        const char* path = paths.empty() ? "hdri/belfast_sunset_puresky_1k.hdr" : paths[0].c_str();
+        return prefilterBench(path, iblDefaultBakeParams(), getThreadPool()) ? 0 : 1;
+    }
+    if (paths.empty()) {
+        paths = fsFindAllFiles("hdri", "*.hdr");
+    }
+    if (paths.empty()) {
+        LOG_ERR("iblbake", "Nothing to bake, pass .hdr files or run from data/");
+        return 1;
+    }
+    // The key includes the bake shader sources, without them the game would never find the files
+    if (fsSlurpTextFile("shaders/prefilter_convolute_cubemap.glsl").empty()) {
+        LOG_ERR("iblbake", "shaders/ not found, run from data/");
+        return 1;
+    }
+    const IblBakeParams params = iblDefaultBakeParams();
+    ThreadPool* pool = getThreadPool();
+    LOG("iblbake", "Baking " << paths.size() << " files on " << pool->threadCount() << " threads");
+
+    Stopwatch sw;
+    std::vector<float> brdf_lut;
+    bakeBrdfLut(&brdf_lut, params.brdf_lut_size, pool);
+    LOG("iblbake", "BRDF LUT " << params.brdf_lut_size << "x" << params.brdf_lut_size << " in " << sw.elapsedMs() << "ms");
+
+    int failed = 0;
+    for (const std::string& path : paths) {
+        failed += bakeFile(path.c_str(), params, brdf_lut, pool) ? 0 : 1;
+    }
+    LOG("iblbake", paths.size() - failed << " of " << paths.size() << " baked in " << sw.elapsedMs() << "ms");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,131 @@
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+#include "log/log.hpp"
+#include "filesystem/filesystem.hpp"
+#include "profiler/stopwatch.hpp"
+#include "thread/thread_pool.hpp"
+#include "texture_compress.hpp"
+#include "texture_import.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb_image.h"
+
+
+// One texture to import, a single source or the roughness, metallic and AO of a material
+struct ImportItem {
+    std::vector<std::string> paths;
+    TEXTURE_ROLE role;
+};
+
+// Masks in the same directory are packed together the way loadPbrTextures asks for them
+static std::vector<ImportItem> groupImports(const std::vector<std::string>& paths) {
+    std::vector<ImportItem> items;
+    std::map<std::string, size_t> materials;    // Directory to its item
+    for (const std::string& path : paths) {
+        TEXTURE_ROLE role;
+        if (!textureRoleFromPath(path, &role)) {
+            LOG_WARN("teximport", "Skipping " << path << ", the name doesn't say what it is");
+            continue;
+        }
+        const int channel = textureMaterialChannel(path);
+        if (channel < 0) {
+            items.push_back({ { path }, role });
+            continue;
+        }
+        const size_t slash = path.find_last_of("/\\");
+        const std::string dir = slash == std::string::npos ? std::string() : path.substr(0, slash);
+        auto it = materials.find(dir);
+        if (it == materials.end()) {
+            it = materials.emplace(dir, items.size()).first;
+            items.push_back({ { "", "", "" }, TEXTURE_ROLE_MATERIAL });
+        }
+        std::string& slot = items[it->second].paths[channel];
+        if (!slot.empty()) {
+            LOG_WARN("teximport", "Skipping " << path << ", " << slot << " already fills that material channel");
+            continue;
+        }
+        slot = path;
+    }
+    return items;
+}
+
+static std::string itemName(const ImportItem& item) {
+    std::string name;
+    for (const std::string& path : item.paths) {
+        if (!path.empty()) {
+            name += name.empty() ? path : " + " + path;
+        }
+    }
+    return name;
+}
+
+static bool importItem(const ImportItem& item, bool albedo_bc1, ThreadPool* pool, size_t* uncompressed_bytes, size_t* compressed_bytes) {
+    const TEXTURE_ROLE role = item.role;
+    TEXTURE_CODEC codec = textureRoleDefaultCodec(role);
+    if (role == TEXTURE_ROLE_ALBEDO && albedo_bc1) {
+        codec = TEXTURE_CODEC_BC1;
+    }
+    std::vector<uint8_t> file;
+    TextureImportStats stats;
+    if (!textureImport(item.paths, role, codec, pool, &file, &stats)) {
+        return false;
+    }
+    const uint64_t source_hash = ((const TextureFileHeader*)file.data())->source_hash;
+    if (!textureFileWrite(textureFilePath(source_hash, role).c_str(), file)) {
+        return false;
+    }
+    *uncompressed_bytes += stats.uncompressed_bytes;
+    *compressed_bytes += stats.compressed_bytes;
+    const double mb = stats.uncompressed_bytes / (1024.0 * 1024.0);
+    LOG("teximport", itemName(item) << " " << stats.width << "x" << stats.height << " " << textureRoleName(role) << " " << textureCodecName(codec)
+        << ", " << stats.level_count << " levels, psnr " << stats.psnr << "dB, " << stats.uncompressed_bytes / 1024 << "KB -> "
+        << stats.compressed_bytes / 1024 << "KB: decode " << stats.decode_ms << "ms, mips " << stats.mip_ms << "ms, encode "
+        << stats.encode_ms << "ms (" << mb / (stats.encode_ms * .001) << "MB/s)");
+    return true;
+}
+
+// Block compresses PBR textures for the game, run from data/ like the game:
+//   teximport                every textures/**/*.png and *.jpg
+//   teximport a.png b.jpg    just these
+//   -bc1                     albedo as BC1 instead of BC7, half the size, no alpha
+// The role comes from the file name. Roughness, metallic and AO files of one directory go into a single
+// packed material texture, mips are filtered in linear space for color and renormalized for normals.
+// Files go to cache/textures under the keys the texture stream looks up, sources without one keep
+// loading uncompressed
+int main(int argc, char* argv[]) {
+    std::vector<std::string> paths;
+    bool albedo_bc1 = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-bc1") == 0) {
+            albedo_bc1 = true;
+            continue;
+        }
+        paths.push_back(argv[i]);
+    }
+    if (paths.empty()) {
+        paths = fsFindAllFiles("textures", "*.png");
+        const std::vector<std::string> jpgs = fsFindAllFiles("textures", "*.jpg");
+        paths.insert(paths.end(), jpgs.begin(), jpgs.end());
+    }
+    if (paths.empty()) {
+        LOG_ERR("teximport", "Nothing to import, pass image files or run from data/");
+        return 1;
+    }
+    const std::vector<ImportItem> items = groupImports(paths);
+    ThreadPool* pool = getThreadPool();
+    LOG("teximport", "Importing " << paths.size() << " files as " << items.size() << " textures on " << pool->threadCount() << " threads, "
+        << textureEncodePathName(TEXTURE_ENCODE_AUTO) << " encoder");
+
+    Stopwatch sw;
+    size_t uncompressed_bytes = 0;
+    size_t compressed_bytes = 0;
+    int failed = 0;
+    for (const ImportItem& item : items) {
+        failed += importItem(item, albedo_bc1, pool, &uncompressed_bytes, &compressed_bytes) ? 0 : 1;
+    }
+    LOG("teximport", items.size() - failed << " of " << items.size() << " imported in " << sw.elapsedMs() << "ms, "
+        << uncompressed_bytes / (1024 * 1024) << "MB -> " << compressed_bytes / (1024 * 1024) << "MB");
+    return failed ? 1 : 0;
+}